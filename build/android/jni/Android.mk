@@ -108,6 +108,8 @@ LOCAL_C_INCLUDES := \
 
 LOCAL_SRC_FILES := \
 		jni/src/ban.cpp                           \
+		jni/src/block_decode_thread.cpp           \
+		jni/src/callbackprofiler.cpp              \
 		jni/src/camera.cpp                        \
 		jni/src/cavegen.cpp                       \
 		jni/src/chat.cpp                          \
@@ -168,12 +170,15 @@ LOCAL_SRC_FILES := \
 		jni/src/itemstackmetadata.cpp             \
 		jni/src/keycode.cpp                       \
 		jni/src/light.cpp                         \
+		jni/src/liquid_queue.cpp                  \
 		jni/src/localplayer.cpp                   \
 		jni/src/log.cpp                           \
 		jni/src/main.cpp                          \
 		jni/src/map.cpp                           \
 		jni/src/map_settings_manager.cpp          \
 		jni/src/mapblock.cpp                      \
+		jni/src/mapblock_compact.cpp              \
+		jni/src/mapblock_index.cpp                \
 		jni/src/mapblock_mesh.cpp                 \
 		jni/src/mapgen.cpp                        \
 		jni/src/mapgen_flat.cpp                   \
@@ -185,6 +190,7 @@ LOCAL_SRC_FILES := \
 		jni/src/mapgen_valleys.cpp                \
 		jni/src/mapnode.cpp                       \
 		jni/src/mapsector.cpp                     \
+		jni/src/mediastore.cpp                    \
 		jni/src/mesh.cpp                          \
 		jni/src/mesh_generator_thread.cpp         \
 		jni/src/metadata.cpp                      \
@@ -225,6 +231,7 @@ LOCAL_SRC_FILES := \
 		jni/src/staticobject.cpp                  \
 		jni/src/tileanimation.cpp                 \
 		jni/src/tool.cpp                          \
+		jni/src/tracer.cpp                        \
 		jni/src/treegen.cpp                       \
 		jni/src/version.cpp                       \
 		jni/src/voxel.cpp                         \
@@ -241,16 +248,28 @@ LOCAL_SRC_FILES := \
 		jni/src/util/string.cpp                   \
 		jni/src/util/srp.cpp                      \
 		jni/src/util/timetaker.cpp                \
+		jni/src/benchmark/benchmark_server.cpp    \
 		jni/src/unittest/test.cpp                 \
+		jni/src/unittest/test_authdatabase.cpp    \
+		jni/src/unittest/test_callbackprofiler.cpp \
 		jni/src/unittest/test_collision.cpp       \
 		jni/src/unittest/test_compression.cpp     \
 		jni/src/unittest/test_connection.cpp      \
 		jni/src/unittest/test_filepath.cpp        \
+		jni/src/unittest/test_greedy_merge.cpp    \
 		jni/src/unittest/test_inventory.cpp       \
+		jni/src/unittest/test_liquid_queue.cpp    \
 		jni/src/unittest/test_map_settings_manager.cpp \
+		jni/src/unittest/test_mapblock.cpp        \
+		jni/src/unittest/test_mapblock_compact.cpp \
+		jni/src/unittest/test_mapblock_index.cpp  \
 		jni/src/unittest/test_mapnode.cpp         \
+		jni/src/unittest/test_mediaserver.cpp     \
+		jni/src/unittest/test_mesh_collector.cpp  \
+		jni/src/unittest/test_modmetadatadatabase.cpp \
 		jni/src/unittest/test_nodedef.cpp         \
 		jni/src/unittest/test_noderesolver.cpp    \
+		jni/src/unittest/test_nodetimer.cpp       \
 		jni/src/unittest/test_noise.cpp           \
 		jni/src/unittest/test_objdef.cpp          \
 		jni/src/unittest/test_profiler.cpp        \
@@ -259,6 +278,7 @@ LOCAL_SRC_FILES := \
 		jni/src/unittest/test_serialization.cpp   \
 		jni/src/unittest/test_settings.cpp        \
 		jni/src/unittest/test_socket.cpp          \
+		jni/src/unittest/test_tracer.cpp          \
 		jni/src/unittest/test_utilities.cpp       \
 		jni/src/unittest/test_voxelalgorithms.cpp \
 		jni/src/unittest/test_voxelmanipulator.cpp \
@@ -277,6 +297,7 @@ LOCAL_SRC_FILES := \
 # Network
 LOCAL_SRC_FILES += \
 		jni/src/network/connection.cpp            \
+		jni/src/network/mediaserver.cpp           \
 		jni/src/network/networkpacket.cpp         \
 		jni/src/network/clientopcodes.cpp         \
 		jni/src/network/clientpackethandler.cpp   \
@@ -303,6 +324,7 @@ LOCAL_SRC_FILES += \
 		jni/src/script/cpp_api/s_security.cpp     \
 		jni/src/script/cpp_api/s_server.cpp       \
 		jni/src/script/lua_api/l_areastore.cpp    \
+		jni/src/script/lua_api/l_auth.cpp         \
 		jni/src/script/lua_api/l_base.cpp         \
 		jni/src/script/lua_api/l_camera.cpp       \
 		jni/src/script/lua_api/l_client.cpp       \
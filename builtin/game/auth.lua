@@ -29,72 +29,51 @@ end
 assert(core.string_to_privs("a,b").b == true)
 assert(core.privs_to_string({a=true,b=true}) == "a,b")
 
-core.auth_file_path = core.get_worldpath().."/auth.txt"
-core.auth_table = {}
-
-local function read_auth_file()
-	local newtable = {}
-	local file, errmsg = io.open(core.auth_file_path, 'rb')
-	if not file then
-		core.log("info", core.auth_file_path.." could not be opened for reading ("..errmsg.."); assuming new world")
-		return
-	end
-	for line in file:lines() do
-		if line ~= "" then
-			local fields = line:split(":", true)
-			local name, password, privilege_string, last_login = unpack(fields)
-			last_login = tonumber(last_login)
-			if not (name and password and privilege_string) then
-				error("Invalid line in auth.txt: "..dump(line))
-			end
-			local privileges = core.string_to_privs(privilege_string)
-			newtable[name] = {password=password, privileges=privileges, last_login=last_login}
+-- Native auth database of the world, see src/script/lua_api/l_auth.cpp
+local core_auth = core.auth
+core.auth = nil
+
+-- Entries of the players that are online, the others are read when needed
+local auth_cache = {}
+
+local function read_auth(name)
+	local auth_entry = auth_cache[name]
+	if not auth_entry then
+		auth_entry = core_auth.read(name)
+		if auth_entry and core.get_player_by_name(name) then
+			auth_cache[name] = auth_entry
 		end
 	end
-	io.close(file)
-	core.auth_table = newtable
-	core.notify_authentication_modified()
+	return auth_entry
 end
 
-local function save_auth_file()
-	local newtable = {}
-	-- Check table for validness before attempting to save
-	for name, stuff in pairs(core.auth_table) do
-		assert(type(name) == "string")
-		assert(name ~= "")
-		assert(type(stuff) == "table")
-		assert(type(stuff.password) == "string")
-		assert(type(stuff.privileges) == "table")
-		assert(stuff.last_login == nil or type(stuff.last_login) == "number")
-	end
-	local content = {}
-	for name, stuff in pairs(core.auth_table) do
-		local priv_string = core.privs_to_string(stuff.privileges)
-		local parts = {name, stuff.password, priv_string, stuff.last_login or ""}
-		content[#content + 1] = table.concat(parts, ":")
-	end
-	if not core.safe_file_write(core.auth_file_path, table.concat(content, "\n")) then
-		error(core.auth_file_path.." could not be written to")
+local function save_auth(auth_entry)
+	assert(type(auth_entry.name) == "string")
+	assert(auth_entry.name ~= "")
+	assert(type(auth_entry.password) == "string")
+	assert(type(auth_entry.privileges) == "table")
+	assert(auth_entry.last_login == nil or type(auth_entry.last_login) == "number")
+	if not core_auth.save(auth_entry) then
+		error("Auth entry of "..auth_entry.name.." could not be saved")
 	end
 end
 
-read_auth_file()
+core.register_on_leaveplayer(function(player)
+	auth_cache[player:get_player_name()] = nil
+end)
 
 core.builtin_auth_handler = {
 	get_auth = function(name)
 		assert(type(name) == "string")
-		-- Figure out what password to use for a new player (singleplayer
-		-- always has an empty password, otherwise use default, which is
-		-- usually empty too)
-		local new_password_hash = ""
+		local auth_entry = read_auth(name)
 		-- If not in authentication table, return nil
-		if not core.auth_table[name] then
+		if not auth_entry then
 			return nil
 		end
 		-- Figure out what privileges the player should have.
 		-- Take a copy of the privilege table
 		local privileges = {}
-		for priv, _ in pairs(core.auth_table[name].privileges) do
+		for priv, _ in pairs(auth_entry.privileges) do
 			privileges[priv] = true
 		end
 		-- If singleplayer, give all privileges except those marked as give_to_singleplayer = false
@@ -112,73 +91,137 @@ core.builtin_auth_handler = {
 		end
 		-- All done
 		return {
-			password = core.auth_table[name].password,
+			password = auth_entry.password,
 			privileges = privileges,
 			-- Is set to nil if unknown
-			last_login = core.auth_table[name].last_login,
+			last_login = auth_entry.last_login,
 		}
 	end,
 	create_auth = function(name, password)
 		assert(type(name) == "string")
 		assert(type(password) == "string")
 		core.log('info', "Built-in authentication handler adding player '"..name.."'")
-		core.auth_table[name] = {
+		local auth_entry = core_auth.create({
+			name = name,
 			password = password,
 			privileges = core.string_to_privs(core.settings:get("default_privs")),
 			last_login = os.time(),
-		}
-		save_auth_file()
+		})
+		if not auth_entry then
+			error("Auth entry of "..name.." could not be created")
+		end
 	end,
 	set_password = function(name, password)
 		assert(type(name) == "string")
 		assert(type(password) == "string")
-		if not core.auth_table[name] then
+		local auth_entry = read_auth(name)
+		if not auth_entry then
 			core.builtin_auth_handler.create_auth(name, password)
 		else
 			core.log('info', "Built-in authentication handler setting password of player '"..name.."'")
-			core.auth_table[name].password = password
-			save_auth_file()
+			auth_entry.password = password
+			save_auth(auth_entry)
 		end
 		return true
 	end,
 	set_privileges = function(name, privileges)
 		assert(type(name) == "string")
 		assert(type(privileges) == "table")
-		if not core.auth_table[name] then
+		local auth_entry = read_auth(name)
+		if not auth_entry then
 			core.builtin_auth_handler.create_auth(name,
 				core.get_password_hash(name,
 					core.settings:get("default_password")))
+			auth_entry = read_auth(name)
 		end
 
 		-- Run grant callbacks
 		for priv, _ in pairs(privileges) do
-			if not core.auth_table[name].privileges[priv] then
+			if not auth_entry.privileges[priv] then
 				core.run_priv_callbacks(name, priv, nil, "grant")
 			end
 		end
 
 		-- Run revoke callbacks
-		for priv, _ in pairs(core.auth_table[name].privileges) do
+		for priv, _ in pairs(auth_entry.privileges) do
 			if not privileges[priv] then
 				core.run_priv_callbacks(name, priv, nil, "revoke")
 			end
 		end
 
-		core.auth_table[name].privileges = privileges
+		auth_entry.privileges = privileges
+		save_auth(auth_entry)
 		core.notify_authentication_modified(name)
-		save_auth_file()
 	end,
 	reload = function()
-		read_auth_file()
+		core_auth.reload()
+		auth_cache = {}
+		core.notify_authentication_modified()
 		return true
 	end,
 	record_login = function(name)
 		assert(type(name) == "string")
-		assert(core.auth_table[name]).last_login = os.time()
-		save_auth_file()
+		local auth_entry = assert(read_auth(name))
+		auth_entry.last_login = os.time()
+		save_auth(auth_entry)
+	end,
+	iterate = function()
+		local names = {}
+		for _, name in ipairs(core_auth.list_names()) do
+			names[name] = true
+		end
+		return pairs(names)
 	end,
 }
 
+-- Compatibility for mods that used the auth table of the old builtin
+-- handler. Entries are read from and written to the database, iterating
+-- over the table with pairs() is not supported.
+local auth_table_warned = false
+local function auth_table_deprecated()
+	if not auth_table_warned then
+		auth_table_warned = true
+		core.log("deprecated", "core.auth_table is deprecated, " ..
+			"use the auth handler functions instead")
+	end
+end
+
+core.auth_table = setmetatable({}, {
+	__index = function(t, name)
+		auth_table_deprecated()
+		if type(name) ~= "string" then
+			return nil
+		end
+		return read_auth(name)
+	end,
+	__newindex = function(t, name, value)
+		auth_table_deprecated()
+		assert(type(name) == "string")
+		if value == nil then
+			core_auth.delete(name)
+			auth_cache[name] = nil
+			return
+		end
+		local auth_entry = read_auth(name)
+		if not auth_entry then
+			auth_entry = core_auth.create({
+				name = name,
+				password = value.password or "",
+				privileges = value.privileges or {},
+				last_login = value.last_login,
+			})
+			if not auth_entry then
+				error("Auth entry of "..name.." could not be created")
+			end
+			return
+		end
+		auth_entry.password = value.password or auth_entry.password
+		auth_entry.privileges = value.privileges or auth_entry.privileges
+		auth_entry.last_login = value.last_login
+		save_auth(auth_entry)
+	end,
+})
+
 function core.register_authentication_handler(handler)
 	if core.registered_auth_handler then
 		error("Add-on authentication handler already registered by "..core.registered_auth_handler_modname)
@@ -214,18 +257,19 @@ core.register_on_joinplayer(function(player)
 end)
 
 core.register_on_prejoinplayer(function(name, ip)
-	local auth = core.auth_table
-	if auth[name] ~= nil then
+	if core.registered_auth_handler ~= nil then
+		return -- Don't do anything if custom auth handler registered
+	end
+	local auth_handler = core.builtin_auth_handler
+	if auth_handler.get_auth(name) ~= nil then
 		return
 	end
 
-	local name_lower = name:lower()
-	for k in pairs(auth) do
-		if k:lower() == name_lower then
-			return string.format("\nCannot create new player called '%s'. "..
-					"Another account called '%s' is already registered. "..
-					"Please check the spelling if it's your account "..
-					"or use a different nickname.", name, k)
-		end
+	local k = core_auth.find_name_case_insensitive(name)
+	if k then
+		return string.format("\nCannot create new player called '%s'. "..
+				"Another account called '%s' is already registered. "..
+				"Please check the spelling if it's your account "..
+				"or use a different nickname.", name, k)
 	end
 end)
@@ -30,7 +30,11 @@ core.register_on_chat_message(function(name, message)
 	local has_privs, missing_privs = core.check_player_privs(name, cmd_def.privs)
 	if has_privs then
 		core.set_last_run_mod(cmd_def.mod_origin)
+		local start = core.callback_profiling and core.get_us_time()
 		local success, message = cmd_def.func(name, param)
+		if start then
+			core.record_callback_time(cmd_def.mod_origin, "/" .. cmd, start)
+		end
 		if message then
 			core.chat_send_player(name, message)
 		end
@@ -814,6 +818,62 @@ core.register_chatcommand("status", {
 	end,
 })
 
+core.register_chatcommand("trace", {
+	params = "start | stop | save",
+	description = "Record a trace of the server steps, or save it",
+	privs = {server=true},
+	func = function(name, param)
+		if param == "start" then
+			core.set_tracing(true)
+			return true, "Tracing started."
+		elseif param == "stop" then
+			core.set_tracing(false)
+			return true, "Tracing stopped."
+		elseif param == "save" then
+			local path = core.save_trace()
+			if not path then
+				return false, "Failed to save the trace."
+			end
+			return true, "Trace saved to " .. path
+		end
+		return false, "Invalid parameters (see /help trace)"
+	end,
+})
+
+core.register_chatcommand("callbacks", {
+	params = "start | stop | [total | max] [<count>]",
+	description = "Account the time of Lua callbacks to mods, or show " ..
+		"the callbacks that took the most time in total or in a single call",
+	privs = {server=true},
+	func = function(name, param)
+		if param == "start" then
+			core.set_callback_profiling(true)
+			return true, "Callback profiling started."
+		elseif param == "stop" then
+			core.set_callback_profiling(false)
+			return true, "Callback profiling stopped."
+		end
+		local sort, count = param:match("^(%a*) *(%d*)$")
+		if not sort or (sort ~= "" and sort ~= "total" and sort ~= "max") then
+			return false, "Invalid parameters (see /help callbacks)"
+		end
+		if sort == "" then
+			sort = "total"
+		end
+		local stats = core.get_callback_stats(tonumber(count) or 10, sort)
+		if #stats == 0 then
+			return true, "No callbacks recorded, use /callbacks start."
+		end
+		local lines = {}
+		for _, s in ipairs(stats) do
+			lines[#lines + 1] = ("%s: %s: %d calls, %.1f ms total, " ..
+				"%.1f ms max"):format(s.mod, s.callback, s.calls,
+				s.total_us / 1000, s.max_us / 1000)
+		end
+		return true, table.concat(lines, "\n")
+	end,
+})
+
 core.register_chatcommand("time", {
 	params = "<0..23>:<0..59> | <0..24000>",
 	description = "Set time of day",
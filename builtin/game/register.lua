@@ -407,6 +407,7 @@ function core.run_callbacks(callbacks, mode, ...)
 			return false
 		end
 	end
+	local profiling = core.callback_profiling
 	local ret = nil
 	for i = 1, cb_len do
 		local origin = core.callback_origins[callbacks[i]]
@@ -417,7 +418,11 @@ function core.run_callbacks(callbacks, mode, ...)
 		else
 			--print("No data associated with callback")
 		end
+		local start = profiling and origin and core.get_us_time()
 		local cb_ret = callbacks[i](...)
+		if start then
+			core.record_callback_time(origin.mod, origin.name, start)
+		end
 
 		if mode == 0 and i == 1 then
 			ret = cb_ret
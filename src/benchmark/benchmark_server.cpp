@@ -0,0 +1,503 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "benchmark/benchmark_server.h"
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <fstream>
+#include "constants.h"
+#include "content/subgames.h"
+#include "emerge.h"
+#include "exceptions.h"
+#include "filesys.h"
+#include "log.h"
+#include "network/connection.h"
+#include "network/networkpacket.h"
+#include "network/networkprotocol.h"
+#include "porting.h"
+#include "serialization.h"
+#include "server.h"
+#include "settings.h"
+#include "version.h"
+#include "util/auth.h"
+#include "util/numeric.h"
+#include "util/pointedthing.h"
+#include "util/string.h"
+
+// How often the fake clients send their position, dig or place, and try
+// to connect, in seconds
+#define BENCHMARK_POSITION_INTERVAL 0.1
+#define BENCHMARK_INTERACT_INTERVAL 2.0
+#define BENCHMARK_INIT_INTERVAL 1.0
+
+// The fake clients walk this fast, this far away from the spawn and back,
+// in nodes
+#define BENCHMARK_WALK_SPEED 4.0
+#define BENCHMARK_WALK_DISTANCE 160.0
+
+// Viewing range the fake clients ask for, in blocks
+#define BENCHMARK_WANTED_RANGE 10
+
+struct BenchmarkStats
+{
+	BenchmarkStats():
+		packets(0),
+		bytes(0),
+		blocks(0),
+		block_bytes(0),
+		interactions(0)
+	{}
+
+	u32 packets;
+	u64 bytes;
+	u32 blocks;
+	u64 block_bytes;
+	u32 interactions;
+};
+
+/*
+	A client that speaks just enough of the protocol to join. It then
+	walks away from the spawn in a straight line and back, digging and
+	placing the node below it every now and then.
+*/
+class BenchmarkClient
+{
+public:
+	BenchmarkClient(const std::string &name, float direction);
+
+	void connect(const Address &address);
+	// Handles the packets that came in
+	void receive(BenchmarkStats &stats);
+	void step(float dtime, BenchmarkStats &stats);
+
+	bool isReady() const { return m_state == STATE_READY; }
+	bool isDenied() const { return m_state == STATE_DENIED; }
+
+private:
+	enum State
+	{
+		STATE_INIT,
+		STATE_AUTH,
+		STATE_DEFINITIONS,
+		STATE_READY,
+		STATE_DENIED
+	};
+
+	void handlePacket(NetworkPacket &pkt, BenchmarkStats &stats);
+	void send(NetworkPacket &pkt, u8 channel, bool reliable);
+	void sendInit();
+	void sendReady();
+	void sendPosition();
+	void interact(u8 action);
+	void writePosition(NetworkPacket &pkt);
+
+	con::Connection m_con;
+	std::string m_name;
+	State m_state;
+
+	v3f m_spawn;
+	v3f m_direction;
+	v3f m_position;
+	v3f m_speed;
+	float m_yaw;
+
+	float m_time;
+	float m_init_timer;
+	float m_position_timer;
+	float m_interact_timer;
+	bool m_dig_next;
+};
+
+BenchmarkClient::BenchmarkClient(const std::string &name, float direction):
+	m_con(PROTOCOL_ID, 512, CONNECTION_TIMEOUT, false, NULL),
+	m_name(name),
+	m_state(STATE_INIT),
+	m_direction(cos(direction), 0, sin(direction)),
+	m_yaw(direction * core::RADTODEG),
+	m_time(0),
+	m_init_timer(0),
+	m_position_timer(0),
+	m_interact_timer(0),
+	m_dig_next(true)
+{
+	m_con.SetTimeoutMs(0);
+}
+
+void BenchmarkClient::connect(const Address &address)
+{
+	m_con.Connect(address);
+	sendInit();
+}
+
+void BenchmarkClient::send(NetworkPacket &pkt, u8 channel, bool reliable)
+{
+	m_con.Send(PEER_ID_SERVER, channel, &pkt, reliable);
+}
+
+void BenchmarkClient::sendInit()
+{
+	NetworkPacket pkt(TOSERVER_INIT, 1 + 2 + 2 + (1 + m_name.size()));
+	pkt << (u8)SER_FMT_VER_HIGHEST_READ << (u16)NETPROTO_COMPRESSION_NONE;
+	pkt << (u16)CLIENT_PROTOCOL_VERSION_MIN << (u16)CLIENT_PROTOCOL_VERSION_MAX;
+	pkt << m_name;
+	send(pkt, 1, false);
+}
+
+void BenchmarkClient::sendReady()
+{
+	u16 hash_len = strlen(g_version_hash);
+	NetworkPacket pkt(TOSERVER_CLIENT_READY, 1 + 1 + 1 + 1 + 2 + hash_len);
+	pkt << (u8)VERSION_MAJOR << (u8)VERSION_MINOR << (u8)VERSION_PATCH
+		<< (u8)0 << hash_len;
+	pkt.putRawString(g_version_hash, hash_len);
+	send(pkt, 0, true);
+}
+
+void BenchmarkClient::writePosition(NetworkPacket &pkt)
+{
+	// Same format as Client::sendPlayerPos()
+	v3f pf = m_position * 100;
+	v3f sf = m_speed * 100;
+	pkt << v3s32(pf.X, pf.Y, pf.Z) << v3s32(sf.X, sf.Y, sf.Z);
+	pkt << (s32)0 << (s32)(m_yaw * 100) << (u32)0;
+	pkt << (u8)(72 * core::DEGTORAD * 80) << (u8)BENCHMARK_WANTED_RANGE;
+}
+
+void BenchmarkClient::sendPosition()
+{
+	NetworkPacket pkt(TOSERVER_PLAYERPOS, 12 + 12 + 4 + 4 + 4 + 1 + 1);
+	writePosition(pkt);
+	send(pkt, 0, false);
+}
+
+void BenchmarkClient::interact(u8 action)
+{
+	// The node below the feet, pointed at from above
+	v3s16 above = floatToInt(m_position, BS);
+	v3s16 under = above - v3s16(0, 1, 0);
+	PointedThing pointed(under, above, under, intToFloat(under, BS),
+		v3s16(0, 1, 0), 0);
+
+	NetworkPacket pkt(TOSERVER_INTERACT, 1 + 2 + 0);
+	pkt << action << (u16)0;
+	std::ostringstream os(std::ios::binary);
+	pointed.serialize(os);
+	pkt.putLongString(os.str());
+	writePosition(pkt);
+	send(pkt, 0, true);
+}
+
+void BenchmarkClient::receive(BenchmarkStats &stats)
+{
+	for (;;) {
+		NetworkPacket pkt;
+		try {
+			m_con.Receive(&pkt);
+		} catch (con::NoIncomingDataException &e) {
+			return;
+		} catch (con::InvalidIncomingDataException &e) {
+			continue;
+		}
+		stats.packets++;
+		stats.bytes += pkt.getSize();
+		handlePacket(pkt, stats);
+	}
+}
+
+void BenchmarkClient::handlePacket(NetworkPacket &pkt, BenchmarkStats &stats)
+{
+	switch (pkt.getCommand()) {
+	case TOCLIENT_HELLO: {
+		if (m_state != STATE_INIT)
+			break;
+		u8 ser_ver;
+		u16 compression_mode, proto_ver;
+		u32 auth_mechs;
+		pkt >> ser_ver >> compression_mode >> proto_ver >> auth_mechs;
+		if (!(auth_mechs & AUTH_MECHANISM_FIRST_SRP)) {
+			errorstream << "Benchmark: " << m_name << " can't log in, "
+				"the world should be new" << std::endl;
+			m_state = STATE_DENIED;
+			break;
+		}
+
+		// Register with an empty password
+		std::string verifier, salt;
+		generate_srp_verifier_and_salt(m_name, "", &verifier, &salt);
+		NetworkPacket resp(TOSERVER_FIRST_SRP, 0);
+		resp << salt << verifier << (u8)1;
+		send(resp, 1, true);
+		m_state = STATE_AUTH;
+		break;
+	}
+	case TOCLIENT_AUTH_ACCEPT: {
+		pkt >> m_spawn;
+		m_position = m_spawn;
+		NetworkPacket resp(TOSERVER_INIT2, 0);
+		send(resp, 1, true);
+		m_state = STATE_DEFINITIONS;
+		break;
+	}
+	case TOCLIENT_ANNOUNCE_MEDIA:
+		// Sent after the definitions, the media isn't needed
+		if (m_state != STATE_DEFINITIONS)
+			break;
+		sendReady();
+		m_state = STATE_READY;
+		break;
+	case TOCLIENT_BLOCKDATA: {
+		v3s16 blockpos;
+		pkt >> blockpos;
+		stats.blocks++;
+		stats.block_bytes += pkt.getSize();
+		NetworkPacket resp(TOSERVER_GOTBLOCKS, 1 + 6);
+		resp << (u8)1 << blockpos;
+		send(resp, 2, true);
+		break;
+	}
+	case TOCLIENT_ACCESS_DENIED:
+	case TOCLIENT_ACCESS_DENIED_LEGACY:
+		errorstream << "Benchmark: " << m_name << " was denied access"
+			<< std::endl;
+		m_state = STATE_DENIED;
+		break;
+	default:
+		break;
+	}
+}
+
+void BenchmarkClient::step(float dtime, BenchmarkStats &stats)
+{
+	if (m_state == STATE_INIT) {
+		// The init packet is unreliable
+		m_init_timer += dtime;
+		if (m_init_timer >= BENCHMARK_INIT_INTERVAL) {
+			m_init_timer = 0;
+			sendInit();
+		}
+		return;
+	}
+	if (m_state != STATE_READY)
+		return;
+
+	m_time += dtime;
+	float distance = fmodf(m_time * BENCHMARK_WALK_SPEED,
+		2 * BENCHMARK_WALK_DISTANCE);
+	float speed = BENCHMARK_WALK_SPEED * BS;
+	if (distance > BENCHMARK_WALK_DISTANCE) {
+		distance = 2 * BENCHMARK_WALK_DISTANCE - distance;
+		speed = -speed;
+	}
+	m_position = m_spawn + m_direction * distance * BS;
+	m_speed = m_direction * speed;
+
+	m_position_timer += dtime;
+	if (m_position_timer >= BENCHMARK_POSITION_INTERVAL) {
+		m_position_timer = 0;
+		sendPosition();
+	}
+
+	m_interact_timer += dtime;
+	if (m_interact_timer >= BENCHMARK_INTERACT_INTERVAL) {
+		m_interact_timer = 0;
+		if (m_dig_next) {
+			// Start digging, then complete it
+			interact(0);
+			interact(2);
+		} else {
+			// Place the first item of the inventory
+			interact(3);
+		}
+		m_dig_next = !m_dig_next;
+		stats.interactions++;
+	}
+}
+
+// Resident and peak memory of the process in kB, 0 if unknown
+static void get_memory_usage(u32 *resident, u32 *peak)
+{
+	*resident = 0;
+	*peak = 0;
+#ifdef __linux__
+	std::ifstream is("/proc/self/status");
+	std::string line;
+	while (std::getline(is, line)) {
+		if (str_starts_with(line, "VmRSS:"))
+			*resident = stoi(trim(line.substr(6)));
+		else if (str_starts_with(line, "VmHWM:"))
+			*peak = stoi(trim(line.substr(6)));
+	}
+#endif
+}
+
+static u32 get_percentile(const std::vector<u32> &sorted, float percentile)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = MYMIN(sorted.size() * percentile / 100, sorted.size() - 1);
+	return sorted[i];
+}
+
+static bool run_benchmark(const std::string &world_path,
+	const SubgameSpec &gamespec, u16 port, u32 num_clients, float duration)
+{
+	std::vector<u32> step_times;
+	BenchmarkStats stats;
+	u32 generated_chunks;
+	float join_time = -1;
+	u32 clients_denied = 0;
+	u32 memory_resident, memory_peak;
+
+	u64 t_start = porting::getTimeMs();
+	{
+		Server server(world_path, gamespec, false, false, true);
+		server.setStepTimeLog(&step_times);
+		server.start(Address(0, 0, 0, 0, port));
+		u64 t_started = porting::getTimeMs();
+
+		std::vector<BenchmarkClient *> clients;
+		for (u32 i = 0; i < num_clients; i++) {
+			BenchmarkClient *client = new BenchmarkClient(
+				"benchmark" + itos(i + 1), 2 * M_PI * i / num_clients);
+			client->connect(Address(127, 0, 0, 1, port));
+			clients.push_back(client);
+		}
+
+		// Run the server like dedicated_server_loop() does
+		float steplen = g_settings->getFloat("dedicated_server_step");
+		float server_timer = 0;
+		u64 t_last = t_started;
+		u64 t_now = t_started;
+		while (t_now - t_started < duration * 1000) {
+			sleep_ms(10);
+			t_now = porting::getTimeMs();
+			float dtime = (t_now - t_last) / 1000.0f;
+			t_last = t_now;
+
+			server_timer += dtime;
+			if (server_timer >= steplen) {
+				server.step(server_timer);
+				server_timer = 0;
+			}
+
+			u32 ready = 0;
+			clients_denied = 0;
+			for (size_t i = 0; i < clients.size(); i++) {
+				clients[i]->receive(stats);
+				clients[i]->step(dtime, stats);
+				ready += clients[i]->isReady();
+				clients_denied += clients[i]->isDenied();
+			}
+			if (join_time < 0 && ready == num_clients)
+				join_time = (t_now - t_started) / 1000.0f;
+		}
+
+		generated_chunks = server.getEmergeManager()->getGeneratedChunkCount();
+		get_memory_usage(&memory_resident, &memory_peak);
+
+		for (size_t i = 0; i < clients.size(); i++)
+			delete clients[i];
+	}
+	u64 t_end = porting::getTimeMs();
+
+	std::sort(step_times.begin(), step_times.end());
+
+	rawstream
+		<< "++++++++++++++++++++++++++++++++++++++++"
+		<< "++++++++++++++++++++++++++++++++++++++++" << std::endl
+		<< "Server Benchmark: " << num_clients << " clients for "
+		<< duration << "s on " << gamespec.id << std::endl;
+	if (join_time >= 0)
+		rawstream << "    All clients joined in " << join_time << "s." << std::endl;
+	else
+		rawstream << "    " << clients_denied << " clients were denied, "
+			"not all joined." << std::endl;
+	rawstream
+		<< "    " << step_times.size() << " server steps, step time p50 "
+		<< get_percentile(step_times, 50) / 1000.0f << "ms, p90 "
+		<< get_percentile(step_times, 90) / 1000.0f << "ms, p99 "
+		<< get_percentile(step_times, 99) / 1000.0f << "ms, max "
+		<< (step_times.empty() ? 0 : step_times.back()) / 1000.0f << "ms."
+		<< std::endl
+		<< "    " << generated_chunks << " chunks generated ("
+		<< generated_chunks / duration << "/s)." << std::endl
+		<< "    " << stats.bytes / 1024 << "kB sent in " << stats.packets
+		<< " packets (" << stats.bytes / 1024 / duration << "kB/s), "
+		<< stats.blocks << " blocks (" << stats.block_bytes / 1024 << "kB)."
+		<< std::endl
+		<< "    " << stats.interactions << " digs and places." << std::endl;
+	if (memory_peak != 0)
+		rawstream << "    " << memory_resident / 1024 << "MB resident, "
+			<< memory_peak / 1024 << "MB peak." << std::endl;
+	rawstream
+		<< "    Benchmark took " << (t_end - t_start) << "ms total." << std::endl
+		<< "++++++++++++++++++++++++++++++++++++++++"
+		<< "++++++++++++++++++++++++++++++++++++++++" << std::endl;
+
+	return join_time >= 0;
+}
+
+bool run_server_benchmark(const Settings &cmd_args)
+{
+	std::string gameid = cmd_args.exists("gameid") ?
+		cmd_args.get("gameid") : "minimal";
+	u16 port = cmd_args.exists("port") ? cmd_args.getU16("port") : 30000;
+	u32 num_clients = cmd_args.exists("benchmark-clients") ?
+		cmd_args.getU16("benchmark-clients") : 10;
+	float duration = cmd_args.exists("benchmark-duration") ?
+		cmd_args.getFloat("benchmark-duration") : 60;
+
+	SubgameSpec gamespec = findSubgame(gameid);
+	if (!gamespec.isValid()) {
+		errorstream << "Game \"" << gameid << "\" not found" << std::endl;
+		return false;
+	}
+	if (num_clients == 0 || duration <= 0) {
+		errorstream << "Benchmark: Invalid number of clients or duration"
+			<< std::endl;
+		return false;
+	}
+
+	std::string world_path = fs::TempPath() + DIR_DELIM + "benchmark_world_" +
+		itos(time(NULL));
+	if (!loadGameConfAndInitWorld(world_path, gamespec)) {
+		errorstream << "Benchmark: Failed to create world at "
+			<< world_path << std::endl;
+		return false;
+	}
+
+	// The clients fly around, dig out of reach and may not die
+	g_settings->setBool("disable_anticheat", true);
+	g_settings->setBool("enable_damage", false);
+	g_settings->setBool("disallow_empty_password", false);
+	g_settings->setU16("max_users",
+		MYMAX(num_clients, g_settings->getU16("max_users")));
+
+	bool success = false;
+	try {
+		success = run_benchmark(world_path, gamespec, port, num_clients,
+			duration);
+	} catch (BaseException &e) {
+		errorstream << "Benchmark: " << e.what() << std::endl;
+	}
+
+	fs::RecursiveDelete(world_path);
+	return success;
+}
@@ -0,0 +1,36 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BENCHMARK_SERVER_HEADER
+#define BENCHMARK_SERVER_HEADER
+
+class Settings;
+
+/*
+	Runs a server on a temporary world with fake clients connected over
+	loopback, which walk around, dig and place. Reports how long the
+	server steps took, how many chunks were generated, how much was sent
+	and how much memory was used.
+
+	Uses the gameid, port, benchmark-clients and benchmark-duration
+	command line options. Returns false on failure.
+*/
+bool run_server_benchmark(const Settings &cmd_args);
+
+#endif
@@ -0,0 +1,78 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "block_decode_thread.h"
+#include <sstream>
+#include "exceptions.h"
+#include "log.h"
+#include "mapblock.h"
+#include "porting.h"
+#include "profiler.h"
+#include "tracer.h"
+
+BlockDecodeThread::BlockDecodeThread(IGameDef *gamedef, Map *map):
+	UpdateThread("BlockDecode"),
+	m_gamedef(gamedef),
+	m_map(map)
+{
+}
+
+BlockDecodeThread::~BlockDecodeThread()
+{
+	while (!m_queue_out.empty())
+		delete m_queue_out.pop_frontNoEx().block;
+}
+
+void BlockDecodeThread::queueBlock(v3s16 p, const std::string &data, u8 ser_ver)
+{
+	QueuedBlockDecode q;
+	q.p = p;
+	q.data = data;
+	q.ser_ver = ser_ver;
+	q.queued_time_us = porting::getTimeUs();
+	m_queue_in.push_back(q);
+	deferUpdate();
+}
+
+void BlockDecodeThread::doUpdate()
+{
+	while (!m_queue_in.empty()) {
+		QueuedBlockDecode q = m_queue_in.pop_frontNoEx();
+		ScopeProfiler sp(g_profiler, "Client: Block decoding");
+		TraceScope ts(TZ_CLIENT_BLOCK_DECODE);
+
+		BlockDecodeResult r;
+		r.p = q.p;
+		r.queued_time_us = q.queued_time_us;
+
+		std::istringstream is(q.data, std::ios_base::binary);
+		MapBlock *block = new MapBlock(m_map, q.p, m_gamedef);
+		try {
+			block->deSerialize(is, q.ser_ver, false);
+			block->deSerializeNetworkSpecific(is);
+			r.block = block;
+		} catch (BaseException &e) {
+			errorstream << "BlockDecodeThread: Dropping invalid block "
+				<< PP(q.p) << ": " << e.what() << std::endl;
+			delete block;
+		}
+
+		m_queue_out.push_back(r);
+	}
+}
@@ -0,0 +1,87 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BLOCK_DECODE_THREAD_HEADER
+#define BLOCK_DECODE_THREAD_HEADER
+
+#include <string>
+#include "irr_v3d.h"
+#include "util/container.h"
+#include "util/thread.h"
+
+class IGameDef;
+class Map;
+class MapBlock;
+
+struct QueuedBlockDecode
+{
+	v3s16 p;
+	std::string data;
+	u8 ser_ver;
+	u64 queued_time_us;
+
+	QueuedBlockDecode():
+		p(-1337, -1337, -1337),
+		ser_ver(0),
+		queued_time_us(0)
+	{}
+};
+
+struct BlockDecodeResult
+{
+	v3s16 p;
+	// NULL if the data could not be read
+	MapBlock *block;
+	u64 queued_time_us;
+
+	BlockDecodeResult():
+		p(-1338, -1338, -1338),
+		block(NULL),
+		queued_time_us(0)
+	{}
+};
+
+/*
+	Reads the mapblocks received from the server into new MapBlocks, which
+	are not part of the map yet. The main thread puts their contents into
+	the map, see Client::applyDecodedBlocks().
+
+	Blocks come out in the order they were queued.
+*/
+class BlockDecodeThread : public UpdateThread
+{
+public:
+	BlockDecodeThread(IGameDef *gamedef, Map *map);
+	~BlockDecodeThread();
+
+	// Queues the serialized block of a TOCLIENT_BLOCKDATA packet
+	void queueBlock(v3s16 p, const std::string &data, u8 ser_ver);
+
+	MutexedQueue<BlockDecodeResult> m_queue_out;
+
+protected:
+	virtual void doUpdate();
+
+private:
+	IGameDef *m_gamedef;
+	Map *m_map;
+	MutexedQueue<QueuedBlockDecode> m_queue_in;
+};
+
+#endif
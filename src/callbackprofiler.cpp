@@ -0,0 +1,126 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "callbackprofiler.h"
+#include <algorithm>
+#include "log.h"
+
+// Slow calls of a callback are logged at most this often
+#define CALLBACK_WARNING_INTERVAL_US 10000000
+
+CallbackProfiler::CallbackProfiler():
+	m_enabled(false),
+	m_warning_threshold(0)
+{
+}
+
+void CallbackProfiler::setEnabled(bool enabled)
+{
+	if (enabled && !m_enabled)
+		clear();
+	m_enabled = enabled;
+}
+
+void CallbackProfiler::setWarningThreshold(u32 threshold_us,
+	const std::string &callback)
+{
+	if (callback.empty())
+		m_warning_threshold = threshold_us;
+	else
+		m_callback_thresholds[callback] = threshold_us;
+
+	for (UNORDERED_MAP<std::string, Entry>::iterator it = m_entries.begin();
+			it != m_entries.end(); ++it)
+		it->second.warning_threshold =
+			getWarningThreshold(it->second.stats.callback);
+}
+
+u32 CallbackProfiler::getWarningThreshold(const std::string &callback) const
+{
+	UNORDERED_MAP<std::string, u32>::const_iterator it =
+		m_callback_thresholds.find(callback);
+	return it != m_callback_thresholds.end() ? it->second : m_warning_threshold;
+}
+
+bool CallbackProfiler::record(const std::string &mod, const char *callback,
+	u64 start_us)
+{
+	u64 now = porting::getTimeUs();
+	u32 duration = now - start_us;
+
+	m_key.assign(mod);
+	m_key.push_back('\n');
+	m_key.append(callback);
+
+	UNORDERED_MAP<std::string, Entry>::iterator it = m_entries.find(m_key);
+	if (it == m_entries.end()) {
+		Entry entry;
+		entry.stats.mod = mod;
+		entry.stats.callback = callback;
+		entry.stats.calls = 0;
+		entry.stats.total_us = 0;
+		entry.stats.max_us = 0;
+		entry.warning_threshold = getWarningThreshold(entry.stats.callback);
+		entry.last_warning = 0;
+		it = m_entries.insert(std::make_pair(m_key, entry)).first;
+	}
+
+	CallbackStats &stats = it->second.stats;
+	stats.calls++;
+	stats.total_us += duration;
+	stats.max_us = MYMAX(stats.max_us, duration);
+
+	u32 threshold = it->second.warning_threshold;
+	if (threshold == 0 || duration <= threshold ||
+			now - it->second.last_warning < CALLBACK_WARNING_INTERVAL_US)
+		return false;
+	it->second.last_warning = now;
+	warningstream << "Mod " << mod << ": " << callback << " took "
+		<< duration / 1000 << "ms" << std::endl;
+	return true;
+}
+
+static bool compare_total(const CallbackStats &a, const CallbackStats &b)
+{
+	return a.total_us > b.total_us;
+}
+
+static bool compare_max(const CallbackStats &a, const CallbackStats &b)
+{
+	return a.max_us > b.max_us;
+}
+
+void CallbackProfiler::getTop(std::vector<CallbackStats> &result, u32 count,
+	bool by_max) const
+{
+	result.clear();
+	for (UNORDERED_MAP<std::string, Entry>::const_iterator it =
+			m_entries.begin(); it != m_entries.end(); ++it)
+		result.push_back(it->second.stats);
+
+	count = MYMIN(count, (u32)result.size());
+	std::partial_sort(result.begin(), result.begin() + count, result.end(),
+		by_max ? compare_max : compare_total);
+	result.resize(count);
+}
+
+void CallbackProfiler::clear()
+{
+	m_entries.clear();
+}
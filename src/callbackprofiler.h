@@ -0,0 +1,127 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef CALLBACKPROFILER_HEADER
+#define CALLBACKPROFILER_HEADER
+
+#include <string>
+#include <vector>
+#include "irrlichttypes.h"
+#include "porting.h"
+#include "util/basic_macros.h"
+#include "util/cpp11_container.h"
+
+struct CallbackStats
+{
+	std::string mod;
+	std::string callback;
+	u32 calls;
+	u64 total_us;
+	u32 max_us;
+};
+
+/*
+	Accounts the time spent in Lua callbacks to the mods that registered
+	them. A callback is e.g. "register_globalstep" or "on_step", the time
+	of nested callbacks is included in the outer ones.
+
+	Not thread safe, it is only used with the script lock held.
+*/
+class CallbackProfiler
+{
+public:
+	CallbackProfiler();
+
+	inline bool isEnabled() const { return m_enabled; }
+	// Enabling starts over
+	void setEnabled(bool enabled);
+
+	// Single calls taking longer than threshold_us are logged, 0 disables
+	// this. Without a callback name it sets the default for all callbacks
+	// that have no threshold of their own.
+	void setWarningThreshold(u32 threshold_us,
+		const std::string &callback = "");
+	u32 getWarningThreshold(const std::string &callback) const;
+
+	// Accounts a callback that started at start_us and ends now, returns
+	// true if the call was logged as slow
+	bool record(const std::string &mod, const char *callback, u64 start_us);
+
+	// Gets the count callbacks that took the most time in total, or in
+	// a single call if by_max is set
+	void getTop(std::vector<CallbackStats> &result, u32 count,
+		bool by_max) const;
+
+	void clear();
+
+private:
+	struct Entry
+	{
+		CallbackStats stats;
+		u32 warning_threshold;
+		u64 last_warning;
+	};
+
+	// Keyed by mod and callback, separated by a newline
+	UNORDERED_MAP<std::string, Entry> m_entries;
+	std::string m_key;
+
+	bool m_enabled;
+	u32 m_warning_threshold;
+	// Thresholds of single callbacks, by callback name
+	UNORDERED_MAP<std::string, u32> m_callback_thresholds;
+
+	DISABLE_CLASS_COPY(CallbackProfiler);
+};
+
+/*
+	Accounts the time until the end of the scope to the callback of mod
+*/
+class CallbackScope
+{
+public:
+	CallbackScope(CallbackProfiler *profiler, const std::string &mod,
+			const char *callback):
+		m_profiler(profiler->isEnabled() ? profiler : NULL),
+		m_callback(callback),
+		m_start(0)
+	{
+		if (m_profiler) {
+			// The origin changes with nested callbacks
+			m_mod = mod;
+			m_start = porting::getTimeUs();
+		}
+	}
+
+	~CallbackScope()
+	{
+		if (m_profiler)
+			m_profiler->record(m_mod, m_callback, m_start);
+	}
+
+private:
+	CallbackProfiler *m_profiler;
+	std::string m_mod;
+	const char *m_callback;
+	u64 m_start;
+
+	DISABLE_CLASS_COPY(CallbackScope);
+};
+
+#endif
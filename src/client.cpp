@@ -25,15 +25,20 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "threading/mutex_auto_lock.h"
 #include "util/auth.h"
 #include "util/directiontables.h"
+#include "util/hex.h"
 #include "util/pointedthing.h"
 #include "util/serialize.h"
+#include "util/sha1.h"
 #include "util/string.h"
 #include "util/srp.h"
 #include "client.h"
 #include "network/clientopcodes.h"
+#include "filecache.h"
 #include "filesys.h"
 #include "mapblock_mesh.h"
 #include "mapblock.h"
+#include "mapsector.h"
+#include "map.h"
 #include "minimap.h"
 #include "content/mods.h"
 #include "profiler.h"
@@ -42,6 +47,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "clientmedia.h"
 #include "version.h"
 #include "drawscene.h"
+#include "database-files.h"
 #include "database-sqlite3.h"
 #include "serialization.h"
 #include "guiscalingfilter.h"
@@ -79,7 +85,7 @@ Client::Client(
 	m_nodedef(nodedef),
 	m_sound(sound),
 	m_event(event),
-	m_mesh_update_thread(this),
+	m_mesh_update_manager(this),
 	m_env(
 		new ClientMap(this, control,
 			device->getSceneManager()->getRootSceneNode(),
@@ -87,6 +93,9 @@ Client::Client(
 		device->getSceneManager(),
 		tsrc, this, device
 	),
+	m_block_decode_thread(this, &m_env.getMap()),
+	m_pending_block_decodes(0),
+	m_block_decodes_applied(0),
 	m_particle_manager(&m_env),
 	m_con(PROTOCOL_ID, 512, CONNECTION_TIMEOUT, ipv6, this),
 	m_address_name(address_name),
@@ -122,6 +131,7 @@ Client::Client(
 	m_state(LC_Created),
 	m_localdb(NULL),
 	m_script(NULL),
+	m_mod_storage_database(NULL),
 	m_mod_storage_save_timer(10.0f),
 	m_game_ui_flags(game_ui_flags),
 	m_shutdown(false)
@@ -135,6 +145,7 @@ Client::Client(
 	m_cache_save_interval = g_settings->getU16("server_map_save_interval");
 
 	m_modding_enabled = g_settings->getBool("enable_client_modding");
+	m_mod_storage_database = new ModMetadataDatabaseFiles(getModStoragePath());
 	m_script = new ClientScripting(this);
 	m_env.setScript(m_script);
 	m_script->setEnv(&m_env);
@@ -213,7 +224,8 @@ void Client::Stop()
 	// Don't disable this part when modding is disabled, it's used in builtin
 	m_script->on_shutdown();
 	//request all client managed threads to stop
-	m_mesh_update_thread.stop();
+	m_mesh_update_manager.stop();
+	m_block_decode_thread.stop();
 	// Save local server map
 	if (m_localdb) {
 		infostream << "Local map saving ended." << std::endl;
@@ -225,7 +237,7 @@ void Client::Stop()
 
 bool Client::isShutdown()
 {
-	return m_shutdown || !m_mesh_update_thread.isRunning();
+	return m_shutdown || !m_mesh_update_manager.isRunning();
 }
 
 Client::~Client()
@@ -235,10 +247,12 @@ Client::~Client()
 
 	deleteAuthData();
 
-	m_mesh_update_thread.stop();
-	m_mesh_update_thread.wait();
-	while (!m_mesh_update_thread.m_queue_out.empty()) {
-		MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_frontNoEx();
+	m_mesh_update_manager.stop();
+	m_mesh_update_manager.wait();
+	m_block_decode_thread.stop();
+	m_block_decode_thread.wait();
+	while (!m_mesh_update_manager.m_queue_out.empty()) {
+		MeshUpdateResult r = m_mesh_update_manager.m_queue_out.pop_frontNoEx();
 		delete r.mesh;
 	}
 
@@ -263,6 +277,7 @@ Client::~Client()
 
 	delete m_minimap;
 	delete m_media_downloader;
+	delete m_mod_storage_database;
 }
 
 void Client::connect(Address address, bool is_local_server)
@@ -472,19 +487,21 @@ void Client::step(float dtime)
 		}
 	}
 
+	applyDecodedBlocks(false);
+
 	/*
 		Replace updated meshes
 	*/
 	{
 		int num_processed_meshes = 0;
-		while (!m_mesh_update_thread.m_queue_out.empty())
+		while (!m_mesh_update_manager.m_queue_out.empty())
 		{
 			num_processed_meshes++;
 
 			MinimapMapblock *minimap_mapblock = NULL;
 			bool do_mapper_update = true;
 
-			MeshUpdateResult r = m_mesh_update_thread.m_queue_out.pop_frontNoEx();
+			MeshUpdateResult r = m_mesh_update_manager.m_queue_out.pop_frontNoEx();
 			MapBlock *block = m_env.getMap().getBlockNoCreateNoEx(r.p);
 			if (block) {
 				// Delete the old mesh
@@ -615,7 +632,7 @@ void Client::step(float dtime)
 		for (UNORDERED_MAP<std::string, ModMetadata *>::const_iterator
 				it = m_mod_storages.begin(); it != m_mod_storages.end(); ++it) {
 			if (it->second->isModified()) {
-				it->second->save(getModStoragePath());
+				it->second->save();
 			}
 		}
 	}
@@ -776,6 +793,126 @@ void Client::initLocalMapSaving(const Address &address,
 	actionstream << "Local map saving started, map will be saved at '" << world_path << "'" << std::endl;
 }
 
+static std::string getDefinitionsCacheDir()
+{
+	return porting::path_cache + DIR_DELIM + "definitions";
+}
+
+// The address is hex encoded, IPv6 addresses aren't valid file names
+static std::string get_definitions_index_name(const std::string &address_name,
+		u16 port)
+{
+	return "server_" + hex_encode(address_name) + "_" + itos(port);
+}
+
+// Removes the cached definitions that no server index refers to anymore
+static void prune_cached_definitions(FileCache &cache)
+{
+	std::vector<fs::DirListNode> files =
+			fs::GetDirListing(getDefinitionsCacheDir());
+	std::set<std::string> used;
+	for (std::vector<fs::DirListNode>::const_iterator it = files.begin();
+			it != files.end(); ++it) {
+		if (it->dir || !str_starts_with(it->name, "server_"))
+			continue;
+		std::ostringstream index_os(std::ios::binary);
+		if (!cache.load(it->name, index_os))
+			continue;
+		std::istringstream index_is(index_os.str());
+		std::string sha1_hex;
+		while (std::getline(index_is, sha1_hex))
+			used.insert(sha1_hex);
+	}
+
+	for (std::vector<fs::DirListNode>::const_iterator it = files.begin();
+			it != files.end(); ++it) {
+		if (it->dir || str_starts_with(it->name, "server_") ||
+				used.count(it->name))
+			continue;
+		infostream << "Client: Removing superseded cached definitions "
+				<< it->name << std::endl;
+		fs::DeleteSingleFileOrEmptyDirectory(getDefinitionsCacheDir() +
+				DIR_DELIM + it->name);
+	}
+}
+
+// Loads the compressed definitions named by sha1_hex, if they are intact
+static void load_cached_definitions(FileCache &cache,
+		const std::string &sha1_hex, std::string &data, std::string &sha1)
+{
+	std::ostringstream os(std::ios::binary);
+	if (sha1_hex.empty() || !cache.load(sha1_hex, os))
+		return;
+
+	std::string loaded = os.str();
+	SHA1 sha1_loaded;
+	sha1_loaded.addBytes(loaded.c_str(), loaded.size());
+	unsigned char *digest = sha1_loaded.getDigest();
+	std::string digest_str((char *)digest, 20);
+	free(digest);
+	if (hex_encode(digest_str) != sha1_hex) {
+		infostream << "Client: Ignoring corrupt cached definitions "
+				<< sha1_hex << std::endl;
+		return;
+	}
+	data = loaded;
+	sha1 = digest_str;
+}
+
+void Client::loadCachedDefinitions()
+{
+	// The index lists the SHA1s of the latest definitions of the server
+	FileCache cache(getDefinitionsCacheDir());
+	std::ostringstream index_os(std::ios::binary);
+	if (!cache.load(get_definitions_index_name(m_address_name,
+			getServerAddress().getPort()), index_os))
+		return;
+
+	std::istringstream index_is(index_os.str());
+	std::string itemdef_hex, nodedef_hex;
+	std::getline(index_is, itemdef_hex);
+	std::getline(index_is, nodedef_hex);
+	load_cached_definitions(cache, itemdef_hex,
+			m_cached_itemdef, m_cached_itemdef_sha1);
+	load_cached_definitions(cache, nodedef_hex,
+			m_cached_nodedef, m_cached_nodedef_sha1);
+}
+
+std::string Client::updateCachedDefinitions(const std::string &data,
+		const std::string &sha1, std::string &cached, std::string &cached_sha1)
+{
+	std::string result;
+	if (data.empty() && !sha1.empty() && sha1 == cached_sha1) {
+		infostream << "Client: Using cached definitions "
+				<< hex_encode(sha1) << std::endl;
+		result.swap(cached);
+	} else {
+		result = data;
+		// Older servers don't send the SHA1
+		if (!sha1.empty()) {
+			fs::CreateAllDirs(getDefinitionsCacheDir());
+			FileCache cache(getDefinitionsCacheDir());
+			cache.update(hex_encode(sha1), data);
+		}
+	}
+	cached.clear();
+	cached_sha1 = sha1;
+	return result;
+}
+
+void Client::saveCachedDefinitionsIndex()
+{
+	if (m_cached_itemdef_sha1.empty() || m_cached_nodedef_sha1.empty())
+		return;
+
+	FileCache cache(getDefinitionsCacheDir());
+	if (cache.update(get_definitions_index_name(m_address_name,
+			getServerAddress().getPort()),
+			hex_encode(m_cached_itemdef_sha1) + "\n" +
+			hex_encode(m_cached_nodedef_sha1) + "\n"))
+		prune_cached_definitions(cache);
+}
+
 void Client::ReceiveAll()
 {
 	DSTACK(FUNCTION_NAME);
@@ -1287,6 +1424,83 @@ void Client::sendReady()
 	Send(&pkt);
 }
 
+void Client::applyDecodedBlocks(bool wait)
+{
+	while (m_pending_block_decodes > 0) {
+		BlockDecodeResult r;
+		try {
+			r = m_block_decode_thread.m_queue_out.pop_front(wait ? 100 : 0);
+		} catch (ItemNotFoundException &e) {
+			if (wait && m_block_decode_thread.isRunning())
+				continue;
+			break;
+		}
+		// Edits received before this block are applied before it
+		applyNodeEdits();
+		m_pending_block_decodes--;
+		m_block_decodes_applied++;
+
+		g_profiler->avg("Client: Block decode latency [ms]",
+			(porting::getTimeUs() - r.queued_time_us) / 1000.0f);
+		if (!r.block)
+			continue;
+
+		MapSector *sector = m_env.getMap().emergeSector(v2s16(r.p.X, r.p.Z));
+		MapBlock *block = sector->getBlockNoCreateNoEx(r.p.Y);
+		if (block) {
+			// Meshes and the draw list keep pointers to the old block
+			block->swapDeserializedData(r.block);
+			delete r.block;
+		} else {
+			block = r.block;
+			sector->insertBlock(block);
+		}
+
+		if (m_localdb) {
+			ServerMap::saveBlock(block, m_localdb);
+		}
+
+		/*
+			Add it to mesh update queue and set it to be acknowledged after update.
+		*/
+		addUpdateMeshTaskWithEdge(r.p, true);
+	}
+	applyNodeEdits();
+}
+
+void Client::queueNodeEdit(v3s16 p, MapNode n, bool remove, bool remove_metadata)
+{
+	if (m_pending_block_decodes == 0) {
+		applyNodeEdits();
+		if (remove)
+			removeNode(p);
+		else
+			addNode(p, n, remove_metadata);
+		return;
+	}
+
+	QueuedNodeEdit edit;
+	edit.p = p;
+	edit.n = n;
+	edit.remove = remove;
+	edit.remove_metadata = remove_metadata;
+	edit.after_block_decodes = m_block_decodes_applied + m_pending_block_decodes;
+	m_node_edits.push(edit);
+}
+
+void Client::applyNodeEdits()
+{
+	while (!m_node_edits.empty() &&
+			m_node_edits.front().after_block_decodes <= m_block_decodes_applied) {
+		const QueuedNodeEdit &edit = m_node_edits.front();
+		if (edit.remove)
+			removeNode(edit.p);
+		else
+			addNode(edit.p, edit.n, edit.remove_metadata);
+		m_node_edits.pop();
+	}
+}
+
 void Client::sendPlayerPos()
 {
 	LocalPlayer *myplayer = m_env.getLocalPlayer();
@@ -1572,12 +1786,12 @@ void Client::addUpdateMeshTask(v3s16 p, bool ack_to_server, bool urgent)
 {
 	// Check if the block exists to begin with. In the case when a non-existing
 	// neighbor is automatically added, it may not. In that case we don't want
-	// to tell the mesh update thread about it.
+	// to tell the mesh update threads about it.
 	MapBlock *b = m_env.getMap().getBlockNoCreateNoEx(p);
 	if (b == NULL)
 		return;
 
-	m_mesh_update_thread.updateBlock(&m_env.getMap(), p, ack_to_server, urgent);
+	m_mesh_update_manager.updateBlock(&m_env.getMap(), p, ack_to_server, urgent);
 }
 
 void Client::addUpdateMeshTaskWithEdge(v3s16 blockpos, bool ack_to_server, bool urgent)
@@ -1743,9 +1957,10 @@ void Client::afterContentReceived(IrrlichtDevice *device)
 	m_nodedef->updateTextures(this, texture_update_progress, &tu_args);
 	delete[] tu_args.text_base;
 
-	// Start mesh update thread after setting up content definitions
-	infostream<<"- Starting mesh update thread"<<std::endl;
-	m_mesh_update_thread.start();
+	// Start mesh update threads after setting up content definitions
+	infostream<<"- Starting mesh update threads"<<std::endl;
+	m_mesh_update_manager.start();
+	m_block_decode_thread.start();
 
 	m_state = LC_Ready;
 	sendReady();
@@ -1960,7 +2175,7 @@ void Client::unregisterModStorage(const std::string &name)
 	UNORDERED_MAP<std::string, ModMetadata *>::const_iterator it = m_mod_storages.find(name);
 	if (it != m_mod_storages.end()) {
 		// Save unconditionaly on unregistration
-		it->second->save(getModStoragePath());
+		it->second->save();
 		m_mod_storages.erase(name);
 	}
 }
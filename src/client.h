@@ -37,6 +37,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mapnode.h"
 #include "tileanimation.h"
 #include "mesh_generator_thread.h"
+#include "block_decode_thread.h"
 
 #define CLIENT_CHAT_MESSAGE_LIMIT_PER_10S 10.0f
 
@@ -349,6 +350,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void handleCommand_LocalPlayerAnimations(NetworkPacket* pkt);
 	void handleCommand_EyeOffset(NetworkPacket* pkt);
 	void handleCommand_UpdatePlayerList(NetworkPacket* pkt);
+	void handleCommand_InventoryDelta(NetworkPacket* pkt);
 	void handleCommand_SrpBytesSandB(NetworkPacket* pkt);
 
 	void ProcessData(NetworkPacket *pkt);
@@ -428,7 +430,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	void addUpdateMeshTaskForNode(v3s16 nodepos, bool ack_to_server=false, bool urgent=false);
 
 	void updateCameraOffset(v3s16 camera_offset)
-	{ m_mesh_update_thread.m_camera_offset = camera_offset; }
+	{ m_mesh_update_manager.m_camera_offset = camera_offset; }
 
 	bool hasClientEvents() const { return !m_client_event_queue.empty(); }
 	// Get event from queue. If queue is empty, it triggers an assertion failure.
@@ -491,7 +493,9 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	{ return checkPrivilege(priv); }
 	virtual scene::IAnimatedMesh* getMesh(const std::string &filename);
 
-	virtual std::string getModStoragePath() const;
+	std::string getModStoragePath() const;
+	virtual ModMetadataDatabase *getModStorageDatabase()
+	{ return m_mod_storage_database; }
 	virtual bool registerModStorage(ModMetadata *meta);
 	virtual void unregisterModStorage(const std::string &name);
 
@@ -547,9 +551,45 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 			const std::string &hostname,
 			bool is_local_server);
 
+	/*
+		The compressed item and node definitions are cached by their SHA1.
+		The SHA1s of the latest definitions of the server are offered to it
+		in TOSERVER_INIT2, so that it does not need to send them again.
+	*/
+	void loadCachedDefinitions();
+	// Returns the compressed definitions of a TOCLIENT_ITEMDEF or
+	// TOCLIENT_NODEDEF packet, from the cache if the server did not send them
+	std::string updateCachedDefinitions(const std::string &data,
+			const std::string &sha1, std::string &cached,
+			std::string &cached_sha1);
+	void saveCachedDefinitionsIndex();
+
 	void ReceiveAll();
 	void Receive();
 
+	/*
+		Puts the blocks read by m_block_decode_thread into the map. If wait
+		is set, first waits until all queued blocks are read. Node edits
+		received after a block are applied after it, see queueNodeEdit().
+	*/
+	void applyDecodedBlocks(bool wait);
+
+	// A TOCLIENT_ADDNODE or TOCLIENT_REMOVENODE waiting for the blocks
+	// received before it
+	struct QueuedNodeEdit
+	{
+		v3s16 p;
+		MapNode n;
+		bool remove;
+		bool remove_metadata;
+		// Applied when m_block_decodes_applied reaches this
+		u32 after_block_decodes;
+	};
+	// Applies the edit now if no blocks are being read, else queues it
+	void queueNodeEdit(v3s16 p, MapNode n, bool remove, bool remove_metadata);
+	// Applies the queued edits whose blocks are in the map
+	void applyNodeEdits();
+
 	void sendPlayerPos();
 	// Send the item number 'item' as player item to the server
 	void sendPlayerItem(u16 item);
@@ -585,8 +625,13 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	MtEventManager *m_event;
 
 
-	MeshUpdateThread m_mesh_update_thread;
+	MeshUpdateManager m_mesh_update_manager;
 	ClientEnvironment m_env;
+	BlockDecodeThread m_block_decode_thread;
+	// Blocks queued to m_block_decode_thread and not yet in the map
+	u32 m_pending_block_decodes;
+	u32 m_block_decodes_applied;
+	std::queue<QueuedNodeEdit> m_node_edits;
 	ParticleManager m_particle_manager;
 	con::Connection m_con;
 	std::string m_address_name;
@@ -643,6 +688,11 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 	std::queue<ClientEvent> m_client_event_queue;
 	bool m_itemdef_received;
 	bool m_nodedef_received;
+	// Definitions offered to the server, see loadCachedDefinitions()
+	std::string m_cached_itemdef;
+	std::string m_cached_itemdef_sha1;
+	std::string m_cached_nodedef;
+	std::string m_cached_nodedef_sha1;
 	ClientMediaDownloader *m_media_downloader;
 
 	// time_of_day speed approximation for old protocol
@@ -682,6 +732,7 @@ class Client : public con::PeerHandler, public InventoryManager, public IGameDef
 
 	ClientScripting *m_script;
 	bool m_modding_enabled;
+	ModMetadataDatabase *m_mod_storage_database;
 	UNORDERED_MAP<std::string, ModMetadata *> m_mod_storages;
 	float m_mod_storage_save_timer;
 	GameUIFlags *m_game_ui_flags;
@@ -704,6 +704,27 @@ void ClientInterface::sendToAll(NetworkPacket *pkt)
 	}
 }
 
+void ClientInterface::sendToAllCompat(NetworkPacket *pkt,
+		NetworkPacket *legacypkt, u16 min_proto_ver)
+{
+	MutexAutoLock clientslock(m_clients_mutex);
+	for (UNORDERED_MAP<u16, RemoteClient*>::iterator i = m_clients.begin();
+			i != m_clients.end(); ++i) {
+		RemoteClient *client = i->second;
+		if (client->net_proto_version == 0)
+			continue;
+
+		NetworkPacket *pkt_to_send = pkt;
+		if (client->net_proto_version < min_proto_ver)
+			pkt_to_send = legacypkt;
+
+		m_con->Send(client->peer_id,
+				clientCommandFactoryTable[pkt_to_send->getCommand()].channel,
+				pkt_to_send,
+				clientCommandFactoryTable[pkt_to_send->getCommand()].reliable);
+	}
+}
+
 RemoteClient* ClientInterface::getClientNoEx(u16 peer_id, ClientState state_min)
 {
 	MutexAutoLock clientslock(m_clients_mutex);
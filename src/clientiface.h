@@ -460,6 +460,9 @@ class ClientInterface {
 
 	/* send to all clients */
 	void sendToAll(NetworkPacket *pkt);
+	// Sends legacypkt instead to clients older than min_proto_ver
+	void sendToAllCompat(NetworkPacket *pkt, NetworkPacket *legacypkt,
+			u16 min_proto_ver);
 
 	/* delete a client */
 	void DeleteClient(u16 peer_id);
@@ -27,13 +27,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <set>
 #include <vector>
 #include "util/cpp11_container.h"
+#include "network/networkprotocol.h" // MTHASHSET_FILE_*
 
 class Client;
 struct HTTPFetchResult;
 
-#define MTHASHSET_FILE_SIGNATURE 0x4d544853 // 'MTHS'
-#define MTHASHSET_FILE_NAME "index.mth"
-
 class ClientMediaDownloader
 {
 public:
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <json/json.h>
 #include <algorithm>
 #include "content/mods.h"
+#include "database.h"
 #include "filesys.h"
 #include "log.h"
 #include "content/subgames.h"
@@ -421,86 +422,68 @@ ClientModConfiguration::ClientModConfiguration(const std::string &path) :
 }
 #endif
 
-ModMetadata::ModMetadata(const std::string &mod_name) : m_mod_name(mod_name)
+ModMetadata::ModMetadata(const std::string &mod_name,
+		ModMetadataDatabase *database) :
+	m_mod_name(mod_name),
+	m_database(database)
 {
-	m_stringvars.clear();
 }
 
 void ModMetadata::clear()
 {
+	for (StringMap::const_iterator it = m_stringvars.begin();
+			it != m_stringvars.end(); ++it)
+		m_modified_keys.insert(it->first);
 	Metadata::clear();
-	m_modified = true;
 }
 
-bool ModMetadata::save(const std::string &root_path)
+bool ModMetadata::save()
 {
-	Json::Value json;
-	for (StringMap::const_iterator it = m_stringvars.begin();
-			it != m_stringvars.end(); ++it) {
-		json[it->first] = it->second;
-	}
-
-	if (!fs::PathExists(root_path)) {
-		if (!fs::CreateAllDirs(root_path)) {
-			errorstream << "ModMetadata[" << m_mod_name
-				    << "]: Unable to save. '" << root_path
-				    << "' tree cannot be created." << std::endl;
-			return false;
+	if (m_modified_keys.empty())
+		return true;
+
+	bool ok = true;
+	bool in_save = false;
+	try {
+		m_database->beginSave();
+		in_save = true;
+		for (std::set<std::string>::const_iterator it = m_modified_keys.begin();
+				it != m_modified_keys.end(); ++it) {
+			StringMap::const_iterator var = m_stringvars.find(*it);
+			if (var != m_stringvars.end())
+				ok &= m_database->setModEntry(m_mod_name, *it, var->second);
+			else
+				ok &= m_database->removeModEntry(m_mod_name, *it);
 		}
-	} else if (!fs::IsDir(root_path)) {
-		errorstream << "ModMetadata[" << m_mod_name << "]: Unable to save. '"
-			    << root_path << "' is not a directory." << std::endl;
-		return false;
+		m_database->endSave();
+	} catch (DatabaseException &e) {
+		errorstream << e.what() << std::endl;
+		ok = false;
+		// The keys stay modified and are all written by the next save
+		if (in_save)
+			m_database->abortSave();
 	}
 
-	bool w_ok = fs::safeWriteToFile(
-			root_path + DIR_DELIM + m_mod_name, Json::FastWriter().write(json));
-
-	if (w_ok) {
-		m_modified = false;
+	if (ok) {
+		m_modified_keys.clear();
 	} else {
-		errorstream << "ModMetadata[" << m_mod_name << "]: failed write file."
-			    << std::endl;
+		errorstream << "ModMetadata[" << m_mod_name << "]: failed to save."
+			<< std::endl;
 	}
-	return w_ok;
+	return ok;
 }
 
-bool ModMetadata::load(const std::string &root_path)
+bool ModMetadata::load()
 {
 	m_stringvars.clear();
-
-	std::ifstream is((root_path + DIR_DELIM + m_mod_name).c_str(),
-			std::ios_base::binary);
-	if (!is.good()) {
-		return false;
-	}
-
-	Json::Reader reader;
-	Json::Value root;
-	Json::CharReaderBuilder builder;
-	builder.settings_["collectComments"] = false;
-	std::string errs;
-
-	if (!Json::parseFromStream(builder, is, &root, &errs)) {
-		errorstream << "ModMetadata[" << m_mod_name
-			    << "]: failed read data "
-			       "(Json decoding failure). Message: "
-			    << errs << std::endl;
-		return false;
-	}
-
-	const Json::Value::Members attr_list = root.getMemberNames();
-	for (Json::Value::Members::const_iterator it = attr_list.begin();
-			it != attr_list.end(); ++it) {
-		Json::Value attr_value = root[*it];
-		m_stringvars[*it] = attr_value.asString();
-	}
-
-	return true;
+	m_modified_keys.clear();
+	return m_database->getModEntries(m_mod_name, m_stringvars);
 }
 
 bool ModMetadata::setString(const std::string &name, const std::string &var)
 {
-	m_modified = Metadata::setString(name, var);
-	return m_modified;
+	if (!Metadata::setString(name, var))
+		return false;
+	m_modified_keys.insert(name);
+	return true;
 }
@@ -145,25 +145,32 @@ class ClientModConfiguration : public ModConfiguration
 };
 #endif
 
+class ModMetadataDatabase;
+
+/*
+	The storage of a mod. Only the keys changed since the last save are
+	written to the database.
+*/
 class ModMetadata : public Metadata
 {
 public:
-	ModMetadata(const std::string &mod_name);
+	ModMetadata(const std::string &mod_name, ModMetadataDatabase *database);
 	~ModMetadata() {}
 
 	virtual void clear();
 
-	bool save(const std::string &root_path);
-	bool load(const std::string &root_path);
+	bool save();
+	bool load();
 
-	bool isModified() const { return m_modified; }
+	bool isModified() const { return !m_modified_keys.empty(); }
 	const std::string &getModName() const { return m_mod_name; }
 
 	virtual bool setString(const std::string &name, const std::string &var);
 
 private:
 	std::string m_mod_name;
-	bool m_modified;
+	ModMetadataDatabase *m_database;
+	std::set<std::string> m_modified_keys;
 };
 
 #endif
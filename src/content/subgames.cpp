@@ -308,6 +308,8 @@ bool loadGameConfAndInitWorld(const std::string &path, const SubgameSpec &gamesp
 		std::ostringstream ss(std::ios_base::binary);
 		ss << "gameid = " << gamespec.id
 			<< "\nbackend = sqlite3"
+			<< "\nauth_backend = sqlite3"
+			<< "\nmod_storage_backend = sqlite3"
 			<< "\ncreative_mode = " << g_settings->get("creative_mode")
 			<< "\nenable_damage = " << g_settings->get("enable_damage")
 			<< "\n";
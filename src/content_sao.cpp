@@ -195,6 +195,7 @@ void UnitSAO::setAttachment(int parent_id, const std::string &bone, v3f position
 	m_attachment_position = position;
 	m_attachment_rotation = rotation;
 	m_attachment_sent = false;
+	wake();
 }
 
 void UnitSAO::getAttachment(int *parent_id, std::string *bone, v3f *position,
@@ -209,6 +210,7 @@ void UnitSAO::getAttachment(int *parent_id, std::string *bone, v3f *position,
 void UnitSAO::addAttachmentChild(int child_id)
 {
 	m_attachment_child_ids.insert(child_id);
+	wake();
 }
 
 void UnitSAO::removeAttachmentChild(int child_id)
@@ -229,6 +231,7 @@ ObjectProperties* UnitSAO::accessObjectProperties()
 void UnitSAO::notifyObjectPropertiesModified()
 {
 	m_properties_sent = false;
+	wake();
 }
 
 /*
@@ -244,6 +247,8 @@ LuaEntitySAO::LuaEntitySAO(ServerEnvironment *env, v3f pos,
 	m_init_name(name),
 	m_init_state(state),
 	m_registered(false),
+	m_state_dirty(true),
+	m_step_batch(-1),
 	m_velocity(0,0,0),
 	m_acceleration(0,0,0),
 	m_last_sent_yaw(0),
@@ -286,6 +291,11 @@ void LuaEntitySAO::addedToEnvironment(u32 dtime_s)
 			luaentity_GetProperties(m_id, &m_prop);
 		// Initialize HP from properties
 		m_hp = m_prop.hp_max;
+		m_step_batch = m_env->getScriptIface()->
+			luaentity_GetStepBatch(m_init_name);
+		// on_activate may change the state, so it is always asked for
+		// the first time the entity is stored
+		m_state_dirty = true;
 		// Activate entity, supplying serialized state
 		m_env->getScriptIface()->
 			luaentity_Activate(m_id, m_init_state.c_str(), dtime_s);
@@ -405,7 +415,10 @@ void LuaEntitySAO::step(float dtime, bool send_recommended)
 		}
 	}
 
-	if(m_registered){
+	if (m_step_batch >= 0) {
+		// Stepped with the others of the type after all objects
+		m_env->getScriptIface()->luaentity_QueueStep(m_step_batch, m_id, dtime);
+	} else if (m_registered) {
 		m_env->getScriptIface()->luaentity_Step(m_id, dtime);
 	}
 
@@ -524,9 +537,20 @@ void LuaEntitySAO::getStaticData(std::string *result) const
 	os<<serializeString(m_init_name);
 	// state
 	if(m_registered){
-		std::string state = m_env->getScriptIface()->
-			luaentity_GetStaticdata(m_id);
-		os<<serializeLongString(state);
+		if (!m_prop.cache_staticdata) {
+			std::string state = m_env->getScriptIface()->
+				luaentity_GetStaticdata(m_id);
+			os<<serializeLongString(state);
+			m_state_dirty = true;
+		} else {
+			// Only ask the entity again when it reported a change
+			if (m_state_dirty) {
+				m_state_cache = m_env->getScriptIface()->
+					luaentity_GetStaticdata(m_id);
+				m_state_dirty = false;
+			}
+			os<<serializeLongString(m_state_cache);
+		}
 	} else {
 		os<<serializeLongString(m_init_state);
 	}
@@ -554,6 +578,8 @@ int LuaEntitySAO::punch(v3f dir,
 	if (isAttached())
 		return 0;
 
+	wake();
+
 	ItemStack *punchitem = NULL;
 	ItemStack punchitem_static;
 	if (puncher) {
@@ -604,6 +630,7 @@ void LuaEntitySAO::rightClick(ServerActiveObject *clicker)
 	// It's best that attachments cannot be clicked
 	if (isAttached())
 		return;
+	wake();
 	m_env->getScriptIface()->luaentity_Rightclick(m_id, clicker);
 }
 
@@ -612,6 +639,7 @@ void LuaEntitySAO::setPos(const v3f &pos)
 	if(isAttached())
 		return;
 	m_base_position = pos;
+	wake();
 	sendPosition(false, true);
 }
 
@@ -620,10 +648,18 @@ void LuaEntitySAO::moveTo(v3f pos, bool continuous)
 	if(isAttached())
 		return;
 	m_base_position = pos;
+	wake();
 	if(!continuous)
 		sendPosition(true, true);
 }
 
+bool LuaEntitySAO::canReduceStepping() const
+{
+	// Attached objects move with their parent
+	return m_registered && !m_prop.full_step_rate && !isAttached() &&
+		m_attachment_child_ids.empty();
+}
+
 float LuaEntitySAO::getMinimumSavedMovement()
 {
 	return 0.1 * BS;
@@ -644,6 +680,7 @@ void LuaEntitySAO::setHP(s16 hp)
 {
 	if(hp < 0) hp = 0;
 	m_hp = hp;
+	wake();
 }
 
 s16 LuaEntitySAO::getHP() const
@@ -654,6 +691,7 @@ s16 LuaEntitySAO::getHP() const
 void LuaEntitySAO::setVelocity(v3f velocity)
 {
 	m_velocity = velocity;
+	wake();
 }
 
 v3f LuaEntitySAO::getVelocity()
@@ -664,6 +702,7 @@ v3f LuaEntitySAO::getVelocity()
 void LuaEntitySAO::setAcceleration(v3f acceleration)
 {
 	m_acceleration = acceleration;
+	wake();
 }
 
 v3f LuaEntitySAO::getAcceleration()
@@ -110,6 +110,7 @@ class LuaEntitySAO : public UnitSAO
 	void rightClick(ServerActiveObject *clicker);
 	void setPos(const v3f &pos);
 	void moveTo(v3f pos, bool continuous);
+	bool canReduceStepping() const;
 	float getMinimumSavedMovement();
 	std::string getDescription();
 	void setHP(s16 hp);
@@ -125,6 +126,7 @@ class LuaEntitySAO : public UnitSAO
 	void setSprite(v2s16 p, int num_frames, float framelength,
 			bool select_horiz_by_yawpitch);
 	std::string getName();
+	void setStaticDataDirty() { m_state_dirty = true; }
 	bool getCollisionBox(aabb3f *toset) const;
 	bool getSelectionBox(aabb3f *toset) const;
 	bool collideWithObjects() const;
@@ -135,6 +137,11 @@ class LuaEntitySAO : public UnitSAO
 	std::string m_init_name;
 	std::string m_init_state;
 	bool m_registered;
+	// Last state from get_staticdata, see cache_staticdata
+	mutable std::string m_state_cache;
+	mutable bool m_state_dirty;
+	// See ScriptApiEntity::luaentity_GetStepBatch()
+	s32 m_step_batch;
 
 	v3f m_velocity;
 	v3f m_acceleration;
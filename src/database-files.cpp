@@ -25,6 +25,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "settings.h"
 #include "porting.h"
 #include "filesys.h"
+#include "log.h"
+#include "exceptions.h"
+#include "util/string.h"
 
 // !!! WARNING !!!
 // This backend is intended to be used on Minetest 0.4.16 only for the transition backend
@@ -177,3 +180,308 @@ void PlayerDatabaseFiles::listPlayers(std::vector<std::string> &res)
 		res.push_back(player.getName());
 	}
 }
+
+AuthDatabaseFiles::AuthDatabaseFiles(const std::string &savedir) :
+	m_savedir(savedir),
+	m_in_save(false),
+	m_modified(false)
+{
+	readAuthFile();
+}
+
+void AuthDatabaseFiles::beginSave()
+{
+	m_in_save = true;
+}
+
+void AuthDatabaseFiles::endSave()
+{
+	m_in_save = false;
+	if (m_modified)
+		writeAuthFile();
+}
+
+bool AuthDatabaseFiles::getAuth(const std::string &name, AuthEntry &res)
+{
+	UNORDERED_MAP<std::string, AuthEntry>::const_iterator it =
+		m_auth_list.find(name);
+	if (it == m_auth_list.end())
+		return false;
+	res = it->second;
+	return true;
+}
+
+bool AuthDatabaseFiles::saveAuth(const AuthEntry &authEntry)
+{
+	m_auth_list[authEntry.name] = authEntry;
+	addToIndex(authEntry.name);
+
+	// save entire file
+	return writeAuthFile();
+}
+
+bool AuthDatabaseFiles::createAuth(AuthEntry &authEntry)
+{
+	// The entries are found by name
+	authEntry.id = 0;
+	return saveAuth(authEntry);
+}
+
+bool AuthDatabaseFiles::deleteAuth(const std::string &name)
+{
+	if (!m_auth_list.erase(name)) {
+		// did not delete anything -> hadn't existed
+		return false;
+	}
+	removeFromIndex(name);
+	return writeAuthFile();
+}
+
+void AuthDatabaseFiles::listNames(std::vector<std::string> &res)
+{
+	res.clear();
+	res.reserve(m_auth_list.size());
+	for (UNORDERED_MAP<std::string, AuthEntry>::const_iterator it =
+			m_auth_list.begin(); it != m_auth_list.end(); ++it)
+		res.push_back(it->first);
+}
+
+bool AuthDatabaseFiles::findNameCaseInsensitive(const std::string &name,
+	std::string &res)
+{
+	UNORDERED_MAP<std::string, std::string>::const_iterator it =
+		m_names_lowercase.find(lowercase(name));
+	if (it == m_names_lowercase.end())
+		return false;
+	res = it->second;
+	return true;
+}
+
+void AuthDatabaseFiles::reload()
+{
+	readAuthFile();
+}
+
+void AuthDatabaseFiles::addToIndex(const std::string &name)
+{
+	// Keeps the first of names that only differ in case
+	m_names_lowercase.insert(std::make_pair(lowercase(name), name));
+}
+
+void AuthDatabaseFiles::removeFromIndex(const std::string &name)
+{
+	std::string key = lowercase(name);
+	UNORDERED_MAP<std::string, std::string>::iterator it =
+		m_names_lowercase.find(key);
+	if (it == m_names_lowercase.end() || it->second != name)
+		return;
+	m_names_lowercase.erase(it);
+
+	// Another name may differ only in case, this is rare
+	for (UNORDERED_MAP<std::string, AuthEntry>::const_iterator it =
+			m_auth_list.begin(); it != m_auth_list.end(); ++it) {
+		if (lowercase(it->first) == key) {
+			m_names_lowercase[key] = it->first;
+			break;
+		}
+	}
+}
+
+bool AuthDatabaseFiles::readAuthFile()
+{
+	std::string path = m_savedir + DIR_DELIM + "auth.txt";
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file.good()) {
+		infostream << path << " could not be opened for reading; "
+			"assuming new world" << std::endl;
+		return false;
+	}
+	m_auth_list.clear();
+	m_names_lowercase.clear();
+	std::string line;
+	while (std::getline(file, line)) {
+		// name:password:privilege,privilege:last_login
+		// Empty trailing fields are dropped
+		std::vector<std::string> parts = str_split(line, ':');
+		if (parts.size() < 2) {
+			if (!line.empty())
+				errorstream << "Invalid line in " << path << ": "
+					<< line << std::endl;
+			continue;
+		}
+		AuthEntry entry;
+		entry.id = 0;
+		entry.name = parts[0];
+		entry.password = parts[1];
+		std::vector<std::string> privileges;
+		if (parts.size() > 2)
+			privileges = str_split(parts[2], ',');
+		for (size_t i = 0; i < privileges.size(); i++) {
+			std::string priv = trim(privileges[i]);
+			if (!priv.empty())
+				entry.privileges.push_back(priv);
+		}
+		entry.last_login = parts.size() > 3 && !parts[3].empty() ?
+			stoi64(parts[3]) : -1;
+		m_auth_list[entry.name] = entry;
+		addToIndex(entry.name);
+	}
+	return true;
+}
+
+bool AuthDatabaseFiles::writeAuthFile()
+{
+	m_modified = true;
+	if (m_in_save)
+		return true;
+
+	std::ostringstream output(std::ios_base::binary);
+	for (UNORDERED_MAP<std::string, AuthEntry>::const_iterator it =
+			m_auth_list.begin(); it != m_auth_list.end(); ++it) {
+		const AuthEntry &entry = it->second;
+		output << entry.name << ":" << entry.password << ":";
+		for (size_t i = 0; i < entry.privileges.size(); i++) {
+			if (i != 0)
+				output << ",";
+			output << entry.privileges[i];
+		}
+		output << ":";
+		if (entry.last_login >= 0)
+			output << entry.last_login;
+		output << "\n";
+	}
+	std::string path = m_savedir + DIR_DELIM + "auth.txt";
+	if (!fs::safeWriteToFile(path, output.str())) {
+		errorstream << path << " could not be written to" << std::endl;
+		return false;
+	}
+	m_modified = false;
+	return true;
+}
+
+ModMetadataDatabaseFiles::ModMetadataDatabaseFiles(const std::string &storage_dir) :
+	m_storage_dir(storage_dir),
+	m_in_save(false)
+{
+}
+
+void ModMetadataDatabaseFiles::beginSave()
+{
+	m_in_save = true;
+}
+
+void ModMetadataDatabaseFiles::endSave()
+{
+	m_in_save = false;
+	bool ok = true;
+	while (!m_changes.empty())
+		ok &= applyChanges(m_changes.begin()->first);
+	if (!ok)
+		throw DatabaseException("ModMetadataDatabaseFiles: failed to save "
+			"the mod storage");
+}
+
+void ModMetadataDatabaseFiles::abortSave()
+{
+	m_in_save = false;
+	m_changes.clear();
+}
+
+bool ModMetadataDatabaseFiles::getModEntries(const std::string &modname,
+	StringMap &storage)
+{
+	return readModFile(modname, storage);
+}
+
+bool ModMetadataDatabaseFiles::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	ModChanges &changes = m_changes[modname];
+	changes.set[key] = value;
+	changes.removed.erase(key);
+	return m_in_save || applyChanges(modname);
+}
+
+bool ModMetadataDatabaseFiles::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	ModChanges &changes = m_changes[modname];
+	changes.set.erase(key);
+	changes.removed.insert(key);
+	return m_in_save || applyChanges(modname);
+}
+
+void ModMetadataDatabaseFiles::listMods(std::vector<std::string> &res)
+{
+	std::vector<fs::DirListNode> files = fs::GetDirListing(m_storage_dir);
+	for (std::vector<fs::DirListNode>::const_iterator it = files.begin();
+			it != files.end(); ++it) {
+		if (!it->dir)
+			res.push_back(it->name);
+	}
+}
+
+bool ModMetadataDatabaseFiles::readModFile(const std::string &modname,
+	StringMap &meta)
+{
+	std::string path = m_storage_dir + DIR_DELIM + modname;
+	std::ifstream is(path.c_str(), std::ios_base::binary);
+	if (!is.good())
+		return true;
+
+	Json::Value root;
+	Json::CharReaderBuilder builder;
+	builder.settings_["collectComments"] = false;
+	std::string errs;
+
+	if (!Json::parseFromStream(builder, is, &root, &errs)) {
+		errorstream << "ModMetadataDatabaseFiles[" << modname
+			<< "]: failed to read data (Json decoding failure). "
+			<< "Message: " << errs << std::endl;
+		return false;
+	}
+
+	const Json::Value::Members attr_list = root.getMemberNames();
+	for (Json::Value::Members::const_iterator it = attr_list.begin();
+			it != attr_list.end(); ++it)
+		meta[*it] = root[*it].asString();
+	return true;
+}
+
+bool ModMetadataDatabaseFiles::applyChanges(const std::string &modname)
+{
+	std::map<std::string, ModChanges>::iterator found = m_changes.find(modname);
+	if (found == m_changes.end())
+		return true;
+	ModChanges changes;
+	std::swap(changes, found->second);
+	m_changes.erase(found);
+
+	StringMap meta;
+	if (!readModFile(modname, meta))
+		return false;
+	for (StringMap::const_iterator it = changes.set.begin();
+			it != changes.set.end(); ++it)
+		meta[it->first] = it->second;
+	for (std::set<std::string>::const_iterator it = changes.removed.begin();
+			it != changes.removed.end(); ++it)
+		meta.erase(*it);
+
+	if (!fs::CreateAllDirs(m_storage_dir)) {
+		errorstream << "ModMetadataDatabaseFiles: Unable to save. '"
+			<< m_storage_dir << "' tree cannot be created." << std::endl;
+		return false;
+	}
+
+	Json::Value json;
+	for (StringMap::const_iterator it = meta.begin(); it != meta.end(); ++it)
+		json[it->first] = it->second;
+
+	std::string path = m_storage_dir + DIR_DELIM + modname;
+	if (!fs::safeWriteToFile(path, Json::FastWriter().write(json))) {
+		errorstream << "ModMetadataDatabaseFiles[" << modname
+			<< "]: failed to write file." << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -24,7 +24,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // This backend is intended to be used on Minetest 0.4.16 only for the transition backend
 // for player files
 
+#include <map>
+#include <set>
 #include "database.h"
+#include "util/cpp11_container.h"
 
 class PlayerDatabaseFiles : public PlayerDatabase
 {
@@ -43,4 +46,78 @@ class PlayerDatabaseFiles : public PlayerDatabase
 	std::string m_savedir;
 };
 
+/*
+	The auth.txt of older versions. Each change rewrites the whole file,
+	use --migrate-auth to move to a database on servers with many players.
+*/
+class AuthDatabaseFiles : public AuthDatabase
+{
+public:
+	AuthDatabaseFiles(const std::string &savedir);
+	virtual ~AuthDatabaseFiles() {}
+
+	bool getAuth(const std::string &name, AuthEntry &res);
+	bool saveAuth(const AuthEntry &authEntry);
+	bool createAuth(AuthEntry &authEntry);
+	bool deleteAuth(const std::string &name);
+	void listNames(std::vector<std::string> &res);
+	bool findNameCaseInsensitive(const std::string &name, std::string &res);
+	void reload();
+
+	void beginSave();
+	void endSave();
+
+private:
+	bool readAuthFile();
+	void addToIndex(const std::string &name);
+	void removeFromIndex(const std::string &name);
+	// Rewrites the file, or only marks it as modified during a save
+	bool writeAuthFile();
+
+	UNORDERED_MAP<std::string, AuthEntry> m_auth_list;
+	// Names by their lowercase form
+	UNORDERED_MAP<std::string, std::string> m_names_lowercase;
+	std::string m_savedir;
+	bool m_in_save;
+	bool m_modified;
+};
+
+/*
+	The mod storage of older versions, a JSON file for each mod in the
+	mod_storage directory. A change rewrites the file of the mod. Only
+	the pending changes are kept in memory, the whole storage of a mod is
+	held by its ModMetadata.
+*/
+class ModMetadataDatabaseFiles : public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabaseFiles(const std::string &storage_dir);
+	virtual ~ModMetadataDatabaseFiles() {}
+
+	bool getModEntries(const std::string &modname, StringMap &storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+	void listMods(std::vector<std::string> &res);
+
+	void beginSave();
+	void endSave();
+	void abortSave();
+
+private:
+	struct ModChanges {
+		StringMap set;
+		std::set<std::string> removed;
+	};
+
+	// Adds the entries in the file of the mod to meta
+	bool readModFile(const std::string &modname, StringMap &meta);
+	// Rewrites the file of the mod with its pending changes
+	bool applyChanges(const std::string &modname);
+
+	std::map<std::string, ModChanges> m_changes;
+	std::string m_storage_dir;
+	bool m_in_save;
+};
+
 #endif
@@ -36,11 +36,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <netinet/in.h>
 #endif
 
+#include <algorithm>
 #include "log.h"
 #include "exceptions.h"
 #include "settings.h"
 #include "content_sao.h"
 #include "remoteplayer.h"
+#include "util/string.h"
 
 Database_PostgreSQL::Database_PostgreSQL(const std::string &connect_string) :
 	m_connect_string(connect_string),
@@ -632,4 +634,230 @@ void PlayerDatabasePostgreSQL::listPlayers(std::vector<std::string> &res)
 	PQclear(results);
 }
 
+AuthDatabasePostgreSQL::AuthDatabasePostgreSQL(const std::string &connect_string) :
+	Database_PostgreSQL(connect_string),
+	AuthDatabase(),
+	m_in_save(false)
+{
+	connectToDatabase();
+}
+
+void AuthDatabasePostgreSQL::createDatabase()
+{
+	createTableIfNotExists("auth",
+		"CREATE TABLE auth ("
+			"id SERIAL,"
+			"name TEXT UNIQUE,"
+			"password TEXT,"
+			"last_login BIGINT NOT NULL DEFAULT -1,"
+			"PRIMARY KEY (id)"
+		");");
+
+	createTableIfNotExists("user_privileges",
+		"CREATE TABLE user_privileges ("
+			"id INT,"
+			"privilege TEXT,"
+			"PRIMARY KEY (id, privilege),"
+			"CONSTRAINT fk_id FOREIGN KEY (id) REFERENCES auth (id) ON DELETE CASCADE"
+		");");
+
+	// Indexes are relations too
+	createTableIfNotExists("auth_name_lower",
+		"CREATE INDEX auth_name_lower ON auth (lower(name));");
+
+	infostream << "PostgreSQL: Auth Database was inited." << std::endl;
+}
+
+void AuthDatabasePostgreSQL::initStatements()
+{
+	prepareStatement("auth_read", "SELECT id, name, password, last_login FROM auth "
+		"WHERE name = $1");
+	prepareStatement("auth_write", "UPDATE auth SET name = $1, password = $2, "
+		"last_login = $3::bigint WHERE id = $4::int");
+	prepareStatement("auth_create", "INSERT INTO auth (name, password, last_login) "
+		"VALUES ($1, $2, $3::bigint) RETURNING id");
+	prepareStatement("auth_delete", "DELETE FROM auth WHERE name = $1");
+
+	prepareStatement("auth_list_names", "SELECT name FROM auth");
+	prepareStatement("auth_find_name", "SELECT name FROM auth "
+		"WHERE lower(name) = lower($1) LIMIT 1");
+
+	prepareStatement("auth_read_privs", "SELECT privilege FROM user_privileges "
+		"WHERE id = $1::int");
+	prepareStatement("auth_write_privs", "INSERT INTO user_privileges (id, privilege) "
+		"VALUES ($1::int, $2)");
+	prepareStatement("auth_delete_privs", "DELETE FROM user_privileges WHERE id = $1::int");
+}
+
+bool AuthDatabasePostgreSQL::getAuth(const std::string &name, AuthEntry &res)
+{
+	verifyDatabase();
+
+	const char *values[] = { name.c_str() };
+	PGresult *result = execPrepared("auth_read", 1, values, false, false);
+	if (!PQntuples(result)) {
+		PQclear(result);
+		return false;
+	}
+
+	res.id = pg_to_uint(result, 0, 0);
+	res.name = PQgetvalue(result, 0, 1);
+	res.password = PQgetvalue(result, 0, 2);
+	res.last_login = stoi64(PQgetvalue(result, 0, 3));
+	PQclear(result);
+
+	std::string id_str = i64tos(res.id);
+	const char *privs_values[] = { id_str.c_str() };
+	PGresult *results = execPrepared("auth_read_privs", 1, privs_values, false);
+
+	res.privileges.clear();
+	int numrows = PQntuples(results);
+	for (int row = 0; row < numrows; row++)
+		res.privileges.push_back(PQgetvalue(results, row, 0));
+	PQclear(results);
+
+	return true;
+}
+
+bool AuthDatabasePostgreSQL::saveAuth(const AuthEntry &authEntry)
+{
+	verifyDatabase();
+
+	beginWrite();
+
+	std::string last_login = i64tos(authEntry.last_login);
+	std::string id = i64tos(authEntry.id);
+	const char *values[] = {
+		authEntry.name.c_str(),
+		authEntry.password.c_str(),
+		last_login.c_str(),
+		id.c_str()
+	};
+	execPrepared("auth_write", 4, values);
+
+	const char *privs_values[] = { id.c_str() };
+	execPrepared("auth_delete_privs", 1, privs_values);
+
+	writePrivileges(authEntry);
+
+	endWrite();
+	return true;
+}
+
+bool AuthDatabasePostgreSQL::createAuth(AuthEntry &authEntry)
+{
+	verifyDatabase();
+
+	beginWrite();
+
+	std::string last_login = i64tos(authEntry.last_login);
+	const char *values[] = {
+		authEntry.name.c_str(),
+		authEntry.password.c_str(),
+		last_login.c_str()
+	};
+	PGresult *result = execPrepared("auth_create", 3, values, false, false);
+	if (!PQntuples(result)) {
+		PQclear(result);
+		endWrite();
+		errorstream << "Strange behaviour on auth creation, no ID returned." << std::endl;
+		return false;
+	}
+	authEntry.id = pg_to_uint(result, 0, 0);
+	PQclear(result);
+
+	writePrivileges(authEntry);
+
+	endWrite();
+	return true;
+}
+
+bool AuthDatabasePostgreSQL::deleteAuth(const std::string &name)
+{
+	verifyDatabase();
+
+	// The privileges are deleted by the foreign key
+	const char *values[] = { name.c_str() };
+	PGresult *result = execPrepared("auth_delete", 1, values, false);
+	bool deleted = atoi(PQcmdTuples(result)) > 0;
+	PQclear(result);
+
+	return deleted;
+}
+
+void AuthDatabasePostgreSQL::listNames(std::vector<std::string> &res)
+{
+	verifyDatabase();
+
+	PGresult *results = execPrepared("auth_list_names", 0, NULL, false);
+
+	int numrows = PQntuples(results);
+	for (int row = 0; row < numrows; row++)
+		res.push_back(PQgetvalue(results, row, 0));
+
+	PQclear(results);
+}
+
+bool AuthDatabasePostgreSQL::findNameCaseInsensitive(const std::string &name,
+	std::string &res)
+{
+	verifyDatabase();
+
+	const char *values[] = { name.c_str() };
+	PGresult *result = execPrepared("auth_find_name", 1, values, false, false);
+	bool found = PQntuples(result) > 0;
+	if (found)
+		res = PQgetvalue(result, 0, 0);
+	PQclear(result);
+	return found;
+}
+
+void AuthDatabasePostgreSQL::reload()
+{
+	// nothing to do for PostgreSQL
+}
+
+void AuthDatabasePostgreSQL::beginSave()
+{
+	Database_PostgreSQL::beginSave();
+	m_in_save = true;
+}
+
+void AuthDatabasePostgreSQL::endSave()
+{
+	m_in_save = false;
+	Database_PostgreSQL::endSave();
+}
+
+void AuthDatabasePostgreSQL::beginWrite()
+{
+	if (m_in_save)
+		return;
+	Database_PostgreSQL::beginSave();
+}
+
+void AuthDatabasePostgreSQL::endWrite()
+{
+	if (m_in_save)
+		return;
+	Database_PostgreSQL::endSave();
+}
+
+void AuthDatabasePostgreSQL::writePrivileges(const AuthEntry &authEntry)
+{
+	std::string id = i64tos(authEntry.id);
+	const std::vector<std::string> &privs = authEntry.privileges;
+	for (size_t i = 0; i < privs.size(); i++) {
+		// The primary key doesn't allow duplicates
+		if (std::find(privs.begin(), privs.begin() + i, privs[i]) !=
+				privs.begin() + i)
+			continue;
+		const char *values[] = {
+			id.c_str(),
+			privs[i].c_str()
+		};
+		execPrepared("auth_write_privs", 2, values);
+	}
+}
+
 #endif // USE_POSTGRESQL
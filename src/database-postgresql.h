@@ -146,5 +146,35 @@ class PlayerDatabasePostgreSQL : private Database_PostgreSQL, public PlayerDatab
 	bool playerDataExists(const std::string &playername);
 };
 
+class AuthDatabasePostgreSQL : private Database_PostgreSQL, public AuthDatabase
+{
+public:
+	AuthDatabasePostgreSQL(const std::string &connect_string);
+	virtual ~AuthDatabasePostgreSQL() {}
+
+	bool getAuth(const std::string &name, AuthEntry &res);
+	bool saveAuth(const AuthEntry &authEntry);
+	bool createAuth(AuthEntry &authEntry);
+	bool deleteAuth(const std::string &name);
+	void listNames(std::vector<std::string> &res);
+	bool findNameCaseInsensitive(const std::string &name, std::string &res);
+	void reload();
+
+	void beginSave();
+	void endSave();
+
+protected:
+	virtual void createDatabase();
+	virtual void initStatements();
+
+private:
+	// A transaction for each change, if there is none from beginSave()
+	void beginWrite();
+	void endWrite();
+	void writePrivileges(const AuthEntry &authEntry);
+
+	bool m_in_save;
+};
+
 #endif
 
@@ -119,7 +119,8 @@ Database_SQLite3::Database_SQLite3(const std::string &savedir, const std::string
 	m_savedir(savedir),
 	m_dbname(dbname),
 	m_stmt_begin(NULL),
-	m_stmt_end(NULL)
+	m_stmt_end(NULL),
+	m_stmt_abort(NULL)
 {
 }
 
@@ -139,6 +140,17 @@ void Database_SQLite3::endSave()
 	sqlite3_reset(m_stmt_end);
 }
 
+void Database_SQLite3::abortSave()
+{
+	// Some errors roll back the transaction by themselves
+	if (!m_initialized || sqlite3_get_autocommit(m_database))
+		return;
+	if (sqlite3_step(m_stmt_abort) != SQLITE_DONE)
+		errorstream << "Failed to roll back SQLite3 transaction: "
+			<< sqlite3_errmsg(m_database) << std::endl;
+	sqlite3_reset(m_stmt_abort);
+}
+
 void Database_SQLite3::openDatabase()
 {
 	if (m_database) return;
@@ -183,6 +195,7 @@ void Database_SQLite3::verifyDatabase()
 
 	PREPARE_STATEMENT(begin, "BEGIN;");
 	PREPARE_STATEMENT(end, "COMMIT;");
+	PREPARE_STATEMENT(abort, "ROLLBACK;");
 
 	initStatements();
 
@@ -193,6 +206,7 @@ Database_SQLite3::~Database_SQLite3()
 {
 	FINALIZE_STATEMENT(m_stmt_begin)
 	FINALIZE_STATEMENT(m_stmt_end)
+	FINALIZE_STATEMENT(m_stmt_abort)
 
 	SQLOK_ERRSTREAM(sqlite3_close(m_database), "Failed to close database");
 }
@@ -627,3 +641,340 @@ void PlayerDatabaseSQLite3::listPlayers(std::vector<std::string> &res)
 
 	sqlite3_reset(m_stmt_player_list);
 }
+
+/*
+ * Auth database
+ */
+
+AuthDatabaseSQLite3::AuthDatabaseSQLite3(const std::string &savedir) :
+	Database_SQLite3(savedir, "auth"),
+	AuthDatabase(),
+	m_in_save(false),
+	m_stmt_read(NULL),
+	m_stmt_write(NULL),
+	m_stmt_create(NULL),
+	m_stmt_delete(NULL),
+	m_stmt_list_names(NULL),
+	m_stmt_find_name(NULL),
+	m_stmt_read_privs(NULL),
+	m_stmt_write_privs(NULL),
+	m_stmt_delete_privs(NULL),
+	m_stmt_last_insert_rowid(NULL)
+{
+}
+
+AuthDatabaseSQLite3::~AuthDatabaseSQLite3()
+{
+	FINALIZE_STATEMENT(m_stmt_read)
+	FINALIZE_STATEMENT(m_stmt_write)
+	FINALIZE_STATEMENT(m_stmt_create)
+	FINALIZE_STATEMENT(m_stmt_delete)
+	FINALIZE_STATEMENT(m_stmt_list_names)
+	FINALIZE_STATEMENT(m_stmt_find_name)
+	FINALIZE_STATEMENT(m_stmt_read_privs)
+	FINALIZE_STATEMENT(m_stmt_write_privs)
+	FINALIZE_STATEMENT(m_stmt_delete_privs)
+	FINALIZE_STATEMENT(m_stmt_last_insert_rowid)
+}
+
+void AuthDatabaseSQLite3::createDatabase()
+{
+	assert(m_database); // Pre-condition
+
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE TABLE IF NOT EXISTS `auth` ("
+			"`id` INTEGER PRIMARY KEY AUTOINCREMENT,"
+			"`name` VARCHAR(32) UNIQUE,"
+			"`password` VARCHAR(512),"
+			"`last_login` INTEGER"
+		");",
+		NULL, NULL, NULL),
+		"Failed to create auth table");
+
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE TABLE IF NOT EXISTS `user_privileges` ("
+			"`id` INTEGER,"
+			"`privilege` VARCHAR(32),"
+			"PRIMARY KEY (id, privilege),"
+			"CONSTRAINT fk_id FOREIGN KEY (id) REFERENCES auth (id) ON DELETE CASCADE"
+		");",
+		NULL, NULL, NULL),
+		"Failed to create auth privileges table");
+}
+
+void AuthDatabaseSQLite3::initStatements()
+{
+	// Also for databases created before the index was added
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE INDEX IF NOT EXISTS `auth_name_nocase` "
+			"ON `auth` (`name` COLLATE NOCASE);",
+		NULL, NULL, NULL),
+		"Failed to create auth name index");
+
+	PREPARE_STATEMENT(read, "SELECT id, name, password, last_login FROM auth "
+		"WHERE name = ?")
+	PREPARE_STATEMENT(write, "UPDATE auth SET name = ?, password = ?, "
+		"last_login = ? WHERE id = ?")
+	PREPARE_STATEMENT(create, "INSERT INTO auth (name, password, last_login) "
+		"VALUES (?, ?, ?)")
+	PREPARE_STATEMENT(delete, "DELETE FROM auth WHERE name = ?")
+
+	PREPARE_STATEMENT(list_names, "SELECT name FROM auth")
+	PREPARE_STATEMENT(find_name, "SELECT name FROM auth "
+		"WHERE name = ? COLLATE NOCASE LIMIT 1")
+
+	PREPARE_STATEMENT(read_privs, "SELECT privilege FROM user_privileges "
+		"WHERE id = ?")
+	PREPARE_STATEMENT(write_privs, "INSERT OR IGNORE INTO user_privileges "
+		"(id, privilege) VALUES (?, ?)")
+	PREPARE_STATEMENT(delete_privs, "DELETE FROM user_privileges WHERE id = ?")
+
+	PREPARE_STATEMENT(last_insert_rowid, "SELECT last_insert_rowid()")
+	verbosestream << "ServerEnvironment: SQLite3 database opened (auth)." << std::endl;
+}
+
+bool AuthDatabaseSQLite3::getAuth(const std::string &name, AuthEntry &res)
+{
+	verifyDatabase();
+	str_to_sqlite(m_stmt_read, 1, name);
+	if (sqlite3_step(m_stmt_read) != SQLITE_ROW) {
+		sqlite3_reset(m_stmt_read);
+		return false;
+	}
+	res.id = sqlite_to_int64(m_stmt_read, 0);
+	res.name = sqlite_to_string(m_stmt_read, 1);
+	res.password = sqlite_to_string(m_stmt_read, 2);
+	res.last_login = sqlite_to_int64(m_stmt_read, 3);
+	sqlite3_reset(m_stmt_read);
+
+	int64_to_sqlite(m_stmt_read_privs, 1, res.id);
+	res.privileges.clear();
+	while (sqlite3_step(m_stmt_read_privs) == SQLITE_ROW)
+		res.privileges.push_back(sqlite_to_string(m_stmt_read_privs, 0));
+	sqlite3_reset(m_stmt_read_privs);
+
+	return true;
+}
+
+bool AuthDatabaseSQLite3::saveAuth(const AuthEntry &authEntry)
+{
+	beginWrite();
+
+	str_to_sqlite(m_stmt_write, 1, authEntry.name);
+	str_to_sqlite(m_stmt_write, 2, authEntry.password);
+	int64_to_sqlite(m_stmt_write, 3, authEntry.last_login);
+	int64_to_sqlite(m_stmt_write, 4, authEntry.id);
+	sqlite3_vrfy(sqlite3_step(m_stmt_write), SQLITE_DONE);
+	sqlite3_reset(m_stmt_write);
+
+	int64_to_sqlite(m_stmt_delete_privs, 1, authEntry.id);
+	sqlite3_vrfy(sqlite3_step(m_stmt_delete_privs), SQLITE_DONE);
+	sqlite3_reset(m_stmt_delete_privs);
+
+	writePrivileges(authEntry);
+
+	endWrite();
+	return true;
+}
+
+bool AuthDatabaseSQLite3::createAuth(AuthEntry &authEntry)
+{
+	beginWrite();
+
+	str_to_sqlite(m_stmt_create, 1, authEntry.name);
+	str_to_sqlite(m_stmt_create, 2, authEntry.password);
+	int64_to_sqlite(m_stmt_create, 3, authEntry.last_login);
+	sqlite3_vrfy(sqlite3_step(m_stmt_create), SQLITE_DONE);
+	sqlite3_reset(m_stmt_create);
+
+	sqlite3_vrfy(sqlite3_step(m_stmt_last_insert_rowid), SQLITE_ROW);
+	authEntry.id = sqlite_to_int64(m_stmt_last_insert_rowid, 0);
+	sqlite3_reset(m_stmt_last_insert_rowid);
+
+	writePrivileges(authEntry);
+
+	endWrite();
+	return true;
+}
+
+bool AuthDatabaseSQLite3::deleteAuth(const std::string &name)
+{
+	verifyDatabase();
+
+	// The privileges are deleted by the foreign key
+	str_to_sqlite(m_stmt_delete, 1, name);
+	sqlite3_vrfy(sqlite3_step(m_stmt_delete), SQLITE_DONE);
+	int changes = sqlite3_changes(m_database);
+	sqlite3_reset(m_stmt_delete);
+
+	return changes > 0;
+}
+
+void AuthDatabaseSQLite3::listNames(std::vector<std::string> &res)
+{
+	verifyDatabase();
+
+	while (sqlite3_step(m_stmt_list_names) == SQLITE_ROW)
+		res.push_back(sqlite_to_string(m_stmt_list_names, 0));
+	sqlite3_reset(m_stmt_list_names);
+}
+
+bool AuthDatabaseSQLite3::findNameCaseInsensitive(const std::string &name,
+	std::string &res)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_find_name, 1, name);
+	bool found = sqlite3_step(m_stmt_find_name) == SQLITE_ROW;
+	if (found)
+		res = sqlite_to_string(m_stmt_find_name, 0);
+	sqlite3_reset(m_stmt_find_name);
+	return found;
+}
+
+void AuthDatabaseSQLite3::reload()
+{
+	// nothing to do for SQLite3
+}
+
+void AuthDatabaseSQLite3::beginSave()
+{
+	Database_SQLite3::beginSave();
+	m_in_save = true;
+}
+
+void AuthDatabaseSQLite3::endSave()
+{
+	m_in_save = false;
+	Database_SQLite3::endSave();
+}
+
+void AuthDatabaseSQLite3::beginWrite()
+{
+	if (m_in_save)
+		return;
+	Database_SQLite3::beginSave();
+}
+
+void AuthDatabaseSQLite3::endWrite()
+{
+	if (m_in_save)
+		return;
+	Database_SQLite3::endSave();
+}
+
+void AuthDatabaseSQLite3::writePrivileges(const AuthEntry &authEntry)
+{
+	int64_to_sqlite(m_stmt_write_privs, 1, authEntry.id);
+	for (size_t i = 0; i < authEntry.privileges.size(); i++) {
+		str_to_sqlite(m_stmt_write_privs, 2, authEntry.privileges[i]);
+		sqlite3_vrfy(sqlite3_step(m_stmt_write_privs), SQLITE_DONE);
+		sqlite3_reset(m_stmt_write_privs);
+	}
+}
+
+/*
+ * Mod storage database
+ */
+
+ModMetadataDatabaseSQLite3::ModMetadataDatabaseSQLite3(const std::string &savedir) :
+	Database_SQLite3(savedir, "mod_storage"),
+	ModMetadataDatabase(),
+	m_stmt_get(NULL),
+	m_stmt_set(NULL),
+	m_stmt_remove(NULL),
+	m_stmt_list(NULL)
+{
+}
+
+ModMetadataDatabaseSQLite3::~ModMetadataDatabaseSQLite3()
+{
+	FINALIZE_STATEMENT(m_stmt_get)
+	FINALIZE_STATEMENT(m_stmt_set)
+	FINALIZE_STATEMENT(m_stmt_remove)
+	FINALIZE_STATEMENT(m_stmt_list)
+}
+
+void ModMetadataDatabaseSQLite3::createDatabase()
+{
+	assert(m_database); // Pre-condition
+
+	SQLOK(sqlite3_exec(m_database,
+		"CREATE TABLE IF NOT EXISTS `entries` ("
+			"`modname` TEXT NOT NULL,"
+			"`key` BLOB NOT NULL,"
+			"`value` BLOB NOT NULL,"
+			"PRIMARY KEY (`modname`, `key`)"
+		");",
+		NULL, NULL, NULL),
+		"Failed to create mod storage table");
+}
+
+void ModMetadataDatabaseSQLite3::initStatements()
+{
+	PREPARE_STATEMENT(get, "SELECT `key`, `value` FROM `entries` "
+		"WHERE `modname` = ?")
+	PREPARE_STATEMENT(set, "REPLACE INTO `entries` (`modname`, `key`, `value`) "
+		"VALUES (?, ?, ?)")
+	PREPARE_STATEMENT(remove, "DELETE FROM `entries` "
+		"WHERE `modname` = ? AND `key` = ?")
+	PREPARE_STATEMENT(list, "SELECT DISTINCT `modname` FROM `entries`")
+	verbosestream << "ServerEnvironment: SQLite3 database opened (mod storage)." << std::endl;
+}
+
+bool ModMetadataDatabaseSQLite3::getModEntries(const std::string &modname,
+	StringMap &storage)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_get, 1, modname);
+	while (sqlite3_step(m_stmt_get) == SQLITE_ROW)
+		storage[sqlite_to_blob(m_stmt_get, 0)] = sqlite_to_blob(m_stmt_get, 1);
+	sqlite3_reset(m_stmt_get);
+
+	return true;
+}
+
+bool ModMetadataDatabaseSQLite3::setModEntry(const std::string &modname,
+	const std::string &key, const std::string &value)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_set, 1, modname);
+	blob_to_sqlite(m_stmt_set, 2, key);
+	blob_to_sqlite(m_stmt_set, 3, value);
+	SQLRES(sqlite3_step(m_stmt_set), SQLITE_DONE, "Failed to set mod entry")
+	sqlite3_reset(m_stmt_set);
+
+	return true;
+}
+
+bool ModMetadataDatabaseSQLite3::removeModEntry(const std::string &modname,
+	const std::string &key)
+{
+	verifyDatabase();
+
+	str_to_sqlite(m_stmt_remove, 1, modname);
+	blob_to_sqlite(m_stmt_remove, 2, key);
+	SQLRES(sqlite3_step(m_stmt_remove), SQLITE_DONE, "Failed to remove mod entry")
+	sqlite3_reset(m_stmt_remove);
+
+	return true;
+}
+
+void ModMetadataDatabaseSQLite3::abortSave()
+{
+	// A failed write leaves its statement unfinished
+	sqlite3_reset(m_stmt_set);
+	sqlite3_reset(m_stmt_remove);
+	Database_SQLite3::abortSave();
+}
+
+void ModMetadataDatabaseSQLite3::listMods(std::vector<std::string> &res)
+{
+	verifyDatabase();
+
+	while (sqlite3_step(m_stmt_list) == SQLITE_ROW)
+		res.push_back(sqlite_to_string(m_stmt_list, 0));
+	sqlite3_reset(m_stmt_list);
+}
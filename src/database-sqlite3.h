@@ -36,6 +36,8 @@ class Database_SQLite3 : public Database
 
 	void beginSave();
 	void endSave();
+	// Rolls back the transaction of beginSave(), if it is still open
+	void abortSave();
 
 	bool initialized() const { return m_initialized; }
 protected:
@@ -55,6 +57,11 @@ class Database_SQLite3 : public Database
 		sqlite3_vrfy(sqlite3_bind_text(s, iCol, str, strlen(str), NULL));
 	}
 
+	inline void blob_to_sqlite(sqlite3_stmt *s, int iCol, const std::string &str) const
+	{
+		sqlite3_vrfy(sqlite3_bind_blob(s, iCol, str.c_str(), str.size(), NULL));
+	}
+
 	inline void int_to_sqlite(sqlite3_stmt *s, int iCol, int val) const
 	{
 		sqlite3_vrfy(sqlite3_bind_int(s, iCol, val));
@@ -76,6 +83,12 @@ class Database_SQLite3 : public Database
 		return std::string(text ? text : "");
 	}
 
+	inline std::string sqlite_to_blob(sqlite3_stmt *s, int iCol)
+	{
+		const char *data = reinterpret_cast<const char*>(sqlite3_column_blob(s, iCol));
+		return data ? std::string(data, sqlite3_column_bytes(s, iCol)) : "";
+	}
+
 	inline s32 sqlite_to_int(sqlite3_stmt *s, int iCol)
 	{
 		return sqlite3_column_int(s, iCol);
@@ -86,6 +99,11 @@ class Database_SQLite3 : public Database
 		return (u32) sqlite3_column_int(s, iCol);
 	}
 
+	inline s64 sqlite_to_int64(sqlite3_stmt *s, int iCol)
+	{
+		return (s64) sqlite3_column_int64(s, iCol);
+	}
+
 	inline float sqlite_to_float(sqlite3_stmt *s, int iCol)
 	{
 		return (float) sqlite3_column_double(s, iCol);
@@ -125,6 +143,7 @@ class Database_SQLite3 : public Database
 
 	sqlite3_stmt *m_stmt_begin;
 	sqlite3_stmt *m_stmt_end;
+	sqlite3_stmt *m_stmt_abort;
 
 	s64 m_busy_handler_data[2];
 
@@ -193,4 +212,72 @@ class PlayerDatabaseSQLite3 : private Database_SQLite3, public PlayerDatabase
 	sqlite3_stmt *m_stmt_player_metadata_add;
 };
 
+class AuthDatabaseSQLite3 : private Database_SQLite3, public AuthDatabase
+{
+public:
+	AuthDatabaseSQLite3(const std::string &savedir);
+	virtual ~AuthDatabaseSQLite3();
+
+	bool getAuth(const std::string &name, AuthEntry &res);
+	bool saveAuth(const AuthEntry &authEntry);
+	bool createAuth(AuthEntry &authEntry);
+	bool deleteAuth(const std::string &name);
+	void listNames(std::vector<std::string> &res);
+	bool findNameCaseInsensitive(const std::string &name, std::string &res);
+	void reload();
+
+	void beginSave();
+	void endSave();
+
+protected:
+	virtual void createDatabase();
+	virtual void initStatements();
+
+private:
+	// A transaction for each change, if there is none from beginSave()
+	void beginWrite();
+	void endWrite();
+	void writePrivileges(const AuthEntry &authEntry);
+
+	bool m_in_save;
+
+	sqlite3_stmt *m_stmt_read;
+	sqlite3_stmt *m_stmt_write;
+	sqlite3_stmt *m_stmt_create;
+	sqlite3_stmt *m_stmt_delete;
+	sqlite3_stmt *m_stmt_list_names;
+	sqlite3_stmt *m_stmt_find_name;
+	sqlite3_stmt *m_stmt_read_privs;
+	sqlite3_stmt *m_stmt_write_privs;
+	sqlite3_stmt *m_stmt_delete_privs;
+	sqlite3_stmt *m_stmt_last_insert_rowid;
+};
+
+class ModMetadataDatabaseSQLite3 : private Database_SQLite3, public ModMetadataDatabase
+{
+public:
+	ModMetadataDatabaseSQLite3(const std::string &savedir);
+	virtual ~ModMetadataDatabaseSQLite3();
+
+	bool getModEntries(const std::string &modname, StringMap &storage);
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value);
+	bool removeModEntry(const std::string &modname, const std::string &key);
+	void listMods(std::vector<std::string> &res);
+
+	void beginSave() { Database_SQLite3::beginSave(); }
+	void endSave() { Database_SQLite3::endSave(); }
+	void abortSave();
+
+protected:
+	virtual void createDatabase();
+	virtual void initStatements();
+
+private:
+	sqlite3_stmt *m_stmt_get;
+	sqlite3_stmt *m_stmt_set;
+	sqlite3_stmt *m_stmt_remove;
+	sqlite3_stmt *m_stmt_list;
+};
+
 #endif
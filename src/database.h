@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include "irrlichttypes.h"
 #include "util/basic_macros.h"
+#include "util/string.h"
 
 class Database
 {
@@ -62,4 +63,60 @@ class PlayerDatabase
 	virtual void listPlayers(std::vector<std::string> &res) = 0;
 };
 
+struct AuthEntry
+{
+	u64 id;
+	std::string name;
+	std::string password;
+	std::vector<std::string> privileges;
+	// Unix time, -1 if unknown
+	s64 last_login;
+};
+
+/*
+	Each change is saved at once, unless it is made between beginSave() and
+	endSave().
+*/
+class AuthDatabase : public Database
+{
+public:
+	virtual ~AuthDatabase() {}
+
+	virtual bool getAuth(const std::string &name, AuthEntry &res) = 0;
+	// Saves an entry got with getAuth() or createAuth()
+	virtual bool saveAuth(const AuthEntry &authEntry) = 0;
+	// Sets the id of the new entry
+	virtual bool createAuth(AuthEntry &authEntry) = 0;
+	virtual bool deleteAuth(const std::string &name) = 0;
+	virtual void listNames(std::vector<std::string> &res) = 0;
+	// Gets the name of an entry that only differs from name in the case
+	// of ASCII letters, through an index
+	virtual bool findNameCaseInsensitive(const std::string &name,
+		std::string &res) = 0;
+	virtual void reload() = 0;
+};
+
+/*
+	Key-value storage of the mods, see ModMetadata. Like AuthDatabase, each
+	change is saved at once unless it is made between beginSave() and
+	endSave().
+*/
+class ModMetadataDatabase : public Database
+{
+public:
+	virtual ~ModMetadataDatabase() {}
+
+	// Adds the entries of the mod to storage
+	virtual bool getModEntries(const std::string &modname, StringMap &storage) = 0;
+	virtual bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value) = 0;
+	// Succeeds if there is no such entry
+	virtual bool removeModEntry(const std::string &modname,
+		const std::string &key) = 0;
+	virtual void listMods(std::vector<std::string> &res) = 0;
+	// Discards the changes since beginSave() that are not saved yet, after
+	// a failed change or endSave(). Does not throw.
+	virtual void abortSave() = 0;
+};
+
 #endif
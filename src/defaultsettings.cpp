@@ -39,6 +39,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("sound_volume", "0.8");
 	settings->setDefault("enable_mesh_cache", "false");
 	settings->setDefault("mesh_generation_interval", "0");
+	settings->setDefault("mesh_generation_threads", "1");
+	settings->setDefault("mesh_face_merging", "false");
 	settings->setDefault("meshgen_block_cache_size", "20");
 	settings->setDefault("enable_vbo", "true");
 	settings->setDefault("free_move", "false");
@@ -293,6 +295,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("disallow_empty_password", "false");
 	settings->setDefault("disable_anticheat", "false");
 	settings->setDefault("enable_rollback_recording", "false");
+	settings->setDefault("rollback_coalesce_time", "0");
 #ifdef NDEBUG
 	settings->setDefault("deprecated_lua_api_handling", "legacy");
 #else
@@ -304,8 +307,15 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("ask_reconnect_on_crash", "false");
 
 	settings->setDefault("profiler_print_interval", "0");
+	settings->setDefault("tracing", "false");
+	settings->setDefault("tracing_slow_step_threshold", "500");
+	settings->setDefault("callback_profiling", "false");
+	settings->setDefault("callback_warning_threshold", "0");
 	settings->setDefault("active_object_send_range_blocks", "3");
 	settings->setDefault("active_block_range", "3");
+	settings->setDefault("entity_lod_distance", "0");
+	settings->setDefault("entity_lod_step_interval", "0.5");
+	settings->setDefault("entity_sleep_distance", "0");
 	//settings->setDefault("max_simultaneous_block_sends_per_client", "1");
 	// This causes frametime jitter on client side, or does it?
 	settings->setDefault("max_block_send_distance", "9");
@@ -314,7 +324,9 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("max_clearobjects_extra_loaded_blocks", "4096");
 	settings->setDefault("time_speed", "72");
 	settings->setDefault("server_unload_unused_data_timeout", "29");
+	settings->setDefault("mapblock_compact_timeout", "0");
 	settings->setDefault("max_objects_per_block", "64");
+	settings->setDefault("max_objects_activated_per_step", "100");
 	settings->setDefault("server_map_save_interval", "5.3");
 	settings->setDefault("chat_message_max_size", "500");
 	settings->setDefault("chat_message_limit_per_10sec", "8.0");
@@ -327,6 +339,7 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("nodetimer_interval", "0.2");
 	settings->setDefault("ignore_world_load_errors", "false");
 	settings->setDefault("remote_media", "");
+	settings->setDefault("media_server_port", "0");
 	settings->setDefault("debug_log_level", "action");
 	settings->setDefault("emergequeue_limit_total", "256");
 	settings->setDefault("emergequeue_limit_diskonly", "32");
@@ -354,6 +367,8 @@ void set_default_settings(Settings *settings)
 	settings->setDefault("liquid_loop_max", "100000");
 	settings->setDefault("liquid_queue_purge_time", "0");
 	settings->setDefault("liquid_update", "1.0");
+	settings->setDefault("num_liquid_threads", "0");
+	settings->setDefault("deferred_lighting", "false");
 
 	// Mapgen
 	settings->setDefault("mg_name", "v7");
@@ -40,6 +40,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "mg_schematic.h"
 #include "nodedef.h"
 #include "profiler.h"
+#include "tracer.h"
 #include "scripting_server.h"
 #include "server.h"
 #include "serverobject.h"
@@ -97,6 +98,7 @@ EmergeManager::EmergeManager(Server *server)
 	this->decomgr   = new DecorationManager(server);
 	this->schemmgr  = new SchematicManager(server);
 	this->gen_notify_on = 0;
+	this->m_generated_chunks = 0;
 
 	// Note that accesses to this variable are not synchronized.
 	// This is because the *only* thread ever starting or stopping
@@ -539,6 +541,7 @@ MapBlock *EmergeThread::finishGen(v3s16 pos, BlockMakeData *bmdata,
 	MutexAutoLock envlock(m_server->m_env_mutex);
 	ScopeProfiler sp(g_profiler,
 		"EmergeThread: after Mapgen::makeChunk", SPT_AVG);
+	TraceScope ts(TZ_EMERGE_FINISH_GEN);
 
 	/*
 		Perform post-processing on blocks (invalidate lighting, queue liquid
@@ -626,9 +629,11 @@ void *EmergeThread::run()
 			{
 				ScopeProfiler sp(g_profiler,
 					"EmergeThread: Mapgen::makeChunk", SPT_AVG);
+				TraceScope ts(TZ_EMERGE_MAKE_CHUNK);
 				TimeTaker t("mapgen::make_block()");
 
 				m_mapgen->makeChunk(&bmdata);
+				m_emerge->m_generated_chunks++;
 
 				if (enable_mapgen_debug_info == false)
 					t.stop(true); // Hide output
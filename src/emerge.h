@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <map>
 #include "irr_v3d.h"
 #include "util/container.h"
+#include "threading/atomic.h"
 #include "mapgen.h" // for MapgenParams
 #include "map.h"
 
@@ -51,7 +52,7 @@ struct BlockMakeData {
 	v3s16 blockpos_min;
 	v3s16 blockpos_max;
 	v3s16 blockpos_requested;
-	UniqueQueue<v3s16> transforming_liquid;
+	LiquidQueue transforming_liquid;
 	INodeDefManager *nodedef;
 
 	BlockMakeData():
@@ -150,6 +151,9 @@ class EmergeManager {
 
 	static v3s16 getContainingChunk(v3s16 blockpos, s16 chunksize);
 
+	// Number of chunks the mapgens have made so far
+	u32 getGeneratedChunkCount() { return m_generated_chunks; }
+
 private:
 	std::vector<Mapgen *> m_mapgens;
 	std::vector<EmergeThread *> m_threads;
@@ -163,6 +167,8 @@ class EmergeManager {
 	u16 m_qlimit_diskonly;
 	u16 m_qlimit_generate;
 
+	Atomic<u32> m_generated_chunks;
+
 	// Requires m_queue_mutex held
 	EmergeThread *getOptimalThread();
 
@@ -123,6 +123,18 @@ bool IsDirDelimiter(char c)
 	return c == '/' || c == '\\';
 }
 
+bool GetFileStat(const std::string &path, u64 *size, u64 *mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attr;
+	if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &attr) ||
+			(attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+		return false;
+	*size = ((u64)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+	*mtime = ((u64)attr.ftLastWriteTime.dwHighDateTime << 32) |
+			attr.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
 bool RecursiveDelete(const std::string &path)
 {
 	infostream<<"Recursively deleting \""<<path<<"\""<<std::endl;
@@ -302,6 +314,16 @@ bool IsDirDelimiter(char c)
 	return c == '/';
 }
 
+bool GetFileStat(const std::string &path, u64 *size, u64 *mtime)
+{
+	struct stat statbuf;
+	if (stat(path.c_str(), &statbuf) || !S_ISREG(statbuf.st_mode))
+		return false;
+	*size = statbuf.st_size;
+	*mtime = statbuf.st_mtime;
+	return true;
+}
+
 bool RecursiveDelete(const std::string &path)
 {
 	/*
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <string>
 #include <vector>
 #include "exceptions.h"
+#include "irrlichttypes.h"
 
 #ifdef _WIN32 // WINDOWS
 #define DIR_DELIM "\\"
@@ -58,6 +59,11 @@ bool IsDir(const std::string &path);
 
 bool IsDirDelimiter(char c);
 
+// Gets the size and last modification time of a regular file.
+// The time is only meant to be compared with other values returned
+// by this function. Returns false if the file can't be stat'ed.
+bool GetFileStat(const std::string &path, u64 *size, u64 *mtime);
+
 // Only pass full paths to this one. True on success.
 // NOTE: The WIN32 version returns always true.
 bool RecursiveDelete(const std::string &path);
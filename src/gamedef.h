@@ -35,6 +35,7 @@ class IRollbackManager;
 class EmergeManager;
 class Camera;
 class ModMetadata;
+class ModMetadataDatabase;
 
 namespace irr { namespace scene {
 	class IAnimatedMesh;
@@ -76,7 +77,7 @@ class IGameDef
 	virtual const std::vector<ModSpec> &getMods() const = 0;
 	virtual const ModSpec* getModSpec(const std::string &modname) const = 0;
 	virtual std::string getWorldPath() const { return ""; }
-	virtual std::string getModStoragePath() const = 0;
+	virtual ModMetadataDatabase *getModStorageDatabase() = 0;
 	virtual bool registerModStorage(ModMetadata *storage) = 0;
 	virtual void unregisterModStorage(const std::string &name) = 0;
 };
@@ -373,7 +373,8 @@ InventoryList::InventoryList(const std::string &name, u32 size, IItemDefManager
 	m_name(name),
 	m_size(size),
 	m_width(0),
-	m_itemdef(itemdef)
+	m_itemdef(itemdef),
+	m_has_dirty_slots(false)
 {
 	clearItems();
 }
@@ -391,24 +392,31 @@ void InventoryList::clearItems()
 		m_items.push_back(ItemStack());
 	}
 
-	//setDirty(true);
+	setAllSlotsDirty();
 }
 
 void InventoryList::setSize(u32 newsize)
 {
-	if(newsize != m_items.size())
+	if (newsize != m_items.size()) {
 		m_items.resize(newsize);
+		// New slots are dirty
+		m_dirty_slots.resize(newsize, true);
+		m_has_dirty_slots = true;
+	}
 	m_size = newsize;
 }
 
 void InventoryList::setWidth(u32 newwidth)
 {
+	if (newwidth != m_width)
+		m_has_dirty_slots = true;
 	m_width = newwidth;
 }
 
 void InventoryList::setName(const std::string &name)
 {
 	m_name = name;
+	setAllSlotsDirty();
 }
 
 void InventoryList::serialize(std::ostream &os) const
@@ -498,7 +506,7 @@ InventoryList & InventoryList::operator = (const InventoryList &other)
 	m_width = other.m_width;
 	m_name = other.m_name;
 	m_itemdef = other.m_itemdef;
-	//setDirty(true);
+	setAllSlotsDirty();
 
 	return *this;
 }
@@ -573,7 +581,10 @@ ItemStack InventoryList::changeItem(u32 i, const ItemStack &newitem)
 
 	ItemStack olditem = m_items[i];
 	m_items[i] = newitem;
-	//setDirty(true);
+	// Avoid resending e.g. an unchanged craft preview
+	if (olditem.name != newitem.name || olditem.count != newitem.count ||
+			olditem.wear != newitem.wear || olditem.metadata != newitem.metadata)
+		setSlotDirty(i);
 	return olditem;
 }
 
@@ -581,6 +592,7 @@ void InventoryList::deleteItem(u32 i)
 {
 	assert(i < m_items.size()); // Pre-condition
 	m_items[i].clear();
+	setSlotDirty(i);
 }
 
 ItemStack InventoryList::addItem(const ItemStack &newitem_)
@@ -628,8 +640,8 @@ ItemStack InventoryList::addItem(u32 i, const ItemStack &newitem)
 		return newitem;
 
 	ItemStack leftover = m_items[i].addItem(newitem, m_itemdef);
-	//if(leftover != newitem)
-	//	setDirty(true);
+	if (leftover.count != newitem.count)
+		setSlotDirty(i);
 	return leftover;
 }
 
@@ -690,6 +702,7 @@ ItemStack InventoryList::removeItem(const ItemStack &item)
 	{
 		if(i->name == item.name)
 		{
+			setSlotDirty(m_items.rend() - i - 1);
 			u32 still_to_remove = item.count - removed.count;
 			removed.addItem(i->takeItem(still_to_remove), m_itemdef);
 			if(removed.count == item.count)
@@ -705,8 +718,8 @@ ItemStack InventoryList::takeItem(u32 i, u32 takecount)
 		return ItemStack();
 
 	ItemStack taken = m_items[i].takeItem(takecount);
-	//if(!taken.empty())
-	//	setDirty(true);
+	if (!taken.empty())
+		setSlotDirty(i);
 	return taken;
 }
 
@@ -793,6 +806,90 @@ u32 InventoryList::moveItem(u32 i, InventoryList *dest, u32 dest_i,
 	return (oldcount - item1.count);
 }
 
+void InventoryList::setSlotDirty(u32 i)
+{
+	if (i >= m_items.size())
+		return;
+	if (m_dirty_slots.size() != m_items.size())
+		m_dirty_slots.resize(m_items.size(), false);
+	m_dirty_slots[i] = true;
+	m_has_dirty_slots = true;
+}
+
+void InventoryList::setAllSlotsDirty()
+{
+	m_dirty_slots.assign(m_items.size(), true);
+	m_has_dirty_slots = true;
+}
+
+bool InventoryList::isSlotDirty(u32 i) const
+{
+	return i < m_dirty_slots.size() && m_dirty_slots[i];
+}
+
+void InventoryList::clearDirtySlots()
+{
+	m_dirty_slots.assign(m_items.size(), false);
+	m_has_dirty_slots = false;
+}
+
+void InventoryList::serializeDirtySlots(std::ostream &os) const
+{
+	u16 count = 0;
+	for (u32 i = 0; i < m_items.size(); i++) {
+		if (isSlotDirty(i))
+			count++;
+	}
+
+	writeU32(os, m_items.size());
+	writeU32(os, m_width);
+	writeU16(os, count);
+	for (u32 i = 0; i < m_items.size(); i++) {
+		if (!isSlotDirty(i))
+			continue;
+		const ItemStack &item = m_items[i];
+		writeU16(os, i);
+		if (item.empty()) {
+			os << serializeString("");
+			continue;
+		}
+		os << serializeString(item.name);
+		writeU16(os, item.count);
+		writeU16(os, item.wear);
+		std::string metadata;
+		if (!item.metadata.empty()) {
+			std::ostringstream meta_os(std::ios::binary);
+			item.metadata.serialize(meta_os);
+			metadata = meta_os.str();
+		}
+		os << serializeLongString(metadata);
+	}
+}
+
+void InventoryList::deSerializeDirtySlots(std::istream &is)
+{
+	setSize(readU32(is));
+	setWidth(readU32(is));
+
+	u16 count = readU16(is);
+	for (u16 k = 0; k < count; k++) {
+		u16 i = readU16(is);
+		if (i >= m_items.size())
+			throw SerializationError("inventory slot out of range");
+
+		ItemStack item;
+		item.name = deSerializeString(is);
+		if (!item.name.empty()) {
+			item.count = readU16(is);
+			item.wear = readU16(is);
+			std::istringstream meta_is(deSerializeLongString(is),
+				std::ios::binary);
+			item.metadata.deSerialize(meta_is);
+		}
+		changeItem(i, item);
+	}
+}
+
 /*
 	Inventory
 */
@@ -805,6 +902,8 @@ Inventory::~Inventory()
 void Inventory::clear()
 {
 	m_dirty = true;
+	if (!m_lists.empty())
+		m_lists_removed = true;
 	for(u32 i=0; i<m_lists.size(); i++)
 	{
 		delete m_lists[i];
@@ -828,11 +927,13 @@ void Inventory::clearContents()
 Inventory::Inventory(IItemDefManager *itemdef)
 {
 	m_dirty = false;
+	m_lists_removed = false;
 	m_itemdef = itemdef;
 }
 
 Inventory::Inventory(const Inventory &other)
 {
+	m_lists_removed = false;
 	*this = other;
 	m_dirty = false;
 }
@@ -970,6 +1071,7 @@ bool Inventory::deleteList(const std::string &name)
 	if(i == -1)
 		return false;
 	m_dirty = true;
+	m_lists_removed = true;
 	delete m_lists[i];
 	m_lists.erase(m_lists.begin() + i);
 	return true;
@@ -983,6 +1085,67 @@ const InventoryList * Inventory::getList(const std::string &name) const
 	return m_lists[i];
 }
 
+bool Inventory::canSerializeDirtySlots() const
+{
+	if (m_lists_removed)
+		return false;
+	// Slot indices are sent as u16
+	for (u32 i = 0; i < m_lists.size(); i++) {
+		if (m_lists[i]->getSize() > U16_MAX)
+			return false;
+	}
+	return true;
+}
+
+bool Inventory::hasDirtySlots() const
+{
+	for (u32 i = 0; i < m_lists.size(); i++) {
+		if (m_lists[i]->hasDirtySlots())
+			return true;
+	}
+	return false;
+}
+
+void Inventory::clearDirtySlots()
+{
+	m_lists_removed = false;
+	for (u32 i = 0; i < m_lists.size(); i++)
+		m_lists[i]->clearDirtySlots();
+}
+
+void Inventory::serializeDirtySlots(std::ostream &os) const
+{
+	u16 count = 0;
+	for (u32 i = 0; i < m_lists.size(); i++) {
+		if (m_lists[i]->hasDirtySlots())
+			count++;
+	}
+
+	writeU16(os, count);
+	for (u32 i = 0; i < m_lists.size(); i++) {
+		const InventoryList *list = m_lists[i];
+		if (!list->hasDirtySlots())
+			continue;
+		os << serializeString(list->getName());
+		list->serializeDirtySlots(os);
+	}
+}
+
+void Inventory::deSerializeDirtySlots(std::istream &is)
+{
+	m_dirty = true;
+	u16 count = readU16(is);
+	for (u16 i = 0; i < count; i++) {
+		std::string name = deSerializeString(is);
+		InventoryList *list = getList(name);
+		if (!list) {
+			list = new InventoryList(name, 0, m_itemdef);
+			m_lists.push_back(list);
+		}
+		list->deSerializeDirtySlots(is);
+	}
+}
+
 const s32 Inventory::getListIndex(const std::string &name) const
 {
 	for(u32 i=0; i<m_lists.size(); i++)
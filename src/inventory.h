@@ -250,11 +250,29 @@ class InventoryList
 	// also with optional rollback recording
 	void moveItemSomewhere(u32 i, InventoryList *dest, u32 count);
 
+	/*
+		Change tracking for incremental network updates.
+		All modifying methods mark the slots they touch; the server sends
+		and clears them. Items changed through the reference returned by
+		getItem() have to be marked with setSlotDirty().
+	*/
+	void setSlotDirty(u32 i);
+	void setAllSlotsDirty();
+	// Also true if only size or width changed
+	bool hasDirtySlots() const { return m_has_dirty_slots; }
+	bool isSlotDirty(u32 i) const;
+	void clearDirtySlots();
+	// Compact binary format, see TOCLIENT_INVENTORY_DELTA
+	void serializeDirtySlots(std::ostream &os) const;
+	void deSerializeDirtySlots(std::istream &is);
+
 private:
 	std::vector<ItemStack> m_items;
 	std::string m_name;
 	u32 m_size, m_width;
 	IItemDefManager *m_itemdef;
+	std::vector<bool> m_dirty_slots;
+	bool m_has_dirty_slots;
 };
 
 class Inventory
@@ -302,6 +320,19 @@ class Inventory
 		m_dirty = x;
 	}
 
+	/*
+		Incremental network updates: only the lists and slots changed
+		since the last clearDirtySlots() are serialized.
+		Removed lists can't be expressed, the full inventory has to be
+		sent if canSerializeDirtySlots() returns false.
+	*/
+	bool canSerializeDirtySlots() const;
+	bool hasDirtySlots() const;
+	void clearDirtySlots();
+	void serializeDirtySlots(std::ostream &os) const;
+	// Lists not mentioned are left untouched
+	void deSerializeDirtySlots(std::istream &is);
+
 private:
 	// -1 if not found
 	const s32 getListIndex(const std::string &name) const;
@@ -309,6 +340,8 @@ class Inventory
 	std::vector<InventoryList*> m_lists;
 	IItemDefManager *m_itemdef;
 	bool m_dirty;
+	// Set when lists were removed or replaced since clearDirtySlots()
+	bool m_lists_removed;
 };
 
 #endif
@@ -30,6 +30,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define PLAYER_TO_SA(p)   p->getEnv()->getScriptIface()
 
+// i < 0 marks the whole list
+static void set_slot_dirty(InventoryManager *mgr, const InventoryLocation &loc,
+		const std::string &listname, s16 i)
+{
+	Inventory *inv = mgr->getInventory(loc);
+	if (!inv)
+		return;
+	InventoryList *list = inv->getList(listname);
+	if (!list)
+		return;
+	if (i < 0)
+		list->setAllSlotsDirty();
+	else
+		list->setSlotDirty(i);
+}
+
 /*
 	InventoryLocation
 */
@@ -166,6 +182,12 @@ IMoveAction::IMoveAction(std::istream &is, bool somewhere)
 	}
 }
 
+void IMoveAction::setSlotsDirty(InventoryManager *mgr) const
+{
+	set_slot_dirty(mgr, from_inv, from_list, from_i);
+	set_slot_dirty(mgr, to_inv, to_list, move_somewhere ? -1 : to_i);
+}
+
 void IMoveAction::apply(InventoryManager *mgr, ServerActiveObject *player, IGameDef *gamedef)
 {
 	Inventory *inv_from = mgr->getInventory(from_inv);
@@ -578,6 +600,11 @@ IDropAction::IDropAction(std::istream &is)
 	from_i = stoi(ts);
 }
 
+void IDropAction::setSlotsDirty(InventoryManager *mgr) const
+{
+	set_slot_dirty(mgr, from_inv, from_list, from_i);
+}
+
 void IDropAction::apply(InventoryManager *mgr, ServerActiveObject *player, IGameDef *gamedef)
 {
 	Inventory *inv_from = mgr->getInventory(from_inv);
@@ -762,6 +789,12 @@ ICraftAction::ICraftAction(std::istream &is)
 	craft_inv.deSerialize(ts);
 }
 
+void ICraftAction::setSlotsDirty(InventoryManager *mgr) const
+{
+	set_slot_dirty(mgr, craft_inv, "craft", -1);
+	set_slot_dirty(mgr, craft_inv, "craftresult", -1);
+}
+
 void ICraftAction::apply(InventoryManager *mgr,
 	ServerActiveObject *player, IGameDef *gamedef)
 {
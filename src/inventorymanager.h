@@ -130,6 +130,9 @@ struct InventoryAction
 	virtual void apply(InventoryManager *mgr, ServerActiveObject *player,
 			IGameDef *gamedef) = 0;
 	virtual void clientApply(InventoryManager *mgr, IGameDef *gamedef) = 0;
+	// Marks the slots the action touches as modified, so that they are
+	// resent even if the action is denied or changed (only on server)
+	virtual void setSlotsDirty(InventoryManager *mgr) const = 0;
 	virtual ~InventoryAction() {};
 };
 
@@ -186,6 +189,8 @@ struct IMoveAction : public InventoryAction
 	void apply(InventoryManager *mgr, ServerActiveObject *player, IGameDef *gamedef);
 
 	void clientApply(InventoryManager *mgr, IGameDef *gamedef);
+
+	void setSlotsDirty(InventoryManager *mgr) const;
 };
 
 struct IDropAction : public InventoryAction
@@ -221,6 +226,8 @@ struct IDropAction : public InventoryAction
 	void apply(InventoryManager *mgr, ServerActiveObject *player, IGameDef *gamedef);
 
 	void clientApply(InventoryManager *mgr, IGameDef *gamedef);
+
+	void setSlotsDirty(InventoryManager *mgr) const;
 };
 
 struct ICraftAction : public InventoryAction
@@ -251,6 +258,8 @@ struct ICraftAction : public InventoryAction
 	void apply(InventoryManager *mgr, ServerActiveObject *player, IGameDef *gamedef);
 
 	void clientApply(InventoryManager *mgr, IGameDef *gamedef);
+
+	void setSlotsDirty(InventoryManager *mgr) const;
 };
 
 // Crafting helper
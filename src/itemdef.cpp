@@ -244,7 +244,8 @@ class CItemDefManager: public IWritableItemDefManager
 #endif
 
 public:
-	CItemDefManager()
+	CItemDefManager():
+		m_revision(0)
 	{
 
 #ifndef SERVER
@@ -440,6 +441,7 @@ class CItemDefManager: public IWritableItemDefManager
 #endif
 	void clear()
 	{
+		m_revision++;
 		for(std::map<std::string, ItemDefinition*>::const_iterator
 				i = m_item_definitions.begin();
 				i != m_item_definitions.end(); ++i)
@@ -488,6 +490,7 @@ class CItemDefManager: public IWritableItemDefManager
 			m_item_definitions[def.name] = new ItemDefinition(def);
 		else
 			*(m_item_definitions[def.name]) = def;
+		m_revision++;
 
 		// Remove conflicting alias if it exists
 		bool alias_removed = (m_aliases.erase(def.name) != 0);
@@ -501,6 +504,7 @@ class CItemDefManager: public IWritableItemDefManager
 
 		delete m_item_definitions[name];
 		m_item_definitions.erase(name);
+		m_revision++;
 	}
 	virtual void registerAlias(const std::string &name,
 			const std::string &convert_to)
@@ -509,6 +513,7 @@ class CItemDefManager: public IWritableItemDefManager
 			verbosestream<<"ItemDefManager: setting alias "<<name
 				<<" -> "<<convert_to<<std::endl;
 			m_aliases[name] = convert_to;
+			m_revision++;
 		}
 	}
 	void serialize(std::ostream &os, u16 protocol_version)
@@ -536,6 +541,10 @@ class CItemDefManager: public IWritableItemDefManager
 			os << serializeString(it->second);
 		}
 	}
+	virtual u32 getRevision() const
+	{
+		return m_revision;
+	}
 	void deSerialize(std::istream &is)
 	{
 		// Clear everything
@@ -581,6 +590,8 @@ class CItemDefManager: public IWritableItemDefManager
 	std::map<std::string, ItemDefinition*> m_item_definitions;
 	// Aliases
 	StringMap m_aliases;
+	// Incremented by the changes of the above, see getRevision()
+	u32 m_revision;
 #ifndef SERVER
 	// The id of the thread that is allowed to use irrlicht directly
 	threadid_t m_main_thread;
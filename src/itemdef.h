@@ -129,6 +129,8 @@ class IItemDefManager
 #endif
 
 	virtual void serialize(std::ostream &os, u16 protocol_version)=0;
+	// Changes whenever the serialized definitions may change
+	virtual u32 getRevision() const=0;
 };
 
 class IWritableItemDefManager : public IItemDefManager
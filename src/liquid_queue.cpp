@@ -0,0 +1,144 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "liquid_queue.h"
+#include <cstring>
+#include "util/numeric.h"
+
+// Emptied blocks kept around for reuse
+#define LIQUID_QUEUE_MAX_UNUSED 64
+
+LiquidQueue::LiquidQueue() :
+	m_last_block(NULL),
+	m_size(0)
+{
+}
+
+LiquidQueue::~LiquidQueue()
+{
+	clear();
+	for (std::vector<Block *>::iterator it = m_unused.begin();
+			it != m_unused.end(); ++it)
+		delete *it;
+}
+
+bool LiquidQueue::push_back(v3s16 p)
+{
+	v3s16 blockpos = getContainerPos(p, MAP_BLOCKSIZE);
+	Block *block = m_last_block;
+	if (!block || block->pos != blockpos) {
+		u64 key = blockKey(blockpos);
+		UNORDERED_MAP<u64, Block *>::iterator it = m_blocks.find(key);
+		if (it != m_blocks.end()) {
+			block = it->second;
+		} else {
+			if (m_unused.empty()) {
+				block = new Block();
+			} else {
+				block = m_unused.back();
+				m_unused.pop_back();
+			}
+			block->pos = blockpos;
+			memset(block->queued, 0, sizeof(block->queued));
+			block->nodes.clear();
+			block->head = 0;
+			m_blocks[key] = block;
+			m_order.push_back(block);
+		}
+		m_last_block = block;
+	}
+
+	v3s16 rel = p - blockpos * MAP_BLOCKSIZE;
+	u16 i = (rel.Z * MAP_BLOCKSIZE + rel.Y) * MAP_BLOCKSIZE + rel.X;
+	u32 bit = 1U << (i & 31);
+	if (block->queued[i >> 5] & bit)
+		return false;
+	block->queued[i >> 5] |= bit;
+	block->nodes.push_back(i);
+	m_size++;
+	return true;
+}
+
+v3s16 LiquidQueue::front() const
+{
+	const Block *block = m_order.front();
+	return nodePos(block, block->nodes[block->head]);
+}
+
+void LiquidQueue::pop_front()
+{
+	Block *block = m_order.front();
+	u16 i = block->nodes[block->head++];
+	block->queued[i >> 5] &= ~(1U << (i & 31));
+	m_size--;
+	releaseFront();
+}
+
+void LiquidQueue::popBlocks(u32 max, std::vector<v3s16> &nodes,
+	std::vector<u32> &block_ends)
+{
+	while (max > 0 && !m_order.empty()) {
+		Block *block = m_order.front();
+		u32 count = MYMIN(max, block->nodes.size() - block->head);
+		for (u32 k = 0; k < count; k++) {
+			u16 i = block->nodes[block->head++];
+			block->queued[i >> 5] &= ~(1U << (i & 31));
+			nodes.push_back(nodePos(block, i));
+		}
+		block_ends.push_back(nodes.size());
+		m_size -= count;
+		max -= count;
+		releaseFront();
+	}
+}
+
+void LiquidQueue::clear()
+{
+	for (std::deque<Block *>::iterator it = m_order.begin();
+			it != m_order.end(); ++it)
+		delete *it;
+	m_order.clear();
+	m_blocks.clear();
+	m_last_block = NULL;
+	m_size = 0;
+}
+
+void LiquidQueue::releaseFront()
+{
+	Block *block = m_order.front();
+	if (block->head < block->nodes.size()) {
+		// Don't let a block that keeps getting nodes grow forever
+		if (block->head >= 1024 && block->head * 2 >= block->nodes.size()) {
+			block->nodes.erase(block->nodes.begin(),
+				block->nodes.begin() + block->head);
+			block->head = 0;
+		}
+		return;
+	}
+
+	m_blocks.erase(blockKey(block->pos));
+	m_order.pop_front();
+	if (m_last_block == block)
+		m_last_block = NULL;
+
+	if (m_unused.size() < LIQUID_QUEUE_MAX_UNUSED)
+		m_unused.push_back(block);
+	else
+		delete block;
+}
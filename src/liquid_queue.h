@@ -0,0 +1,107 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef LIQUID_QUEUE_HEADER
+#define LIQUID_QUEUE_HEADER
+
+#include <deque>
+#include <vector>
+#include "irrlichttypes_bloated.h"
+#include "constants.h"
+#include "util/basic_macros.h"
+#include "util/cpp11_container.h"
+
+/*
+	Queue of nodes waiting for a liquid update, partitioned by MapBlock.
+
+	Every block with queued nodes keeps a bitmap of them, which rejects
+	duplicates, and the queued nodes in order. Blocks are handed out in
+	the order they were first queued, so nodes of one block are
+	processed together.
+*/
+class LiquidQueue
+{
+public:
+	LiquidQueue();
+	~LiquidQueue();
+
+	// Does nothing if p is already queued. Returns true if p was added.
+	bool push_back(v3s16 p);
+
+	// The oldest node, the queue must not be empty
+	v3s16 front() const;
+	void pop_front();
+
+	inline u32 size() const
+	{
+		return m_size;
+	}
+
+	/*
+		Removes up to max nodes from the front, a block at a time.
+		The nodes of each block are appended to nodes, and the end
+		offset of each block's nodes is appended to block_ends.
+	*/
+	void popBlocks(u32 max, std::vector<v3s16> &nodes,
+		std::vector<u32> &block_ends);
+
+	void clear();
+
+private:
+	static const u32 NODECOUNT = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+	struct Block
+	{
+		v3s16 pos;
+		// Bit i is set if node i of the block is queued
+		u32 queued[NODECOUNT / 32];
+		// Queued node indices, oldest at head
+		std::vector<u16> nodes;
+		u32 head;
+	};
+
+	static inline u64 blockKey(v3s16 blockpos)
+	{
+		return ((u64)(u16)blockpos.X << 32) | ((u64)(u16)blockpos.Y << 16) |
+			(u64)(u16)blockpos.Z;
+	}
+
+	static inline v3s16 nodePos(const Block *block, u16 i)
+	{
+		return block->pos * MAP_BLOCKSIZE + v3s16(i % MAP_BLOCKSIZE,
+			(i / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+			i / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+	}
+
+	// Drops the front block if all of its nodes were popped
+	void releaseFront();
+
+	UNORDERED_MAP<u64, Block *> m_blocks;
+	// Blocks in the order they were queued
+	std::deque<Block *> m_order;
+	// Emptied blocks, kept for reuse
+	std::vector<Block *> m_unused;
+	// The block of the previous push_back(), most pushes hit it again
+	Block *m_last_block;
+	u32 m_size;
+
+	DISABLE_CLASS_COPY(LiquidQueue);
+};
+
+#endif
@@ -64,14 +64,15 @@ class Logger {
 	static LogLevel stringToLevel(const std::string &name);
 	static const std::string getLevelLabel(LogLevel lev);
 
+	// Name of the calling thread, as registered
+	const std::string getThreadName();
+
 private:
 	void logToOutputsRaw(LogLevel, const std::string &line);
 	void logToOutputs(LogLevel, const std::string &combined,
 		const std::string &time, const std::string &thread_name,
 		const std::string &payload_text);
 
-	const std::string getThreadName();
-
 	std::vector<ILogOutput *> m_outputs[LL_MAX];
 
 	// Should implement atomic loads and stores (even though it's only
@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irrlichttypes_extrabloated.h"
 #include "debug.h"
 #include "unittest/test.h"
+#include "benchmark/benchmark_server.h"
 #include "server.h"
 #include "filesys.h"
 #include "version.h"
@@ -183,6 +184,19 @@ int main(int argc, char *argv[])
 	if (cmd_args.getFlag("run-unittests")) {
 		return run_tests();
 	}
+
+	// Run the benchmarks of the unit test modules and the server benchmark
+	if (cmd_args.getFlag("run-benchmark")) {
+		std::string name = cmd_args.exists("benchmark") ?
+			cmd_args.get("benchmark") : "";
+		if (name == "server")
+			return run_server_benchmark(cmd_args) ? 0 : 1;
+		if (!name.empty())
+			return run_benchmarks(name) ? 0 : 1;
+		bool success = run_benchmarks("");
+		success &= run_server_benchmark(cmd_args);
+		return success ? 0 : 1;
+	}
 #endif
 
 	GameParams game_params;
@@ -255,6 +269,14 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Set network port (UDP)"))));
 	allowed_options->insert(std::make_pair("run-unittests", ValueSpec(VALUETYPE_FLAG,
 			_("Run the unit tests and exit"))));
+	allowed_options->insert(std::make_pair("run-benchmark", ValueSpec(VALUETYPE_FLAG,
+			_("Run the benchmarks and exit"))));
+	allowed_options->insert(std::make_pair("benchmark", ValueSpec(VALUETYPE_STRING,
+			_("Only run the named benchmark: 'server' or a unit test module"))));
+	allowed_options->insert(std::make_pair("benchmark-clients", ValueSpec(VALUETYPE_STRING,
+			_("Number of fake clients for --run-benchmark (default 10)"))));
+	allowed_options->insert(std::make_pair("benchmark-duration", ValueSpec(VALUETYPE_STRING,
+			_("Duration of --run-benchmark in seconds (default 60)"))));
 	allowed_options->insert(std::make_pair("map-dir", ValueSpec(VALUETYPE_STRING,
 			_("Same as --world (deprecated)"))));
 	allowed_options->insert(std::make_pair("world", ValueSpec(VALUETYPE_STRING,
@@ -277,6 +299,10 @@ static void set_allowed_options(OptionList *allowed_options)
 			_("Migrate from current map backend to another (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("migrate-players", ValueSpec(VALUETYPE_STRING,
 		_("Migrate from current players backend to another (Only works when using minetestserver or with --server)"))));
+	allowed_options->insert(std::make_pair("migrate-auth", ValueSpec(VALUETYPE_STRING,
+		_("Migrate from current auth backend to another (Only works when using minetestserver or with --server)"))));
+	allowed_options->insert(std::make_pair("migrate-mod-storage", ValueSpec(VALUETYPE_STRING,
+		_("Migrate from current mod storage backend to another (Only works when using minetestserver or with --server)"))));
 	allowed_options->insert(std::make_pair("terminal", ValueSpec(VALUETYPE_FLAG,
 			_("Feature an interactive terminal (Only works when using minetestserver or with --server)"))));
 #ifndef SERVER
@@ -816,6 +842,10 @@ static bool run_dedicated_server(const GameParams &game_params, const Settings &
 		return migrate_map_database(game_params, cmd_args);
 	else if (cmd_args.exists("migrate-players"))
 		return ServerEnvironment::migratePlayersDatabase(game_params, cmd_args);
+	else if (cmd_args.exists("migrate-auth"))
+		return Server::migrateAuthDatabase(game_params, cmd_args);
+	else if (cmd_args.exists("migrate-mod-storage"))
+		return Server::migrateModStorageDatabase(game_params, cmd_args);
 
 	if (cmd_args.exists("terminal")) {
 #if USE_CURSES
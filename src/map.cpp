@@ -45,6 +45,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "database-dummy.h"
 #include "database-sqlite3.h"
 #include "script/scripting_server.h"
+#include "threading/thread.h"
 #include <deque>
 #include <queue>
 #if USE_LEVELDB
@@ -57,6 +58,73 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "database-postgresql.h"
 #endif
 
+/*
+	Liquid transformation helpers
+*/
+
+// Steps with fewer nodes are computed on the server thread alone
+#define LIQUID_PARALLEL_MIN_NODES 1024
+
+/*
+	Reads nodes for computing liquid updates. Unlike Map::getNodeNoEx()
+	it doesn't touch the recently used blocks of the block index, so
+	several threads can use it at once while the map is not modified.
+*/
+class LiquidNodeReader
+{
+public:
+	LiquidNodeReader(const MapBlockIndex &index) :
+		m_index(index),
+		m_blockpos(MAX_MAP_GENERATION_LIMIT, 0, 0),
+		m_block(NULL)
+	{}
+
+	MapNode get(v3s16 p)
+	{
+		v3s16 blockpos = getNodeBlockPos(p);
+		if (blockpos != m_blockpos) {
+			m_blockpos = blockpos;
+			m_block = m_index.get(blockpos);
+		}
+		if (!m_block || m_block->isDummy())
+			return MapNode(CONTENT_IGNORE);
+
+		v3s16 relpos = p - blockpos * MAP_BLOCKSIZE;
+		return m_block->getNodeUnsafe(relpos);
+	}
+
+private:
+	const MapBlockIndex &m_index;
+	v3s16 m_blockpos;
+	MapBlock *m_block;
+};
+
+class LiquidThread : public Thread
+{
+public:
+	LiquidThread(Map *map) :
+		Thread("Liquid"),
+		m_map(map)
+	{}
+
+	void *run()
+	{
+		while (!stopRequested()) {
+			m_start.wait();
+			if (stopRequested())
+				break;
+			m_map->computeLiquidUpdates();
+			m_map->m_liquid_done.post();
+		}
+		return NULL;
+	}
+
+	// Posted for every step that is to be computed
+	Semaphore m_start;
+
+private:
+	Map *m_map;
+};
 
 /*
 	Map
@@ -67,6 +135,10 @@ Map::Map(std::ostream &dout, IGameDef *gamedef):
 	m_gamedef(gamedef),
 	m_sector_cache(NULL),
 	m_nodedef(gamedef->ndef()),
+	m_compact_timeout(g_settings->getFloat("mapblock_compact_timeout")),
+	m_light_batch_depth(0),
+	m_liquid_threads_started(false),
+	m_liquid_next_block(0),
 	m_transforming_liquid_loop_count_multiplier(1.0f),
 	m_unprocessed_count(0),
 	m_inc_trending_up_start_time(0),
@@ -76,6 +148,14 @@ Map::Map(std::ostream &dout, IGameDef *gamedef):
 
 Map::~Map()
 {
+	for (std::vector<LiquidThread *>::iterator it = m_liquid_threads.begin();
+			it != m_liquid_threads.end(); ++it) {
+		(*it)->stop();
+		(*it)->m_start.post();
+		(*it)->wait();
+		delete *it;
+	}
+
 	/*
 		Free all MapSectors
 	*/
@@ -143,12 +223,7 @@ MapSector * Map::getSectorNoGenerate(v2s16 p)
 
 MapBlock * Map::getBlockNoCreateNoEx(v3s16 p3d)
 {
-	v2s16 p2d(p3d.X, p3d.Z);
-	MapSector * sector = getSectorNoGenerateNoEx(p2d);
-	if(sector == NULL)
-		return NULL;
-	MapBlock *block = sector->getBlockNoCreateNoEx(p3d.Y);
-	return block;
+	return m_block_index.lookup(p3d);
 }
 
 MapBlock * Map::getBlockNoCreate(v3s16 p3d)
@@ -258,9 +333,19 @@ void Map::addNodeAndUpdate(v3s16 p, MapNode n,
 	setNode(p, n);
 
 	// Update lighting
-	std::vector<std::pair<v3s16, MapNode> > oldnodes;
-	oldnodes.push_back(std::pair<v3s16, MapNode>(p, oldnode));
-	voxalgo::update_lighting_nodes(this, oldnodes, modified_blocks);
+	if (m_light_batch_depth > 0) {
+		// Only the first change of a node in a batch knows its old light
+		u64 key = ((u64)(u16)p.X << 32) | ((u64)(u16)p.Y << 16) | (u16)p.Z;
+		if (m_light_batch_positions.insert(key).second)
+			m_light_batch_nodes.push_back(
+				std::pair<v3s16, MapNode>(p, oldnode));
+		v3s16 blockpos = getNodeBlockPos(p);
+		modified_blocks[blockpos] = getBlockNoCreate(blockpos);
+	} else {
+		std::vector<std::pair<v3s16, MapNode> > oldnodes;
+		oldnodes.push_back(std::pair<v3s16, MapNode>(p, oldnode));
+		voxalgo::update_lighting_nodes(this, oldnodes, modified_blocks);
+	}
 
 	for(std::map<v3s16, MapBlock*>::iterator
 			i = modified_blocks.begin();
@@ -310,6 +395,61 @@ void Map::removeNodeAndUpdate(v3s16 p,
 	addNodeAndUpdate(p, MapNode(CONTENT_AIR), modified_blocks, true);
 }
 
+void Map::beginLightingBatch()
+{
+	m_light_batch_depth++;
+}
+
+bool Map::endLightingBatch()
+{
+	if (m_light_batch_depth == 0)
+		return false;
+	if (--m_light_batch_depth == 0)
+		flushLightingBatch();
+	return true;
+}
+
+void Map::flushLightingBatch()
+{
+	std::map<v3s16, MapBlock*> modified_blocks;
+	updateBatchLighting(modified_blocks);
+	if (modified_blocks.empty())
+		return;
+
+	MapEditEvent event;
+	event.type = MEET_OTHER;
+	for (std::map<v3s16, MapBlock*>::iterator it = modified_blocks.begin();
+			it != modified_blocks.end(); ++it)
+		event.modified_blocks.insert(it->first);
+	dispatchEvent(&event);
+}
+
+void Map::updateBatchLighting(std::map<v3s16, MapBlock*> &modified_blocks)
+{
+	if (m_light_batch_nodes.empty())
+		return;
+
+	std::map<v3s16, MapBlock*> light_blocks;
+	voxalgo::update_lighting_nodes(this, m_light_batch_nodes, light_blocks,
+		true);
+	m_light_batch_nodes.clear();
+	m_light_batch_positions.clear();
+
+	for (std::map<v3s16, MapBlock*>::iterator it = light_blocks.begin();
+			it != light_blocks.end(); ++it) {
+		it->second->expireDayNightDiff();
+		modified_blocks[it->first] = it->second;
+	}
+}
+
+u32 Map::endAllLightingBatches()
+{
+	u32 depth = m_light_batch_depth;
+	m_light_batch_depth = 0;
+	flushLightingBatch();
+	return depth;
+}
+
 bool Map::addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata)
 {
 	MapEditEvent event;
@@ -339,6 +479,51 @@ bool Map::addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata)
 	return succeeded;
 }
 
+u32 Map::setNodesWithEvent(const std::vector<v3s16> &positions,
+		const MapNode &n, bool remove_metadata)
+{
+	std::map<v3s16, MapBlock*> modified_blocks;
+	u32 count = 0;
+
+	// Inside an open batch the light is updated when that batch ends
+	bool own_batch = m_light_batch_depth == 0;
+	m_light_batch_depth++;
+	try {
+		for (std::vector<v3s16>::const_iterator it = positions.begin();
+				it != positions.end(); ++it) {
+			try {
+				addNodeAndUpdate(*it, n, modified_blocks, remove_metadata);
+				count++;
+			} catch (InvalidPositionException &e) {
+			}
+		}
+	} catch (...) {
+		// A batch left open would defer all later light updates
+		endSetNodes(own_batch, modified_blocks);
+		throw;
+	}
+	endSetNodes(own_batch, modified_blocks);
+	return count;
+}
+
+void Map::endSetNodes(bool own_batch,
+		std::map<v3s16, MapBlock*> &modified_blocks)
+{
+	m_light_batch_depth--;
+	if (own_batch)
+		updateBatchLighting(modified_blocks);
+
+	if (modified_blocks.empty())
+		return;
+
+	MapEditEvent event;
+	event.type = MEET_OTHER;
+	for (std::map<v3s16, MapBlock*>::iterator it = modified_blocks.begin();
+			it != modified_blocks.end(); ++it)
+		event.modified_blocks.insert(it->first);
+	dispatchEvent(&event);
+}
+
 bool Map::removeNodeWithEvent(v3s16 p)
 {
 	MapEditEvent event;
@@ -497,6 +682,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 				} else {
 					all_blocks_deleted = false;
 					block_count_all++;
+					compactIfUnused(block, dtime);
 				}
 			}
 
@@ -519,6 +705,7 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 
 				block->incrementUsageTimer(dtime);
 				mapblock_queue.push(TimeOrderedMapBlock(sector, block));
+				compactIfUnused(block, dtime);
 			}
 		}
 		block_count_all = mapblock_queue.size();
@@ -582,6 +769,17 @@ void Map::timerUpdate(float dtime, float unload_timeout, u32 max_loaded_blocks,
 	}
 }
 
+void Map::compactIfUnused(MapBlock *block, float dtime)
+{
+	if (m_compact_timeout <= 0)
+		return;
+
+	// Only try once when the timeout passes, compacting can fail
+	float t = block->getUsageTimer();
+	if (t > m_compact_timeout && t - dtime <= m_compact_timeout)
+		block->compact();
+}
+
 void Map::unloadUnreferencedBlocks(std::vector<v3s16> *unloaded_blocks)
 {
 	timerUpdate(0.0, -1.0, 0, unloaded_blocks);
@@ -638,17 +836,297 @@ s32 Map::transforming_liquid_size() {
         return m_transforming_liquid.size();
 }
 
+void Map::startLiquidThreads()
+{
+	m_liquid_threads_started = true;
+
+	s32 num_threads = g_settings->getS32("num_liquid_threads");
+	if (num_threads < 0)
+		num_threads = MYMIN((s32)Thread::getNumberOfProcessors() - 1, 4);
+
+	for (s32 i = 0; i < num_threads; i++) {
+		LiquidThread *thread = new LiquidThread(this);
+		if (!thread->start()) {
+			errorstream << "Map: Could not start liquid thread" << std::endl;
+			delete thread;
+			break;
+		}
+		m_liquid_threads.push_back(thread);
+	}
+}
+
+void Map::computeLiquidUpdates()
+{
+	u32 num_blocks = m_liquid_block_ends.size();
+	for (;;) {
+		u32 b = m_liquid_next_block++;
+		if (b >= num_blocks)
+			break;
+
+		LiquidNodeReader reader(m_block_index);
+		u32 end = m_liquid_block_ends[b];
+		for (u32 i = b > 0 ? m_liquid_block_ends[b - 1] : 0; i < end; i++)
+			computeLiquidUpdate(m_liquid_nodes[i], m_liquid_updates[i], reader);
+	}
+}
+
+void Map::computeLiquidUpdate(v3s16 p0, LiquidUpdate &u,
+		LiquidNodeReader &reader)
+{
+	u.p = p0;
+	u.changed = false;
+	u.flood = false;
+	u.reflow = false;
+	u.num_queue = 0;
+	u.num_queue_changed = 0;
+
+	MapNode n0 = reader.get(p0);
+	u.n_old = n0;
+
+	/*
+		Collect information about current node
+	 */
+	s8 liquid_level = -1;
+	// The liquid node which will be placed there if
+	// the liquid flows into this node.
+	content_t liquid_kind = CONTENT_IGNORE;
+	// The node which will be placed there if liquid
+	// can't flow into this node.
+	content_t floodable_node = CONTENT_AIR;
+	const ContentFeatures &cf = m_nodedef->get(n0);
+	LiquidType liquid_type = cf.liquid_type;
+	switch (liquid_type) {
+		case LIQUID_SOURCE:
+			liquid_level = LIQUID_LEVEL_SOURCE;
+			liquid_kind = m_nodedef->getId(cf.liquid_alternative_flowing);
+			break;
+		case LIQUID_FLOWING:
+			liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
+			liquid_kind = n0.getContent();
+			break;
+		case LIQUID_NONE:
+			// if this node is 'floodable', it *could* be transformed
+			// into a liquid, otherwise, continue with the next node.
+			if (!cf.floodable)
+				return;
+			floodable_node = n0.getContent();
+			liquid_kind = CONTENT_AIR;
+			break;
+	}
+
+	/*
+		Collect information about the environment
+	 */
+	const v3s16 *dirs = g_6dirs;
+	NodeNeighbor sources[6]; // surrounding sources
+	int num_sources = 0;
+	NodeNeighbor flows[6]; // surrounding flowing liquid nodes
+	int num_flows = 0;
+	NodeNeighbor airs[6]; // surrounding air
+	int num_airs = 0;
+	NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
+	int num_neutrals = 0;
+	bool flowing_down = false;
+	bool ignored_sources = false;
+	for (u16 i = 0; i < 6; i++) {
+		NeighborType nt = NEIGHBOR_SAME_LEVEL;
+		switch (i) {
+			case 1:
+				nt = NEIGHBOR_UPPER;
+				break;
+			case 4:
+				nt = NEIGHBOR_LOWER;
+				break;
+		}
+		v3s16 npos = p0 + dirs[i];
+		NodeNeighbor nb(reader.get(npos), nt, npos);
+		const ContentFeatures &cfnb = m_nodedef->get(nb.n);
+		switch (m_nodedef->get(nb.n.getContent()).liquid_type) {
+			case LIQUID_NONE:
+				if (cfnb.floodable) {
+					airs[num_airs++] = nb;
+					// if the current node is a water source the neighbor
+					// should be enqueded for transformation regardless of whether the
+					// current node changes or not.
+					if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
+						u.queue[u.num_queue++] = npos;
+					// if the current node happens to be a flowing node, it will start to flow down here.
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				} else {
+					neutrals[num_neutrals++] = nb;
+					if (nb.n.getContent() == CONTENT_IGNORE) {
+						// If node below is ignore prevent water from
+						// spreading outwards and otherwise prevent from
+						// flowing away as ignore node might be the source
+						if (nb.t == NEIGHBOR_LOWER)
+							flowing_down = true;
+						else
+							ignored_sources = true;
+					}
+				}
+				break;
+			case LIQUID_SOURCE:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
+				if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					// Do not count bottom source, it will screw things up
+					if(dirs[i].Y != -1)
+						sources[num_sources++] = nb;
+				}
+				break;
+			case LIQUID_FLOWING:
+				// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
+				if (liquid_kind == CONTENT_AIR)
+					liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
+				if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
+					neutrals[num_neutrals++] = nb;
+				} else {
+					flows[num_flows++] = nb;
+					if (nb.t == NEIGHBOR_LOWER)
+						flowing_down = true;
+				}
+				break;
+		}
+	}
+
+	/*
+		decide on the type (and possibly level) of the current node
+	 */
+	content_t new_node_content;
+	s8 new_node_level = -1;
+	s8 max_node_level = -1;
+
+	u8 range = m_nodedef->get(liquid_kind).liquid_range;
+	if (range > LIQUID_LEVEL_MAX + 1)
+		range = LIQUID_LEVEL_MAX + 1;
+
+	if ((num_sources >= 2 && m_nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
+		// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
+		// or the flowing alternative of the first of the surrounding sources (if it's air), so
+		// it's perfectly safe to use liquid_kind here to determine the new node content.
+		new_node_content = m_nodedef->getId(m_nodedef->get(liquid_kind).liquid_alternative_source);
+	} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
+		// liquid_kind is set properly, see above
+		max_node_level = new_node_level = LIQUID_LEVEL_MAX;
+		if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+	} else if (ignored_sources && liquid_level >= 0) {
+		// Maybe there are neighbouring sources that aren't loaded yet
+		// so prevent flowing away.
+		new_node_level = liquid_level;
+		new_node_content = liquid_kind;
+	} else {
+		// no surrounding sources, so get the maximum level that can flow into this node
+		for (u16 i = 0; i < num_flows; i++) {
+			u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
+			switch (flows[i].t) {
+				case NEIGHBOR_UPPER:
+					if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
+						max_node_level = LIQUID_LEVEL_MAX;
+						if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
+							max_node_level = nb_liquid_level + WATER_DROP_BOOST;
+					} else if (nb_liquid_level > max_node_level) {
+						max_node_level = nb_liquid_level;
+					}
+					break;
+				case NEIGHBOR_LOWER:
+					break;
+				case NEIGHBOR_SAME_LEVEL:
+					if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
+							nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
+						max_node_level = nb_liquid_level - 1;
+					break;
+			}
+		}
+
+		u8 viscosity = m_nodedef->get(liquid_kind).liquid_viscosity;
+		if (viscosity > 1 && max_node_level != liquid_level) {
+			// amount to gain, limited by viscosity
+			// must be at least 1 in absolute value
+			s8 level_inc = max_node_level - liquid_level;
+			if (level_inc < -viscosity || level_inc > viscosity)
+				new_node_level = liquid_level + level_inc/viscosity;
+			else if (level_inc < 0)
+				new_node_level = liquid_level - 1;
+			else if (level_inc > 0)
+				new_node_level = liquid_level + 1;
+			if (new_node_level != max_node_level)
+				u.reflow = true;
+		} else {
+			new_node_level = max_node_level;
+		}
+
+		if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
+			new_node_content = liquid_kind;
+		else
+			new_node_content = floodable_node;
+
+	}
+
+	/*
+		check if anything has changed. if not, just continue with the next node.
+	 */
+	if (new_node_content == n0.getContent() &&
+			(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
+			((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
+			((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
+			== flowing_down)))
+		return;
+
+
+	/*
+		update the current node
+	 */
+	if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
+		// set level to last 3 bits, flowing down bit to 4th bit
+		n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
+	} else {
+		// set the liquid level and flow bit to 0
+		n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+	}
+
+	// change the node.
+	n0.setContent(new_node_content);
+	u.n_new = n0;
+	u.changed = true;
+	u.flood = floodable_node != CONTENT_AIR;
+
+	/*
+		enqueue neighbors for update if neccessary
+	 */
+	switch (m_nodedef->get(n0.getContent()).liquid_type) {
+		case LIQUID_SOURCE:
+		case LIQUID_FLOWING:
+			// make sure source flows into all neighboring nodes
+			for (u16 i = 0; i < num_flows; i++)
+				if (flows[i].t != NEIGHBOR_UPPER)
+					u.queue_changed[u.num_queue_changed++] = flows[i].p;
+			for (u16 i = 0; i < num_airs; i++)
+				if (airs[i].t != NEIGHBOR_UPPER)
+					u.queue_changed[u.num_queue_changed++] = airs[i].p;
+			break;
+		case LIQUID_NONE:
+			// this flow has turned to air; neighboring flows might need to do the same
+			for (u16 i = 0; i < num_flows; i++)
+				u.queue_changed[u.num_queue_changed++] = flows[i].p;
+			break;
+	}
+}
+
 void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 		ServerEnvironment *env)
 {
 	DSTACK(FUNCTION_NAME);
 	//TimeTaker timer("transformLiquids()");
 
-	u32 loopcount = 0;
-	u32 initial_size = m_transforming_liquid.size();
-
-	/*if(initial_size != 0)
-		infostream<<"transformLiquids(): initial_size="<<initial_size<<std::endl;*/
+	// The lighting below expects the light of all other nodes to be right
+	flushLightingBatch();
 
 	// list of nodes that due to viscosity have not reached their max level height
 	std::deque<v3s16> must_reflow;
@@ -675,236 +1153,58 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 	loop_max *= m_transforming_liquid_loop_count_multiplier;
 #endif
 
-	while (m_transforming_liquid.size() != 0)
-	{
-		// This should be done here so that it is done when continue is used
-		if (loopcount >= initial_size || loopcount >= loop_max)
-			break;
-		loopcount++;
-
-		/*
-			Get a queued transforming liquid node
-		*/
-		v3s16 p0 = m_transforming_liquid.front();
-		m_transforming_liquid.pop_front();
-
-		MapNode n0 = getNodeNoEx(p0);
-
-		/*
-			Collect information about current node
-		 */
-		s8 liquid_level = -1;
-		// The liquid node which will be placed there if
-		// the liquid flows into this node.
-		content_t liquid_kind = CONTENT_IGNORE;
-		// The node which will be placed there if liquid
-		// can't flow into this node.
-		content_t floodable_node = CONTENT_AIR;
-		const ContentFeatures &cf = m_nodedef->get(n0);
-		LiquidType liquid_type = cf.liquid_type;
-		switch (liquid_type) {
-			case LIQUID_SOURCE:
-				liquid_level = LIQUID_LEVEL_SOURCE;
-				liquid_kind = m_nodedef->getId(cf.liquid_alternative_flowing);
-				break;
-			case LIQUID_FLOWING:
-				liquid_level = (n0.param2 & LIQUID_LEVEL_MASK);
-				liquid_kind = n0.getContent();
-				break;
-			case LIQUID_NONE:
-				// if this node is 'floodable', it *could* be transformed
-				// into a liquid, otherwise, continue with the next node.
-				if (!cf.floodable)
-					continue;
-				floodable_node = n0.getContent();
-				liquid_kind = CONTENT_AIR;
-				break;
-		}
-
-		/*
-			Collect information about the environment
-		 */
-		const v3s16 *dirs = g_6dirs;
-		NodeNeighbor sources[6]; // surrounding sources
-		int num_sources = 0;
-		NodeNeighbor flows[6]; // surrounding flowing liquid nodes
-		int num_flows = 0;
-		NodeNeighbor airs[6]; // surrounding air
-		int num_airs = 0;
-		NodeNeighbor neutrals[6]; // nodes that are solid or another kind of liquid
-		int num_neutrals = 0;
-		bool flowing_down = false;
-		bool ignored_sources = false;
-		for (u16 i = 0; i < 6; i++) {
-			NeighborType nt = NEIGHBOR_SAME_LEVEL;
-			switch (i) {
-				case 1:
-					nt = NEIGHBOR_UPPER;
-					break;
-				case 4:
-					nt = NEIGHBOR_LOWER;
-					break;
-			}
-			v3s16 npos = p0 + dirs[i];
-			NodeNeighbor nb(getNodeNoEx(npos), nt, npos);
-			const ContentFeatures &cfnb = m_nodedef->get(nb.n);
-			switch (m_nodedef->get(nb.n.getContent()).liquid_type) {
-				case LIQUID_NONE:
-					if (cfnb.floodable) {
-						airs[num_airs++] = nb;
-						// if the current node is a water source the neighbor
-						// should be enqueded for transformation regardless of whether the
-						// current node changes or not.
-						if (nb.t != NEIGHBOR_UPPER && liquid_type != LIQUID_NONE)
-							m_transforming_liquid.push_back(npos);
-						// if the current node happens to be a flowing node, it will start to flow down here.
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					} else {
-						neutrals[num_neutrals++] = nb;
-						if (nb.n.getContent() == CONTENT_IGNORE) {
-							// If node below is ignore prevent water from
-							// spreading outwards and otherwise prevent from
-							// flowing away as ignore node might be the source
-							if (nb.t == NEIGHBOR_LOWER)
-								flowing_down = true;
-							else
-								ignored_sources = true;
-						}
-					}
-					break;
-				case LIQUID_SOURCE:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
-					if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						// Do not count bottom source, it will screw things up
-						if(dirs[i].Y != -1)
-							sources[num_sources++] = nb;
-					}
-					break;
-				case LIQUID_FLOWING:
-					// if this node is not (yet) of a liquid type, choose the first liquid type we encounter
-					if (liquid_kind == CONTENT_AIR)
-						liquid_kind = m_nodedef->getId(cfnb.liquid_alternative_flowing);
-					if (m_nodedef->getId(cfnb.liquid_alternative_flowing) != liquid_kind) {
-						neutrals[num_neutrals++] = nb;
-					} else {
-						flows[num_flows++] = nb;
-						if (nb.t == NEIGHBOR_LOWER)
-							flowing_down = true;
-					}
-					break;
-			}
-		}
-
-		/*
-			decide on the type (and possibly level) of the current node
-		 */
-		content_t new_node_content;
-		s8 new_node_level = -1;
-		s8 max_node_level = -1;
-
-		u8 range = m_nodedef->get(liquid_kind).liquid_range;
-		if (range > LIQUID_LEVEL_MAX + 1)
-			range = LIQUID_LEVEL_MAX + 1;
-
-		if ((num_sources >= 2 && m_nodedef->get(liquid_kind).liquid_renewable) || liquid_type == LIQUID_SOURCE) {
-			// liquid_kind will be set to either the flowing alternative of the node (if it's a liquid)
-			// or the flowing alternative of the first of the surrounding sources (if it's air), so
-			// it's perfectly safe to use liquid_kind here to determine the new node content.
-			new_node_content = m_nodedef->getId(m_nodedef->get(liquid_kind).liquid_alternative_source);
-		} else if (num_sources >= 1 && sources[0].t != NEIGHBOR_LOWER) {
-			// liquid_kind is set properly, see above
-			max_node_level = new_node_level = LIQUID_LEVEL_MAX;
-			if (new_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-		} else if (ignored_sources && liquid_level >= 0) {
-			// Maybe there are neighbouring sources that aren't loaded yet
-			// so prevent flowing away.
-			new_node_level = liquid_level;
-			new_node_content = liquid_kind;
-		} else {
-			// no surrounding sources, so get the maximum level that can flow into this node
-			for (u16 i = 0; i < num_flows; i++) {
-				u8 nb_liquid_level = (flows[i].n.param2 & LIQUID_LEVEL_MASK);
-				switch (flows[i].t) {
-					case NEIGHBOR_UPPER:
-						if (nb_liquid_level + WATER_DROP_BOOST > max_node_level) {
-							max_node_level = LIQUID_LEVEL_MAX;
-							if (nb_liquid_level + WATER_DROP_BOOST < LIQUID_LEVEL_MAX)
-								max_node_level = nb_liquid_level + WATER_DROP_BOOST;
-						} else if (nb_liquid_level > max_node_level) {
-							max_node_level = nb_liquid_level;
-						}
-						break;
-					case NEIGHBOR_LOWER:
-						break;
-					case NEIGHBOR_SAME_LEVEL:
-						if ((flows[i].n.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK &&
-								nb_liquid_level > 0 && nb_liquid_level - 1 > max_node_level)
-							max_node_level = nb_liquid_level - 1;
-						break;
-				}
-			}
-
-			u8 viscosity = m_nodedef->get(liquid_kind).liquid_viscosity;
-			if (viscosity > 1 && max_node_level != liquid_level) {
-				// amount to gain, limited by viscosity
-				// must be at least 1 in absolute value
-				s8 level_inc = max_node_level - liquid_level;
-				if (level_inc < -viscosity || level_inc > viscosity)
-					new_node_level = liquid_level + level_inc/viscosity;
-				else if (level_inc < 0)
-					new_node_level = liquid_level - 1;
-				else if (level_inc > 0)
-					new_node_level = liquid_level + 1;
-				if (new_node_level != max_node_level)
-					must_reflow.push_back(p0);
-			} else {
-				new_node_level = max_node_level;
-			}
-
-			if (max_node_level >= (LIQUID_LEVEL_MAX + 1 - range))
-				new_node_content = liquid_kind;
-			else
-				new_node_content = floodable_node;
-
-		}
+	/*
+		Compute the new state of the queued nodes. Nodes queued while
+		applying it are left for the next step.
+	*/
+	m_liquid_nodes.clear();
+	m_liquid_block_ends.clear();
+	m_transforming_liquid.popBlocks(loop_max, m_liquid_nodes,
+			m_liquid_block_ends);
+	m_liquid_updates.resize(m_liquid_nodes.size());
+	m_liquid_next_block = 0;
+
+	if (!m_liquid_threads_started)
+		startLiquidThreads();
+
+	if (!m_liquid_threads.empty() && m_liquid_block_ends.size() > 1 &&
+			m_liquid_nodes.size() >= LIQUID_PARALLEL_MIN_NODES) {
+		for (size_t i = 0; i < m_liquid_threads.size(); i++)
+			m_liquid_threads[i]->m_start.post();
+		computeLiquidUpdates();
+		for (size_t i = 0; i < m_liquid_threads.size(); i++)
+			m_liquid_done.wait();
+	} else {
+		computeLiquidUpdates();
+	}
 
-		/*
-			check if anything has changed. if not, just continue with the next node.
-		 */
-		if (new_node_content == n0.getContent() &&
-				(m_nodedef->get(n0.getContent()).liquid_type != LIQUID_FLOWING ||
-				((n0.param2 & LIQUID_LEVEL_MASK) == (u8)new_node_level &&
-				((n0.param2 & LIQUID_FLOW_DOWN_MASK) == LIQUID_FLOW_DOWN_MASK)
-				== flowing_down)))
+	/*
+		Apply it
+	*/
+	for (size_t k = 0; k < m_liquid_updates.size(); k++) {
+		const LiquidUpdate &u = m_liquid_updates[k];
+		v3s16 p0 = u.p;
+
+		for (u8 i = 0; i < u.num_queue; i++)
+			m_transforming_liquid.push_back(u.queue[i]);
+		if (u.reflow)
+			must_reflow.push_back(p0);
+		if (!u.changed)
 			continue;
 
-
-		/*
-			update the current node
-		 */
-		MapNode n00 = n0;
-		//bool flow_down_enabled = (flowing_down && ((n0.param2 & LIQUID_FLOW_DOWN_MASK) != LIQUID_FLOW_DOWN_MASK));
-		if (m_nodedef->get(new_node_content).liquid_type == LIQUID_FLOWING) {
-			// set level to last 3 bits, flowing down bit to 4th bit
-			n0.param2 = (flowing_down ? LIQUID_FLOW_DOWN_MASK : 0x00) | (new_node_level & LIQUID_LEVEL_MASK);
-		} else {
-			// set the liquid level and flow bit to 0
-			n0.param2 = ~(LIQUID_LEVEL_MASK | LIQUID_FLOW_DOWN_MASK);
+		// A callback may have changed the node since, try again later
+		MapNode n_current = getNodeNoEx(p0);
+		if (n_current.getContent() != u.n_old.getContent() ||
+				n_current.param2 != u.n_old.param2) {
+			m_transforming_liquid.push_back(p0);
+			continue;
 		}
 
-		// change the node.
-		n0.setContent(new_node_content);
+		MapNode n00 = u.n_old;
+		MapNode n0 = u.n_new;
 
 		// on_flood() the node
-		if (floodable_node != CONTENT_AIR) {
+		if (u.flood) {
 			if (env->getScriptIface()->node_on_flood(p0, n00, n0))
 				continue;
 		}
@@ -945,25 +1245,9 @@ void Map::transformLiquids(std::map<v3s16, MapBlock*> &modified_blocks,
 		/*
 			enqueue neighbors for update if neccessary
 		 */
-		switch (m_nodedef->get(n0.getContent()).liquid_type) {
-			case LIQUID_SOURCE:
-			case LIQUID_FLOWING:
-				// make sure source flows into all neighboring nodes
-				for (u16 i = 0; i < num_flows; i++)
-					if (flows[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(flows[i].p);
-				for (u16 i = 0; i < num_airs; i++)
-					if (airs[i].t != NEIGHBOR_UPPER)
-						m_transforming_liquid.push_back(airs[i].p);
-				break;
-			case LIQUID_NONE:
-				// this flow has turned to air; neighboring flows might need to do the same
-				for (u16 i = 0; i < num_flows; i++)
-					m_transforming_liquid.push_back(flows[i].p);
-				break;
-		}
+		for (u8 i = 0; i < u.num_queue_changed; i++)
+			m_transforming_liquid.push_back(u.queue_changed[i]);
 	}
-	//infostream<<"Map::transformLiquids(): loopcount="<<loopcount<<std::endl;
 
 	for (std::deque<v3s16>::iterator iter = must_reflow.begin(); iter != must_reflow.end(); ++iter)
 		m_transforming_liquid.push_back(*iter);
@@ -1241,7 +1525,8 @@ ServerMap::ServerMap(const std::string &savedir, IGameDef *gamedef,
 	Map(dout_server, gamedef),
 	settings_mgr(g_settings, savedir + DIR_DELIM + "map_meta.txt"),
 	m_emerge(emerge),
-	m_map_metadata_changed(true)
+	m_map_metadata_changed(true),
+	m_node_timer_wheel(g_settings->getFloat("nodetimer_interval"))
 {
 	verbosestream<<FUNCTION_NAME<<std::endl;
 
@@ -2337,8 +2622,9 @@ bool ServerMap::saveBlock(MapBlock *block, MapDatabase *db)
 		return true;
 	}
 
-	// Format used for writing
-	u8 version = SER_FMT_VER_HIGHEST_WRITE;
+	// Format used for writing. Only uniform blocks differ in version 29.
+	u8 version = block->isUniform() ?
+		SER_FMT_VER_HIGHEST_WRITE : SER_FMT_VER_COMPAT_WRITE;
 
 	/*
 		[0] u8 serialization version
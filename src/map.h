@@ -35,6 +35,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/cpp11_container.h"
 #include "nodetimer.h"
 #include "map_settings_manager.h"
+#include "mapblock_index.h"
+#include "liquid_queue.h"
+#include "threading/atomic.h"
+#include "threading/semaphore.h"
 
 class Settings;
 class MapDatabase;
@@ -48,6 +52,8 @@ class IRollbackManager;
 class EmergeManager;
 class ServerEnvironment;
 struct BlockMakeData;
+class LiquidThread;
+class LiquidNodeReader;
 
 /*
 	MapEditEvent
@@ -217,6 +223,23 @@ class Map /*: public NodeContainer*/
 	void removeNodeAndUpdate(v3s16 p,
 			std::map<v3s16, MapBlock*> &modified_blocks);
 
+	/*
+		Lighting batches. While one is open, addNodeAndUpdate() only
+		remembers which nodes changed, and the light of all of them is
+		updated in one pass when the outermost batch ends. Until then
+		the changed nodes have no light.
+		The blocks changed by that pass are sent out as a MEET_OTHER
+		event.
+	*/
+	void beginLightingBatch();
+	// Returns false if no batch was open
+	bool endLightingBatch();
+	// Updates the light of the nodes changed so far, keeps batches open
+	void flushLightingBatch();
+	// Ends all open batches, returns how many there were
+	u32 endAllLightingBatches();
+	u32 getLightingBatchDepth() const { return m_light_batch_depth; }
+
 	/*
 		Wrappers for the latter ones.
 		These emit events.
@@ -225,6 +248,14 @@ class Map /*: public NodeContainer*/
 	bool addNodeWithEvent(v3s16 p, MapNode n, bool remove_metadata = true);
 	bool removeNodeWithEvent(v3s16 p);
 
+	/*
+		Sets n at all positions with a single light update and a single
+		MEET_OTHER event. Positions that aren't loaded are skipped.
+		Returns the number of nodes set.
+	*/
+	u32 setNodesWithEvent(const std::vector<v3s16> &positions,
+			const MapNode &n, bool remove_metadata = true);
+
 	/*
 		Takes the blocks at the edges into account
 	*/
@@ -318,6 +349,8 @@ class Map /*: public NodeContainer*/
 	bool isBlockOccluded(MapBlock *block, v3s16 cam_pos_nodes);
 protected:
 	friend class LuaVoxelManip;
+	// Keeps m_block_index up to date
+	friend class MapSector;
 
 	std::ostream &m_dout; // A bit deprecated, could be removed
 
@@ -331,16 +364,84 @@ class Map /*: public NodeContainer*/
 	MapSector *m_sector_cache;
 	v2s16 m_sector_cache_p;
 
+	// All blocks of all sectors, for fast lookups by position
+	MapBlockIndex m_block_index;
+
 	// Queued transforming water nodes
-	UniqueQueue<v3s16> m_transforming_liquid;
+	LiquidQueue m_transforming_liquid;
 
 	// This stores the properties of the nodes on the map.
 	INodeDefManager *m_nodedef;
 
+	// Blocks unused for this long are compacted, 0 = never
+	float m_compact_timeout;
+
+	// Number of open lighting batches
+	u32 m_light_batch_depth;
+	// Nodes changed in the current batch, with their old node
+	std::vector<std::pair<v3s16, MapNode> > m_light_batch_nodes;
+	UNORDERED_SET<u64> m_light_batch_positions;
+
 	bool isOccluded(v3s16 p0, v3s16 p1, float step, float stepfac,
 			float start_off, float end_off, u32 needed_count);
 
 private:
+	void compactIfUnused(MapBlock *block, float dtime);
+
+	// Updates the light of the nodes in the lighting batch, keeps it open
+	void updateBatchLighting(std::map<v3s16, MapBlock*> &modified_blocks);
+	// Ends the batch of setNodesWithEvent() and sends out the changes
+	void endSetNodes(bool own_batch,
+		std::map<v3s16, MapBlock*> &modified_blocks);
+
+	/*
+		Liquids are transformed in two phases. First the new state of
+		the nodes taken from the queue is computed from the unchanged
+		map, one block at a time and in parallel if there is enough to
+		do. Then the changes are applied in queue order, which is where
+		callbacks run and neighbors get queued.
+	*/
+	friend class LiquidThread;
+
+	// Result of the first phase for one node
+	struct LiquidUpdate
+	{
+		v3s16 p;
+		// The node at computation time and the one to set
+		MapNode n_old;
+		MapNode n_new;
+		// n_new differs from n_old
+		bool changed;
+		// on_flood() needs to be called before setting n_new
+		bool flood;
+		// The level was limited by viscosity
+		bool reflow;
+		// Neighbors to queue in any case
+		u8 num_queue;
+		v3s16 queue[6];
+		// Neighbors to queue if n_new was set
+		u8 num_queue_changed;
+		v3s16 queue_changed[6];
+	};
+
+	// Computes m_liquid_updates for blocks until none are left
+	void computeLiquidUpdates();
+	// Only reads the map
+	void computeLiquidUpdate(v3s16 p0, LiquidUpdate &u,
+			LiquidNodeReader &reader);
+	void startLiquidThreads();
+
+	std::vector<LiquidThread *> m_liquid_threads;
+	bool m_liquid_threads_started;
+	// Posted by the threads when they are done with a step
+	Semaphore m_liquid_done;
+	// Nodes of the current step, grouped by block
+	std::vector<v3s16> m_liquid_nodes;
+	std::vector<u32> m_liquid_block_ends;
+	std::vector<LiquidUpdate> m_liquid_updates;
+	// Next block of the current step to compute
+	Atomic<u32> m_liquid_next_block;
+
 	f32 m_transforming_liquid_loop_count_multiplier;
 	u32 m_unprocessed_count;
 	u64 m_inc_trending_up_start_time; // milliseconds
@@ -485,6 +586,9 @@ class ServerMap : public Map
 	bool repairBlockLight(v3s16 blockpos,
 		std::map<v3s16, MapBlock *> *modified_blocks);
 
+	// Clock of the node timers of the active blocks
+	NodeTimerWheel &getNodeTimerWheel() { return m_node_timer_wheel; }
+
 	MapSettingsManager settings_mgr;
 
 private:
@@ -508,6 +612,8 @@ class ServerMap : public Map
 	*/
 	bool m_map_metadata_changed;
 	MapDatabase *dbase;
+
+	NodeTimerWheel m_node_timer_wheel;
 };
 
 
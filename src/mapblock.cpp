@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapblock.h"
 
+#include <algorithm>
 #include <sstream>
 #include "map.h"
 #include "light.h"
@@ -83,6 +84,8 @@ MapBlock::MapBlock(Map *parent, v3s16 pos, IGameDef *gamedef, bool dummy):
 		m_refcount(0)
 {
 	data = NULL;
+	m_compact = NULL;
+	m_uniform = UNIFORM_UNKNOWN;
 	if(dummy == false)
 		reallocate();
 
@@ -107,6 +110,7 @@ MapBlock::~MapBlock()
 
 	if(data)
 		delete[] data;
+	delete m_compact;
 }
 
 bool MapBlock::isValidPositionParent(v3s16 p)
@@ -125,14 +129,92 @@ MapNode MapBlock::getNodeParent(v3s16 p, bool *is_valid_position)
 	if (isValidPosition(p) == false)
 		return m_parent->getNodeNoEx(getPosRelative() + p, is_valid_position);
 
-	if (data == NULL) {
+	if (isDummy()) {
 		if (is_valid_position)
 			*is_valid_position = false;
 		return MapNode(CONTENT_IGNORE);
 	}
 	if (is_valid_position)
 		*is_valid_position = true;
-	return data[p.Z * zstride + p.Y * ystride + p.X];
+	return getNodeUnsafe(p);
+}
+
+void MapBlock::compact()
+{
+	if (!data)
+		return;
+
+	if (m_uniform == UNIFORM_YES)
+		m_compact = CompactNodeData::createUniform(m_uniform_node);
+	else
+		m_compact = CompactNodeData::create(data);
+	if (m_compact) {
+		delete[] data;
+		data = NULL;
+		if (m_compact->isUniform()) {
+			m_uniform = UNIFORM_YES;
+			m_uniform_node = m_compact->get(0);
+		}
+	}
+}
+
+void MapBlock::expand()
+{
+	if (!m_compact)
+		return;
+
+	data = new MapNode[nodecount];
+	m_compact->decompress(data);
+	delete m_compact;
+	m_compact = NULL;
+}
+
+bool MapBlock::isUniform()
+{
+	if (m_uniform != UNIFORM_UNKNOWN)
+		return m_uniform == UNIFORM_YES;
+
+	if (m_compact) {
+		m_uniform = m_compact->isUniform() ? UNIFORM_YES : UNIFORM_NO;
+		m_uniform_node = m_compact->get(0);
+	} else if (data) {
+		m_uniform = UNIFORM_YES;
+		m_uniform_node = data[0];
+		for (u32 i = 1; i < nodecount; i++) {
+			if (!(m_uniform_node == data[i])) {
+				m_uniform = UNIFORM_NO;
+				break;
+			}
+		}
+	} else {
+		return false;
+	}
+	return m_uniform == UNIFORM_YES;
+}
+
+void MapBlock::fillNodes(const MapNode &n)
+{
+	if (m_compact) {
+		delete m_compact;
+		m_compact = CompactNodeData::createUniform(n);
+	} else {
+		if (!data)
+			data = new MapNode[nodecount];
+		for (u32 i = 0; i < nodecount; i++)
+			data[i] = n;
+	}
+	m_uniform = UNIFORM_YES;
+	m_uniform_node = n;
+	raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
+}
+
+size_t MapBlock::getNodeMemoryUsage()
+{
+	if (m_compact)
+		return m_compact->getMemoryUsage();
+	if (data)
+		return nodecount * sizeof(MapNode);
+	return 0;
 }
 
 std::string MapBlock::getModifiedReasonString()
@@ -356,6 +438,19 @@ void MapBlock::copyTo(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	if (m_compact) {
+		// Decode rows straight into the VoxelManipulator
+		v3s16 p = getPosRelative();
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE; y++) {
+			s32 i = dst.m_area.index(p.X, p.Y + y, p.Z + z);
+			m_compact->decompressRange(z * zstride + y * ystride,
+					MAP_BLOCKSIZE, &dst.m_data[i]);
+			memset(&dst.m_flags[i], 0, MAP_BLOCKSIZE);
+		}
+		return;
+	}
+
 	// Copy from data to VoxelManipulator
 	dst.copyFrom(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
@@ -366,9 +461,48 @@ void MapBlock::copyFrom(VoxelManipulator &dst)
 	v3s16 data_size(MAP_BLOCKSIZE, MAP_BLOCKSIZE, MAP_BLOCKSIZE);
 	VoxelArea data_area(v3s16(0,0,0), data_size - v3s16(1,1,1));
 
+	if (m_compact) {
+		/*
+			A block that is compact already stays compact if the new
+			content is a single node. If nothing is CONTENT_IGNORE, all
+			nodes are overwritten and don't need to be decoded first.
+		*/
+		v3s16 p = getPosRelative();
+		MapNode first = dst.m_data[dst.m_area.index(p)];
+		bool uniform = true;
+		bool has_ignore = false;
+		for (s16 z = 0; z < MAP_BLOCKSIZE && !has_ignore; z++)
+		for (s16 y = 0; y < MAP_BLOCKSIZE && !has_ignore; y++) {
+			const MapNode *row = &dst.m_data[
+					dst.m_area.index(p.X, p.Y + y, p.Z + z)];
+			for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+				if (row[x].getContent() == CONTENT_IGNORE) {
+					has_ignore = true;
+					break;
+				}
+				uniform &= first == row[x];
+			}
+		}
+
+		if (!has_ignore) {
+			delete m_compact;
+			m_compact = NULL;
+			if (uniform) {
+				m_compact = CompactNodeData::createUniform(first);
+				m_uniform = UNIFORM_YES;
+				m_uniform_node = first;
+				return;
+			}
+			data = new MapNode[nodecount];
+		} else {
+			expand();
+		}
+	}
+
 	// Copy from VoxelManipulator to data
 	dst.copyTo(data, data_area, v3s16(0,0,0),
 			getPosRelative(), data_size);
+	m_uniform = UNIFORM_UNKNOWN;
 }
 
 void MapBlock::actuallyUpdateDayNightDiff()
@@ -378,7 +512,7 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	// Running this function un-expires m_day_night_differs
 	m_day_night_differs_expired = false;
 
-	if (data == NULL) {
+	if (isDummy()) {
 		m_day_night_differs = false;
 		return;
 	}
@@ -389,7 +523,7 @@ void MapBlock::actuallyUpdateDayNightDiff()
 		Check if any lighting value differs
 	*/
 	for (u32 i = 0; i < nodecount; i++) {
-		MapNode &n = data[i];
+		MapNode n = m_compact ? m_compact->get(i) : data[i];
 
 		differs = !n.isLightDayNightEq(nodemgr);
 		if (differs)
@@ -403,7 +537,7 @@ void MapBlock::actuallyUpdateDayNightDiff()
 	if (differs) {
 		bool only_air = true;
 		for (u32 i = 0; i < nodecount; i++) {
-			MapNode &n = data[i];
+			MapNode n = m_compact ? m_compact->get(i) : data[i];
 			if (n.getContent() != CONTENT_AIR) {
 				only_air = false;
 				break;
@@ -421,7 +555,7 @@ void MapBlock::expireDayNightDiff()
 {
 	//INodeDefManager *nodemgr = m_gamedef->ndef();
 
-	if(data == NULL){
+	if(isDummy()){
 		m_day_night_differs = false;
 		m_day_night_differs_expired = false;
 		return;
@@ -467,13 +601,13 @@ s16 MapBlock::getGroundLevel(v2s16 p2d)
 // mapblocks.
 static content_t getBlockNodeIdMapping_mapping[USHRT_MAX + 1];
 static void getBlockNodeIdMapping(NameIdMapping *nimap, MapNode *nodes,
-		INodeDefManager *nodedef)
+		u32 count, INodeDefManager *nodedef)
 {
 	memset(getBlockNodeIdMapping_mapping, 0xFF, (USHRT_MAX + 1) * sizeof(content_t));
 
 	std::set<content_t> unknown_contents;
 	content_t id_counter = 0;
-	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+	for (u32 i = 0; i < count; i++) {
 		content_t global_id = nodes[i].getContent();
 		content_t id = CONTENT_IGNORE;
 
@@ -509,7 +643,7 @@ static void getBlockNodeIdMapping(NameIdMapping *nimap, MapNode *nodes,
 // Unknown ones are added to nodedef.
 // Will not update itself to match id-name pairs in nodedef.
 static void correctBlockNodeIds(const NameIdMapping *nimap, MapNode *nodes,
-		IGameDef *gamedef)
+		u32 count, IGameDef *gamedef)
 {
 	INodeDefManager *nodedef = gamedef->ndef();
 	// This means the block contains incorrect ids, and we contain
@@ -518,7 +652,7 @@ static void correctBlockNodeIds(const NameIdMapping *nimap, MapNode *nodes,
 	// correct ids.
 	std::set<content_t> unnamed_contents;
 	std::set<std::string> unallocatable_contents;
-	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+	for (u32 i = 0; i < count; i++) {
 		content_t local_id = nodes[i].getContent();
 		std::string name;
 		bool found = nimap->getName(local_id, name);
@@ -559,13 +693,15 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk,
 	if(!ser_ver_supported(version))
 		throw VersionMismatchException("ERROR: MapBlock format not supported");
 
-	if(data == NULL)
+	if(isDummy())
 	{
 		throw SerializationError("ERROR: Not writing dummy block.");
 	}
 
 	FATAL_ERROR_IF(version < SER_FMT_VER_LOWEST_WRITE, "Serialisation version error");
 
+	bool uniform = version >= 29 && isUniform();
+
 	// First byte
 	u8 flags = 0;
 	if(is_underground)
@@ -574,6 +710,8 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk,
 		flags |= 0x02;
 	if(m_generated == false)
 		flags |= 0x08;
+	if (uniform)
+		flags |= 0x10;
 	writeU8(os, flags);
 	if (version >= 27) {
 		writeU16(os, m_lighting_complete);
@@ -583,12 +721,21 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk,
 		Bulk node data
 	*/
 	NameIdMapping nimap;
-	if(disk)
+	if (uniform)
+	{
+		// Only the single node, uncompressed
+		MapNode n = m_uniform_node;
+		if (disk)
+			getBlockNodeIdMapping(&nimap, &n, 1, m_gamedef->ndef());
+		writeU16(os, n.getContent());
+		writeU8(os, n.getParam1());
+		writeU8(os, n.getParam2());
+	}
+	else if(disk)
 	{
 		MapNode *tmp_nodes = new MapNode[nodecount];
-		for(u32 i=0; i<nodecount; i++)
-			tmp_nodes[i] = data[i];
-		getBlockNodeIdMapping(&nimap, tmp_nodes, m_gamedef->ndef());
+		getNodes(tmp_nodes);
+		getBlockNodeIdMapping(&nimap, tmp_nodes, nodecount, m_gamedef->ndef());
 
 		u8 content_width = 2;
 		u8 params_width = 2;
@@ -604,8 +751,16 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk,
 		u8 params_width = 2;
 		writeU8(os, content_width);
 		writeU8(os, params_width);
-		MapNode::serializeBulk(os, version, data, nodecount,
-				content_width, params_width, true);
+		if (m_compact) {
+			MapNode *tmp_nodes = new MapNode[nodecount];
+			m_compact->decompress(tmp_nodes);
+			MapNode::serializeBulk(os, version, tmp_nodes, nodecount,
+					content_width, params_width, true);
+			delete[] tmp_nodes;
+		} else {
+			MapNode::serializeBulk(os, version, data, nodecount,
+					content_width, params_width, true);
+		}
 	}
 
 	/*
@@ -643,7 +798,7 @@ void MapBlock::serialize(std::ostream &os, u8 version, bool disk,
 
 void MapBlock::serializeNetworkSpecific(std::ostream &os)
 {
-	if (!data) {
+	if (isDummy()) {
 		throw SerializationError("ERROR: Not writing dummy block.");
 	}
 
@@ -659,6 +814,14 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())<<std::endl);
 
+	// All nodes are overwritten
+	if (m_compact) {
+		delete m_compact;
+		m_compact = NULL;
+		data = new MapNode[nodecount];
+	}
+	m_uniform = UNIFORM_UNKNOWN;
+
 	m_day_night_differs_expired = false;
 
 	if(version <= 21)
@@ -675,20 +838,28 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 	else
 		m_lighting_complete = readU16(is);
 	m_generated = (flags & 0x08) ? false : true;
+	bool uniform = version >= 29 && (flags & 0x10);
 
 	/*
 		Bulk node data
 	*/
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 			<<": Bulk node data"<<std::endl);
-	u8 content_width = readU8(is);
-	u8 params_width = readU8(is);
-	if(content_width != 1 && content_width != 2)
-		throw SerializationError("MapBlock::deSerialize(): invalid content_width");
-	if(params_width != 2)
-		throw SerializationError("MapBlock::deSerialize(): invalid params_width");
-	MapNode::deSerializeBulk(is, version, data, nodecount,
-			content_width, params_width, true);
+	MapNode uniform_node;
+	if (uniform) {
+		uniform_node.setContent(readU16(is));
+		uniform_node.setParam1(readU8(is));
+		uniform_node.setParam2(readU8(is));
+	} else {
+		u8 content_width = readU8(is);
+		u8 params_width = readU8(is);
+		if(content_width != 1 && content_width != 2)
+			throw SerializationError("MapBlock::deSerialize(): invalid content_width");
+		if(params_width != 2)
+			throw SerializationError("MapBlock::deSerialize(): invalid params_width");
+		MapNode::deSerializeBulk(is, version, data, nodecount,
+				content_width, params_width, true);
+	}
 
 	/*
 		NodeMetadata
@@ -744,7 +915,10 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 				<<": NameIdMapping"<<std::endl);
 		NameIdMapping nimap;
 		nimap.deSerialize(is);
-		correctBlockNodeIds(&nimap, data, m_gamedef);
+		if (uniform)
+			correctBlockNodeIds(&nimap, &uniform_node, 1, m_gamedef);
+		else
+			correctBlockNodeIds(&nimap, data, nodecount, m_gamedef);
 
 		if(version >= 25){
 			TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
@@ -753,6 +927,13 @@ void MapBlock::deSerialize(std::istream &is, u8 version, bool disk)
 		}
 	}
 
+	if (uniform) {
+		for (u32 i = 0; i < nodecount; i++)
+			data[i] = uniform_node;
+		m_uniform = UNIFORM_YES;
+		m_uniform_node = uniform_node;
+	}
+
 	TRACESTREAM(<<"MapBlock::deSerialize "<<PP(getPos())
 			<<": Done."<<std::endl);
 }
@@ -775,6 +956,22 @@ void MapBlock::deSerializeNetworkSpecific(std::istream &is)
 	}
 }
 
+void MapBlock::swapDeserializedData(MapBlock *block)
+{
+	assert(block->m_pos == m_pos);
+
+	std::swap(data, block->data);
+	std::swap(m_compact, block->m_compact);
+	std::swap(m_uniform, block->m_uniform);
+	std::swap(m_uniform_node, block->m_uniform_node);
+	std::swap(is_underground, block->is_underground);
+	std::swap(m_lighting_complete, block->m_lighting_complete);
+	std::swap(m_day_night_differs, block->m_day_night_differs);
+	std::swap(m_day_night_differs_expired, block->m_day_night_differs_expired);
+	std::swap(m_generated, block->m_generated);
+	m_node_metadata.swap(block->m_node_metadata);
+}
+
 /*
 	Legacy serialization
 */
@@ -938,7 +1135,7 @@ void MapBlock::deSerialize_pre22(std::istream &is, u8 version, bool disk)
 		} else {
 			content_mapnode_get_name_id_mapping(&nimap);
 		}
-		correctBlockNodeIds(&nimap, data, m_gamedef);
+		correctBlockNodeIds(&nimap, data, nodecount, m_gamedef);
 	}
 
 
@@ -24,6 +24,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "debug.h"
 #include "irr_v3d.h"
 #include "mapnode.h"
+#include "mapblock_compact.h"
 #include "exceptions.h"
 #include "constants.h"
 #include "staticobject.h"
@@ -148,18 +149,78 @@ class MapBlock /*: public NodeContainer*/
 	void reallocate()
 	{
 		delete[] data;
+		delete m_compact;
+		m_compact = NULL;
 		data = new MapNode[nodecount];
 		for (u32 i = 0; i < nodecount; i++)
 			data[i] = MapNode(CONTENT_IGNORE);
+		m_uniform = UNIFORM_YES;
+		m_uniform_node = MapNode(CONTENT_IGNORE);
 
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_REALLOCATE);
 	}
 
+	// Expands a compact block
 	MapNode* getData()
 	{
+		if (m_compact)
+			expand();
+		// The caller may write anything
+		m_uniform = UNIFORM_UNKNOWN;
 		return data;
 	}
 
+	// Copies all nodes to dst without expanding a compact block
+	void getNodes(MapNode *dst)
+	{
+		if (m_compact)
+			m_compact->decompress(dst);
+		else if (data)
+			memcpy(dst, data, nodecount * sizeof(MapNode));
+	}
+
+	////
+	//// Compact node storage
+	////
+
+	/*
+		Blocks that are not being modified can store their nodes in a
+		CompactNodeData instead of the plain array. Reads decode from it,
+		anything that writes or needs the array expands the block again.
+	*/
+
+	// Does nothing if the compact form wouldn't save memory
+	void compact();
+	void expand();
+
+	inline bool isCompact()
+	{
+		return m_compact != NULL;
+	}
+
+	// Approximate memory used for the nodes
+	size_t getNodeMemoryUsage();
+
+	////
+	//// Uniform blocks
+	////
+
+	/*
+		Whether all nodes of the block are the same, including param1 and
+		param2. Writes through setNode() keep this up to date, after raw
+		access to the node array the block is scanned again on demand.
+	*/
+	bool isUniform();
+
+	// The node the whole block consists of, only valid if isUniform()
+	inline MapNode getUniformNode()
+	{
+		return m_uniform_node;
+	}
+
+	// Sets all nodes to n
+	void fillNodes(const MapNode &n);
+
 	////
 	//// Modification tracking methods
 	////
@@ -199,7 +260,7 @@ class MapBlock /*: public NodeContainer*/
 
 	inline bool isDummy()
 	{
-		return (data == NULL);
+		return (data == NULL && m_compact == NULL);
 	}
 
 	inline void unDummify()
@@ -299,7 +360,7 @@ class MapBlock /*: public NodeContainer*/
 
 	inline bool isValidPosition(s16 x, s16 y, s16 z)
 	{
-		return data != NULL
+		return !isDummy()
 			&& x >= 0 && x < MAP_BLOCKSIZE
 			&& y >= 0 && y < MAP_BLOCKSIZE
 			&& z >= 0 && z < MAP_BLOCKSIZE;
@@ -317,6 +378,8 @@ class MapBlock /*: public NodeContainer*/
 		if (!*valid_position)
 			return MapNode(CONTENT_IGNORE);
 
+		if (m_compact)
+			return m_compact->get(z * zstride + y * ystride + x);
 		return data[z * zstride + y * ystride + x];
 	}
 
@@ -336,7 +399,10 @@ class MapBlock /*: public NodeContainer*/
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
+		if (m_compact)
+			expand();
 		data[z * zstride + y * ystride + x] = n;
+		updateUniform(n);
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE);
 	}
 
@@ -351,10 +417,12 @@ class MapBlock /*: public NodeContainer*/
 
 	inline MapNode getNodeNoCheck(s16 x, s16 y, s16 z, bool *valid_position)
 	{
-		*valid_position = data != NULL;
+		*valid_position = !isDummy();
 		if (!valid_position)
 			return MapNode(CONTENT_IGNORE);
 
+		if (m_compact)
+			return m_compact->get(z * zstride + y * ystride + x);
 		return data[z * zstride + y * ystride + x];
 	}
 
@@ -369,22 +437,27 @@ class MapBlock /*: public NodeContainer*/
 	//// Caller must ensure that this is not a dummy block (by calling isDummy())
 	////
 
-	inline const MapNode &getNodeUnsafe(s16 x, s16 y, s16 z)
+	inline MapNode getNodeUnsafe(s16 x, s16 y, s16 z)
 	{
+		if (m_compact)
+			return m_compact->get(z * zstride + y * ystride + x);
 		return data[z * zstride + y * ystride + x];
 	}
 
-	inline const MapNode &getNodeUnsafe(v3s16 &p)
+	inline MapNode getNodeUnsafe(v3s16 &p)
 	{
 		return getNodeUnsafe(p.X, p.Y, p.Z);
 	}
 
 	inline void setNodeNoCheck(s16 x, s16 y, s16 z, MapNode & n)
 	{
-		if (data == NULL)
+		if (isDummy())
 			throw InvalidPositionException();
 
+		if (m_compact)
+			expand();
 		data[z * zstride + y * ystride + x] = n;
+		updateUniform(n);
 		raiseModified(MOD_STATE_WRITE_NEEDED, MOD_REASON_SET_NODE_NO_CHECK);
 	}
 
@@ -551,6 +624,10 @@ class MapBlock /*: public NodeContainer*/
 
 	void serializeNetworkSpecific(std::ostream &os);
 	void deSerializeNetworkSpecific(std::istream &is);
+
+	// Exchanges everything deSerialize() reads from the network with block,
+	// which is at the same position
+	void swapDeserializedData(MapBlock *block);
 private:
 	/*
 		Private methods
@@ -567,6 +644,9 @@ class MapBlock /*: public NodeContainer*/
 		if (!isValidPosition(x, y, z))
 			throw InvalidPositionException();
 
+		if (m_compact)
+			expand();
+		m_uniform = UNIFORM_UNKNOWN;
 		return data[z * zstride + y * ystride + x];
 	}
 
@@ -575,6 +655,13 @@ class MapBlock /*: public NodeContainer*/
 		return getNodeRef(p.X, p.Y, p.Z);
 	}
 
+	// Called after a node was set to n
+	inline void updateUniform(const MapNode &n)
+	{
+		if (m_uniform == UNIFORM_YES && !(m_uniform_node == n))
+			m_uniform = UNIFORM_NO;
+	}
+
 public:
 	/*
 		Public member variables
@@ -614,10 +701,21 @@ class MapBlock /*: public NodeContainer*/
 	IGameDef *m_gamedef;
 
 	/*
-		If NULL, block is a dummy block.
+		If both are NULL, block is a dummy block.
 		Dummy blocks are used for caching not-found-on-disk blocks.
+		At most one of them is set.
 	*/
 	MapNode *data;
+	CompactNodeData *m_compact;
+
+	enum UniformState {
+		UNIFORM_UNKNOWN,
+		UNIFORM_YES,
+		UNIFORM_NO,
+	};
+	// Cached result of isUniform()
+	u8 m_uniform;
+	MapNode m_uniform_node;
 
 	/*
 		- On the server, this is used for telling whether the
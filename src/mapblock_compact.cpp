@@ -0,0 +1,147 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mapblock_compact.h"
+#include "constants.h"
+
+static const u32 NODECOUNT = MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE;
+
+CompactNodeData *CompactNodeData::create(const MapNode *nodes)
+{
+	u8 param1 = nodes[0].param1;
+	u8 param2 = nodes[0].param2;
+	bool uniform_param1 = true;
+	bool uniform_param2 = true;
+
+	// Collect the palette, give up on it after 256 entries
+	std::vector<u16> palette;
+	palette.push_back(nodes[0].getContent());
+	u32 last = 0;
+	for (u32 i = 1; i < NODECOUNT; i++) {
+		const MapNode &n = nodes[i];
+		uniform_param1 &= n.param1 == param1;
+		uniform_param2 &= n.param2 == param2;
+
+		u16 c = n.getContent();
+		if (palette.size() > 256 || palette[last] == c)
+			continue;
+		for (last = 0; last < palette.size(); last++) {
+			if (palette[last] == c)
+				break;
+		}
+		if (last == palette.size())
+			palette.push_back(c);
+	}
+
+	u8 index_bits;
+	if (palette.size() == 1)
+		index_bits = 0;
+	else if (palette.size() <= 16)
+		index_bits = 4;
+	else if (palette.size() <= 256)
+		index_bits = 8;
+	else
+		index_bits = 16;
+
+	u32 size = NODECOUNT * index_bits / 8 +
+		(uniform_param1 ? 0 : NODECOUNT) +
+		(uniform_param2 ? 0 : NODECOUNT);
+	if (size >= NODECOUNT * sizeof(MapNode))
+		return NULL;
+
+	CompactNodeData *d = new CompactNodeData();
+	d->m_index_bits = index_bits;
+	d->m_param1 = param1;
+	d->m_param2 = param2;
+
+	if (index_bits == 16) {
+		d->m_contents.resize(NODECOUNT);
+		for (u32 i = 0; i < NODECOUNT; i++)
+			d->m_contents[i] = nodes[i].getContent();
+	} else {
+		d->m_palette.swap(palette);
+	}
+
+	if (index_bits == 4 || index_bits == 8) {
+		const std::vector<u16> &pal = d->m_palette;
+		d->m_indices.resize(NODECOUNT * index_bits / 8, 0);
+		u8 index = 0;
+		for (u32 i = 0; i < NODECOUNT; i++) {
+			u16 c = nodes[i].getContent();
+			if (pal[index] != c) {
+				for (index = 0; pal[index] != c; index++)
+					;
+			}
+			if (index_bits == 8)
+				d->m_indices[i] = index;
+			else
+				d->m_indices[i >> 1] |= index << ((i & 1) << 2);
+		}
+	}
+
+	if (!uniform_param1) {
+		d->m_param1_plane.resize(NODECOUNT);
+		for (u32 i = 0; i < NODECOUNT; i++)
+			d->m_param1_plane[i] = nodes[i].param1;
+	}
+	if (!uniform_param2) {
+		d->m_param2_plane.resize(NODECOUNT);
+		for (u32 i = 0; i < NODECOUNT; i++)
+			d->m_param2_plane[i] = nodes[i].param2;
+	}
+
+	return d;
+}
+
+CompactNodeData *CompactNodeData::createUniform(const MapNode &n)
+{
+	CompactNodeData *d = new CompactNodeData();
+	d->m_palette.push_back(n.getContent());
+	d->m_param1 = n.param1;
+	d->m_param2 = n.param2;
+	return d;
+}
+
+void CompactNodeData::decompress(MapNode *dst) const
+{
+	decompressRange(0, NODECOUNT, dst);
+}
+
+void CompactNodeData::decompressRange(u32 i, u32 count, MapNode *dst) const
+{
+	if (isUniform()) {
+		MapNode n(m_palette[0], m_param1, m_param2);
+		for (u32 k = 0; k < count; k++)
+			dst[k] = n;
+		return;
+	}
+
+	for (u32 k = 0; k < count; k++)
+		dst[k] = get(i + k);
+}
+
+size_t CompactNodeData::getMemoryUsage() const
+{
+	return sizeof(*this) +
+		m_palette.capacity() * sizeof(u16) +
+		m_indices.capacity() +
+		m_contents.capacity() * sizeof(u16) +
+		m_param1_plane.capacity() +
+		m_param2_plane.capacity();
+}
@@ -0,0 +1,108 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAPBLOCK_COMPACT_HEADER
+#define MAPBLOCK_COMPACT_HEADER
+
+#include <vector>
+#include "irrlichttypes.h"
+#include "mapnode.h"
+#include "util/basic_macros.h"
+
+/*
+	Read-only compact form of the nodes of a MapBlock.
+
+	Content ids are stored as 4 or 8 bit indices into a palette, or as
+	plain 16 bit values if there are more than 256 different ones.
+	param1 and param2 are stored in separate planes, which shrink to a
+	single value if it's the same in the whole block. A block made of a
+	single node needs no per-node storage at all.
+*/
+class CompactNodeData
+{
+public:
+	// Returns NULL if the compact form isn't smaller than the plain array
+	static CompactNodeData *create(const MapNode *nodes);
+
+	// All nodes are n
+	static CompactNodeData *createUniform(const MapNode &n);
+
+	inline MapNode get(u32 i) const
+	{
+		u16 content;
+		switch (m_index_bits) {
+		case 0:
+			content = m_palette[0];
+			break;
+		case 4:
+			content = m_palette[(m_indices[i >> 1] >> ((i & 1) << 2)) & 0x0f];
+			break;
+		case 8:
+			content = m_palette[m_indices[i]];
+			break;
+		default:
+			content = m_contents[i];
+			break;
+		}
+
+		return MapNode(content,
+			m_param1_plane.empty() ? m_param1 : m_param1_plane[i],
+			m_param2_plane.empty() ? m_param2 : m_param2_plane[i]);
+	}
+
+	// Writes all nodes, dst has to hold MAP_BLOCKSIZE^3 nodes
+	void decompress(MapNode *dst) const;
+
+	// Writes count nodes starting at node index i
+	void decompressRange(u32 i, u32 count, MapNode *dst) const;
+
+	bool isUniform() const
+	{
+		return m_index_bits == 0 && m_param1_plane.empty() &&
+			m_param2_plane.empty();
+	}
+
+	// Approximate heap usage in bytes, including this object
+	size_t getMemoryUsage() const;
+
+private:
+	CompactNodeData() :
+		m_index_bits(0),
+		m_param1(0),
+		m_param2(0)
+	{}
+
+	// 0: all nodes have content m_palette[0]
+	// 4, 8: m_indices holds palette indices
+	// 16: m_contents holds the content ids
+	u8 m_index_bits;
+	std::vector<u16> m_palette;
+	std::vector<u8> m_indices;
+	std::vector<u16> m_contents;
+
+	// Planes are empty if all nodes have the same value
+	u8 m_param1;
+	u8 m_param2;
+	std::vector<u8> m_param1_plane;
+	std::vector<u8> m_param2_plane;
+
+	DISABLE_CLASS_COPY(CompactNodeData);
+};
+
+#endif
@@ -0,0 +1,184 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mapblock_index.h"
+#include "threading/atomic.h"
+
+// Must be a power of two
+#define MAPBLOCK_INDEX_MIN_CAPACITY 1024
+
+// Most recently looked up blocks of a thread, most recent first. Only
+// valid while the generation of the looked up index matches.
+struct RecentBlocks
+{
+	u32 generation;
+	u64 keys[MAPBLOCK_INDEX_RECENT];
+	MapBlock *blocks[MAPBLOCK_INDEX_RECENT];
+};
+
+static thread_local RecentBlocks g_recent_blocks;
+// 0 is never used, it marks the RecentBlocks of new threads invalid
+static Atomic<u32> g_next_generation;
+
+MapBlockIndex::MapBlockIndex() :
+	m_mask(0),
+	m_shift(64),
+	m_count(0),
+	m_generation(0)
+{
+	resize(MAPBLOCK_INDEX_MIN_CAPACITY);
+}
+
+u32 MapBlockIndex::find(u64 key) const
+{
+	u32 i = slotOf(key);
+	while (m_slots[i].block && m_slots[i].key != key)
+		i = (i + 1) & m_mask;
+	return i;
+}
+
+MapBlock *MapBlockIndex::get(v3s16 p) const
+{
+	return m_slots[find(packKey(p))].block;
+}
+
+MapBlock *MapBlockIndex::lookup(v3s16 p)
+{
+	u64 key = packKey(p);
+	RecentBlocks &recent = g_recent_blocks;
+
+	if (recent.generation != m_generation) {
+		recent.generation = m_generation;
+		for (u32 i = 0; i < MAPBLOCK_INDEX_RECENT; i++)
+			recent.blocks[i] = NULL;
+	} else if (recent.blocks[0] && recent.keys[0] == key) {
+		return recent.blocks[0];
+	}
+
+	u32 i;
+	for (i = 1; i < MAPBLOCK_INDEX_RECENT; i++) {
+		if (recent.blocks[i] && recent.keys[i] == key)
+			break;
+	}
+
+	MapBlock *block;
+	if (i < MAPBLOCK_INDEX_RECENT) {
+		block = recent.blocks[i];
+	} else {
+		block = m_slots[find(key)].block;
+		if (!block)
+			return NULL;
+		i = MAPBLOCK_INDEX_RECENT - 1;
+	}
+
+	// Move to front
+	for (; i > 0; i--) {
+		recent.keys[i] = recent.keys[i - 1];
+		recent.blocks[i] = recent.blocks[i - 1];
+	}
+	recent.keys[0] = key;
+	recent.blocks[0] = block;
+
+	return block;
+}
+
+void MapBlockIndex::insert(v3s16 p, MapBlock *block)
+{
+	u64 key = packKey(p);
+	u32 i = find(key);
+
+	if (m_slots[i].block) {
+		m_slots[i].block = block;
+		forgetRecent();
+		return;
+	}
+
+	m_slots[i].key = key;
+	m_slots[i].block = block;
+	m_count++;
+
+	// Keep the load factor at or below 1/2
+	if (m_count * 2 > m_slots.size())
+		resize(m_slots.size() * 2);
+}
+
+void MapBlockIndex::remove(v3s16 p)
+{
+	u32 i = find(packKey(p));
+	if (!m_slots[i].block)
+		return;
+
+	forgetRecent();
+
+	// Shift following entries of the cluster back into the hole unless
+	// that would move them in front of their home slot
+	u32 j = i;
+	for (;;) {
+		j = (j + 1) & m_mask;
+		if (!m_slots[j].block)
+			break;
+		u32 home = slotOf(m_slots[j].key);
+		if (((j - home) & m_mask) >= ((j - i) & m_mask)) {
+			m_slots[i] = m_slots[j];
+			i = j;
+		}
+	}
+	m_slots[i].block = NULL;
+	m_count--;
+
+	// Give memory back after large unloads
+	if (m_slots.size() > MAPBLOCK_INDEX_MIN_CAPACITY &&
+			m_count * 8 < m_slots.size())
+		resize(m_slots.size() / 2);
+}
+
+void MapBlockIndex::clear()
+{
+	std::vector<Slot>().swap(m_slots);
+	m_count = 0;
+	resize(MAPBLOCK_INDEX_MIN_CAPACITY);
+}
+
+void MapBlockIndex::resize(u32 capacity)
+{
+	std::vector<Slot> old_slots;
+	old_slots.swap(m_slots);
+
+	Slot empty = {0, NULL};
+	m_slots.resize(capacity, empty);
+	m_mask = capacity - 1;
+	m_shift = 64;
+	for (u32 c = capacity; c > 1; c >>= 1)
+		m_shift--;
+
+	for (std::vector<Slot>::const_iterator it = old_slots.begin();
+			it != old_slots.end(); ++it) {
+		if (it->block)
+			m_slots[find(it->key)] = *it;
+	}
+
+	forgetRecent();
+}
+
+void MapBlockIndex::forgetRecent()
+{
+	do {
+		m_generation = ++g_next_generation;
+	} while (m_generation == 0);
+}
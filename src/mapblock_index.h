@@ -0,0 +1,96 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MAPBLOCK_INDEX_HEADER
+#define MAPBLOCK_INDEX_HEADER
+
+#include <vector>
+#include "irrlichttypes.h"
+#include "irr_v3d.h"
+#include "util/basic_macros.h"
+
+class MapBlock;
+
+#define MAPBLOCK_INDEX_RECENT 4
+
+/*
+	Flat hash table of the loaded MapBlocks of a Map, keyed by block
+	position. Uses linear probing with backward shift deletion, so a
+	lookup is a few probes of one contiguous array.
+
+	The blocks are owned by their MapSectors; this only indexes them.
+	Iteration still goes through the sectors.
+
+	lookup() remembers the most recently used blocks per thread, so that
+	the lookups of one thread don't evict the blocks of another.
+*/
+class MapBlockIndex
+{
+public:
+	MapBlockIndex();
+
+	// Returns NULL if there is no block at p
+	MapBlock *get(v3s16 p) const;
+	// Same as get(), but checks and updates the recently used blocks of
+	// the calling thread first
+	MapBlock *lookup(v3s16 p);
+
+	// Replaces an existing block at the same position
+	void insert(v3s16 p, MapBlock *block);
+	void remove(v3s16 p);
+	void clear();
+
+	u32 size() const { return m_count; }
+	u32 capacity() const { return m_slots.size(); }
+
+private:
+	struct Slot {
+		u64 key;
+		MapBlock *block; // NULL if the slot is free
+	};
+
+	static u64 packKey(v3s16 p)
+	{
+		return ((u64)(u16)p.X << 32) | ((u64)(u16)p.Y << 16) | (u64)(u16)p.Z;
+	}
+
+	u32 slotOf(u64 key) const
+	{
+		// Fibonacci hashing, the top bits of the product are well mixed
+		return (u32)((key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+	}
+
+	// Returns the slot holding key, or the free slot where it would go
+	u32 find(u64 key) const;
+	void resize(u32 capacity);
+	void forgetRecent();
+
+	std::vector<Slot> m_slots;
+	u32 m_mask;
+	u32 m_shift;
+	u32 m_count;
+
+	// Changed by forgetRecent(), which makes every thread forget the
+	// blocks it remembered. Unique among all indexes.
+	u32 m_generation;
+
+	DISABLE_CLASS_COPY(MapBlockIndex);
+};
+
+#endif
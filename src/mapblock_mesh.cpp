@@ -30,6 +30,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shader.h"
 #include "settings.h"
 #include "util/directiontables.h"
+#include "util/greedy_merge.h"
 #include <IMeshManipulator.h>
 
 /*
@@ -42,7 +43,9 @@ MeshMakeData::MeshMakeData(Client *client, bool use_shaders,
 	m_blockpos(-1337,-1337,-1337),
 	m_crack_pos_relative(-1337, -1337, -1337),
 	m_smooth_lighting(false),
+	m_merge_faces(false),
 	m_show_hud(false),
+	m_block_is_uniform(false),
 	m_client(client),
 	m_use_shaders(use_shaders),
 	m_use_tangent_vertices(use_tangent_vertices)
@@ -74,6 +77,7 @@ void MeshMakeData::fill(MapBlock *block)
 {
 	fillBlockDataBegin(block->getPos());
 
+	m_block_is_uniform = block->isUniform();
 	fillBlockData(v3s16(0,0,0), block->getData());
 
 	// Get map for reading neigbhor blocks
@@ -577,10 +581,13 @@ static void makeFastFace(const TileSpec &tile, u16 li0, u16 li1, u16 li2, u16 li
 		vertex_pos[i] += pos;
 	}
 
-	f32 abs_scale = 1.0;
-	if     (scale.X < 0.999 || scale.X > 1.001) abs_scale = scale.X;
-	else if(scale.Y < 0.999 || scale.Y > 1.001) abs_scale = scale.Y;
-	else if(scale.Z < 0.999 || scale.Z > 1.001) abs_scale = scale.Z;
+	// The texture is repeated along the sides of merged faces
+	v3s16 u_dir = vertex_dirs[0] - vertex_dirs[1];
+	v3s16 v_dir = vertex_dirs[1] - vertex_dirs[2];
+	f32 scale_u = (abs(u_dir.X) * scale.X + abs(u_dir.Y) * scale.Y +
+			abs(u_dir.Z) * scale.Z) / 2;
+	f32 scale_v = (abs(v_dir.X) * scale.X + abs(v_dir.Y) * scale.Y +
+			abs(v_dir.Z) * scale.Z) / 2;
 
 	v3f normal(dir.X, dir.Y, dir.Z);
 
@@ -597,10 +604,10 @@ static void makeFastFace(const TileSpec &tile, u16 li0, u16 li1, u16 li2, u16 li
 			< abs(day[1] - day[3]) + abs(night[1] - night[3]);
 
 	v2f32 f[4] = {
-		core::vector2d<f32>(x0 + w * abs_scale, y0 + h),
-		core::vector2d<f32>(x0, y0 + h),
+		core::vector2d<f32>(x0 + w * scale_u, y0 + h * scale_v),
+		core::vector2d<f32>(x0, y0 + h * scale_v),
 		core::vector2d<f32>(x0, y0),
-		core::vector2d<f32>(x0 + w * abs_scale, y0) };
+		core::vector2d<f32>(x0 + w * scale_u, y0) };
 
 	for (int layernum = 0; layernum < MAX_TILE_LAYERS; layernum++) {
 		const TileLayer *layer = &tile.layers[layernum];
@@ -958,6 +965,114 @@ static void updateFastFaceRow(
 	}
 }
 
+// The face between a node of a plane and its neighbor in face_dir
+struct PlaneFace
+{
+	bool makes_face;
+	v3s16 p_corrected;
+	v3s16 face_dir_corrected;
+	u16 lights[4];
+	TileSpec tile;
+};
+
+// MAP_BLOCKSIZE * MAP_BLOCKSIZE faces of a plane, see greedy_merge()
+struct PlaneFaces
+{
+	std::vector<PlaneFace> faces;
+
+	PlaneFaces(): faces(MAP_BLOCKSIZE * MAP_BLOCKSIZE) {}
+
+	bool has(u32 i) const
+	{
+		return faces[i].makes_face;
+	}
+
+	// Like the faces merged by updateFastFaceRow()
+	bool mergeable(u32 i, u32 j) const
+	{
+		const PlaneFace &a = faces[i];
+		const PlaneFace &b = faces[j];
+		return b.face_dir_corrected == a.face_dir_corrected
+			&& memcmp(b.lights, a.lights, sizeof(a.lights)) == 0
+			&& b.tile.isTileable(a.tile);
+	}
+};
+
+/*
+	Makes the faces of a plane of nodes, drawing the faces that can be
+	merged as rectangles.
+	startpos: corner of the plane
+	u_dir, v_dir: unit vectors along the sides of the plane
+	face_dir: unit vector normal to the plane
+	plane, covered, rects: reused between the calls
+*/
+static void updateFastFacePlane(
+		MeshMakeData *data,
+		v3s16 startpos,
+		v3s16 u_dir,
+		v3s16 v_dir,
+		v3s16 face_dir,
+		PlaneFaces &plane,
+		std::vector<bool> &covered,
+		std::vector<MergedRect> &rects,
+		std::vector<FastFace> &dest)
+{
+	for (s16 v = 0; v < MAP_BLOCKSIZE; v++)
+	for (s16 u = 0; u < MAP_BLOCKSIZE; u++) {
+		PlaneFace &face = plane.faces[v * MAP_BLOCKSIZE + u];
+		getTileInfo(data, startpos + u_dir * u + v_dir * v, face_dir,
+				face.makes_face, face.p_corrected,
+				face.face_dir_corrected, face.lights, face.tile);
+	}
+
+	rects.clear();
+	greedy_merge(MAP_BLOCKSIZE, MAP_BLOCKSIZE, plane, covered, rects);
+
+	v3f u_dir_f(u_dir.X, u_dir.Y, u_dir.Z);
+	v3f v_dir_f(v_dir.X, v_dir.Y, v_dir.Z);
+	for (std::vector<MergedRect>::const_iterator it = rects.begin();
+			it != rects.end(); ++it) {
+		const PlaneFace &face = plane.faces[it->y * MAP_BLOCKSIZE + it->x];
+		v3f pf(face.p_corrected.X, face.p_corrected.Y, face.p_corrected.Z);
+		// Center point of the rectangle
+		v3f sp = pf + (it->w - 1) / 2.0f * u_dir_f +
+				(it->h - 1) / 2.0f * v_dir_f;
+		v3f scale = v3f(1, 1, 1) + (it->w - 1) * u_dir_f +
+				(it->h - 1) * v_dir_f;
+
+		makeFastFace(face.tile, face.lights[0], face.lights[1],
+				face.lights[2], face.lights[3],
+				sp, face.face_dir_corrected, scale, dest);
+
+		g_profiler->avg("Meshgen: faces drawn by tiling", 0);
+		for (int i = 1; i < it->w * it->h; i++)
+			g_profiler->avg("Meshgen: faces drawn by tiling", 1);
+	}
+}
+
+static void updateAllFastFacePlanes(MeshMakeData *data,
+		std::vector<FastFace> &dest)
+{
+	PlaneFaces plane;
+	std::vector<bool> covered;
+	std::vector<MergedRect> rects;
+
+	// Top (y+) faces
+	for (s16 y = 0; y < MAP_BLOCKSIZE; y++)
+		updateFastFacePlane(data, v3s16(0, y, 0), v3s16(1, 0, 0),
+				v3s16(0, 0, 1), v3s16(0, 1, 0), plane, covered, rects, dest);
+
+	// Right (x+) faces
+	for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+		updateFastFacePlane(data, v3s16(x, 0, 0), v3s16(0, 0, 1),
+				v3s16(0, 1, 0), v3s16(1, 0, 0), plane, covered, rects, dest);
+
+	// Back (z+) faces
+	for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		updateFastFacePlane(data, v3s16(0, 0, z), v3s16(1, 0, 0),
+				v3s16(0, 1, 0), v3s16(0, 0, 1), plane, covered, rects, dest);
+}
+
 static void updateAllFastFaceRows(MeshMakeData *data,
 		std::vector<FastFace> &dest)
 {
@@ -1011,7 +1126,41 @@ static void updateAllFastFaceRows(MeshMakeData *data,
 	MapBlockMesh
 */
 
-MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
+/*
+	For a block that consists of a single node: whether it needs to be
+	meshed at all. Only nodes drawn as plain cubes (or not at all) can
+	be skipped, and only if no face is made at the trailing edges, where
+	the block meets the neighbors at +X, +Y and +Z.
+*/
+static bool uniform_block_has_faces(MeshMakeData *data)
+{
+	INodeDefManager *ndef = data->m_client->ndef();
+	v3s16 p0 = data->m_blockpos * MAP_BLOCKSIZE;
+	content_t c = data->m_vmanip.getNodeNoExNoEmerge(p0).getContent();
+	const ContentFeatures &f = ndef->get(c);
+	if (f.drawtype != NDT_AIRLIKE && f.drawtype != NDT_NORMAL)
+		return true;
+
+	bool equivalent;
+	for (s16 a = 0; a < MAP_BLOCKSIZE; a++)
+	for (s16 b = 0; b < MAP_BLOCKSIZE; b++) {
+		v3s16 neighbors[] = {
+			v3s16(MAP_BLOCKSIZE, a, b),
+			v3s16(a, MAP_BLOCKSIZE, b),
+			v3s16(a, b, MAP_BLOCKSIZE),
+		};
+		for (size_t i = 0; i < ARRLEN(neighbors); i++) {
+			content_t c2 = data->m_vmanip.getNodeNoExNoEmerge(
+				p0 + neighbors[i]).getContent();
+			if (face_contents(c, c2, &equivalent, ndef) != 0)
+				return true;
+		}
+	}
+	return false;
+}
+
+MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset,
+		MeshCollector *collector_reused):
 	m_minimap_mapblock(NULL),
 	m_client(data->m_client),
 	m_driver(m_client->tsrc()->getDevice()->getVideoDriver()),
@@ -1040,7 +1189,13 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 	//TimeTaker timer1("MapBlockMesh()");
 
 	std::vector<FastFace> fastfaces_new;
-	fastfaces_new.reserve(512);
+
+	/*
+		Blocks of a single plain node (open air, solid ground) have
+		nothing to draw unless a neighbor exposes a face.
+	*/
+	bool skip_nodes = data->m_block_is_uniform &&
+		!uniform_block_has_faces(data);
 
 	/*
 		We are including the faces of the trailing edges of the block.
@@ -1049,10 +1204,14 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 
 		NOTE: This is the slowest part of this method.
 	*/
-	{
+	if (!skip_nodes) {
 		// 4-23ms for MAP_BLOCKSIZE=16  (NOTE: probably outdated)
 		//TimeTaker timer2("updateAllFastFaceRows()");
-		updateAllFastFaceRows(data, fastfaces_new);
+		fastfaces_new.reserve(512);
+		if (data->m_merge_faces)
+			updateAllFastFacePlanes(data, fastfaces_new);
+		else
+			updateAllFastFaceRows(data, fastfaces_new);
 	}
 	// End of slow part
 
@@ -1060,13 +1219,39 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 		Convert FastFaces to MeshCollector
 	*/
 
-	MeshCollector collector(m_use_tangent_vertices);
+	MeshCollector collector_local(m_use_tangent_vertices);
+	MeshCollector &collector = collector_reused ?
+		*collector_reused : collector_local;
+	collector.clear();
+	collector.m_use_tangent_vertices = m_use_tangent_vertices;
 
 	{
 		// avg 0ms (100ms spikes when loading textures the first time)
 		// (NOTE: probably outdated)
 		//TimeTaker timer2("MeshCollector building");
 
+		// Count the faces of each buffer to allocate its arrays at once:
+		// pairs of the first face and the count
+		std::vector<std::pair<u32, u32> > face_counts;
+		for (u32 i = 0; i < fastfaces_new.size(); i++) {
+			const FastFace &f = fastfaces_new[i];
+			if (f.layer.texture == NULL)
+				continue;
+			size_t j = 0;
+			for (; j < face_counts.size(); j++) {
+				const FastFace &f2 = fastfaces_new[face_counts[j].first];
+				if (f2.layernum == f.layernum && f2.layer == f.layer)
+					break;
+			}
+			if (j == face_counts.size())
+				face_counts.push_back(std::make_pair(i, 0));
+			face_counts[j].second++;
+		}
+		for (size_t j = 0; j < face_counts.size(); j++) {
+			const FastFace &f = fastfaces_new[face_counts[j].first];
+			collector.reserveFaces(f.layer, f.layernum, face_counts[j].second);
+		}
+
 		for (u32 i = 0; i < fastfaces_new.size(); i++) {
 			FastFace &f = fastfaces_new[i];
 
@@ -1092,7 +1277,7 @@ MapBlockMesh::MapBlockMesh(MeshMakeData *data, v3s16 camera_offset):
 		- whatever
 	*/
 
-	{
+	if (!skip_nodes) {
 		MapblockMeshGenerator generator(data, &collector);
 		generator.generate();
 	}
@@ -1385,6 +1570,54 @@ void MapBlockMesh::updateCameraOffset(v3s16 camera_offset)
 	MeshCollector
 */
 
+void MeshCollector::clear()
+{
+	for (int layer = 0; layer < MAX_TILE_LAYERS; layer++) {
+		std::vector<PreMeshBuffer> &buffers = prebuffers[layer];
+		for (u32 i = 0; i < buffers.size(); i++) {
+			buffers[i].indices.clear();
+			buffers[i].vertices.clear();
+			buffers[i].tangent_vertices.clear();
+			m_spare_buffers.push_back(std::move(buffers[i]));
+		}
+		buffers.clear();
+	}
+}
+
+void MeshCollector::reserveFaces(const TileLayer &layer, u8 layernum,
+		u32 count)
+{
+	count = MYMIN(count, 65535 / 6);
+	PreMeshBuffer &p = findBuffer(layer, layernum, count * 6);
+	p.indices.reserve(p.indices.size() + count * 6);
+	if (m_use_tangent_vertices)
+		p.tangent_vertices.reserve(p.tangent_vertices.size() + count * 4);
+	else
+		p.vertices.reserve(p.vertices.size() + count * 4);
+}
+
+PreMeshBuffer &MeshCollector::findBuffer(const TileLayer &layer,
+		u8 layernum, u32 numIndices)
+{
+	std::vector<PreMeshBuffer> &buffers = prebuffers[layernum];
+	for (u32 i = 0; i < buffers.size(); i++) {
+		PreMeshBuffer &p = buffers[i];
+		if (p.layer == layer && p.indices.size() + numIndices <= 65535)
+			return p;
+	}
+
+	// Reuse the arrays of an earlier mesh if possible
+	if (m_spare_buffers.empty()) {
+		buffers.push_back(PreMeshBuffer());
+	} else {
+		buffers.push_back(std::move(m_spare_buffers.back()));
+		m_spare_buffers.pop_back();
+	}
+	PreMeshBuffer &p = buffers.back();
+	p.layer = layer;
+	return p;
+}
+
 void MeshCollector::append(const TileSpec &tile,
 		const video::S3DVertex *vertices, u32 numVertices,
 		const u16 *indices, u32 numIndices)
@@ -1406,26 +1639,7 @@ void MeshCollector::append(const TileLayer &layer,
 		dstream<<"FIXME: MeshCollector::append() called with numIndices="<<numIndices<<" (limit 65535)"<<std::endl;
 		return;
 	}
-	std::vector<PreMeshBuffer> *buffers = &prebuffers[layernum];
-
-	PreMeshBuffer *p = NULL;
-	for (u32 i = 0; i < buffers->size(); i++) {
-		PreMeshBuffer &pp = (*buffers)[i];
-		if (pp.layer != layer)
-			continue;
-		if (pp.indices.size() + numIndices > 65535)
-			continue;
-
-		p = &pp;
-		break;
-	}
-
-	if (p == NULL) {
-		PreMeshBuffer pp;
-		pp.layer = layer;
-		buffers->push_back(pp);
-		p = &(*buffers)[buffers->size() - 1];
-	}
+	PreMeshBuffer *p = &findBuffer(layer, layernum, numIndices);
 
 	u32 vertex_count;
 	if (m_use_tangent_vertices) {
@@ -1477,26 +1691,7 @@ void MeshCollector::append(const TileLayer &layer,
 		dstream<<"FIXME: MeshCollector::append() called with numIndices="<<numIndices<<" (limit 65535)"<<std::endl;
 		return;
 	}
-	std::vector<PreMeshBuffer> *buffers = &prebuffers[layernum];
-
-	PreMeshBuffer *p = NULL;
-	for (u32 i = 0; i < buffers->size(); i++) {
-		PreMeshBuffer &pp = (*buffers)[i];
-		if(pp.layer != layer)
-			continue;
-		if(pp.indices.size() + numIndices > 65535)
-			continue;
-
-		p = &pp;
-		break;
-	}
-
-	if (p == NULL) {
-		PreMeshBuffer pp;
-		pp.layer = layer;
-		buffers->push_back(pp);
-		p = &(*buffers)[buffers->size() - 1];
-	}
+	PreMeshBuffer *p = &findBuffer(layer, layernum, numIndices);
 
 	video::SColor original_c = c;
 	u32 vertex_count;
@@ -43,7 +43,11 @@ struct MeshMakeData
 	v3s16 m_blockpos;
 	v3s16 m_crack_pos_relative;
 	bool m_smooth_lighting;
+	// Merge the faces of cube nodes into rectangles instead of rows
+	bool m_merge_faces;
 	bool m_show_hud;
+	// All nodes of the central block are the same
+	bool m_block_is_uniform;
 
 	Client *m_client;
 	bool m_use_shaders;
@@ -95,7 +99,10 @@ class MapBlockMesh
 {
 public:
 	// Builds the mesh given
-	MapBlockMesh(MeshMakeData *data, v3s16 camera_offset);
+	// collector: if not NULL, it is cleared and used to build the mesh,
+	// see MeshCollector::clear()
+	MapBlockMesh(MeshMakeData *data, v3s16 camera_offset,
+			MeshCollector *collector = NULL);
 	~MapBlockMesh();
 
 	// Main animation function, parameters:
@@ -200,6 +207,16 @@ struct MeshCollector
 	{
 	}
 
+	/*
+		Empties the collector for the next mesh. The arrays of the buffers
+		are kept, so that a collector that is reused for many meshes soon
+		stops allocating memory.
+	*/
+	void clear();
+
+	// Makes room for count faces of 4 vertices and 6 indices at once
+	void reserveFaces(const TileLayer &layer, u8 layernum, u32 count);
+
 	void append(const TileSpec &material,
 				const video::S3DVertex *vertices, u32 numVertices,
 				const u16 *indices, u32 numIndices);
@@ -218,6 +235,14 @@ struct MeshCollector
 	 * Colorizes all vertices in the collector.
 	 */
 	void applyTileColors();
+
+private:
+	// A buffer of the layer with room for numIndices more indices
+	PreMeshBuffer &findBuffer(const TileLayer &layer, u8 layernum,
+			u32 numIndices);
+
+	// Empty buffers left by clear()
+	std::vector<PreMeshBuffer> m_spare_buffers;
 };
 
 /*!
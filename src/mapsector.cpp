@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "mapsector.h"
 #include "exceptions.h"
+#include "map.h"
 #include "mapblock.h"
 #include "serialization.h"
 
@@ -44,6 +45,8 @@ void MapSector::deleteBlocks()
 	// Delete all
 	for (UNORDERED_MAP<s16, MapBlock*>::iterator i = m_blocks.begin();
 		 	i != m_blocks.end(); ++i) {
+		if (m_parent)
+			m_parent->m_block_index.remove(i->second->getPos());
 		delete i->second;
 	}
 
@@ -91,6 +94,8 @@ MapBlock * MapSector::createBlankBlock(s16 y)
 	MapBlock *block = createBlankBlockNoInsert(y);
 
 	m_blocks[y] = block;
+	if (m_parent)
+		m_parent->m_block_index.insert(block->getPos(), block);
 
 	return block;
 }
@@ -109,6 +114,8 @@ void MapSector::insertBlock(MapBlock *block)
 
 	// Insert into container
 	m_blocks[block_y] = block;
+	if (m_parent)
+		m_parent->m_block_index.insert(block->getPos(), block);
 }
 
 void MapSector::deleteBlock(MapBlock *block)
@@ -120,6 +127,8 @@ void MapSector::deleteBlock(MapBlock *block)
 
 	// Remove from container
 	m_blocks.erase(block_y);
+	if (m_parent)
+		m_parent->m_block_index.remove(block->getPos());
 
 	// Delete
 	delete block;
@@ -0,0 +1,72 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mediastore.h"
+#include <fstream>
+#include "filesys.h"
+#include "log.h"
+#include "threading/mutex_auto_lock.h"
+
+MediaData::MediaData(const std::string &path, u32 size, u64 mtime):
+	m_path(path),
+	m_mtime(mtime),
+	m_data(NULL),
+	m_size(size),
+	m_failed(false),
+	m_refcount(1)
+{
+}
+
+MediaData::~MediaData()
+{
+	delete[] m_data;
+}
+
+bool MediaData::load()
+{
+	MutexAutoLock lock(m_load_mutex);
+	if (m_data)
+		return true;
+	if (m_failed)
+		return false;
+
+	// Only the content that was hashed may be sent
+	u64 size, mtime;
+	if (!fs::GetFileStat(m_path, &size, &mtime) || size != m_size ||
+			mtime != m_mtime) {
+		errorstream << "MediaData: \"" << m_path << "\" has been changed "
+				"or removed since the server started" << std::endl;
+		m_failed = true;
+		return false;
+	}
+
+	std::ifstream fis(m_path.c_str(), std::ios_base::binary);
+	char *data = new char[m_size];
+	fis.read(data, m_size);
+	if (!fis.good() || (u32)fis.gcount() != m_size) {
+		errorstream << "MediaData: Failed to read \"" << m_path
+				<< "\"" << std::endl;
+		delete[] data;
+		m_failed = true;
+		return false;
+	}
+
+	m_data = data;
+	return true;
+}
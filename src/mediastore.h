@@ -0,0 +1,73 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MEDIASTORE_HEADER
+#define MEDIASTORE_HEADER
+
+#include <string>
+#include "irrlichttypes.h"
+#include "threading/atomic.h"
+#include "threading/mutex.h"
+#include "util/basic_macros.h"
+
+/*
+	Content of a media file, read once when it is first sent and shared by
+	everything that sends it to clients.
+
+	Reference counted like irrlicht objects: grab() a pointer before
+	keeping it around, drop() it when done.
+*/
+class MediaData
+{
+public:
+	// The file had this size and modification time when it was hashed
+	MediaData(const std::string &path, u32 size, u64 mtime);
+
+	// Reads the file unless done already, can be called from any thread.
+	// Returns false (and logs an error) if it can't be read or has been
+	// changed since it was hashed.
+	bool load();
+
+	const std::string &getPath() const { return m_path; }
+	// Only valid after load() succeeded
+	const char *getData() const { return m_data; }
+	u32 getSize() const { return m_size; }
+
+	void grab() { m_refcount++; }
+	void drop()
+	{
+		if (--m_refcount == 0)
+			delete this;
+	}
+
+private:
+	~MediaData();
+
+	std::string m_path;
+	u64 m_mtime;
+	char *m_data;
+	u32 m_size;
+	bool m_failed;
+	Mutex m_load_mutex;
+	Atomic<u32> m_refcount;
+
+	DISABLE_CLASS_COPY(MediaData);
+};
+
+#endif
@@ -31,6 +31,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 CachedMapBlockData::CachedMapBlockData():
 	p(-1337,-1337,-1337),
 	data(NULL),
+	is_uniform(false),
 	refcount_from_queue(0),
 	last_used_timestamp(time(0))
 {
@@ -54,7 +55,8 @@ QueuedMeshUpdate::QueuedMeshUpdate():
 	urgent(false),
 	crack_level(-1),
 	crack_pos(0,0,0),
-	data(NULL)
+	data(NULL),
+	sequence(0)
 {
 }
 
@@ -69,13 +71,15 @@ QueuedMeshUpdate::~QueuedMeshUpdate()
 */
 
 MeshUpdateQueue::MeshUpdateQueue(Client *client):
-	m_client(client)
+	m_client(client),
+	m_next_sequence(0)
 {
 	m_cache_enable_shaders = g_settings->getBool("enable_shaders");
 	m_cache_use_tangent_vertices = m_cache_enable_shaders && (
 		g_settings->getBool("enable_bumpmapping") ||
 		g_settings->getBool("enable_parallax_occlusion"));
 	m_cache_smooth_lighting = g_settings->getBool("smooth_lighting");
+	m_cache_merge_faces = g_settings->getBool("mesh_face_merging");
 	m_meshgen_block_cache_size = g_settings->getS32("meshgen_block_cache_size");
 }
 
@@ -172,20 +176,33 @@ QueuedMeshUpdate *MeshUpdateQueue::pop()
 {
 	MutexAutoLock lock(m_mutex);
 
-	bool must_be_urgent = !m_urgents.empty();
-	for (std::vector<QueuedMeshUpdate*>::iterator i = m_queue.begin();
-			i != m_queue.end(); ++i) {
-		QueuedMeshUpdate *q = *i;
-		if(must_be_urgent && m_urgents.count(q->p) == 0)
-			continue;
-		m_queue.erase(i);
-		m_urgents.erase(q->p);
-		fillDataFromMapBlockCache(q);
-		return q;
+	// First look for an urgent block, then for any block
+	for (int pass = m_urgents.empty() ? 1 : 0; pass < 2; pass++) {
+		for (std::vector<QueuedMeshUpdate*>::iterator i = m_queue.begin();
+				i != m_queue.end(); ++i) {
+			QueuedMeshUpdate *q = *i;
+			if (pass == 0 && m_urgents.count(q->p) == 0)
+				continue;
+			// Another thread is making the previous mesh of the block
+			if (m_inflight_blocks.count(q->p))
+				continue;
+			m_queue.erase(i);
+			m_urgents.erase(q->p);
+			m_inflight_blocks.insert(q->p);
+			q->sequence = m_next_sequence++;
+			fillDataFromMapBlockCache(q);
+			return q;
+		}
 	}
 	return NULL;
 }
 
+void MeshUpdateQueue::done(v3s16 p)
+{
+	MutexAutoLock lock(m_mutex);
+	m_inflight_blocks.erase(p);
+}
+
 CachedMapBlockData* MeshUpdateQueue::cacheBlock(Map *map, v3s16 p, UpdateMode mode,
 			size_t *cache_hit_counter)
 {
@@ -204,11 +221,12 @@ CachedMapBlockData* MeshUpdateQueue::cacheBlock(Map *map, v3s16 p, UpdateMode mo
 			if (cached_block->data == NULL)
 				cached_block->data =
 						new MapNode[MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE];
-			memcpy(cached_block->data, b->getData(),
-					MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE * sizeof(MapNode));
+			b->getNodes(cached_block->data);
+			cached_block->is_uniform = b->isUniform();
 		} else {
 			delete[] cached_block->data;
 			cached_block->data = NULL;
+			cached_block->is_uniform = false;
 		}
 		return cached_block;
 	} else {
@@ -219,8 +237,8 @@ CachedMapBlockData* MeshUpdateQueue::cacheBlock(Map *map, v3s16 p, UpdateMode mo
 		if (b) {
 			cached_block->data =
 					new MapNode[MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE];
-			memcpy(cached_block->data, b->getData(),
-					MAP_BLOCKSIZE * MAP_BLOCKSIZE * MAP_BLOCKSIZE * sizeof(MapNode));
+			b->getNodes(cached_block->data);
+			cached_block->is_uniform = b->isUniform();
 		}
 		return cached_block;
 	}
@@ -255,13 +273,17 @@ void MeshUpdateQueue::fillDataFromMapBlockCache(QueuedMeshUpdate *q)
 		if (cached_block) {
 			cached_block->refcount_from_queue--;
 			cached_block->last_used_timestamp = t_now;
-			if (cached_block->data)
+			if (cached_block->data) {
 				data->fillBlockData(dp, cached_block->data);
+				if (dp == v3s16(0, 0, 0))
+					data->m_block_is_uniform = cached_block->is_uniform;
+			}
 		}
 	}
 
 	data->setCrack(q->crack_level, q->crack_pos);
 	data->setSmoothLighting(m_cache_smooth_lighting);
+	data->m_merge_faces = m_cache_merge_faces;
 }
 
 void MeshUpdateQueue::cleanupCache()
@@ -294,42 +316,127 @@ void MeshUpdateQueue::cleanupCache()
 }
 
 /*
-	MeshUpdateThread
+	MeshUpdateWorkerThread
 */
 
-MeshUpdateThread::MeshUpdateThread(Client *client):
+MeshUpdateWorkerThread::MeshUpdateWorkerThread(MeshUpdateQueue *queue_in,
+		MeshUpdateManager *manager, v3s16 *camera_offset):
 	UpdateThread("Mesh"),
-	m_queue_in(client)
+	m_queue_in(queue_in),
+	m_manager(manager),
+	m_camera_offset(camera_offset),
+	m_collector(false)
 {
 	m_generation_interval = g_settings->getU16("mesh_generation_interval");
 	m_generation_interval = rangelim(m_generation_interval, 0, 50);
 }
 
-void MeshUpdateThread::updateBlock(Map *map, v3s16 p, bool ack_block_to_server,
-		bool urgent)
-{
-	// Allow the MeshUpdateQueue to do whatever it wants
-	m_queue_in.addBlock(map, p, ack_block_to_server, urgent);
-	deferUpdate();
-}
-
-void MeshUpdateThread::doUpdate()
+void MeshUpdateWorkerThread::doUpdate()
 {
 	QueuedMeshUpdate *q;
-	while ((q = m_queue_in.pop())) {
+	while ((q = m_queue_in->pop())) {
 		if (m_generation_interval)
 			sleep_ms(m_generation_interval);
 		ScopeProfiler sp(g_profiler, "Client: Mesh making");
 
-		MapBlockMesh *mesh_new = new MapBlockMesh(q->data, m_camera_offset);
+		MapBlockMesh *mesh_new = new MapBlockMesh(q->data, *m_camera_offset,
+				&m_collector);
 
 		MeshUpdateResult r;
 		r.p = q->p;
 		r.mesh = mesh_new;
 		r.ack_block_to_server = q->ack_block_to_server;
 
-		m_queue_out.push_back(r);
+		// Push before done(), so that a newer mesh of the block can't
+		// overtake this one
+		m_manager->pushResult(q->sequence, r);
+		m_queue_in->done(q->p);
 
 		delete q;
 	}
 }
+
+/*
+	MeshUpdateManager
+*/
+
+MeshUpdateManager::MeshUpdateManager(Client *client):
+	m_queue_in(client),
+	m_next_result(0)
+{
+	// If unspecified, leave a processor for the main thread
+	s16 nthreads = g_settings->getS16("mesh_generation_threads");
+	if (nthreads <= 0)
+		nthreads = MYMIN((s32)Thread::getNumberOfProcessors() - 1, 8);
+	nthreads = MYMAX(nthreads, 1);
+
+	for (s16 i = 0; i < nthreads; i++)
+		m_workers.push_back(new MeshUpdateWorkerThread(&m_queue_in, this,
+			&m_camera_offset));
+}
+
+MeshUpdateManager::~MeshUpdateManager()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		delete m_workers[i];
+
+	for (std::map<u32, MeshUpdateResult>::iterator it = m_results_waiting.begin();
+			it != m_results_waiting.end(); ++it)
+		delete it->second.mesh;
+}
+
+void MeshUpdateManager::updateBlock(Map *map, v3s16 p, bool ack_block_to_server,
+		bool urgent)
+{
+	// Allow the MeshUpdateQueue to do whatever it wants
+	m_queue_in.addBlock(map, p, ack_block_to_server, urgent);
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->deferUpdate();
+}
+
+void MeshUpdateManager::pushResult(u32 sequence, const MeshUpdateResult &r)
+{
+	MutexAutoLock lock(m_results_mutex);
+	if (sequence != m_next_result) {
+		m_results_waiting[sequence] = r;
+		return;
+	}
+	m_queue_out.push_back(r);
+	m_next_result++;
+
+	std::map<u32, MeshUpdateResult>::iterator it = m_results_waiting.begin();
+	while (it != m_results_waiting.end() && it->first == m_next_result) {
+		m_queue_out.push_back(it->second);
+		m_results_waiting.erase(it++);
+		m_next_result++;
+	}
+}
+
+void MeshUpdateManager::start()
+{
+	infostream << "MeshUpdateManager: starting " << m_workers.size()
+		<< " mesh threads" << std::endl;
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->start();
+}
+
+void MeshUpdateManager::stop()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->stop();
+}
+
+void MeshUpdateManager::wait()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->wait();
+}
+
+// Returns false if any of the threads stopped
+bool MeshUpdateManager::isRunning()
+{
+	for (size_t i = 0; i < m_workers.size(); i++)
+		if (!m_workers[i]->isRunning())
+			return false;
+	return true;
+}
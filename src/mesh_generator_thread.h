@@ -28,6 +28,7 @@ struct CachedMapBlockData
 {
 	v3s16 p;
 	MapNode *data; // A copy of the MapBlock's data member
+	bool is_uniform; // MapBlock::isUniform() at the time of the copy
 	int refcount_from_queue;
 	int last_used_timestamp;
 
@@ -43,13 +44,19 @@ struct QueuedMeshUpdate
 	int crack_level;
 	v3s16 crack_pos;
 	MeshMakeData *data; // This is generated in MeshUpdateQueue::pop()
+	u32 sequence; // Order of pop(), the results are delivered in it
 
 	QueuedMeshUpdate();
 	~QueuedMeshUpdate();
 };
 
 /*
-	A thread-safe queue of mesh update tasks and a cache of MapBlock data
+	A thread-safe queue of mesh update tasks and a cache of MapBlock data.
+
+	The cache is only accessed with m_mutex locked: pop() copies the data
+	a task needs, so any number of mesh threads can work on the queue.
+	A block is not handed out again before done() is called for it, so the
+	meshes of a block are finished in the order they were queued.
 */
 class MeshUpdateQueue
 {
@@ -69,9 +76,13 @@ class MeshUpdateQueue
 	void addBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
 
 	// Returned pointer must be deleted
-	// Returns NULL if queue is empty
+	// Returns NULL if queue is empty or all queued blocks are in progress.
+	// Urgent blocks are returned first.
 	QueuedMeshUpdate *pop();
 
+	// Marks the mesh of a popped block as finished
+	void done(v3s16 p);
+
 	u32 size()
 	{
 		MutexAutoLock lock(m_mutex);
@@ -82,6 +93,9 @@ class MeshUpdateQueue
 	Client *m_client;
 	std::vector<QueuedMeshUpdate *> m_queue;
 	std::set<v3s16> m_urgents;
+	// Blocks that were popped but are not done yet
+	std::set<v3s16> m_inflight_blocks;
+	u32 m_next_sequence;
 	std::map<v3s16, CachedMapBlockData *> m_cache;
 	Mutex m_mutex;
 
@@ -89,6 +103,7 @@ class MeshUpdateQueue
 	bool m_cache_enable_shaders;
 	bool m_cache_use_tangent_vertices;
 	bool m_cache_smooth_lighting;
+	bool m_cache_merge_faces;
 	int m_meshgen_block_cache_size;
 
 	CachedMapBlockData *cacheBlock(Map *map, v3s16 p, UpdateMode mode,
@@ -110,26 +125,60 @@ struct MeshUpdateResult
 	}
 };
 
-class MeshUpdateThread : public UpdateThread
+class MeshUpdateManager;
+
+class MeshUpdateWorkerThread : public UpdateThread
 {
 public:
-	MeshUpdateThread(Client *client);
+	MeshUpdateWorkerThread(MeshUpdateQueue *queue_in,
+			MeshUpdateManager *manager, v3s16 *camera_offset);
+
+private:
+	MeshUpdateQueue *m_queue_in;
+	MeshUpdateManager *m_manager;
+	v3s16 *m_camera_offset;
+	// Reused for the meshes made by this thread
+	MeshCollector m_collector;
+
+	// TODO: Add callback to update these when g_settings changes
+	int m_generation_interval;
+
+protected:
+	virtual void doUpdate();
+};
+
+/*
+	Runs mesh_generation_threads worker threads on a shared MeshUpdateQueue
+*/
+class MeshUpdateManager
+{
+public:
+	MeshUpdateManager(Client *client);
+	~MeshUpdateManager();
 
 	// Caches the block at p and its neighbors (if needed) and queues a mesh
 	// update for the block at p
 	void updateBlock(Map *map, v3s16 p, bool ack_block_to_server, bool urgent);
 
+	void start();
+	void stop();
+	void wait();
+	bool isRunning();
+
+	// Adds the result to m_queue_out after the results of the updates
+	// popped before it, so that the order doesn't depend on the threads
+	void pushResult(u32 sequence, const MeshUpdateResult &r);
+
 	v3s16 m_camera_offset;
 	MutexedQueue<MeshUpdateResult> m_queue_out;
 
 private:
 	MeshUpdateQueue m_queue_in;
-
-	// TODO: Add callback to update these when g_settings changes
-	int m_generation_interval;
-
-protected:
-	virtual void doUpdate();
+	// Results that wait for an earlier one, by sequence
+	std::map<u32, MeshUpdateResult> m_results_waiting;
+	u32 m_next_result;
+	Mutex m_results_mutex;
+	std::vector<MeshUpdateWorkerThread *> m_workers;
 };
 
 #endif
@@ -111,7 +111,7 @@ const ToClientCommandHandler toClientCommandTable[TOCLIENT_NUM_MSG_TYPES] =
 	{ "TOCLIENT_CLOUD_PARAMS",             TOCLIENT_STATE_CONNECTED, &Client::handleCommand_CloudParams }, // 0x54
 	{ "TOCLIENT_FADE_SOUND",               TOCLIENT_STATE_CONNECTED, &Client::handleCommand_FadeSound }, // 0x55
 	{ "TOCLIENT_UPDATE_PLAYER_LIST",       TOCLIENT_STATE_CONNECTED, &Client::handleCommand_UpdatePlayerList }, // 0x56
-	null_command_handler,
+	{ "TOCLIENT_INVENTORY_DELTA",          TOCLIENT_STATE_CONNECTED, &Client::handleCommand_InventoryDelta }, // 0x57
 	null_command_handler,
 	null_command_handler,
 	null_command_handler,
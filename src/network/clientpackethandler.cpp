@@ -120,8 +120,10 @@ void Client::handleCommand_AuthAccept(NetworkPacket* pkt)
 	infostream << "Client: received recommended send interval "
 					<< m_recommended_send_interval<<std::endl;
 
-	// Reply to server
+	// Reply to server, offering the definitions cached from it
+	loadCachedDefinitions();
 	NetworkPacket resp_pkt(TOSERVER_INIT2, 0);
+	resp_pkt << m_cached_itemdef_sha1 << m_cached_nodedef_sha1;
 	Send(&resp_pkt);
 
 	m_state = LC_Init;
@@ -257,7 +259,8 @@ void Client::handleCommand_RemoveNode(NetworkPacket* pkt)
 
 	v3s16 p;
 	*pkt >> p;
-	removeNode(p);
+	// The node may be in a block that is still being read
+	queueNodeEdit(p, MapNode(CONTENT_AIR), true, true);
 }
 
 void Client::handleCommand_AddNode(NetworkPacket* pkt)
@@ -277,7 +280,8 @@ void Client::handleCommand_AddNode(NetworkPacket* pkt)
 		remove_metadata = false;
 	}
 
-	addNode(p, n, remove_metadata);
+	// The node may be in a block that is still being read
+	queueNodeEdit(p, n, false, remove_metadata);
 }
 void Client::handleCommand_BlockData(NetworkPacket* pkt)
 {
@@ -288,43 +292,10 @@ void Client::handleCommand_BlockData(NetworkPacket* pkt)
 	v3s16 p;
 	*pkt >> p;
 
+	// Read on m_block_decode_thread, see applyDecodedBlocks()
 	std::string datastring(pkt->getString(6), pkt->getSize() - 6);
-	std::istringstream istr(datastring, std::ios_base::binary);
-
-	MapSector *sector;
-	MapBlock *block;
-
-	v2s16 p2d(p.X, p.Z);
-	sector = m_env.getMap().emergeSector(p2d);
-
-	assert(sector->getPos() == p2d);
-
-	block = sector->getBlockNoCreateNoEx(p.Y);
-	if (block) {
-		/*
-			Update an existing block
-		*/
-		block->deSerialize(istr, m_server_ser_ver, false);
-		block->deSerializeNetworkSpecific(istr);
-	}
-	else {
-		/*
-			Create a new block
-		*/
-		block = new MapBlock(&m_env.getMap(), p, this);
-		block->deSerialize(istr, m_server_ser_ver, false);
-		block->deSerializeNetworkSpecific(istr);
-		sector->insertBlock(block);
-	}
-
-	if (m_localdb) {
-		ServerMap::saveBlock(block, m_localdb);
-	}
-
-	/*
-		Add it to mesh update queue and set it to be acknowledged after update.
-	*/
-	addUpdateMeshTaskWithEdge(p, true);
+	m_block_decode_thread.queueBlock(p, datastring, m_server_ser_ver);
+	m_pending_block_decodes++;
 }
 
 void Client::handleCommand_Inventory(NetworkPacket* pkt)
@@ -620,9 +591,9 @@ void Client::handleCommand_AnnounceMedia(NetworkPacket* pkt)
 		return;
 	}
 
-	// Mesh update thread must be stopped while
+	// Mesh update threads must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	for (u16 i = 0; i < num_files; i++) {
 		std::string name, sha1_base64;
@@ -692,9 +663,9 @@ void Client::handleCommand_Media(NetworkPacket* pkt)
 		return;
 	}
 
-	// Mesh update thread must be stopped while
+	// Mesh update threads must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
 
 	for (u32 i=0; i < num_files; i++) {
 		std::string name;
@@ -713,12 +684,21 @@ void Client::handleCommand_NodeDef(NetworkPacket* pkt)
 	infostream << "Client: Received node definitions: packet size: "
 			<< pkt->getSize() << std::endl;
 
-	// Mesh update thread must be stopped while
+	// Mesh update threads must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
+
+	std::string data = pkt->readLongString();
+	std::string sha1;
+	if (pkt->getRemainingBytes() > 0)
+		*pkt >> sha1;
+	data = updateCachedDefinitions(data, sha1,
+			m_cached_nodedef, m_cached_nodedef_sha1);
+	// The item definitions come first
+	saveCachedDefinitionsIndex();
 
 	// Decompress node definitions
-	std::istringstream tmp_is(pkt->readLongString(), std::ios::binary);
+	std::istringstream tmp_is(data, std::ios::binary);
 	std::ostringstream tmp_os;
 	decompressZlib(tmp_is, tmp_os);
 
@@ -733,12 +713,19 @@ void Client::handleCommand_ItemDef(NetworkPacket* pkt)
 	infostream << "Client: Received item definitions: packet size: "
 			<< pkt->getSize() << std::endl;
 
-	// Mesh update thread must be stopped while
+	// Mesh update threads must be stopped while
 	// updating content definitions
-	sanity_check(!m_mesh_update_thread.isRunning());
+	sanity_check(!m_mesh_update_manager.isRunning());
+
+	std::string data = pkt->readLongString();
+	std::string sha1;
+	if (pkt->getRemainingBytes() > 0)
+		*pkt >> sha1;
+	data = updateCachedDefinitions(data, sha1,
+			m_cached_itemdef, m_cached_itemdef_sha1);
 
 	// Decompress item definitions
-	std::istringstream tmp_is(pkt->readLongString(), std::ios::binary);
+	std::istringstream tmp_is(data, std::ios::binary);
 	std::ostringstream tmp_os;
 	decompressZlib(tmp_is, tmp_os);
 
@@ -884,6 +871,37 @@ void Client::handleCommand_DetachedInventory(NetworkPacket* pkt)
 	inv->deSerialize(is);
 }
 
+void Client::handleCommand_InventoryDelta(NetworkPacket* pkt)
+{
+	std::string datastring(pkt->getString(0), pkt->getSize());
+	std::istringstream is(datastring, std::ios_base::binary);
+
+	std::string name = deSerializeString(is);
+
+	if (name.empty()) {
+		LocalPlayer *player = m_env.getLocalPlayer();
+		assert(player != NULL);
+
+		player->inventory.deSerializeDirtySlots(is);
+
+		m_inventory_updated = true;
+
+		delete m_inventory_from_server;
+		m_inventory_from_server = new Inventory(player->inventory);
+		m_inventory_from_server_age = 0.0;
+		return;
+	}
+
+	// The full inventory is still on its way
+	if (m_detached_inventories.count(name) == 0) {
+		infostream << "Client: Ignoring update of unknown detached "
+				"inventory \"" << name << "\"" << std::endl;
+		return;
+	}
+
+	m_detached_inventories[name]->deSerializeDirtySlots(is);
+}
+
 void Client::handleCommand_ShowFormSpec(NetworkPacket* pkt)
 {
 	std::string formspec = pkt->readLongString();
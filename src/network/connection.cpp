@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/string.h"
 #include "settings.h"
 #include "profiler.h"
+#include "tracer.h"
 
 namespace con
 {
@@ -1288,6 +1289,7 @@ void * ConnectionSendThread::run()
 	while(!stopRequested() || packetsQueued()) {
 		BEGIN_DEBUG_EXCEPTION_HANDLER
 		PROFILE(ScopeProfiler sp(g_profiler, ThreadIdentifier.str(), SPT_AVG));
+		TraceScope ts(TZ_CON_SEND_ITERATION);
 
 		m_iteration_packets_avaialble = m_max_data_packets_per_iteration;
 
@@ -1382,6 +1384,7 @@ void ConnectionSendThread::runTimeouts(float dtime)
 		PROFILE(peerIdentifier << "runTimeouts[" << m_connection->getDesc()
 				<< ";" << *j << ";RELIABLE]");
 		PROFILE(ScopeProfiler peerprofiler(g_profiler, peerIdentifier.str(), SPT_AVG));
+		TraceScope ts(TZ_CON_PEER_TIMEOUTS, *j);
 
 		SharedBuffer<u8> data(2); // data for sending ping, required here because of goto
 
@@ -1914,6 +1917,7 @@ void ConnectionSendThread::sendPackets(float dtime)
 		PROFILE(std::stringstream peerIdentifier);
 		PROFILE(peerIdentifier << "sendPackets[" << m_connection->getDesc() << ";" << *j << ";RELIABLE]");
 		PROFILE(ScopeProfiler peerprofiler(g_profiler, peerIdentifier.str(), SPT_AVG));
+		TraceScope ts(TZ_CON_PEER_SEND, *j);
 
 		LOG(dout_con<<m_connection->getDesc()
 				<< " Handle per peer queues: peer_id=" << *j
@@ -2055,6 +2059,7 @@ void * ConnectionReceiveThread::run()
 	while(!stopRequested()) {
 		BEGIN_DEBUG_EXCEPTION_HANDLER
 		PROFILE(ScopeProfiler sp(g_profiler, ThreadIdentifier.str(), SPT_AVG));
+		TraceScope ts(TZ_CON_RECEIVE_ITERATION);
 
 #ifdef DEBUG_CONNECTION_KBPS
 		lasttime = curtime;
@@ -2951,6 +2956,17 @@ float Connection::getPeerStat(u16 peer_id, rtt_stat_type type)
 	return peer->getStat(type);
 }
 
+u32 Connection::getPeerWindowSize(u16 peer_id, u8 channelnum)
+{
+	PeerHelper peer = getPeerNoEx(peer_id);
+	if (!peer || channelnum >= CHANNEL_COUNT)
+		return 0;
+	UDPPeer *udp_peer = dynamic_cast<UDPPeer*>(&peer);
+	if (!udp_peer)
+		return 0;
+	return udp_peer->channels[channelnum].getWindowSize();
+}
+
 float Connection::getLocalStat(rate_stat_type type)
 {
 	PeerHelper peer = getPeerNoEx(PEER_ID_SERVER);
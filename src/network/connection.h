@@ -29,6 +29,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/container.h"
 #include "util/thread.h"
 #include "util/numeric.h"
+#include "threading/atomic.h"
 #include <iostream>
 #include <fstream>
 #include <list>
@@ -545,7 +546,8 @@ class Channel
 	void setWindowSize(unsigned int size) { window_size = size; };
 private:
 	Mutex m_internal_mutex;
-	int window_size;
+	// Read by Connection::getPeerWindowSize() from other threads
+	Atomic<int> window_size;
 
 	u16 next_incoming_seqnum;
 
@@ -1021,6 +1023,8 @@ class Connection
 	Address GetPeerAddress(u16 peer_id);
 	float getPeerStat(u16 peer_id, rtt_stat_type type);
 	float getLocalStat(rate_stat_type type);
+	// Reliable send window of a peer's channel in packets, 0 if unknown
+	u32 getPeerWindowSize(u16 peer_id, u8 channelnum);
 	const u32 GetProtocolID() const { return m_protocol_id; };
 	const std::string getDesc();
 	void DisconnectPeer(u16 peer_id);
@@ -0,0 +1,649 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "mediaserver.h"
+
+#include <string.h>
+#include <errno.h>
+#include <sstream>
+#include "mediastore.h"
+#include "networkprotocol.h"
+#include "debug.h"
+#include "log.h"
+#include "porting.h"
+#include "util/hex.h"
+#include "util/serialize.h"
+#include "util/container.h"
+#include "util/strfnd.h"
+#include "util/string.h"
+#include "util/thread.h"
+
+#ifdef _WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	#define LAST_SOCKET_ERR() WSAGetLastError()
+	#define SOCKET_WOULD_BLOCK(e) ((e) == WSAEWOULDBLOCK)
+	#define INVALID_SOCKET_FD INVALID_SOCKET
+	typedef int socklen_t;
+#else
+	#include <sys/types.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <netinet/in.h>
+	#include <netinet/tcp.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#define LAST_SOCKET_ERR() (errno)
+	#define SOCKET_WOULD_BLOCK(e) ((e) == EAGAIN || (e) == EWOULDBLOCK || (e) == EINTR)
+	#define INVALID_SOCKET_FD (-1)
+	#define closesocket close
+#endif
+
+// A client closing its connection must not raise SIGPIPE
+#ifdef MSG_NOSIGNAL
+	#define MEDIA_HTTP_SEND_FLAGS MSG_NOSIGNAL
+#else
+	#define MEDIA_HTTP_SEND_FLAGS 0
+#endif
+
+// Requests are tiny, only the hash set may be posted
+#define MEDIA_HTTP_MAX_HEADER_SIZE 8192
+// The listening socket has to fit into the fd_set too, which only holds
+// 64 sockets on Windows
+#define MEDIA_HTTP_MAX_CONNECTIONS MYMIN(200, FD_SETSIZE - 1)
+#define MEDIA_HTTP_IDLE_TIMEOUT_MS 30000
+#define MEDIA_HTTP_CHUNK_SIZE 65536
+// select() timeout while files are being read for some connections
+#define MEDIA_HTTP_LOAD_POLL_US 5000
+
+struct MediaHTTPConnection
+{
+	media_socket_t fd;
+	std::string in;
+	// Response header (or complete response if there is no file)
+	std::string out;
+	size_t out_pos = 0;
+	// File body following the header
+	MediaData *file = NULL;
+	u32 file_pos = 0;
+	// File that is being read by the MediaLoadThread for this connection,
+	// which isn't polled meanwhile
+	MediaData *loading = NULL;
+	bool loading_head = false;
+	bool continue_sent = false;
+	bool close_after = false;
+	u64 last_active;
+
+	bool isSending() const { return out_pos < out.size() || file; }
+
+	void finishFile()
+	{
+		if (file)
+			file->drop();
+		file = NULL;
+		if (loading)
+			loading->drop();
+		loading = NULL;
+	}
+};
+
+struct MediaLoadResult
+{
+	MediaData *file;
+	bool ok;
+
+	MediaLoadResult():
+		file(NULL),
+		ok(false)
+	{}
+};
+
+/*
+	Reads the media files requested from MediaHTTPServer.
+*/
+class MediaLoadThread : public UpdateThread
+{
+public:
+	MediaLoadThread():
+		UpdateThread("MediaLoad")
+	{}
+
+	~MediaLoadThread()
+	{
+		while (!m_queue_in.empty())
+			m_queue_in.pop_frontNoEx()->drop();
+		while (!m_queue_out.empty())
+			m_queue_out.pop_frontNoEx().file->drop();
+	}
+
+	// Grabs file until its result has been taken from m_queue_out
+	void queueFile(MediaData *file)
+	{
+		file->grab();
+		m_queue_in.push_back(file);
+		deferUpdate();
+	}
+
+	MutexedQueue<MediaLoadResult> m_queue_out;
+
+protected:
+	virtual void doUpdate()
+	{
+		while (!m_queue_in.empty()) {
+			MediaLoadResult r;
+			r.file = m_queue_in.pop_frontNoEx();
+			r.ok = r.file->load();
+			m_queue_out.push_back(r);
+		}
+	}
+
+private:
+	MutexedQueue<MediaData*> m_queue_in;
+};
+
+static void set_nonblocking(media_socket_t fd)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket(fd, FIONBIO, &mode);
+#else
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+// Returns false if hex isn't a hex encoded SHA1 digest
+static bool decode_sha1_hex(const std::string &hex, std::string *digest)
+{
+	if (hex.size() != 40)
+		return false;
+	digest->resize(20);
+	for (size_t i = 0; i < 20; i++) {
+		unsigned char hi, lo;
+		if (!hex_digit_decode(hex[i * 2], hi) ||
+				!hex_digit_decode(hex[i * 2 + 1], lo))
+			return false;
+		(*digest)[i] = (char)((hi << 4) | lo);
+	}
+	return true;
+}
+
+static const char *status_text(int status)
+{
+	switch (status) {
+	case 200: return "OK";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 405: return "Method Not Allowed";
+	case 413: return "Payload Too Large";
+	default:  return "Error";
+	}
+}
+
+MediaHTTPServer::MediaHTTPServer() :
+	Thread("MediaHTTP"),
+	m_socket(INVALID_SOCKET_FD),
+	m_loader(new MediaLoadThread())
+{
+}
+
+MediaHTTPServer::~MediaHTTPServer()
+{
+	stop();
+	wait();
+	delete m_loader;
+
+	for (size_t i = 0; i < m_connections.size(); i++) {
+		m_connections[i]->finishFile();
+		closesocket(m_connections[i]->fd);
+		delete m_connections[i];
+	}
+
+	if (m_socket != INVALID_SOCKET_FD)
+		closesocket(m_socket);
+
+	for (UNORDERED_MAP<std::string, MediaData*>::iterator
+			it = m_files.begin(); it != m_files.end(); ++it)
+		it->second->drop();
+}
+
+void MediaHTTPServer::addFile(const std::string &sha1_digest, MediaData *data)
+{
+	sanity_check(!isRunning());
+
+	// Same content may be registered under several names
+	if (m_files.find(sha1_digest) != m_files.end())
+		return;
+	data->grab();
+	m_files[sha1_digest] = data;
+}
+
+void MediaHTTPServer::bind(const Address &addr)
+{
+	int family = addr.isIPv6() ? AF_INET6 : AF_INET;
+	m_socket = socket(family, SOCK_STREAM, IPPROTO_TCP);
+	if (m_socket == INVALID_SOCKET_FD)
+		throw SocketException("MediaHTTPServer: Failed to create socket: error "
+			+ itos(LAST_SOCKET_ERR()));
+
+	int value = 1;
+	setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR,
+		(const char *)&value, sizeof(value));
+
+	int res;
+	if (family == AF_INET6) {
+		// Accept IPv4 clients too, like the UDP socket does with ipv6_server
+		value = 0;
+		setsockopt(m_socket, IPPROTO_IPV6, IPV6_V6ONLY,
+			(const char *)&value, sizeof(value));
+
+		struct sockaddr_in6 address = addr.getAddress6();
+		address.sin6_family = AF_INET6;
+		address.sin6_port = htons(addr.getPort());
+		res = ::bind(m_socket, (const struct sockaddr *)&address, sizeof(address));
+	} else {
+		struct sockaddr_in address = addr.getAddress();
+		address.sin_family = AF_INET;
+		address.sin_port = htons(addr.getPort());
+		res = ::bind(m_socket, (const struct sockaddr *)&address, sizeof(address));
+	}
+
+	if (res < 0 || listen(m_socket, 64) < 0) {
+		int err = LAST_SOCKET_ERR();
+		closesocket(m_socket);
+		m_socket = INVALID_SOCKET_FD;
+		throw SocketException("MediaHTTPServer: Failed to listen on port "
+			+ itos(addr.getPort()) + ": error " + itos(err));
+	}
+
+	set_nonblocking(m_socket);
+}
+
+void *MediaHTTPServer::run()
+{
+	sanity_check(m_socket != INVALID_SOCKET_FD);
+
+	m_loader->start();
+
+	while (!stopRequested()) {
+		while (!m_loader->m_queue_out.empty())
+			fileLoaded(m_loader->m_queue_out.pop_frontNoEx());
+
+		fd_set readset, writeset;
+		FD_ZERO(&readset);
+		FD_ZERO(&writeset);
+		media_socket_t maxfd = m_socket;
+		bool loading = false;
+
+		if (m_connections.size() < MEDIA_HTTP_MAX_CONNECTIONS)
+			FD_SET(m_socket, &readset);
+		for (size_t i = 0; i < m_connections.size(); i++) {
+			MediaHTTPConnection *con = m_connections[i];
+			if (con->loading)
+				loading = true;
+			else if (con->isSending())
+				FD_SET(con->fd, &writeset);
+			else
+				FD_SET(con->fd, &readset);
+			maxfd = MYMAX(maxfd, con->fd);
+		}
+
+		// Short timeout to notice stop requests and loaded files
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = loading ? MEDIA_HTTP_LOAD_POLL_US : 100000;
+		// The first argument is ignored on Windows
+		int res = select((int)maxfd + 1, &readset, &writeset, NULL, &tv);
+		if (res < 0) {
+			int err = LAST_SOCKET_ERR();
+			if (SOCKET_WOULD_BLOCK(err))
+				continue;
+			errorstream << "MediaHTTPServer: select() failed: error "
+				<< err << std::endl;
+			break;
+		}
+
+		if (FD_ISSET(m_socket, &readset))
+			acceptConnection();
+
+		u64 now = porting::getTimeMs();
+		for (size_t i = 0; i < m_connections.size(); ) {
+			MediaHTTPConnection *con = m_connections[i];
+			bool keep = true;
+			if (FD_ISSET(con->fd, &readset)) {
+				keep = receiveData(con);
+			} else if (FD_ISSET(con->fd, &writeset)) {
+				keep = sendData(con);
+			} else if (!con->loading &&
+					now > con->last_active + MEDIA_HTTP_IDLE_TIMEOUT_MS) {
+				keep = false;
+			}
+
+			if (keep) {
+				i++;
+				continue;
+			}
+			closeConnection(con);
+			m_connections.erase(m_connections.begin() + i);
+		}
+	}
+
+	m_loader->stop();
+	m_loader->wait();
+
+	return NULL;
+}
+
+void MediaHTTPServer::acceptConnection()
+{
+	media_socket_t fd = accept(m_socket, NULL, NULL);
+	if (fd == INVALID_SOCKET_FD)
+		return;
+#ifndef _WIN32
+	if (fd >= FD_SETSIZE) {
+		close(fd);
+		return;
+	}
+#endif
+
+	set_nonblocking(fd);
+	int value = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&value, sizeof(value));
+#ifdef SO_NOSIGPIPE
+	// No MSG_NOSIGNAL on BSD and macOS
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, (const char *)&value, sizeof(value));
+#endif
+
+	MediaHTTPConnection *con = new MediaHTTPConnection();
+	con->fd = fd;
+	con->last_active = porting::getTimeMs();
+	m_connections.push_back(con);
+}
+
+void MediaHTTPServer::closeConnection(MediaHTTPConnection *con)
+{
+	con->finishFile();
+	closesocket(con->fd);
+	delete con;
+}
+
+bool MediaHTTPServer::receiveData(MediaHTTPConnection *con)
+{
+	char buf[4096];
+	int received = recv(con->fd, buf, sizeof(buf), 0);
+	if (received < 0)
+		return SOCKET_WOULD_BLOCK(LAST_SOCKET_ERR());
+	if (received == 0)
+		return false;
+
+	con->in.append(buf, received);
+	con->last_active = porting::getTimeMs();
+
+	if (!handleRequest(con))
+		return false;
+	// Start sending right away instead of waiting for the next select()
+	if (con->isSending())
+		return sendData(con);
+	return true;
+}
+
+bool MediaHTTPServer::sendData(MediaHTTPConnection *con)
+{
+	con->last_active = porting::getTimeMs();
+
+	if (con->out_pos < con->out.size()) {
+		int sent = send(con->fd, con->out.c_str() + con->out_pos,
+			con->out.size() - con->out_pos, MEDIA_HTTP_SEND_FLAGS);
+		if (sent < 0)
+			return SOCKET_WOULD_BLOCK(LAST_SOCKET_ERR());
+		con->out_pos += sent;
+		if (con->out_pos < con->out.size())
+			return true;
+		con->out.clear();
+		con->out_pos = 0;
+	}
+
+	if (con->file) {
+		// The loaded content is sent, which is what was hashed
+		u32 left = con->file->getSize() - con->file_pos;
+		int sent = send(con->fd, con->file->getData() + con->file_pos,
+			MYMIN(left, MEDIA_HTTP_CHUNK_SIZE), MEDIA_HTTP_SEND_FLAGS);
+		if (sent < 0)
+			return SOCKET_WOULD_BLOCK(LAST_SOCKET_ERR());
+		con->file_pos += sent;
+		if (con->file_pos < con->file->getSize())
+			return true;
+		con->finishFile();
+	}
+
+	if (con->close_after)
+		return false;
+
+	// Pipelined request
+	if (!con->in.empty())
+		return handleRequest(con);
+	return true;
+}
+
+MediaHTTPParseResult parse_media_http_request(const std::string &in,
+		u32 max_body_size, MediaHTTPRequest *request)
+{
+	request->expect_continue = false;
+
+	size_t header_end = in.find("\r\n\r\n");
+	if (header_end == std::string::npos)
+		return in.size() > MEDIA_HTTP_MAX_HEADER_SIZE ?
+			MEDIA_HTTP_HEADER_TOO_LARGE : MEDIA_HTTP_INCOMPLETE;
+	if (header_end > MEDIA_HTTP_MAX_HEADER_SIZE)
+		return MEDIA_HTTP_HEADER_TOO_LARGE;
+
+	std::istringstream is(in.substr(0, header_end));
+	std::string line;
+	std::getline(is, line);
+	Strfnd request_line(trim(line));
+	request->method = request_line.next(" ");
+	std::string target = request_line.next(" ");
+	std::string version = request_line.next(" ");
+
+	// HTTP/1.1 defaults to keep-alive, older versions don't
+	request->keep_alive = version == "HTTP/1.1";
+	u32 content_length = 0;
+	while (std::getline(is, line)) {
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string name = lowercase(trim(line.substr(0, colon)));
+		std::string value = lowercase(trim(line.substr(colon + 1)));
+		if (name == "content-length")
+			content_length = mystoi(value, 0, S32_MAX);
+		else if (name == "connection")
+			request->keep_alive = value == "keep-alive";
+		else if (name == "expect")
+			request->expect_continue = value == "100-continue";
+	}
+
+	if (content_length > max_body_size)
+		return MEDIA_HTTP_BODY_TOO_LARGE;
+
+	request->size = header_end + 4 + content_length;
+	if (in.size() < request->size)
+		return MEDIA_HTTP_INCOMPLETE;
+
+	request->body = in.substr(header_end + 4, content_length);
+
+	// Ignore the query string
+	target = target.substr(0, target.find('?'));
+	if (target.size() > 1 && target[0] == '/')
+		target = target.substr(1);
+	request->target = target;
+	return MEDIA_HTTP_COMPLETE;
+}
+
+bool MediaHTTPServer::handleRequest(MediaHTTPConnection *con)
+{
+	if (con->isSending() || con->loading)
+		return true;
+
+	// Each hash has 20 bytes, refuse to buffer more than all of them
+	u32 max_body_size = 6 + 20 * (m_files.size() + 1);
+	MediaHTTPRequest request;
+	switch (parse_media_http_request(con->in, max_body_size, &request)) {
+	case MEDIA_HTTP_INCOMPLETE:
+		if (request.expect_continue && !con->continue_sent) {
+			con->out = "HTTP/1.1 100 Continue\r\n\r\n";
+			con->continue_sent = true;
+		}
+		return true;
+	case MEDIA_HTTP_HEADER_TOO_LARGE:
+		con->close_after = true;
+		respond(con, 413, "Request header too large\n");
+		return true;
+	case MEDIA_HTTP_BODY_TOO_LARGE:
+		con->close_after = true;
+		respond(con, 413, "Request body too large\n");
+		return true;
+	case MEDIA_HTTP_COMPLETE:
+		break;
+	}
+
+	con->in.erase(0, request.size);
+	con->continue_sent = false;
+	con->close_after = !request.keep_alive;
+
+	const std::string &method = request.method;
+	const std::string &target = request.target;
+	const std::string &body = request.body;
+	verbosestream << "MediaHTTPServer: " << method << " " << target << std::endl;
+
+	if (target == MTHASHSET_FILE_NAME) {
+		if (method != "POST" && method != "GET") {
+			respond(con, 405, "Method not allowed\n");
+			return true;
+		}
+		// A GET (or empty POST) asks for all available files
+		if (!body.empty() && (body.size() < 6 || body.size() % 20 != 6 ||
+				readU32((const u8 *)body.c_str()) != MTHASHSET_FILE_SIGNATURE ||
+				readU16((const u8 *)body.c_str() + 4) != 1)) {
+			respond(con, 400, "Invalid hash set\n");
+			return true;
+		}
+		respond(con, 200, getHashSet(body), "application/octet-stream");
+		return true;
+	}
+
+	if (method != "GET" && method != "HEAD") {
+		respond(con, 405, "Method not allowed\n");
+		return true;
+	}
+
+	std::string digest;
+	UNORDERED_MAP<std::string, MediaData*>::const_iterator it = m_files.end();
+	if (decode_sha1_hex(target, &digest))
+		it = m_files.find(digest);
+	if (it == m_files.end()) {
+		respond(con, 404, "Not found\n");
+		return true;
+	}
+
+	// Continued in fileLoaded(), even if the file has been read before:
+	// load() waits while the server thread reads it for a UDP transfer
+	it->second->grab();
+	con->loading = it->second;
+	con->loading_head = method == "HEAD";
+	m_loader->queueFile(it->second);
+	return true;
+}
+
+void MediaHTTPServer::fileLoaded(const MediaLoadResult &result)
+{
+	u64 now = porting::getTimeMs();
+	for (size_t i = 0; i < m_connections.size(); i++) {
+		MediaHTTPConnection *con = m_connections[i];
+		if (con->loading != result.file)
+			continue;
+
+		con->loading->drop();
+		con->loading = NULL;
+		con->last_active = now;
+		if (!result.ok) {
+			respond(con, 404, "Not found\n");
+			continue;
+		}
+		respondFile(con, result.file);
+		if (con->loading_head)
+			con->finishFile();
+	}
+	result.file->drop();
+}
+
+static std::string response_header(int status, const char *content_type,
+		u32 content_length, bool close)
+{
+	std::ostringstream os;
+	os << "HTTP/1.1 " << status << " " << status_text(status) << "\r\n"
+		<< "Content-Type: " << content_type << "\r\n"
+		<< "Content-Length: " << content_length << "\r\n"
+		<< "Connection: " << (close ? "close" : "keep-alive") << "\r\n"
+		<< "\r\n";
+	return os.str();
+}
+
+void MediaHTTPServer::respond(MediaHTTPConnection *con, int status,
+		const std::string &body, const char *content_type)
+{
+	con->out = response_header(status, content_type, body.size(),
+		con->close_after) + body;
+	con->out_pos = 0;
+}
+
+void MediaHTTPServer::respondFile(MediaHTTPConnection *con, MediaData *file)
+{
+	con->out = response_header(200, "application/octet-stream",
+		file->getSize(), con->close_after);
+	con->out_pos = 0;
+
+	file->grab();
+	con->file = file;
+	con->file_pos = 0;
+}
+
+std::string MediaHTTPServer::getHashSet(const std::string &request)
+{
+	std::ostringstream os(std::ios::binary);
+	writeU32(os, MTHASHSET_FILE_SIGNATURE);
+	writeU16(os, 1);
+
+	if (request.empty()) {
+		for (UNORDERED_MAP<std::string, MediaData*>::const_iterator
+				it = m_files.begin(); it != m_files.end(); ++it) {
+			os << it->first;
+		}
+		return os.str();
+	}
+
+	for (size_t pos = 6; pos + 20 <= request.size(); pos += 20) {
+		std::string digest = request.substr(pos, 20);
+		if (m_files.find(digest) != m_files.end())
+			os << digest;
+	}
+	return os.str();
+}
@@ -0,0 +1,118 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MEDIASERVER_HEADER
+#define MEDIASERVER_HEADER
+
+#include <string>
+#include <vector>
+#include "irrlichttypes.h"
+#include "socket.h"
+#include "threading/thread.h"
+#include "util/cpp11_container.h"
+
+class MediaData;
+class MediaLoadThread;
+struct MediaHTTPConnection;
+struct MediaLoadResult;
+
+#ifdef _WIN32
+	typedef SOCKET media_socket_t;
+#else
+	typedef int media_socket_t;
+#endif
+
+struct MediaHTTPRequest
+{
+	std::string method;
+	// Without leading slash and query string
+	std::string target;
+	std::string body;
+	bool keep_alive;
+	// Also set while the body is incomplete
+	bool expect_continue;
+	// Bytes of the request at the start of the buffer
+	size_t size;
+};
+
+enum MediaHTTPParseResult
+{
+	MEDIA_HTTP_INCOMPLETE,
+	MEDIA_HTTP_COMPLETE,
+	MEDIA_HTTP_HEADER_TOO_LARGE,
+	MEDIA_HTTP_BODY_TOO_LARGE,
+};
+
+// Parses the first request in the received data in
+MediaHTTPParseResult parse_media_http_request(const std::string &in,
+		u32 max_body_size, MediaHTTPRequest *request);
+
+/*
+	Small built-in HTTP server for the remote media protocol used by
+	ClientMediaDownloader, so that servers don't need to run and sync an
+	external web server to use remote_media:
+
+	POST /index.mth     Hash set (see ClientMediaDownloader) of the
+	                    posted hashes that are available here
+	GET  /<sha1 in hex> Content of the media file
+
+	All files have to be added before the thread is started. Files are read
+	on a separate thread, so that a slow disk doesn't stall the other
+	connections.
+*/
+class MediaHTTPServer : public Thread
+{
+public:
+	MediaHTTPServer();
+	~MediaHTTPServer();
+
+	// Grabs data, sha1_digest is the raw 20 byte digest
+	void addFile(const std::string &sha1_digest, MediaData *data);
+
+	// Throws SocketException on failure
+	void bind(const Address &addr);
+
+protected:
+	void *run();
+
+private:
+	void acceptConnection();
+	void closeConnection(MediaHTTPConnection *con);
+
+	// These return false if the connection has to be closed
+	bool receiveData(MediaHTTPConnection *con);
+	bool sendData(MediaHTTPConnection *con);
+	bool handleRequest(MediaHTTPConnection *con);
+	void fileLoaded(const MediaLoadResult &result);
+
+	void respond(MediaHTTPConnection *con, int status, const std::string &body,
+			const char *content_type = "text/plain");
+	void respondFile(MediaHTTPConnection *con, MediaData *file);
+	std::string getHashSet(const std::string &request);
+
+	media_socket_t m_socket;
+	// Key is the raw SHA1 digest
+	UNORDERED_MAP<std::string, MediaData*> m_files;
+	std::vector<MediaHTTPConnection*> m_connections;
+	MediaLoadThread *m_loader;
+
+	DISABLE_CLASS_COPY(MediaHTTPServer);
+};
+
+#endif
@@ -122,17 +122,15 @@ NetworkPacket& NetworkPacket::operator<<(const std::string &src)
 	return *this;
 }
 
-void NetworkPacket::putLongString(const std::string &src)
+void NetworkPacket::putLongString(const char *src, u32 len)
 {
-	if (src.size() > LONG_STRING_MAX_LEN) {
+	if (len > LONG_STRING_MAX_LEN) {
 		throw PacketError("String too long");
 	}
 
-	u32 msgsize = src.size();
+	*this << len;
 
-	*this << msgsize;
-
-	putRawString(src.c_str(), msgsize);
+	putRawString(src, len);
 }
 
 NetworkPacket& NetworkPacket::operator>>(std::wstring& dst)
@@ -54,7 +54,9 @@ class NetworkPacket
 		NetworkPacket& operator>>(std::string& dst);
 		NetworkPacket& operator<<(const std::string &src);
 
-		void putLongString(const std::string &src);
+		void putLongString(const std::string &src)
+			{ putLongString(src.c_str(), src.size()); }
+		void putLongString(const char *src, u32 len);
 
 		NetworkPacket& operator>>(std::wstring& dst);
 		NetworkPacket& operator<<(const std::wstring &src);
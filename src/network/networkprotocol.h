@@ -158,10 +158,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 	PROTOCOL VERSION 33:
 		Add TOCLIENT_UPDATE_PLAYER_LIST and send the player list to the client,
 			instead of guessing based on the active object list.
+	PROTOCOL VERSION 34:
+		Add TOCLIENT_INVENTORY_DELTA, inventories are only fully sent
+			when lists got removed
 
 */
 
-#define LATEST_PROTOCOL_VERSION 33
+#define LATEST_PROTOCOL_VERSION 34
 
 // Server's supported network protocol range
 #define SERVER_PROTOCOL_VERSION_MIN 24
@@ -185,6 +188,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define TEXTURENAME_ALLOWED_CHARS "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-"
 
+// Hash set file of the remote media protocol, see ClientMediaDownloader
+#define MTHASHSET_FILE_SIGNATURE 0x4d544853 // 'MTHS'
+#define MTHASHSET_FILE_NAME "index.mth"
+
 enum ToClientCommand
 {
 	TOCLIENT_HELLO = 0x02,
@@ -395,7 +402,10 @@ enum ToClientCommand
 	TOCLIENT_NODEDEF = 0x3a,
 	/*
 		u32 length of the next item
-		serialized NodeDefManager
+		zlib-compressed serialized NodeDefManager, empty if the client
+			has it cached (see TOSERVER_INIT2)
+		u16 length of sha1_digest (added later, not sent by older servers)
+		string sha1_digest of the compressed NodeDefManager
 	*/
 
 	TOCLIENT_CRAFTITEMDEF = 0x3b,
@@ -419,7 +429,10 @@ enum ToClientCommand
 	TOCLIENT_ITEMDEF = 0x3d,
 	/*
 		u32 length of next item
-		serialized ItemDefManager
+		zlib-compressed serialized ItemDefManager, empty if the client
+			has it cached (see TOSERVER_INIT2)
+		u16 length of sha1_digest (added later, not sent by older servers)
+		string sha1_digest of the compressed ItemDefManager
 	*/
 
 	TOCLIENT_PLAY_SOUND = 0x3f,
@@ -642,6 +655,27 @@ enum ToClientCommand
 			u8[len] player name
 	*/
 
+	TOCLIENT_INVENTORY_DELTA = 0x57,
+	/*
+		Changed slots of the player's or a detached inventory
+
+		std::string detached inventory name, empty for the player's inventory
+		u16 list count
+		for each list:
+			std::string list name
+			u32 list size
+			u32 list width
+			u16 slot count
+			for each slot:
+				u16 index
+				std::string item name, empty for an empty slot
+				if item name is not empty:
+					u16 count
+					u16 wear
+					u32 len
+					u8[len] serialized ItemStackMetadata
+	*/
+
 	TOCLIENT_SRP_BYTES_S_B = 0x60,
 	/*
 		Belonging to AUTH_MECHANISM_LEGACY_PASSWORD and AUTH_MECHANISM_SRP.
@@ -684,6 +718,12 @@ enum ToServerCommand
 		After this, the server can send data.
 
 		[0] u16 TOSERVER_INIT2
+		Added later, not sent by older clients:
+		u16 length of item definitions sha1_digest
+		string sha1_digest of the item definitions cached from this server
+		u16 length of node definitions sha1_digest
+		string sha1_digest of the node definitions cached from this server
+		The digests are empty if the client has no cached definitions.
 	*/
 
 	TOSERVER_GETBLOCK=0x20, // Obsolete
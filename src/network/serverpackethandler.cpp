@@ -610,6 +610,10 @@ void Server::handleCommand_Init2(NetworkPacket* pkt)
 	m_clients.event(pkt->getPeerId(), CSE_GotInit2);
 	u16 protocol_version = m_clients.getProtocolVersion(pkt->getPeerId());
 
+	// SHA1s of the definitions the client has cached, if it caches them
+	std::string itemdef_sha1, nodedef_sha1;
+	if (pkt->getRemainingBytes() > 0)
+		*pkt >> itemdef_sha1 >> nodedef_sha1;
 
 	/*
 		Send some initialization data
@@ -622,10 +626,10 @@ void Server::handleCommand_Init2(NetworkPacket* pkt)
 	SendMovement(pkt->getPeerId());
 
 	// Send item definitions
-	SendItemDef(pkt->getPeerId(), m_itemdef, protocol_version);
+	SendItemDef(pkt->getPeerId(), m_itemdef, protocol_version, itemdef_sha1);
 
 	// Send node definitions
-	SendNodeDef(pkt->getPeerId(), m_nodedef, protocol_version);
+	SendNodeDef(pkt->getPeerId(), m_nodedef, protocol_version, nodedef_sha1);
 
 	m_clients.event(pkt->getPeerId(), CSE_SetDefinitionsSent);
 
@@ -930,7 +934,9 @@ void Server::handleCommand_InventoryAction(NetworkPacket* pkt)
 
 	/*
 		Note: Always set inventory not sent, to repair cases
-		where the client made a bad prediction.
+		where the client made a bad prediction. The touched slots
+		are marked with setSlotsDirty() first, so that the detached
+		inventory deltas sent here contain them.
 	*/
 
 	/*
@@ -942,6 +948,7 @@ void Server::handleCommand_InventoryAction(NetworkPacket* pkt)
 		ma->from_inv.applyCurrentPlayer(player->getName());
 		ma->to_inv.applyCurrentPlayer(player->getName());
 
+		ma->setSlotsDirty(this);
 		setInventoryModified(ma->from_inv, false);
 		setInventoryModified(ma->to_inv, false);
 
@@ -1008,6 +1015,7 @@ void Server::handleCommand_InventoryAction(NetworkPacket* pkt)
 
 		da->from_inv.applyCurrentPlayer(player->getName());
 
+		da->setSlotsDirty(this);
 		setInventoryModified(da->from_inv, false);
 
 		/*
@@ -1044,6 +1052,7 @@ void Server::handleCommand_InventoryAction(NetworkPacket* pkt)
 
 		ca->craft_inv.applyCurrentPlayer(player->getName());
 
+		ca->setSlotsDirty(this);
 		setInventoryModified(ca->craft_inv, false);
 
 		//bool craft_inv_is_current_player =
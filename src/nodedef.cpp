@@ -898,6 +898,7 @@ class CNodeDefManager: public IWritableNodeDefManager {
 		void *progress_cbk_args);
 	void serialize(std::ostream &os, u16 protocol_version) const;
 	void deSerialize(std::istream &is);
+	virtual u32 getRevision() const { return m_revision; }
 
 	inline virtual void setNodeRegistrationStatus(bool completed);
 
@@ -953,10 +954,14 @@ class CNodeDefManager: public IWritableNodeDefManager {
 	 * contains all nodes' selection boxes.
 	 */
 	core::aabbox3d<s16> m_selection_box_int_union;
+
+	// Incremented by the changes of m_content_features, see getRevision()
+	u32 m_revision;
 };
 
 
-CNodeDefManager::CNodeDefManager()
+CNodeDefManager::CNodeDefManager():
+	m_revision(0)
 {
 	clear();
 }
@@ -978,6 +983,7 @@ CNodeDefManager::~CNodeDefManager()
 
 void CNodeDefManager::clear()
 {
+	m_revision++;
 	m_content_features.clear();
 	m_name_id_mapping.clear();
 	m_name_id_mapping_with_aliases.clear();
@@ -1288,6 +1294,7 @@ content_t CNodeDefManager::set(const std::string &name, const ContentFeatures &d
 		addNameIdMapping(id, name);
 	}
 	m_content_features[id] = def;
+	m_revision++;
 	verbosestream << "NodeDefManager: registering content id \"" << id
 		<< "\": name=\"" << def.name << "\""<<std::endl;
 
@@ -1331,6 +1338,7 @@ void CNodeDefManager::removeNode(const std::string &name)
 	// Erase name from name ID mapping
 	content_t id = CONTENT_IGNORE;
 	if (m_name_id_mapping.getId(name, id)) {
+		m_revision++;
 		m_name_id_mapping.eraseName(name);
 		m_name_id_mapping_with_aliases.erase(name);
 	}
@@ -1377,6 +1385,7 @@ void CNodeDefManager::applyTextureOverrides(const std::string &override_filepath
 {
 	infostream << "CNodeDefManager::applyTextureOverrides(): Applying "
 		"overrides to textures from " << override_filepath << std::endl;
+	m_revision++;
 
 	std::ifstream infile(override_filepath.c_str());
 	std::string line;
@@ -1874,6 +1883,7 @@ void CNodeDefManager::resetNodeResolveState()
 
 void CNodeDefManager::mapNodeboxConnections()
 {
+	m_revision++;
 	for (u32 i = 0; i < m_content_features.size(); i++) {
 		ContentFeatures *f = &m_content_features[i];
 		if ((f->drawtype != NDT_NODEBOX) || (f->node_box.type != NODEBOX_CONNECTED))
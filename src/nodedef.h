@@ -433,6 +433,8 @@ class INodeDefManager {
 	virtual const ContentFeatures &get(const std::string &name) const=0;
 
 	virtual void serialize(std::ostream &os, u16 protocol_version) const=0;
+	// Changes whenever the serialized definitions may change
+	virtual u32 getRevision() const=0;
 
 	virtual void pendNodeResolve(NodeResolver *nr)=0;
 	virtual bool cancelNodeResolveCallback(NodeResolver *nr)=0;
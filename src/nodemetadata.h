@@ -91,6 +91,8 @@ class NodeMetadataList
 	void set(v3s16 p, NodeMetadata *d);
 	// Deletes all
 	void clear();
+	void swap(NodeMetadataList &other)
+	{ m_data.swap(other.m_data); }
 
 private:
 	int countNonEmpty() const;
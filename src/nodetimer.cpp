@@ -18,10 +18,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "nodetimer.h"
+#include <algorithm>
+#include <cmath>
 #include "log.h"
 #include "serialization.h"
 #include "util/serialize.h"
-#include "constants.h" // MAP_BLOCKSIZE
 
 /*
 	NodeTimer
@@ -39,6 +40,130 @@ void NodeTimer::deSerialize(std::istream &is)
 	elapsed = readF1000(is);
 }
 
+/*
+	NodeTimerWheel
+*/
+
+NodeTimerWheel::NodeTimerWheel(double resolution):
+	m_resolution(resolution > 0 ? resolution : 0.2),
+	m_time(0.),
+	m_tick(0),
+	m_next_id(1),
+	m_size(0)
+{
+}
+
+u32 NodeTimerWheel::schedule(v3s16 blockpos, u16 index, double trigger_time)
+{
+	Entry e;
+	e.blockpos = blockpos;
+	e.index = index;
+	e.id = m_next_id++;
+	if (m_next_id == 0)
+		m_next_id = 1;
+
+	// Timers that are already due trigger on the next tick
+	double tick = std::ceil(trigger_time / m_resolution);
+	e.tick = tick > (double)m_tick ? (u64)tick : m_tick + 1;
+
+	add(e);
+	m_size++;
+	return e.id;
+}
+
+void NodeTimerWheel::cancel(u32 id)
+{
+	if (id == 0)
+		return;
+	m_cancelled.insert(id);
+
+	// Ids of entries that already came up are kept too, until the next
+	// compaction clears them
+	if (m_cancelled.size() > 1024 && m_cancelled.size() > m_size / 2)
+		compact();
+}
+
+bool NodeTimerWheel::drop(const Entry &e)
+{
+	if (m_cancelled.empty() || m_cancelled.erase(e.id) == 0)
+		return false;
+	m_size--;
+	return true;
+}
+
+void NodeTimerWheel::compact()
+{
+	for (u32 level = 0; level < LEVELS; level++)
+	for (u32 slot = 0; slot < SLOTS; slot++)
+		dropAll(m_slots[level][slot]);
+	dropAll(m_overflow);
+	m_cancelled.clear();
+}
+
+void NodeTimerWheel::dropAll(std::vector<Entry> &entries)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (!drop(entries[i]))
+			entries[kept++] = entries[i];
+	}
+	entries.resize(kept);
+}
+
+void NodeTimerWheel::add(const Entry &e)
+{
+	u64 delta = e.tick - m_tick;
+	for (u32 level = 0; level < LEVELS; level++) {
+		if (delta < (1ULL << (SLOT_BITS * (level + 1)))) {
+			u32 slot = (e.tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+			m_slots[level][slot].push_back(e);
+			return;
+		}
+	}
+	m_overflow.push_back(e);
+}
+
+void NodeTimerWheel::step(double dtime, std::vector<Entry> &expired)
+{
+	m_time += dtime;
+	// Tolerate the rounding errors of adding up dtimes
+	u64 target = (u64)(m_time / m_resolution + 0.001);
+
+	std::vector<Entry> moved;
+	while (m_tick < target) {
+		m_tick++;
+
+		// Move the entries of the slots that came up a level down,
+		// starting at the top
+		if ((m_tick & ((1ULL << (SLOT_BITS * LEVELS)) - 1)) == 0) {
+			moved.swap(m_overflow);
+			for (size_t i = 0; i < moved.size(); i++)
+				if (!drop(moved[i]))
+					add(moved[i]);
+			moved.clear();
+		}
+		for (u32 level = LEVELS - 1; level > 0; level--) {
+			if ((m_tick & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+				continue;
+			u32 slot = (m_tick >> (SLOT_BITS * level)) & (SLOTS - 1);
+			moved.swap(m_slots[level][slot]);
+			for (size_t i = 0; i < moved.size(); i++)
+				if (!drop(moved[i]))
+					add(moved[i]);
+			moved.clear();
+		}
+
+		std::vector<Entry> &due = m_slots[0][m_tick & (SLOTS - 1)];
+		for (size_t i = 0; i < due.size(); i++) {
+			if (drop(due[i]))
+				continue;
+			expired.push_back(due[i]);
+			m_size--;
+		}
+		due.clear();
+	}
+}
+
 /*
 	NodeTimerList
 */
@@ -60,16 +185,14 @@ void NodeTimerList::serialize(std::ostream &os, u8 map_format_version) const
 		writeU16(os, m_timers.size());
 	}
 
-	for (std::multimap<double, NodeTimer>::const_iterator
-			i = m_timers.begin();
+	double time = getTime();
+	for (std::map<u16, Timer>::const_iterator i = m_timers.begin();
 			i != m_timers.end(); ++i) {
-		NodeTimer t = i->second;
-		NodeTimer nt = NodeTimer(t.timeout,
-			t.timeout - (f32)(i->first - m_time), t.position);
-		v3s16 p = t.position;
+		const Timer &t = i->second;
+		NodeTimer nt(t.timeout, t.timeout - (f32)(t.trigger_time - time),
+			getPosition(i->first));
 
-		u16 p16 = p.Z * MAP_BLOCKSIZE * MAP_BLOCKSIZE + p.Y * MAP_BLOCKSIZE + p.X;
-		writeU16(os, p16);
+		writeU16(os, i->first);
 		nt.serialize(os);
 	}
 }
@@ -115,7 +238,7 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 			continue;
 		}
 
-		if (m_iterators.find(p) != m_iterators.end()) {
+		if (m_timers.find(getIndex(p)) != m_timers.end()) {
 			warningstream<<"NodeTimerList::deSerialize(): "
 					<<"already set data at position"
 					<<"("<<p.X<<","<<p.Y<<","<<p.Z<<"): Ignoring."
@@ -127,26 +250,128 @@ void NodeTimerList::deSerialize(std::istream &is, u8 map_format_version)
 	}
 }
 
+NodeTimer NodeTimerList::get(const v3s16 &p) const
+{
+	std::map<u16, Timer>::const_iterator n = m_timers.find(getIndex(p));
+	if (n == m_timers.end())
+		return NodeTimer();
+	const Timer &t = n->second;
+	return NodeTimer(t.timeout,
+		t.timeout - (f32)(t.trigger_time - getTime()), p);
+}
+
+void NodeTimerList::remove(const v3s16 &p)
+{
+	std::map<u16, Timer>::iterator n = m_timers.find(getIndex(p));
+	if (n == m_timers.end())
+		return;
+	if (m_wheel)
+		m_wheel->cancel(n->second.id);
+	m_timers.erase(n);
+}
+
+void NodeTimerList::clear()
+{
+	if (m_wheel) {
+		for (std::map<u16, Timer>::iterator i = m_timers.begin();
+				i != m_timers.end(); ++i)
+			m_wheel->cancel(i->second.id);
+	}
+	m_timers.clear();
+}
+
+void NodeTimerList::insert(const NodeTimer &timer)
+{
+	u16 i = getIndex(timer.position);
+	Timer t;
+	t.timeout = timer.timeout;
+	t.trigger_time = getTime() + (double)(timer.timeout - timer.elapsed);
+	t.id = m_wheel ? m_wheel->schedule(m_blockpos, i, t.trigger_time) : 0;
+	m_timers[i] = t;
+}
+
+struct ElapsedTimerOrder
+{
+	bool operator()(const std::pair<double, NodeTimer> &a,
+		const std::pair<double, NodeTimer> &b) const
+	{
+		return a.first < b.first;
+	}
+};
+
 std::vector<NodeTimer> NodeTimerList::step(float dtime)
 {
 	std::vector<NodeTimer> elapsed_timers;
 	m_time += dtime;
-	if (m_next_trigger_time == -1. || m_time < m_next_trigger_time) {
-		return elapsed_timers;
-	}
-	std::multimap<double, NodeTimer>::iterator i = m_timers.begin();
+
 	// Process timers
-	for (; i != m_timers.end() && i->first <= m_time; ++i) {
-		NodeTimer t = i->second;
-		t.elapsed = t.timeout + (f32)(m_time - i->first);
-		elapsed_timers.push_back(t);
-		m_iterators.erase(t.position);
+	std::vector<std::pair<double, NodeTimer> > elapsed;
+	for (std::map<u16, Timer>::iterator i = m_timers.begin();
+			i != m_timers.end();) {
+		const Timer &t = i->second;
+		if (t.trigger_time > m_time) {
+			++i;
+			continue;
+		}
+		elapsed.push_back(std::make_pair(t.trigger_time, NodeTimer(t.timeout,
+			t.timeout + (f32)(m_time - t.trigger_time),
+			getPosition(i->first))));
+		m_timers.erase(i++);
 	}
-	// Delete elapsed timers
-	m_timers.erase(m_timers.begin(), i);
-	if (m_timers.empty())
-		m_next_trigger_time = -1.;
-	else
-		m_next_trigger_time = m_timers.begin()->first;
+
+	// In the order they elapsed
+	std::stable_sort(elapsed.begin(), elapsed.end(), ElapsedTimerOrder());
+	for (size_t i = 0; i < elapsed.size(); i++)
+		elapsed_timers.push_back(elapsed[i].second);
 	return elapsed_timers;
 }
+
+void NodeTimerList::schedule(NodeTimerWheel *wheel, v3s16 blockpos)
+{
+	if (m_wheel)
+		unschedule();
+
+	double shift = wheel->getTime() - m_time;
+	for (std::map<u16, Timer>::iterator i = m_timers.begin();
+			i != m_timers.end(); ++i) {
+		Timer &t = i->second;
+		t.trigger_time += shift;
+		t.id = wheel->schedule(blockpos, i->first, t.trigger_time);
+	}
+	m_wheel = wheel;
+	m_blockpos = blockpos;
+}
+
+void NodeTimerList::unschedule()
+{
+	if (!m_wheel)
+		return;
+
+	m_time = m_wheel->getTime();
+	for (std::map<u16, Timer>::iterator i = m_timers.begin();
+			i != m_timers.end(); ++i) {
+		m_wheel->cancel(i->second.id);
+		i->second.id = 0;
+	}
+	m_wheel = NULL;
+}
+
+bool NodeTimerList::takeExpired(const NodeTimerWheel::Entry &e,
+	NodeTimer &timer)
+{
+	std::map<u16, Timer>::iterator i = m_timers.find(e.index);
+	if (!m_wheel || i == m_timers.end() || i->second.id != e.id)
+		return false;
+
+	Timer &t = i->second;
+	double time = m_wheel->getTime();
+	if (t.trigger_time > time) {
+		t.id = m_wheel->schedule(m_blockpos, e.index, t.trigger_time);
+		return false;
+	}
+
+	timer = NodeTimer(t.timeout, t.timeout + (f32)(time - t.trigger_time),
+		getPosition(e.index));
+	m_timers.erase(i);
+	return true;
+}
@@ -24,6 +24,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <iostream>
 #include <map>
 #include <vector>
+#include "constants.h"
+#include "util/basic_macros.h"
+#include "util/cpp11_container.h"
 
 /*
 	NodeTimer provides per-node timed callback functionality.
@@ -51,86 +54,157 @@ class NodeTimer
 	v3s16 position;
 };
 
+/*
+	Hierarchical timing wheel holding the node timers of all active
+	blocks, keyed by the time they trigger at.
+
+	Time advances in ticks of a fixed length. Each level has a ring of
+	slots, a slot of level l covering 64^l ticks. A timer goes to the
+	lowest level that reaches its tick, and is moved down a level when
+	the slot it is in comes up. Stepping only touches the slots that come
+	up and the timers in them, no matter how many timers are waiting.
+
+	The wheel only knows where timers are, the timers themselves are kept
+	by the NodeTimerList of their block. Changing or removing a timer
+	cancels its entry. Cancelled entries are dropped when their slot comes
+	up, or all at once when they outnumber the others. Entries the list
+	did not cancel, e.g. of unloaded blocks, are rejected by their id.
+*/
+
+class NodeTimerWheel
+{
+public:
+	struct Entry
+	{
+		v3s16 blockpos;
+		// Index of the node in its block
+		u16 index;
+		u32 id;
+		u64 tick;
+	};
+
+	NodeTimerWheel(double resolution);
+
+	inline double getTime() const { return m_time; }
+	// Number of entries, including cancelled ones that were not dropped yet
+	u32 size() const { return m_size; }
+
+	// Returns the id of the new entry
+	u32 schedule(v3s16 blockpos, u16 index, double trigger_time);
+	// The entry will not be returned by step()
+	void cancel(u32 id);
+
+	// Move forward in time, appends the entries that came up to expired
+	void step(double dtime, std::vector<Entry> &expired);
+
+private:
+	static const u32 SLOT_BITS = 6;
+	static const u32 SLOTS = 1 << SLOT_BITS;
+	static const u32 LEVELS = 4;
+
+	void add(const Entry &e);
+	// If e was cancelled, forgets about it and returns true
+	bool drop(const Entry &e);
+	// Removes the cancelled entries from entries
+	void dropAll(std::vector<Entry> &entries);
+	// Removes all cancelled entries from the wheel
+	void compact();
+
+	std::vector<Entry> m_slots[LEVELS][SLOTS];
+	// Entries beyond the last level
+	std::vector<Entry> m_overflow;
+	double m_resolution;
+	double m_time;
+	// The last tick that was processed
+	u64 m_tick;
+	u32 m_next_id;
+	u32 m_size;
+	// Ids of the cancelled entries
+	UNORDERED_SET<u32> m_cancelled;
+
+	DISABLE_CLASS_COPY(NodeTimerWheel);
+};
+
 /*
 	List of timers of all the nodes of a block
+
+	While the block is active, the list is scheduled on a NodeTimerWheel
+	and runs on its clock. Otherwise it keeps a clock of its own, which
+	only moves when stepped.
 */
 
 class NodeTimerList
 {
 public:
-	NodeTimerList(): m_next_trigger_time(-1.), m_time(0.) {}
+	NodeTimerList(): m_time(0.), m_wheel(NULL) {}
 	~NodeTimerList() {}
-	
+
 	void serialize(std::ostream &os, u8 map_format_version) const;
 	void deSerialize(std::istream &is, u8 map_format_version);
-	
+
 	// Get timer
-	NodeTimer get(const v3s16 &p) {
-		std::map<v3s16, std::multimap<double, NodeTimer>::iterator>::iterator n =
-			m_iterators.find(p);
-		if (n == m_iterators.end())
-			return NodeTimer();
-		NodeTimer t = n->second->second;
-		t.elapsed = t.timeout - (n->second->first - m_time);
-		return t;
-	}
+	NodeTimer get(const v3s16 &p) const;
 	// Deletes timer
-	void remove(v3s16 p) {
-		std::map<v3s16, std::multimap<double, NodeTimer>::iterator>::iterator n =
-			m_iterators.find(p);
-		if(n != m_iterators.end()) {
-			double removed_time = n->second->first;
-			m_timers.erase(n->second);
-			m_iterators.erase(n);
-			// Yes, this is float equality, but it is not a problem
-			// since we only test equality of floats as an ordered type
-			// and thus we never lose precision
-			if (removed_time == m_next_trigger_time) {
-				if (m_timers.empty())
-					m_next_trigger_time = -1.;
-				else
-					m_next_trigger_time = m_timers.begin()->first;
-			}
-		}
-	}
+	void remove(const v3s16 &p);
 	// Undefined behaviour if there already is a timer
-	void insert(NodeTimer timer) {
-		v3s16 p = timer.position;
-		double trigger_time = m_time + (double)(timer.timeout - timer.elapsed);
-		std::multimap<double, NodeTimer>::iterator it =
-			m_timers.insert(std::pair<double, NodeTimer>(
-				trigger_time, timer
-			));
-		m_iterators.insert(
-			std::pair<v3s16, std::multimap<double, NodeTimer>::iterator>(p, it));
-		if (m_next_trigger_time == -1. || trigger_time < m_next_trigger_time)
-			m_next_trigger_time = trigger_time;
-	}
+	void insert(const NodeTimer &timer);
 	// Deletes old timer and sets a new one
 	inline void set(const NodeTimer &timer) {
 		remove(timer.position);
 		insert(timer);
 	}
 	// Deletes all timers
-	void clear() {
-		m_timers.clear();
-		m_iterators.clear();
-		m_next_trigger_time = -1.;
-	}
+	void clear();
 
-	inline double getNextTriggerTime() {
-		return m_next_trigger_time;
+	inline u32 size() const {
+		return m_timers.size();
 	}
 
-	// Move forward in time, returns elapsed timers
+	// Move forward in time, returns elapsed timers.
+	// Only for lists that are not scheduled.
 	std::vector<NodeTimer> step(float dtime);
 
+	// Hands the timers over to the wheel and switches to its clock
+	void schedule(NodeTimerWheel *wheel, v3s16 blockpos);
+	// Switches back to a clock of its own
+	void unschedule();
+	inline bool isScheduled() const {
+		return m_wheel != NULL;
+	}
+
+	/*
+		If the wheel entry is current and its timer has elapsed, removes
+		the timer and returns true. A timer that is not quite due yet is
+		scheduled again.
+	*/
+	bool takeExpired(const NodeTimerWheel::Entry &e, NodeTimer &timer);
+
 private:
-	std::multimap<double, NodeTimer> m_timers;
-	std::map<v3s16, std::multimap<double, NodeTimer>::iterator> m_iterators;
-	double m_next_trigger_time;
+	struct Timer
+	{
+		f32 timeout;
+		double trigger_time;
+		// Id of the wheel entry, if scheduled
+		u32 id;
+	};
+
+	inline double getTime() const {
+		return m_wheel ? m_wheel->getTime() : m_time;
+	}
+
+	static inline u16 getIndex(const v3s16 &p) {
+		return (p.Z * MAP_BLOCKSIZE + p.Y) * MAP_BLOCKSIZE + p.X;
+	}
+	static inline v3s16 getPosition(u16 i) {
+		return v3s16(i % MAP_BLOCKSIZE, (i / MAP_BLOCKSIZE) % MAP_BLOCKSIZE,
+			i / (MAP_BLOCKSIZE * MAP_BLOCKSIZE));
+	}
+
+	// Timers by node index
+	std::map<u16, Timer> m_timers;
 	double m_time;
+	NodeTimerWheel *m_wheel;
+	v3s16 m_blockpos;
 };
 
 #endif
-
@@ -44,7 +44,9 @@ ObjectProperties::ObjectProperties():
 	backface_culling(true),
 	nametag(""),
 	nametag_color(255, 255, 255, 255),
-	automatic_face_movement_max_rotation_per_sec(-1)
+	automatic_face_movement_max_rotation_per_sec(-1),
+	full_step_rate(false),
+	cache_staticdata(false)
 {
 	textures.push_back("unknown_object.png");
 	colors.push_back(video::SColor(255,255,255,255));
@@ -77,6 +79,8 @@ std::string ObjectProperties::dump()
 	os<<", makes_footstep_sound="<<makes_footstep_sound;
 	os<<", automatic_rotate="<<automatic_rotate;
 	os<<", backface_culling="<<backface_culling;
+	os << ", full_step_rate=" << full_step_rate;
+	os << ", cache_staticdata=" << cache_staticdata;
 	os << ", nametag=" << nametag;
 	os << ", nametag_color=" << "\"" << nametag_color.getAlpha() << "," << nametag_color.getRed()
 			<< "," << nametag_color.getGreen() << "," << nametag_color.getBlue() << "\" ";
@@ -54,6 +54,11 @@ struct ObjectProperties
 	std::string infotext;
 	//! For dropped items, this contains item information.
 	std::string wield_item;
+	//! Server only, not sent to clients: never step less often, see
+	//! entity_lod_distance.
+	bool full_step_rate;
+	//! Server only: reuse the last staticdata until set_staticdata_dirty()
+	bool cache_staticdata;
 
 	ObjectProperties();
 	std::string dump();
@@ -31,9 +31,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "inventorymanager.h" // deserializing InventoryLocations
 #include "sqlite3.h"
 #include "filesys.h"
+#include "settings.h"
+#include "threading/mutex_auto_lock.h"
+#include "threading/thread.h"
 
 #define POINTS_PER_NODE (16.0)
 
+// Wake the write thread when this many actions are queued
+#define ROLLBACK_WRITE_BATCH 500
+// Block the reporting thread until the queue is written above this size
+#define ROLLBACK_QUEUE_MAX 100000
+
 #define SQLRES(f, good) \
 	if ((f) != (good)) {\
 		throw FileNotGoodException(std::string("RollbackManager: " \
@@ -82,9 +90,27 @@ struct ActionRow {
 };
 
 
-struct Entity {
-	int         id;
-	std::string name;
+class RollbackWriteThread : public Thread
+{
+public:
+	RollbackWriteThread(RollbackManager *mgr) :
+		Thread("RollbackWrite"),
+		m_mgr(mgr)
+	{}
+
+	void *run()
+	{
+		while (!stopRequested()) {
+			// Write queued actions at least once a second
+			m_mgr->m_queue_sem.wait(1000);
+			m_mgr->writeQueued(false);
+		}
+		m_mgr->writeQueued(true);
+		return NULL;
+	}
+
+private:
+	RollbackManager *m_mgr;
 };
 
 
@@ -92,7 +118,10 @@ struct Entity {
 RollbackManager::RollbackManager(const std::string & world_path,
 		IGameDef * gamedef_) :
 	gamedef(gamedef_),
-	current_actor_is_guess(false)
+	current_actor_is_guess(false),
+	m_write_thread(NULL),
+	m_flush_requests(0),
+	m_coalesce_time(MYMAX(g_settings->getS32("rollback_coalesce_time"), 0))
 {
 	verbosestream << "RollbackManager::RollbackManager(" << world_path
 		<< ")" << std::endl;
@@ -110,12 +139,19 @@ RollbackManager::RollbackManager(const std::string & world_path,
 		migrate(txt_filename);
 		fs::DeleteSingleFileOrEmptyDirectory(migrating_flag);
 	}
+
+	m_write_thread = new RollbackWriteThread(this);
+	m_write_thread->start();
 }
 
 
 RollbackManager::~RollbackManager()
 {
-	flush();
+	// The thread writes everything left before exiting
+	m_write_thread->stop();
+	m_queue_sem.post();
+	m_write_thread->wait();
+	delete m_write_thread;
 
 	FINALIZE_STATEMENT(stmt_insert);
 	FINALIZE_STATEMENT(stmt_replace);
@@ -133,26 +169,23 @@ RollbackManager::~RollbackManager()
 
 void RollbackManager::registerNewActor(const int id, const std::string &name)
 {
-	Entity actor = {id, name};
-	knownActors.push_back(actor);
+	knownActorIds[name] = id;
+	knownActorNames[id] = name;
 }
 
 
 void RollbackManager::registerNewNode(const int id, const std::string &name)
 {
-	Entity node = {id, name};
-	knownNodes.push_back(node);
+	knownNodeIds[name] = id;
+	knownNodeNames[id] = name;
 }
 
 
 int RollbackManager::getActorId(const std::string &name)
 {
-	for (std::vector<Entity>::const_iterator iter = knownActors.begin();
-			iter != knownActors.end(); ++iter) {
-		if (iter->name == name) {
-			return iter->id;
-		}
-	}
+	UNORDERED_MAP<std::string, int>::const_iterator it = knownActorIds.find(name);
+	if (it != knownActorIds.end())
+		return it->second;
 
 	SQLOK(sqlite3_bind_text(stmt_knownActor_insert, 1, name.c_str(), name.size(), NULL));
 	SQLRES(sqlite3_step(stmt_knownActor_insert), SQLITE_DONE);
@@ -167,12 +200,9 @@ int RollbackManager::getActorId(const std::string &name)
 
 int RollbackManager::getNodeId(const std::string &name)
 {
-	for (std::vector<Entity>::const_iterator iter = knownNodes.begin();
-			iter != knownNodes.end(); ++iter) {
-		if (iter->name == name) {
-			return iter->id;
-		}
-	}
+	UNORDERED_MAP<std::string, int>::const_iterator it = knownNodeIds.find(name);
+	if (it != knownNodeIds.end())
+		return it->second;
 
 	SQLOK(sqlite3_bind_text(stmt_knownNode_insert, 1, name.c_str(), name.size(), NULL));
 	SQLRES(sqlite3_step(stmt_knownNode_insert), SQLITE_DONE);
@@ -187,12 +217,9 @@ int RollbackManager::getNodeId(const std::string &name)
 
 const char * RollbackManager::getActorName(const int id)
 {
-	for (std::vector<Entity>::const_iterator iter = knownActors.begin();
-			iter != knownActors.end(); ++iter) {
-		if (iter->id == id) {
-			return iter->name.c_str();
-		}
-	}
+	UNORDERED_MAP<int, std::string>::const_iterator it = knownActorNames.find(id);
+	if (it != knownActorNames.end())
+		return it->second.c_str();
 
 	return "";
 }
@@ -200,12 +227,9 @@ const char * RollbackManager::getActorName(const int id)
 
 const char * RollbackManager::getNodeName(const int id)
 {
-	for (std::vector<Entity>::const_iterator iter = knownNodes.begin();
-			iter != knownNodes.end(); ++iter) {
-		if (iter->id == id) {
-			return iter->name.c_str();
-		}
-	}
+	UNORDERED_MAP<int, std::string>::const_iterator it = knownNodeNames.find(id);
+	if (it != knownNodeNames.end())
+		return it->second.c_str();
 
 	return "";
 }
@@ -913,39 +937,154 @@ std::string RollbackManager::getSuspect(v3s16 p, float nearness_shortcut,
 
 void RollbackManager::flush()
 {
-	sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		m_flush_requests++;
+	}
+	m_queue_sem.post();
+	m_flush_done_sem.wait();
+}
 
-	std::list<RollbackAction>::const_iterator iter;
 
-	for (iter  = action_todisk_buffer.begin();
-			iter != action_todisk_buffer.end();
-			++iter) {
-		if (iter->actor == "") {
-			continue;
+void RollbackManager::writeQueued(bool flush_all)
+{
+	std::vector<RollbackAction> actions;
+	u32 flush_requests;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		actions.swap(m_queue);
+		flush_requests = m_flush_requests;
+		m_flush_requests = 0;
+	}
+
+	for (std::vector<RollbackAction>::const_iterator it = actions.begin();
+			it != actions.end(); ++it)
+		stageAction(*it);
+
+	std::vector<RollbackAction> to_write;
+	if (flush_all || flush_requests > 0 || m_coalesce_time == 0) {
+		to_write.swap(m_staged);
+		m_staged_nodes.clear();
+	} else {
+		// Keep recent actions to merge further changes into them
+		time_t first_kept = time(0) - m_coalesce_time;
+		std::vector<RollbackAction> kept;
+		for (std::vector<RollbackAction>::const_iterator it = m_staged.begin();
+				it != m_staged.end(); ++it) {
+			if (it->unix_time <= first_kept)
+				to_write.push_back(*it);
+			else
+				kept.push_back(*it);
 		}
 
-		registerRow(actionRowFromRollbackAction(*iter));
+		if (!to_write.empty()) {
+			m_staged.swap(kept);
+			m_staged_nodes.clear();
+			for (size_t i = 0; i < m_staged.size(); i++) {
+				if (m_staged[i].type == RollbackAction::TYPE_SET_NODE)
+					m_staged_nodes[m_staged[i].p] = i;
+			}
+		}
 	}
 
-	sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
-	action_todisk_buffer.clear();
+	if (!to_write.empty())
+		writeActions(to_write);
+
+	if (flush_requests > 0)
+		m_flush_done_sem.post(flush_requests);
+}
+
+
+void RollbackManager::stageAction(const RollbackAction &action)
+{
+	if (m_coalesce_time == 0) {
+		m_staged.push_back(action);
+		return;
+	}
+
+	if (action.type != RollbackAction::TYPE_SET_NODE) {
+		// Don't merge node changes across an inventory action there
+		v3s16 p;
+		if (action.getPosition(&p))
+			m_staged_nodes.erase(p);
+		m_staged.push_back(action);
+		return;
+	}
+
+	// Merge into the previous change of this node by the same actor,
+	// keeping its time and old node
+	std::map<v3s16, size_t>::const_iterator it = m_staged_nodes.find(action.p);
+	if (it != m_staged_nodes.end()) {
+		RollbackAction &prev = m_staged[it->second];
+		if (prev.actor == action.actor &&
+				prev.actor_is_guess == action.actor_is_guess &&
+				action.unix_time - prev.unix_time <= (time_t)m_coalesce_time) {
+			prev.n_new = action.n_new;
+			return;
+		}
+	}
+
+	m_staged_nodes[action.p] = m_staged.size();
+	m_staged.push_back(action);
+}
+
+
+void RollbackManager::writeActions(const std::vector<RollbackAction> &actions)
+{
+	MutexAutoLock lock(m_db_mutex);
+
+	try {
+		sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+
+		for (std::vector<RollbackAction>::const_iterator it = actions.begin();
+				it != actions.end(); ++it) {
+			if (it->actor == "")
+				continue;
+			// Coalesced changes can cancel out
+			if (it->type == RollbackAction::TYPE_SET_NODE &&
+					it->n_old == it->n_new)
+				continue;
+
+			registerRow(actionRowFromRollbackAction(*it));
+		}
+
+		sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+	} catch (FileNotGoodException &e) {
+		errorstream << "RollbackManager: Failed to write " << actions.size()
+			<< " actions: " << e.what() << std::endl;
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+	}
 }
 
 
 void RollbackManager::addAction(const RollbackAction & action)
 {
-	action_todisk_buffer.push_back(action);
 	action_latest_buffer.push_back(action);
 
-	// Flush to disk sometimes
-	if (action_todisk_buffer.size() >= 500) {
-		flush();
+	// getSuspect() doesn't look further back than 100 seconds
+	time_t first_time = time(0) - 100;
+	while (!action_latest_buffer.empty() &&
+			action_latest_buffer.front().unix_time < first_time)
+		action_latest_buffer.pop_front();
+
+	size_t queued;
+	{
+		MutexAutoLock lock(m_queue_mutex);
+		m_queue.push_back(action);
+		queued = m_queue.size();
 	}
+
+	// Wait for the write thread if it can't keep up
+	if (queued >= ROLLBACK_QUEUE_MAX)
+		flush();
+	else if (queued % ROLLBACK_WRITE_BATCH == 0)
+		m_queue_sem.post();
 }
 
 std::list<RollbackAction> RollbackManager::getEntriesSince(time_t first_time)
 {
 	flush();
+	MutexAutoLock lock(m_db_mutex);
 	return getActionsSince(first_time);
 }
 
@@ -956,6 +1095,7 @@ std::list<RollbackAction> RollbackManager::getNodeActors(v3s16 pos, int range,
 	time_t cur_time = time(0);
 	time_t first_time = cur_time - seconds;
 
+	MutexAutoLock lock(m_db_mutex);
 	return getActionsSince_range(first_time, pos, range, limit);
 }
 
@@ -968,6 +1108,7 @@ std::list<RollbackAction> RollbackManager::getRevertActions(
 
 	flush();
 
+	MutexAutoLock lock(m_db_mutex);
 	return getActionsSince(first_time, actor_filter);
 }
 
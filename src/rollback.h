@@ -24,13 +24,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "irr_v3d.h"
 #include "rollback_interface.h"
 #include <list>
+#include <map>
 #include <vector>
 #include "sqlite3.h"
+#include "threading/mutex.h"
+#include "threading/semaphore.h"
+#include "util/cpp11_container.h"
 
 class IGameDef;
+class RollbackWriteThread;
 
 struct ActionRow;
-struct Entity;
 
 class RollbackManager: public IRollbackManager
 {
@@ -44,6 +48,7 @@ class RollbackManager: public IRollbackManager
 	void setActor(const std::string & actor, bool is_guess);
 	std::string getSuspect(v3s16 p, float nearness_shortcut,
 			float min_nearness);
+	// Blocks until all reported actions are written
 	void flush();
 
 	void addAction(const RollbackAction & action);
@@ -54,6 +59,17 @@ class RollbackManager: public IRollbackManager
 			const std::string & actor_filter, time_t seconds);
 
 private:
+	friend class RollbackWriteThread;
+
+	/*
+		Actions are written to the database by a separate thread.
+		The server thread only appends to m_queue.
+	*/
+	// Runs on the write thread; writes everything if flush_all is set
+	void writeQueued(bool flush_all);
+	void stageAction(const RollbackAction &action);
+	void writeActions(const std::vector<RollbackAction> &actions);
+
 	void registerNewActor(const int id, const std::string & name);
 	void registerNewNode(const int id, const std::string & name);
 	int getActorId(const std::string & name);
@@ -85,9 +101,24 @@ class RollbackManager: public IRollbackManager
 	std::string current_actor;
 	bool current_actor_is_guess;
 
-	std::list<RollbackAction> action_todisk_buffer;
+	// Recent actions for getSuspect(), server thread only
 	std::list<RollbackAction> action_latest_buffer;
 
+	RollbackWriteThread *m_write_thread;
+	Mutex m_queue_mutex;
+	std::vector<RollbackAction> m_queue;
+	u32 m_flush_requests;
+	Semaphore m_queue_sem;
+	Semaphore m_flush_done_sem;
+
+	// Write thread only: actions held back for coalescing
+	std::vector<RollbackAction> m_staged;
+	std::map<v3s16, size_t> m_staged_nodes;
+	u32 m_coalesce_time;
+
+	// Protects the statements and the id caches below
+	Mutex m_db_mutex;
+
 	std::string database_path;
 	sqlite3 * db;
 	sqlite3_stmt * stmt_insert;
@@ -100,8 +131,10 @@ class RollbackManager: public IRollbackManager
 	sqlite3_stmt * stmt_knownNode_select;
 	sqlite3_stmt * stmt_knownNode_insert;
 
-	std::vector<Entity> knownActors;
-	std::vector<Entity> knownNodes;
+	UNORDERED_MAP<std::string, int> knownActorIds;
+	UNORDERED_MAP<int, std::string> knownActorNames;
+	UNORDERED_MAP<std::string, int> knownNodeIds;
+	UNORDERED_MAP<int, std::string> knownNodeNames;
 };
 
 #endif
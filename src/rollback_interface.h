@@ -39,12 +39,12 @@ struct RollbackNode
 	int param2;
 	std::string meta;
 
-	bool operator == (const RollbackNode &other)
+	bool operator == (const RollbackNode &other) const
 	{
 		return (name == other.name && param1 == other.param1 &&
 				param2 == other.param2 && meta == other.meta);
 	}
-	bool operator != (const RollbackNode &other) { return !(*this == other); }
+	bool operator != (const RollbackNode &other) const { return !(*this == other); }
 
 	RollbackNode():
 		param1(0),
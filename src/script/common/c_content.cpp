@@ -278,6 +278,8 @@ void read_object_properties(lua_State *L, int index,
 	if (!lua_isnil(L, -1))
 		prop->wield_item = read_item(L, -1, idef).getItemString();
 	lua_pop(L, 1);
+	getboolfield(L, -1, "full_step_rate", prop->full_step_rate);
+	getboolfield(L, -1, "cache_staticdata", prop->cache_staticdata);
 }
 
 /******************************************************************************/
@@ -348,6 +350,10 @@ void push_object_properties(lua_State *L, ObjectProperties *prop)
 	lua_setfield(L, -2, "infotext");
 	lua_pushlstring(L, prop->wield_item.c_str(), prop->wield_item.size());
 	lua_setfield(L, -2, "wield_item");
+	lua_pushboolean(L, prop->full_step_rate);
+	lua_setfield(L, -2, "full_step_rate");
+	lua_pushboolean(L, prop->cache_staticdata);
+	lua_setfield(L, -2, "cache_staticdata");
 }
 
 /******************************************************************************/
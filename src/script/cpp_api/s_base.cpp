@@ -272,6 +272,18 @@ void ScriptApiBase::setOriginFromTableRaw(int index, const char *fxn)
 #endif
 }
 
+void ScriptApiBase::setCallbackProfiling(bool enabled)
+{
+	SCRIPTAPI_PRECHECKHEADER
+
+	m_callback_profiler.setEnabled(enabled);
+
+	lua_getglobal(L, "core");
+	lua_pushboolean(L, enabled);
+	lua_setfield(L, -2, "callback_profiling");
+	lua_pop(L, 1);
+}
+
 void ScriptApiBase::addObjectReference(ServerActiveObject *cobj)
 {
 	SCRIPTAPI_PRECHECKHEADER
@@ -27,6 +27,7 @@ extern "C" {
 #include <lua.h>
 }
 
+#include "callbackprofiler.h"
 #include "irrlichttypes.h"
 #include "threads.h"
 #include "threading/mutex.h"
@@ -89,6 +90,10 @@ class ScriptApiBase {
 	void setOriginDirect(const char *origin);
 	void setOriginFromTableRaw(int index, const char *fxn);
 
+	CallbackProfiler *getCallbackProfiler() { return &m_callback_profiler; }
+	// Also tells core.run_callbacks whether to time the callbacks
+	void setCallbackProfiling(bool enabled);
+
 protected:
 	friend class LuaABM;
 	friend class LuaLBM;
@@ -118,6 +123,7 @@ class ScriptApiBase {
 
 	RecursiveMutex  m_luastackmutex;
 	std::string     m_last_run_mod;
+	CallbackProfiler m_callback_profiler;
 	bool            m_secure;
 #ifdef SCRIPTAPI_LOCK_DEBUG
 	int             m_lock_recursion_count;
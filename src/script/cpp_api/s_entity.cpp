@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+#include <algorithm>
 #include "cpp_api/s_entity.h"
 #include "cpp_api/s_internal.h"
 #include "log.h"
@@ -24,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/c_converter.h"
 #include "common/c_content.h"
 #include "server.h"
+#include "serverobject.h"
 
 bool ScriptApiEntity::luaentity_Add(u16 id, const char *name)
 {
@@ -96,6 +98,8 @@ void ScriptApiEntity::luaentity_Activate(u16 id,
 		lua_pushinteger(L, dtime_s);
 
 		setOriginFromTable(object);
+		CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+			"on_activate");
 		PCALL_RES(lua_pcall(L, 3, 0, error_handler));
 	} else {
 		lua_pop(L, 1);
@@ -145,6 +149,8 @@ std::string ScriptApiEntity::luaentity_GetStaticdata(u16 id)
 	lua_pushvalue(L, object); // self
 
 	setOriginFromTable(object);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"get_staticdata");
 	PCALL_RES(lua_pcall(L, 1, 1, error_handler));
 
 	lua_remove(L, object);
@@ -219,11 +225,133 @@ void ScriptApiEntity::luaentity_Step(u16 id, float dtime)
 	lua_pushnumber(L, dtime); // dtime
 
 	setOriginFromTable(object);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_step");
 	PCALL_RES(lua_pcall(L, 2, 0, error_handler));
 
 	lua_pop(L, 2); // Pop object and error handler
 }
 
+s32 ScriptApiEntity::luaentity_GetStepBatch(const std::string &name)
+{
+	UNORDERED_MAP<std::string, s32>::const_iterator it =
+		m_step_batch_ids.find(name);
+	if (it != m_step_batch_ids.end())
+		return it->second;
+
+	SCRIPTAPI_PRECHECKHEADER
+
+	// Get core.registered_entities[name].on_step_batch
+	lua_getglobal(L, "core");
+	lua_getfield(L, -1, "registered_entities");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	lua_getfield(L, -1, name.c_str());
+	if (!lua_istable(L, -1)) {
+		lua_pop(L, 3);
+		return -1;
+	}
+	lua_getfield(L, -1, "on_step_batch");
+	bool batched = !lua_isnil(L, -1);
+	lua_pop(L, 4);
+
+	// Types are registered at load time, so the answer doesn't change
+	s32 batch = -1;
+	if (batched) {
+		batch = m_step_batches.size();
+		m_step_batches.push_back(StepBatch(name));
+	}
+	m_step_batch_ids[name] = batch;
+	return batch;
+}
+
+static bool step_dtime_less(const std::pair<float, u16> &a,
+		const std::pair<float, u16> &b)
+{
+	return a.first < b.first;
+}
+
+void ScriptApiEntity::luaentity_StepBatches()
+{
+	if (m_step_batches.empty())
+		return;
+
+	SCRIPTAPI_PRECHECKHEADER
+
+	ServerEnvironment *env = (ServerEnvironment *)getEnv();
+	int error_handler = PUSH_ERROR_HANDLER(L);
+
+	lua_getglobal(L, "core");
+	lua_getfield(L, -1, "luaentities");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	int objectstable = lua_gettop(L);
+	lua_getfield(L, -2, "registered_entities");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	int registered = lua_gettop(L);
+
+	std::vector<std::pair<float, u16> > steps;
+	// on_step_batch may add batches, so no references are kept over calls
+	for (size_t i = 0; i < m_step_batches.size(); i++) {
+		if (m_step_batches[i].steps.empty())
+			continue;
+		steps.swap(m_step_batches[i].steps);
+
+		// Entities stepped less often come with larger dtimes
+		if (!std::is_sorted(steps.begin(), steps.end(), step_dtime_less))
+			std::stable_sort(steps.begin(), steps.end(), step_dtime_less);
+
+		size_t next = 0;
+		while (next < steps.size()) {
+			StepBatch &batch = m_step_batches[i];
+			float dtime = steps[next].first;
+
+			lua_getfield(L, registered, batch.name.c_str());
+			int prototype = lua_gettop(L);
+			lua_getfield(L, prototype, "on_step_batch");
+			luaL_checktype(L, -1, LUA_TFUNCTION);
+
+			if (batch.array_ref == LUA_NOREF) {
+				lua_createtable(L, steps.size(), 0);
+				batch.array_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+			}
+			lua_rawgeti(L, LUA_REGISTRYINDEX, batch.array_ref);
+			int array = lua_gettop(L);
+
+			// An earlier on_step_batch may have removed some of them
+			u32 count = 0;
+			for (; next < steps.size() && steps[next].first == dtime; next++) {
+				u16 id = steps[next].second;
+				ServerActiveObject *obj = env->getActiveObject(id);
+				if (!obj || obj->isGone())
+					continue;
+				lua_rawgeti(L, objectstable, id);
+				lua_rawseti(L, array, ++count);
+			}
+			for (u32 j = count + 1; j <= batch.array_size; j++) {
+				lua_pushnil(L);
+				lua_rawseti(L, array, j);
+			}
+			batch.array_size = count;
+
+			if (count == 0) {
+				lua_pop(L, 3); // Pop array, on_step_batch and prototype
+				continue;
+			}
+
+			lua_pushnumber(L, dtime);
+
+			setOriginFromTable(prototype);
+			CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+				"on_step_batch");
+			PCALL_RES(lua_pcall(L, 2, 0, error_handler));
+
+			lua_pop(L, 1); // Pop prototype
+		}
+		steps.clear();
+	}
+
+	lua_pop(L, 4); // Pop registered_entities, luaentities, core and error handler
+}
+
 // Calls entity:on_punch(ObjectRef puncher, time_from_last_punch,
 //                       tool_capabilities, direction, damage)
 bool ScriptApiEntity::luaentity_Punch(u16 id,
@@ -255,6 +383,8 @@ bool ScriptApiEntity::luaentity_Punch(u16 id,
 	lua_pushnumber(L, damage);
 
 	setOriginFromTable(object);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_punch");
 	PCALL_RES(lua_pcall(L, 6, 1, error_handler));
 
 	bool retval = lua_toboolean(L, -1);
@@ -287,6 +417,8 @@ void ScriptApiEntity::luaentity_Rightclick(u16 id,
 	objectrefGetOrCreate(L, clicker); // Clicker reference
 
 	setOriginFromTable(object);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_rightclick");
 	PCALL_RES(lua_pcall(L, 2, 0, error_handler));
 
 	lua_pop(L, 2); // Pop object and error handler
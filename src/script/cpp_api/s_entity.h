@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "cpp_api/s_base.h"
 #include "irr_v3d.h"
+#include "util/cpp11_container.h"
 
 struct ObjectProperties;
 struct ToolCapabilities;
@@ -38,11 +39,44 @@ class ScriptApiEntity
 	void luaentity_GetProperties(u16 id,
 			ObjectProperties *prop);
 	void luaentity_Step(u16 id, float dtime);
+
+	/*
+		Entities whose type defines on_step_batch are stepped with one
+		call for the whole type: luaentity_QueueStep() collects them while
+		the objects are stepped, luaentity_StepBatches() calls
+		on_step_batch(entities, dtime) afterwards, once for each dtime
+		the entities were queued with.
+	*/
+	// Returns the batch of the entity type, or -1 if it has no on_step_batch
+	s32 luaentity_GetStepBatch(const std::string &name);
+	void luaentity_QueueStep(s32 batch, u16 id, float dtime)
+	{ m_step_batches[batch].steps.push_back(std::make_pair(dtime, id)); }
+	void luaentity_StepBatches();
 	bool luaentity_Punch(u16 id,
 			ServerActiveObject *puncher, float time_from_last_punch,
 			const ToolCapabilities *toolcap, v3f dir, s16 damage);
 	void luaentity_Rightclick(u16 id,
 			ServerActiveObject *clicker);
+
+private:
+	struct StepBatch
+	{
+		StepBatch(const std::string &name_):
+			name(name_),
+			array_ref(LUA_NOREF),
+			array_size(0)
+		{}
+
+		std::string name;
+		// The entities array passed to on_step_batch, reused every step
+		int array_ref;
+		u32 array_size;
+		// dtime and object id
+		std::vector<std::pair<float, u16> > steps;
+	};
+
+	std::vector<StepBatch> m_step_batches;
+	UNORDERED_MAP<std::string, s32> m_step_batch_ids;
 };
 
 
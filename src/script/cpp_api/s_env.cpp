@@ -151,8 +151,12 @@ void ScriptApiEnv::initializeEnvironment(ServerEnvironment *env)
 		bool simple_catch_up = true;
 		getboolfield(L, current_abm, "catch_up", simple_catch_up);
 
-		LuaABM *abm = new LuaABM(L, id, trigger_contents, required_neighbors,
-			trigger_interval, trigger_chance, simple_catch_up);
+		std::string label;
+		getstringfield(L, current_abm, "label", label);
+
+		LuaABM *abm = new LuaABM(L, id, label, trigger_contents,
+			required_neighbors, trigger_interval, trigger_chance,
+			simple_catch_up);
 
 		env->addActiveBlockModifier(abm);
 
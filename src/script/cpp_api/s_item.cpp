@@ -44,6 +44,8 @@ bool ScriptApiItem::item_OnDrop(ItemStack &item,
 	LuaItemStack::create(L, item);
 	objectrefGetOrCreate(L, dropper);
 	pushFloatPos(L, pos);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_drop");
 	PCALL_RES(lua_pcall(L, 3, 1, error_handler));
 	if (!lua_isnil(L, -1)) {
 		try {
@@ -76,6 +78,8 @@ bool ScriptApiItem::item_OnPlace(ItemStack &item,
 		objectrefGetOrCreate(L, placer);
 
 	pushPointedThing(pointed);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_place");
 	PCALL_RES(lua_pcall(L, 3, 1, error_handler));
 	if (!lua_isnil(L, -1)) {
 		try {
@@ -103,6 +107,8 @@ bool ScriptApiItem::item_OnUse(ItemStack &item,
 	LuaItemStack::create(L, item);
 	objectrefGetOrCreate(L, user);
 	pushPointedThing(pointed);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_use");
 	PCALL_RES(lua_pcall(L, 3, 1, error_handler));
 	if(!lua_isnil(L, -1)) {
 		try {
@@ -129,6 +135,8 @@ bool ScriptApiItem::item_OnSecondaryUse(ItemStack &item, ServerActiveObject *use
 	PointedThing pointed;
 	pointed.type = POINTEDTHING_NOTHING;
 	pushPointedThing(pointed);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_secondary_use");
 	PCALL_RES(lua_pcall(L, 3, 1, error_handler));
 	if (!lua_isnil(L, -1)) {
 		try {
@@ -116,6 +116,8 @@ bool ScriptApiNode::node_on_punch(v3s16 p, MapNode node,
 	pushnode(L, node, ndef);
 	objectrefGetOrCreate(L, puncher);
 	pushPointedThing(pointed);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_punch");
 	PCALL_RES(lua_pcall(L, 4, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 	return true;
@@ -138,6 +140,8 @@ bool ScriptApiNode::node_on_dig(v3s16 p, MapNode node,
 	push_v3s16(L, p);
 	pushnode(L, node, ndef);
 	objectrefGetOrCreate(L, digger);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_dig");
 	PCALL_RES(lua_pcall(L, 3, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 	return true;
@@ -157,6 +161,8 @@ void ScriptApiNode::node_on_construct(v3s16 p, MapNode node)
 
 	// Call function
 	push_v3s16(L, p);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_construct");
 	PCALL_RES(lua_pcall(L, 1, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
@@ -175,6 +181,8 @@ void ScriptApiNode::node_on_destruct(v3s16 p, MapNode node)
 
 	// Call function
 	push_v3s16(L, p);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_destruct");
 	PCALL_RES(lua_pcall(L, 1, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
@@ -195,6 +203,8 @@ bool ScriptApiNode::node_on_flood(v3s16 p, MapNode node, MapNode newnode)
 	push_v3s16(L, p);
 	pushnode(L, node, ndef);
 	pushnode(L, newnode, ndef);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_flood");
 	PCALL_RES(lua_pcall(L, 3, 1, error_handler));
 	lua_remove(L, error_handler);
 	return (bool) lua_isboolean(L, -1) && (bool) lua_toboolean(L, -1) == true;
@@ -215,6 +225,8 @@ void ScriptApiNode::node_after_destruct(v3s16 p, MapNode node)
 	// Call function
 	push_v3s16(L, p);
 	pushnode(L, node, ndef);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"after_destruct");
 	PCALL_RES(lua_pcall(L, 2, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
@@ -234,6 +246,8 @@ bool ScriptApiNode::node_on_timer(v3s16 p, MapNode node, f32 dtime)
 	// Call function
 	push_v3s16(L, p);
 	lua_pushnumber(L,dtime);
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_timer");
 	PCALL_RES(lua_pcall(L, 2, 1, error_handler));
 	lua_remove(L, error_handler);
 	return (bool) lua_isboolean(L, -1) && (bool) lua_toboolean(L, -1) == true;
@@ -272,6 +286,8 @@ void ScriptApiNode::node_on_receive_fields(v3s16 p,
 		lua_settable(L, -3);
 	}
 	objectrefGetOrCreate(L, sender);        // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_receive_fields");
 	PCALL_RES(lua_pcall(L, 4, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
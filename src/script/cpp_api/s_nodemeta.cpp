@@ -56,6 +56,8 @@ int ScriptApiNodemeta::nodemeta_inventory_AllowMove(v3s16 p,
 	lua_pushinteger(L, to_index + 1);     // to_index
 	lua_pushinteger(L, count);            // count
 	objectrefGetOrCreate(L, player);      // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"allow_metadata_inventory_move");
 	PCALL_RES(lua_pcall(L, 7, 1, error_handler));
 	if (!lua_isnumber(L, -1))
 		throw LuaError("allow_metadata_inventory_move should"
@@ -92,6 +94,8 @@ int ScriptApiNodemeta::nodemeta_inventory_AllowPut(v3s16 p,
 	lua_pushinteger(L, index + 1);       // index
 	LuaItemStack::create(L, stack);      // stack
 	objectrefGetOrCreate(L, player);     // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"allow_metadata_inventory_put");
 	PCALL_RES(lua_pcall(L, 5, 1, error_handler));
 	if(!lua_isnumber(L, -1))
 		throw LuaError("allow_metadata_inventory_put should"
@@ -128,6 +132,8 @@ int ScriptApiNodemeta::nodemeta_inventory_AllowTake(v3s16 p,
 	lua_pushinteger(L, index + 1);       // index
 	LuaItemStack::create(L, stack);      // stack
 	objectrefGetOrCreate(L, player);     // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"allow_metadata_inventory_take");
 	PCALL_RES(lua_pcall(L, 5, 1, error_handler));
 	if (!lua_isnumber(L, -1))
 		throw LuaError("allow_metadata_inventory_take should"
@@ -167,6 +173,8 @@ void ScriptApiNodemeta::nodemeta_inventory_OnMove(v3s16 p,
 	lua_pushinteger(L, to_index + 1);     // to_index
 	lua_pushinteger(L, count);            // count
 	objectrefGetOrCreate(L, player);      // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_metadata_inventory_move");
 	PCALL_RES(lua_pcall(L, 7, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
@@ -198,6 +206,8 @@ void ScriptApiNodemeta::nodemeta_inventory_OnPut(v3s16 p,
 	lua_pushinteger(L, index + 1);       // index
 	LuaItemStack::create(L, stack);      // stack
 	objectrefGetOrCreate(L, player);     // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_metadata_inventory_put");
 	PCALL_RES(lua_pcall(L, 5, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
@@ -229,6 +239,8 @@ void ScriptApiNodemeta::nodemeta_inventory_OnTake(v3s16 p,
 	lua_pushinteger(L, index + 1);       // index
 	LuaItemStack::create(L, stack);      // stack
 	objectrefGetOrCreate(L, player);     // player
+	CallbackScope callback_scope(&m_callback_profiler, m_last_run_mod,
+		"on_metadata_inventory_take");
 	PCALL_RES(lua_pcall(L, 5, 0, error_handler));
 	lua_pop(L, 1);  // Pop error handler
 }
@@ -0,0 +1,202 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "lua_api/l_auth.h"
+#include "lua_api/l_internal.h"
+#include "common/c_converter.h"
+#include "database.h"
+#include "server.h"
+
+// common start: ensure auth db
+AuthDatabase *ModApiAuth::getAuthDb(lua_State *L)
+{
+	return getServer(L)->getAuthDatabase();
+}
+
+void ModApiAuth::pushAuthEntry(lua_State *L, const AuthEntry &authEntry)
+{
+	lua_newtable(L);
+	int table = lua_gettop(L);
+	// id
+	lua_pushnumber(L, authEntry.id);
+	lua_setfield(L, table, "id");
+	// name
+	lua_pushstring(L, authEntry.name.c_str());
+	lua_setfield(L, table, "name");
+	// password
+	lua_pushstring(L, authEntry.password.c_str());
+	lua_setfield(L, table, "password");
+	// privileges, as a set
+	lua_newtable(L);
+	int privtable = lua_gettop(L);
+	for (size_t i = 0; i < authEntry.privileges.size(); i++) {
+		lua_pushboolean(L, true);
+		lua_setfield(L, privtable, authEntry.privileges[i].c_str());
+	}
+	lua_setfield(L, table, "privileges");
+	// last_login, nil if unknown
+	if (authEntry.last_login >= 0) {
+		lua_pushnumber(L, authEntry.last_login);
+		lua_setfield(L, table, "last_login");
+	}
+}
+
+void ModApiAuth::readAuthEntry(lua_State *L, int index, AuthEntry &authEntry)
+{
+	luaL_checktype(L, index, LUA_TTABLE);
+	lua_getfield(L, index, "id");
+	authEntry.id = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : 0;
+	lua_pop(L, 1);
+	authEntry.name = checkstringfield(L, index, "name");
+	authEntry.password = checkstringfield(L, index, "password");
+
+	authEntry.privileges.clear();
+	lua_getfield(L, index, "privileges");
+	luaL_checktype(L, -1, LUA_TTABLE);
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0) {
+		// key at index -2 and value at index -1
+		if (lua_toboolean(L, -1))
+			authEntry.privileges.push_back(luaL_checkstring(L, -2));
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+
+	lua_getfield(L, index, "last_login");
+	authEntry.last_login = lua_isnumber(L, -1) ? lua_tonumber(L, -1) : -1;
+	lua_pop(L, 1);
+}
+
+// auth_read(name)
+int ModApiAuth::l_auth_read(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	if (!auth_db)
+		return 0;
+	AuthEntry authEntry;
+	const char *name = luaL_checkstring(L, 1);
+	if (!auth_db->getAuth(std::string(name), authEntry)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	pushAuthEntry(L, authEntry);
+	return 1;
+}
+
+// auth_save(table)
+int ModApiAuth::l_auth_save(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	if (!auth_db)
+		return 0;
+	AuthEntry authEntry;
+	readAuthEntry(L, 1, authEntry);
+	lua_pushboolean(L, auth_db->saveAuth(authEntry));
+	return 1;
+}
+
+// auth_create(table)
+int ModApiAuth::l_auth_create(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	if (!auth_db)
+		return 0;
+	AuthEntry authEntry;
+	readAuthEntry(L, 1, authEntry);
+	if (!auth_db->createAuth(authEntry)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	pushAuthEntry(L, authEntry);
+	return 1;
+}
+
+// auth_delete(name)
+int ModApiAuth::l_auth_delete(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	if (!auth_db)
+		return 0;
+	std::string name(luaL_checkstring(L, 1));
+	lua_pushboolean(L, auth_db->deleteAuth(name));
+	return 1;
+}
+
+// auth_list_names()
+int ModApiAuth::l_auth_list_names(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	if (!auth_db)
+		return 0;
+	std::vector<std::string> names;
+	auth_db->listNames(names);
+	lua_createtable(L, names.size(), 0);
+	int table = lua_gettop(L);
+	for (size_t i = 0; i < names.size(); i++) {
+		lua_pushstring(L, names[i].c_str());
+		lua_rawseti(L, table, i + 1);
+	}
+	return 1;
+}
+
+// auth_find_name_case_insensitive(name)
+int ModApiAuth::l_auth_find_name_case_insensitive(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	std::string res;
+	if (!auth_db || !auth_db->findNameCaseInsensitive(luaL_checkstring(L, 1), res))
+		return 0;
+	lua_pushstring(L, res.c_str());
+	return 1;
+}
+
+// auth_reload()
+int ModApiAuth::l_auth_reload(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	AuthDatabase *auth_db = getAuthDb(L);
+	if (auth_db)
+		auth_db->reload();
+	return 0;
+}
+
+void ModApiAuth::Initialize(lua_State *L, int top)
+{
+	lua_newtable(L);
+	int auth_top = lua_gettop(L);
+
+	registerFunction(L, "read", l_auth_read, auth_top);
+	registerFunction(L, "save", l_auth_save, auth_top);
+	registerFunction(L, "create", l_auth_create, auth_top);
+	registerFunction(L, "delete", l_auth_delete, auth_top);
+	registerFunction(L, "list_names", l_auth_list_names, auth_top);
+	registerFunction(L, "find_name_case_insensitive",
+		l_auth_find_name_case_insensitive, auth_top);
+	registerFunction(L, "reload", l_auth_reload, auth_top);
+
+	lua_setfield(L, top, "auth");
+}
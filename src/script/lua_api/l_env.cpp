@@ -84,6 +84,8 @@ void LuaABM::trigger(ServerEnvironment *env, v3s16 p, MapNode n,
 	lua_pushnumber(L, active_object_count);
 	lua_pushnumber(L, active_object_count_wider);
 
+	CallbackScope callback_scope(&scriptIface->m_callback_profiler,
+		scriptIface->m_last_run_mod, m_callback.c_str());
 	int result = lua_pcall(L, 4, 0, error_handler);
 	if (result)
 		scriptIface->scriptError(result, "LuaABM::trigger");
@@ -124,6 +126,8 @@ void LuaLBM::trigger(ServerEnvironment *env, v3s16 p, MapNode n)
 	push_v3s16(L, p);
 	pushnode(L, n, env->getGameDef()->ndef());
 
+	CallbackScope callback_scope(&scriptIface->m_callback_profiler,
+		scriptIface->m_last_run_mod, m_callback.c_str());
 	int result = lua_pcall(L, 2, 0, error_handler);
 	if (result)
 		scriptIface->scriptError(result, "LuaLBM::trigger");
@@ -272,6 +276,30 @@ int ModApiEnvMod::l_add_node(lua_State *L)
 	return l_set_node(L);
 }
 
+// bulk_set_node([pos1, pos2, ...], node)
+// pos = {x=num, y=num, z=num}
+int ModApiEnvMod::l_bulk_set_node(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	INodeDefManager *ndef = env->getGameDef()->ndef();
+	// parameters
+	luaL_checktype(L, 1, LUA_TTABLE);
+	std::vector<v3s16> positions;
+	int len = lua_objlen(L, 1);
+	positions.reserve(len);
+	for (int i = 1; i <= len; i++) {
+		lua_rawgeti(L, 1, i);
+		positions.push_back(read_v3s16(L, -1));
+		lua_pop(L, 1);
+	}
+	MapNode n = readnode(L, 2, ndef);
+	// Do it
+	u32 count = env->setNodes(positions, n);
+	lua_pushboolean(L, count == positions.size());
+	return 1;
+}
+
 // remove_node(pos)
 // pos = {x=num, y=num, z=num}
 int ModApiEnvMod::l_remove_node(lua_State *L)
@@ -996,6 +1024,24 @@ int ModApiEnvMod::l_fix_light(lua_State *L)
 	return 1;
 }
 
+// begin_lighting_batch()
+int ModApiEnvMod::l_begin_lighting_batch(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	env->getMap().beginLightingBatch();
+	return 0;
+}
+
+// end_lighting_batch()
+int ModApiEnvMod::l_end_lighting_batch(lua_State *L)
+{
+	GET_ENV_PTR;
+
+	lua_pushboolean(L, env->getMap().endLightingBatch());
+	return 1;
+}
+
 // load_area(p1, [p2])
 // load mapblocks in area p1..p2, but do not generate map
 int ModApiEnvMod::l_load_area(lua_State *L)
@@ -1240,6 +1286,7 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 {
 	API_FCT(set_node);
 	API_FCT(add_node);
+	API_FCT(bulk_set_node);
 	API_FCT(swap_node);
 	API_FCT(add_item);
 	API_FCT(remove_node);
@@ -1267,6 +1314,8 @@ void ModApiEnvMod::Initialize(lua_State *L, int top)
 	API_FCT(find_nodes_in_area);
 	API_FCT(find_nodes_in_area_under_air);
 	API_FCT(fix_light);
+	API_FCT(begin_lighting_batch);
+	API_FCT(end_lighting_batch);
 	API_FCT(load_area);
 	API_FCT(emerge_area);
 	API_FCT(delete_area);
@@ -32,6 +32,10 @@ class ModApiEnvMod : public ModApiBase {
 
 	static int l_add_node(lua_State *L);
 
+	// bulk_set_node([pos1, pos2, ...], node)
+	// pos = {x=num, y=num, z=num}
+	static int l_bulk_set_node(lua_State *L);
+
 	// remove_node(pos)
 	// pos = {x=num, y=num, z=num}
 	static int l_remove_node(lua_State *L);
@@ -132,6 +136,12 @@ class ModApiEnvMod : public ModApiBase {
 	// fix_light(p1, p2) -> true/false
 	static int l_fix_light(lua_State *L);
 
+	// begin_lighting_batch()
+	static int l_begin_lighting_batch(lua_State *L);
+
+	// end_lighting_batch() -> true/false
+	static int l_end_lighting_batch(lua_State *L);
+
 	// load_area(p1)
 	static int l_load_area(lua_State *L);
 
@@ -191,6 +201,8 @@ class ModApiEnvMod : public ModApiBase {
 class LuaABM : public ActiveBlockModifier {
 private:
 	int m_id;
+	// Name of the action for the callback profiler
+	std::string m_callback;
 
 	std::set<std::string> m_trigger_contents;
 	std::set<std::string> m_required_neighbors;
@@ -198,11 +210,12 @@ class LuaABM : public ActiveBlockModifier {
 	u32 m_trigger_chance;
 	bool m_simple_catch_up;
 public:
-	LuaABM(lua_State *L, int id,
+	LuaABM(lua_State *L, int id, const std::string &label,
 			const std::set<std::string> &trigger_contents,
 			const std::set<std::string> &required_neighbors,
 			float trigger_interval, u32 trigger_chance, bool simple_catch_up):
 		m_id(id),
+		m_callback(label.empty() ? "ABM action" : "ABM action: " + label),
 		m_trigger_contents(trigger_contents),
 		m_required_neighbors(required_neighbors),
 		m_trigger_interval(trigger_interval),
@@ -238,12 +251,15 @@ class LuaLBM : public LoadingBlockModifierDef
 {
 private:
 	int m_id;
+	// Name of the action for the callback profiler
+	std::string m_callback;
 public:
 	LuaLBM(lua_State *L, int id,
 			const std::set<std::string> &trigger_contents,
 			const std::string &name,
 			bool run_at_every_load):
-		m_id(id)
+		m_id(id),
+		m_callback("LBM action: " + name)
 	{
 		this->run_at_every_load = run_at_every_load;
 		this->trigger_contents = trigger_contents;
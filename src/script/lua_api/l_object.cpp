@@ -990,6 +990,18 @@ int ObjectRef::l_get_luaentity(lua_State *L)
 	return 1;
 }
 
+// set_staticdata_dirty(self)
+int ObjectRef::l_set_staticdata_dirty(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	ObjectRef *ref = checkobject(L, 1);
+	LuaEntitySAO *co = getluaobject(ref);
+	if (co == NULL) return 0;
+	// Do it
+	co->setStaticDataDirty();
+	return 0;
+}
+
 /* Player-only */
 
 // is_player_connected(self)
@@ -1990,6 +2002,7 @@ const luaL_Reg ObjectRef::methods[] = {
 	luamethod_aliased(ObjectRef, set_sprite, setsprite),
 	luamethod(ObjectRef, get_entity_name),
 	luamethod(ObjectRef, get_luaentity),
+	luamethod(ObjectRef, set_staticdata_dirty),
 	// Player-only
 	luamethod(ObjectRef, is_player),
 	luamethod(ObjectRef, is_player_connected),
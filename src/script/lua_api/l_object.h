@@ -178,6 +178,9 @@ class ObjectRef : public ModApiBase {
 	// get_luaentity(self)
 	static int l_get_luaentity(lua_State *L);
 
+	// set_staticdata_dirty(self)
+	static int l_set_staticdata_dirty(lua_State *L);
+
 	/* Player-only */
 
 	// is_player_connected(self)
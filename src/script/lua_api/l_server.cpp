@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "environment.h"
 #include "player.h"
 #include "log.h"
+#include "tracer.h"
 #include <algorithm>
 
 // request_shutdown()
@@ -55,6 +56,85 @@ int ModApiServer::l_get_server_uptime(lua_State *L)
 	return 1;
 }
 
+// set_tracing(enabled)
+int ModApiServer::l_set_tracing(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	g_tracer->setEnabled(lua_toboolean(L, 1));
+	return 0;
+}
+
+// save_trace()
+int ModApiServer::l_save_trace(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	std::string path = g_tracer->saveTrace(getServer(L)->getTracePath());
+	if (path.empty())
+		return 0;
+	lua_pushstring(L, path.c_str());
+	return 1;
+}
+
+// set_callback_profiling(enabled)
+int ModApiServer::l_set_callback_profiling(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	getScriptApiBase(L)->setCallbackProfiling(lua_toboolean(L, 1));
+	return 0;
+}
+
+// get_callback_stats([count[, sort]])
+int ModApiServer::l_get_callback_stats(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	u32 count = luaL_optinteger(L, 1, 10);
+	std::string sort = luaL_optstring(L, 2, "total");
+	if (sort != "total" && sort != "max")
+		throw LuaError("Invalid sort \"" + sort +
+			"\", expected \"total\" or \"max\"");
+
+	std::vector<CallbackStats> stats;
+	getScriptApiBase(L)->getCallbackProfiler()->getTop(stats, count,
+		sort == "max");
+
+	lua_createtable(L, stats.size(), 0);
+	for (size_t i = 0; i < stats.size(); i++) {
+		lua_createtable(L, 0, 5);
+		setstringfield(L, -1, "mod", stats[i].mod.c_str());
+		setstringfield(L, -1, "callback", stats[i].callback.c_str());
+		setintfield(L, -1, "calls", stats[i].calls);
+		lua_pushnumber(L, stats[i].total_us);
+		lua_setfield(L, -2, "total_us");
+		setintfield(L, -1, "max_us", stats[i].max_us);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+// set_callback_warning_threshold(threshold_ms[, callback])
+int ModApiServer::l_set_callback_warning_threshold(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	lua_Number threshold = luaL_checknumber(L, 1);
+	if (threshold < 0)
+		throw LuaError("Negative callback warning threshold");
+	getScriptApiBase(L)->getCallbackProfiler()->setWarningThreshold(
+		threshold * 1000, luaL_optstring(L, 2, ""));
+	return 0;
+}
+
+// record_callback_time(mod, callback, start_us)
+int ModApiServer::l_record_callback_time(lua_State *L)
+{
+	NO_MAP_LOCK_REQUIRED;
+	CallbackProfiler *profiler = getScriptApiBase(L)->getCallbackProfiler();
+	if (profiler->isEnabled()) {
+		profiler->record(luaL_checkstring(L, 1), luaL_checkstring(L, 2),
+			luaL_checknumber(L, 3));
+	}
+	return 0;
+}
+
 
 // print(text)
 int ModApiServer::l_print(lua_State *L)
@@ -515,6 +595,12 @@ void ModApiServer::Initialize(lua_State *L, int top)
 	API_FCT(request_shutdown);
 	API_FCT(get_server_status);
 	API_FCT(get_server_uptime);
+	API_FCT(set_tracing);
+	API_FCT(save_trace);
+	API_FCT(set_callback_profiling);
+	API_FCT(set_callback_warning_threshold);
+	API_FCT(get_callback_stats);
+	API_FCT(record_callback_time);
 	API_FCT(get_worldpath);
 	API_FCT(is_singleplayer);
 
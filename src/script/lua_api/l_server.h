@@ -34,6 +34,24 @@ class ModApiServer : public ModApiBase
 	// get_server_uptime()
 	static int l_get_server_uptime(lua_State *L);
 
+	// set_tracing(enabled)
+	static int l_set_tracing(lua_State *L);
+
+	// save_trace()
+	static int l_save_trace(lua_State *L);
+
+	// set_callback_profiling(enabled)
+	static int l_set_callback_profiling(lua_State *L);
+
+	// get_callback_stats([count[, sort]])
+	static int l_get_callback_stats(lua_State *L);
+
+	// set_callback_warning_threshold(threshold_ms[, callback])
+	static int l_set_callback_warning_threshold(lua_State *L);
+
+	// record_callback_time(mod, callback, start_us)
+	static int l_record_callback_time(lua_State *L);
+
 	// get_worldpath()
 	static int l_get_worldpath(lua_State *L);
 
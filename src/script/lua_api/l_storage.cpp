@@ -32,13 +32,13 @@ int ModApiStorage::l_get_mod_storage(lua_State *L)
 
 	std::string mod_name = lua_tostring(L, -1);
 
-	ModMetadata *store = new ModMetadata(mod_name);
-	if (IGameDef *gamedef = getGameDef(L)) {
-		store->load(gamedef->getModStoragePath());
-		gamedef->registerModStorage(store);
-	} else {
-		assert(false); // this should not happen
-	}
+	IGameDef *gamedef = getGameDef(L);
+	assert(gamedef); // this should not happen
+
+	ModMetadata *store = new ModMetadata(mod_name,
+		gamedef->getModStorageDatabase());
+	store->load();
+	gamedef->registerModStorage(store);
 
 	StorageRef::create(L, store);
 	int object = lua_gettop(L);
@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <queue>
 #include <algorithm>
 #include "network/networkprotocol.h"
+#include "network/mediaserver.h"
 #include "network/serveropcodes.h"
 #include "ban.h"
 #include "environment.h"
@@ -37,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "genericobject.h"
 #include "settings.h"
 #include "profiler.h"
+#include "tracer.h"
 #include "log.h"
 #include "scripting_server.h"
 #include "nodedef.h"
@@ -57,10 +59,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "util/serialize.h"
 #include "util/thread.h"
 #include "defaultsettings.h"
+#include "gameparams.h"
 #include "util/base64.h"
 #include "util/sha1.h"
 #include "util/hex.h"
 #include "database.h"
+#include "database-files.h"
+#include "database-sqlite3.h"
+#if USE_POSTGRESQL
+#include "database-postgresql.h"
+#endif
 
 class ClientNotFoundException : public BaseException
 {
@@ -96,7 +104,9 @@ void *ServerThread::run()
 		try {
 			//TimeTaker timer("AsyncRunStep() + Receive()");
 
+			g_tracer->beginFrame();
 			m_server->AsyncRunStep();
+			g_tracer->endFrame();
 
 			m_server->Receive();
 
@@ -182,8 +192,11 @@ Server::Server(
 	m_admin_chat(iface),
 	m_ignore_map_edit_events(false),
 	m_ignore_map_edit_events_peer_id(0),
+	m_media_server(NULL),
 	m_next_sound_id(0),
-	m_mod_storage_save_timer(10.0f)
+	m_mod_storage_database(NULL),
+	m_mod_storage_save_timer(10.0f),
+	m_auth_database(NULL)
 {
 	m_liquid_transform_timer = 0.0;
 	m_liquid_transform_every = 1.0;
@@ -192,6 +205,7 @@ Server::Server(
 	m_savemap_timer = 0.0;
 
 	m_step_dtime = 0.0;
+	m_step_time_log = NULL;
 	m_lag = g_settings->getFloat("dedicated_server_step");
 
 	if(path_world == "")
@@ -212,6 +226,33 @@ Server::Server(
 	if(!loadGameConfAndInitWorld(m_path_world, m_gamespec))
 		throw ServerError("Failed to initialize world");
 
+	// Determine which mod storage backend to use
+	std::string conf_path = m_path_world + DIR_DELIM + "world.mt";
+	Settings conf;
+	conf.readConfigFile(conf_path.c_str());
+	if (!conf.exists("mod_storage_backend")) {
+		// fall back to the mod_storage directory
+		conf.set("mod_storage_backend", "files");
+		if (!conf.updateConfigFile(conf_path.c_str())) {
+			errorstream << "Server::Server(): Failed to update world.mt!"
+				<< std::endl;
+		}
+	}
+	m_mod_storage_database = openModStorageDatabase(
+		conf.get("mod_storage_backend"), m_path_world);
+
+	// Mods may read and change auth data while loading
+	if (!conf.exists("auth_backend")) {
+		// fall back to auth.txt
+		conf.set("auth_backend", "files");
+		if (!conf.updateConfigFile(conf_path.c_str())) {
+			errorstream << "Server::Server(): Failed to update world.mt!"
+				<< std::endl;
+		}
+	}
+	m_auth_database = openAuthDatabase(conf.get("auth_backend"),
+		m_path_world, conf);
+
 	// Create server thread
 	m_thread = new ServerThread(this);
 
@@ -240,6 +281,9 @@ Server::Server(
 	infostream<<"Server: Initializing Lua"<<std::endl;
 
 	m_script = new ServerScripting(this);
+	m_script->setCallbackProfiling(g_settings->getBool("callback_profiling"));
+	m_script->getCallbackProfiler()->setWarningThreshold(
+		g_settings->getU16("callback_warning_threshold") * 1000);
 
 	m_script->loadMod(getBuiltinLuaPath() + DIR_DELIM "init.lua", BUILTIN_MOD_NAME);
 
@@ -323,6 +367,11 @@ Server::Server(
 
 	m_liquid_transform_every = g_settings->getFloat("liquid_update");
 	m_max_chatmessage_length = g_settings->getU16("chat_message_max_size");
+
+	g_tracer->setEnabled(g_settings->getBool("tracing"));
+	g_tracer->setSlowFrameThreshold(
+		g_settings->getU16("tracing_slow_step_threshold") * 1000,
+		getTracePath());
 }
 
 Server::~Server()
@@ -361,6 +410,10 @@ Server::~Server()
 	{
 		MutexAutoLock envlock(m_env_mutex);
 
+		// Objects of blocks that wait for activation are activated before
+		// on_shutdown, so that they are stored with the map as usual
+		m_env->finishAllPendingActivations();
+
 		// Execute script shutdown hooks
 		infostream << "Executing shutdown hooks" << std::endl;
 		m_script->on_shutdown();
@@ -372,6 +425,7 @@ Server::~Server()
 	// Stop threads
 	stop();
 	delete m_thread;
+	delete m_media_server;
 
 	// Delete things in the reverse order of creation
 	delete m_emerge;
@@ -387,6 +441,10 @@ Server::~Server()
 	infostream << "Server: Deinitializing scripting" << std::endl;
 	delete m_script;
 
+	// The mod storages are saved when the scripting is deinitialized
+	delete m_mod_storage_database;
+	delete m_auth_database;
+
 	// Delete detached inventories
 	for (std::map<std::string, Inventory*>::iterator
 			i = m_detached_inventories.begin();
@@ -411,6 +469,8 @@ void Server::start(Address bind_addr)
 	m_con.SetTimeoutMs(30);
 	m_con.Serve(bind_addr);
 
+	startMediaServer(bind_addr);
+
 	// Start thread
 	m_thread->start();
 
@@ -428,6 +488,56 @@ void Server::start(Address bind_addr)
 			<<bind_addr.getPort() << "."<<std::endl;
 }
 
+void Server::startMediaServer(const Address &bind_addr)
+{
+	m_remote_media = g_settings->get("remote_media");
+
+	delete m_media_server;
+	m_media_server = NULL;
+
+	u16 port = g_settings->getU16("media_server_port");
+	if (port == 0 || m_simple_singleplayer_mode)
+		return;
+
+	std::string address = g_settings->get("server_address");
+	if (m_remote_media.empty() && address.empty()) {
+		warningstream << "Server: media_server_port is set, but clients "
+			"can't be told where to find it without server_address or "
+			"remote_media. Not starting the media server." << std::endl;
+		return;
+	}
+
+	MediaHTTPServer *media_server = new MediaHTTPServer();
+	for (UNORDERED_MAP<std::string, MediaInfo>::const_iterator
+			it = m_media.begin(); it != m_media.end(); ++it) {
+		media_server->addFile(base64_decode(it->second.sha1_digest),
+			it->second.data);
+	}
+
+	Address media_addr = bind_addr;
+	media_addr.setPort(port);
+	try {
+		media_server->bind(media_addr);
+	} catch (SocketException &e) {
+		errorstream << "Server: Failed to start the media server: "
+			<< e.what() << std::endl;
+		delete media_server;
+		return;
+	}
+
+	m_media_server = media_server;
+	m_media_server->start();
+
+	if (m_remote_media.empty()) {
+		// IPv6 literals have to be bracketed in URLs
+		if (address.find(':') != std::string::npos)
+			address = "[" + address + "]";
+		m_remote_media = "http://" + address + ":" + itos(port) + "/";
+	}
+	actionstream << "Server: Serving media on TCP port " << port
+		<< ", announced as " << m_remote_media << std::endl;
+}
+
 void Server::stop()
 {
 	DSTACK(FUNCTION_NAME);
@@ -439,6 +549,10 @@ void Server::stop()
 	//m_emergethread.setRun(false);
 	m_thread->wait();
 	//m_emergethread.stop();
+	if (m_media_server) {
+		m_media_server->stop();
+		m_media_server->wait();
+	}
 
 	infostream<<"Server: Threads stopped"<<std::endl;
 }
@@ -486,6 +600,7 @@ void Server::AsyncRunStep(bool initial_step)
 		return;
 
 	g_profiler->add("Server::AsyncRunStep with dtime (num)", 1);
+	u64 step_start = m_step_time_log ? porting::getTimeUs() : 0;
 
 	//infostream<<"Server steps "<<dtime<<std::endl;
 	//infostream<<"Server::AsyncRunStep(): dtime="<<dtime<<std::endl;
@@ -536,6 +651,7 @@ void Server::AsyncRunStep(bool initial_step)
 		// Step environment
 		ScopeProfiler sp(g_profiler, "SEnv step");
 		ScopeProfiler sp2(g_profiler, "SEnv step avg", SPT_AVG);
+		TraceScope ts(TZ_SERVER_ENV_STEP);
 		m_env->step(dtime);
 	}
 
@@ -545,6 +661,7 @@ void Server::AsyncRunStep(bool initial_step)
 		MutexAutoLock lock(m_env_mutex);
 		// Run Map's timers and unload unused data
 		ScopeProfiler sp(g_profiler, "Server: map timer and unload");
+		TraceScope ts(TZ_SERVER_MAP_TIMER);
 		m_env->getMap().timerUpdate(map_timer_and_unload_dtime,
 			g_settings->getFloat("server_unload_unused_data_timeout"),
 			U32_MAX);
@@ -579,6 +696,7 @@ void Server::AsyncRunStep(bool initial_step)
 		MutexAutoLock lock(m_env_mutex);
 
 		ScopeProfiler sp(g_profiler, "Server: liquid transform");
+		TraceScope ts(TZ_SERVER_LIQUID);
 
 		std::map<v3s16, MapBlock*> modified_blocks;
 		m_env->getMap().transformLiquids(modified_blocks, m_env);
@@ -643,6 +761,7 @@ void Server::AsyncRunStep(bool initial_step)
 		m_clients.lock();
 		UNORDERED_MAP<u16, RemoteClient*> clients = m_clients.getClientList();
 		ScopeProfiler sp(g_profiler, "Server: checking added and deleted objs");
+		TraceScope ts(TZ_SERVER_OBJECTS);
 
 		// Radius inside which objects are active
 		static const s16 radius =
@@ -771,7 +890,7 @@ void Server::AsyncRunStep(bool initial_step)
 			for (UNORDERED_MAP<std::string, ModMetadata *>::const_iterator
 				it = m_mod_storages.begin(); it != m_mod_storages.end(); ++it) {
 				if (it->second->isModified()) {
-					it->second->save(getModStoragePath());
+					it->second->save();
 				}
 			}
 		}
@@ -783,6 +902,7 @@ void Server::AsyncRunStep(bool initial_step)
 	{
 		MutexAutoLock envlock(m_env_mutex);
 		ScopeProfiler sp(g_profiler, "Server: sending object messages");
+		TraceScope ts(TZ_SERVER_OBJECT_MESSAGES);
 
 		// Key = object id
 		// Value = data sent by object
@@ -996,6 +1116,7 @@ void Server::AsyncRunStep(bool initial_step)
 			MutexAutoLock lock(m_env_mutex);
 
 			ScopeProfiler sp(g_profiler, "Server: saving stuff");
+			TraceScope ts(TZ_SERVER_SAVE);
 
 			// Save ban file
 			if (m_banmanager->isModified()) {
@@ -1045,6 +1166,9 @@ void Server::AsyncRunStep(bool initial_step)
 			m_shutdown_requested = true;
 		}
 	}
+
+	if (m_step_time_log)
+		m_step_time_log->push_back(porting::getTimeUs() - step_start);
 }
 
 void Server::Receive()
@@ -1125,7 +1249,7 @@ PlayerSAO* Server::StageTwoClientInit(u16 peer_id)
 	SendPlayerInventoryFormspec(peer_id);
 
 	// Send inventory
-	SendInventory(playersao);
+	SendInventory(playersao, false);
 
 	// Send HP or death screen
 	if (playersao->isDead())
@@ -1170,6 +1294,7 @@ void Server::ProcessData(NetworkPacket *pkt)
 	MutexAutoLock envlock(m_env_mutex);
 
 	ScopeProfiler sp(g_profiler, "Server::ProcessData");
+	TraceScope ts(TZ_SERVER_PROCESS_DATA);
 	u32 peer_id = pkt->getPeerId();
 
 	try {
@@ -1340,7 +1465,7 @@ void Server::setInventoryModified(const InventoryLocation &loc, bool playerSend)
 		break;
 	case InventoryLocation::DETACHED:
 	{
-		sendDetachedInventory(loc.name,PEER_ID_INEXISTENT);
+		sendDetachedInventory(loc.name, PEER_ID_INEXISTENT, true);
 	}
 		break;
 	default:
@@ -1566,53 +1691,88 @@ void Server::SendDeathscreen(u16 peer_id,bool set_camera_point_target,
 	Send(&pkt);
 }
 
-void Server::SendItemDef(u16 peer_id,
-		IItemDefManager *itemdef, u16 protocol_version)
+void DefinitionsBlob::update(const std::string &serialized, u32 revision_)
+{
+	std::ostringstream os(std::ios::binary);
+	compressZlib(serialized, os);
+	data = os.str();
+	revision = revision_;
+
+	SHA1 sha1;
+	sha1.addBytes(data.c_str(), data.size());
+	unsigned char *digest = sha1.getDigest();
+	sha1_digest.assign((char *)digest, 20);
+	free(digest);
+}
+
+void Server::SendItemDef(u16 peer_id, IItemDefManager *itemdef,
+		u16 protocol_version, const std::string &cached_sha1)
 {
 	DSTACK(FUNCTION_NAME);
 
+	// Serialize and compress the definitions once for all clients
+	DefinitionsBlob &blob = m_itemdef_blobs[protocol_version];
+	if (blob.data.empty() || blob.revision != itemdef->getRevision()) {
+		ScopeProfiler sp(g_profiler, "Server: serialize definitions");
+		TraceScope ts(TZ_SERVER_SERIALIZE_DEFINITIONS, protocol_version);
+		std::ostringstream tmp_os(std::ios::binary);
+		itemdef->serialize(tmp_os, protocol_version);
+		blob.update(tmp_os.str(), itemdef->getRevision());
+	}
+
 	NetworkPacket pkt(TOCLIENT_ITEMDEF, 0, peer_id);
 
 	/*
 		u16 command
 		u32 length of the next item
-		zlib-compressed serialized ItemDefManager
+		zlib-compressed serialized ItemDefManager, empty if cached_sha1 matches
+		u16 length of the next item
+		SHA1 of the zlib-compressed definitions
 	*/
-	std::ostringstream tmp_os(std::ios::binary);
-	itemdef->serialize(tmp_os, protocol_version);
-	std::ostringstream tmp_os2(std::ios::binary);
-	compressZlib(tmp_os.str(), tmp_os2);
-	pkt.putLongString(tmp_os2.str());
+	bool cached = cached_sha1 == blob.sha1_digest;
+	pkt.putLongString(cached ? "" : blob.data);
+	pkt << blob.sha1_digest;
 
 	// Make data buffer
 	verbosestream << "Server: Sending item definitions to id(" << peer_id
-			<< "): size=" << pkt.getSize() << std::endl;
+			<< "): size=" << pkt.getSize()
+			<< (cached ? " (cached by the client)" : "") << std::endl;
 
 	Send(&pkt);
 }
 
-void Server::SendNodeDef(u16 peer_id,
-		INodeDefManager *nodedef, u16 protocol_version)
+void Server::SendNodeDef(u16 peer_id, INodeDefManager *nodedef,
+		u16 protocol_version, const std::string &cached_sha1)
 {
 	DSTACK(FUNCTION_NAME);
 
+	// Serialize and compress the definitions once for all clients
+	DefinitionsBlob &blob = m_nodedef_blobs[protocol_version];
+	if (blob.data.empty() || blob.revision != nodedef->getRevision()) {
+		ScopeProfiler sp(g_profiler, "Server: serialize definitions");
+		TraceScope ts(TZ_SERVER_SERIALIZE_DEFINITIONS, protocol_version);
+		std::ostringstream tmp_os(std::ios::binary);
+		nodedef->serialize(tmp_os, protocol_version);
+		blob.update(tmp_os.str(), nodedef->getRevision());
+	}
+
 	NetworkPacket pkt(TOCLIENT_NODEDEF, 0, peer_id);
 
 	/*
 		u16 command
 		u32 length of the next item
-		zlib-compressed serialized NodeDefManager
+		zlib-compressed serialized NodeDefManager, empty if cached_sha1 matches
+		u16 length of the next item
+		SHA1 of the zlib-compressed definitions
 	*/
-	std::ostringstream tmp_os(std::ios::binary);
-	nodedef->serialize(tmp_os, protocol_version);
-	std::ostringstream tmp_os2(std::ios::binary);
-	compressZlib(tmp_os.str(), tmp_os2);
-
-	pkt.putLongString(tmp_os2.str());
+	bool cached = cached_sha1 == blob.sha1_digest;
+	pkt.putLongString(cached ? "" : blob.data);
+	pkt << blob.sha1_digest;
 
 	// Make data buffer
 	verbosestream << "Server: Sending node definitions to id(" << peer_id
-			<< "): size=" << pkt.getSize() << std::endl;
+			<< "): size=" << pkt.getSize()
+			<< (cached ? " (cached by the client)" : "") << std::endl;
 
 	Send(&pkt);
 }
@@ -1621,20 +1781,39 @@ void Server::SendNodeDef(u16 peer_id,
 	Non-static send methods
 */
 
-void Server::SendInventory(PlayerSAO* playerSAO)
+void Server::SendInventory(PlayerSAO* playerSAO, bool incremental)
 {
 	DSTACK(FUNCTION_NAME);
 
-	UpdateCrafting(playerSAO->getPlayer());
+	Inventory *inventory = playerSAO->getInventory();
+	u16 peer_id = playerSAO->getPeerID();
+
+	// The craft preview only depends on the craft grid
+	const InventoryList *craftlist = inventory->getList("craft");
+	if (!incremental || !craftlist || craftlist->hasDirtySlots())
+		UpdateCrafting(playerSAO->getPlayer());
+
+	// The client list may be locked here, when on_newplayer gives items
+	incremental = incremental && inventory->canSerializeDirtySlots() &&
+		playerSAO->getPlayer()->protocol_version >= 34;
+	if (incremental && !inventory->hasDirtySlots())
+		return;
 
 	/*
 		Serialize it
 	*/
 
-	NetworkPacket pkt(TOCLIENT_INVENTORY, 0, playerSAO->getPeerID());
+	std::ostringstream os(std::ios_base::binary);
+	if (incremental) {
+		os << serializeString("");
+		inventory->serializeDirtySlots(os);
+	} else {
+		inventory->serialize(os);
+	}
+	inventory->clearDirtySlots();
 
-	std::ostringstream os;
-	playerSAO->getInventory()->serialize(os);
+	NetworkPacket pkt(incremental ? TOCLIENT_INVENTORY_DELTA : TOCLIENT_INVENTORY,
+		0, peer_id);
 
 	std::string s = os.str();
 
@@ -2319,6 +2498,7 @@ void Server::SendBlocks(float dtime)
 	//TODO check if one big lock could be faster then multiple small ones
 
 	ScopeProfiler sp(g_profiler, "Server: sel and send blocks to clients");
+	TraceScope ts(TZ_SERVER_SEND_BLOCKS);
 
 	std::vector<PrioritySortedBlockTransfer> queue;
 
@@ -2326,6 +2506,7 @@ void Server::SendBlocks(float dtime)
 
 	{
 		ScopeProfiler sp(g_profiler, "Server: selecting blocks for sending");
+		TraceScope ts(TZ_SERVER_SELECT_BLOCKS);
 
 		std::vector<u16> clients = m_clients.getClientIDs();
 
@@ -2381,11 +2562,123 @@ void Server::SendBlocks(float dtime)
 	m_clients.unlock();
 }
 
+/*
+	Media checksum cache
+
+	Hashing all media files on every startup is slow for big games, so the
+	checksums are kept in the world directory keyed by path, size and
+	modification time. Files not found in the cache are hashed in parallel,
+	the others are only read when a client asks for them.
+*/
+
+struct MediaHashJob
+{
+	std::string name;
+	std::string path;
+	u64 size;
+	u64 mtime;
+	std::string sha1_digest;
+	MediaData *data;
+};
+
+struct MediaHashCacheEntry
+{
+	u64 size;
+	u64 mtime;
+	std::string sha1_digest;
+};
+
+// Hashes the file unless already known, keeping its content loaded
+static void load_media_file(MediaHashJob *job)
+{
+	if (!job->sha1_digest.empty())
+		return;
+	if (!job->data->load()) {
+		job->data->drop();
+		job->data = NULL;
+		return;
+	}
+
+	SHA1 sha1;
+	sha1.addBytes(job->data->getData(), job->data->getSize());
+	unsigned char *digest = sha1.getDigest();
+	job->sha1_digest = base64_encode(digest, 20);
+	free(digest);
+}
+
+static void load_media_files(std::vector<MediaHashJob> &jobs,
+		size_t first, size_t step)
+{
+	for (size_t i = first; i < jobs.size(); i += step)
+		load_media_file(&jobs[i]);
+}
+
+class MediaHashThread : public Thread
+{
+public:
+	MediaHashThread(std::vector<MediaHashJob> &jobs, size_t first, size_t step):
+		Thread("MediaHash"),
+		m_jobs(jobs),
+		m_first(first),
+		m_step(step)
+	{}
+
+	void *run()
+	{
+		load_media_files(m_jobs, m_first, m_step);
+		return NULL;
+	}
+
+private:
+	std::vector<MediaHashJob> &m_jobs;
+	size_t m_first;
+	size_t m_step;
+};
+
+static void read_media_hash_cache(const std::string &path,
+		std::map<std::string, MediaHashCacheEntry> &cache)
+{
+	std::ifstream is(path.c_str());
+	if (!is.good())
+		return;
+
+	// Format: one "<sha1 base64> <size> <mtime> <file path>" per line
+	std::string line;
+	while (std::getline(is, line)) {
+		std::istringstream iss(line);
+		MediaHashCacheEntry entry;
+		if (!(iss >> entry.sha1_digest >> entry.size >> entry.mtime))
+			continue;
+		std::string filepath;
+		iss.get();
+		std::getline(iss, filepath);
+		if (!filepath.empty())
+			cache[filepath] = entry;
+	}
+}
+
+static void write_media_hash_cache(const std::string &path,
+		const std::vector<MediaHashJob> &files)
+{
+	std::ostringstream os;
+	for (std::vector<MediaHashJob>::const_iterator it = files.begin();
+			it != files.end(); ++it) {
+		if (it->sha1_digest.empty())
+			continue;
+		os << it->sha1_digest << " " << it->size << " " << it->mtime
+				<< " " << it->path << "\n";
+	}
+	if (!fs::safeWriteToFile(path, os.str()))
+		warningstream << "Server: Failed to write media cache "
+				<< path << std::endl;
+}
+
 void Server::fillMediaCache()
 {
 	DSTACK(FUNCTION_NAME);
 
 	infostream<<"Server: Calculating media file checksums"<<std::endl;
+	u64 start_ms = porting::getTimeMs();
 
 	// Collect all media file paths
 	std::vector<std::string> paths;
@@ -2399,7 +2692,13 @@ void Server::fillMediaCache()
 	}
 	paths.push_back(porting::path_user + DIR_DELIM + "textures" + DIR_DELIM + "server");
 
-	// Collect media file information from paths into cache
+	std::string cache_path = m_path_world + DIR_DELIM + "media_cache.txt";
+	std::map<std::string, MediaHashCacheEntry> cache;
+	read_media_hash_cache(cache_path, cache);
+
+	// Collect media file information from paths, reusing cached checksums
+	std::vector<MediaHashJob> files;
+	u32 num_hashed = 0;
 	for(std::vector<std::string>::iterator i = paths.begin();
 			i != paths.end(); ++i) {
 		std::string mediapath = *i;
@@ -2427,54 +2726,74 @@ void Server::fillMediaCache()
 						<< filename << "\"" << std::endl;
 				continue;
 			}
-			// Ok, attempt to load the file and add to cache
-			std::string filepath = mediapath + DIR_DELIM + filename;
-			// Read data
-			std::ifstream fis(filepath.c_str(), std::ios_base::binary);
-			if (!fis.good()) {
+
+			MediaHashJob job;
+			job.name = filename;
+			job.path = mediapath + DIR_DELIM + filename;
+			if (!fs::GetFileStat(job.path, &job.size, &job.mtime)) {
 				errorstream << "Server::fillMediaCache(): Could not open \""
 						<< filename << "\" for reading" << std::endl;
 				continue;
 			}
-			std::ostringstream tmp_os(std::ios_base::binary);
-			bool bad = false;
-			for(;;) {
-				char buf[1024];
-				fis.read(buf, 1024);
-				std::streamsize len = fis.gcount();
-				tmp_os.write(buf, len);
-				if (fis.eof())
-					break;
-				if (!fis.good()) {
-					bad = true;
-					break;
-				}
-			}
-			if(bad) {
-				errorstream<<"Server::fillMediaCache(): Failed to read \""
-						<< filename << "\"" << std::endl;
+			if (job.size == 0 || job.size > LONG_STRING_MAX_LEN) {
+				errorstream << "Server::fillMediaCache(): Empty or too big "
+						"file \"" << filename << "\"" << std::endl;
 				continue;
 			}
-			if(tmp_os.str().length() == 0) {
-				errorstream << "Server::fillMediaCache(): Empty file \""
-						<< filepath << "\"" << std::endl;
-				continue;
-			}
-
-			SHA1 sha1;
-			sha1.addBytes(tmp_os.str().c_str(), tmp_os.str().length());
 
-			unsigned char *digest = sha1.getDigest();
-			std::string sha1_base64 = base64_encode(digest, 20);
-			std::string sha1_hex = hex_encode((char*)digest, 20);
-			free(digest);
+			std::map<std::string, MediaHashCacheEntry>::const_iterator it =
+					cache.find(job.path);
+			if (it != cache.end() && it->second.size == job.size &&
+					it->second.mtime == job.mtime)
+				job.sha1_digest = it->second.sha1_digest;
+			else
+				num_hashed++;
+			job.data = new MediaData(job.path, job.size, job.mtime);
+			files.push_back(job);
+		}
+	}
 
-			// Put in list
-			m_media[filename] = MediaInfo(filepath, sha1_base64);
-			verbosestream << "Server: " << sha1_hex << " is " << filename
-					<< std::endl;
+	// Hash the new and changed files, spread over all cores
+	size_t num_threads = MYMIN(Thread::getNumberOfProcessors(),
+			num_hashed / 16);
+	if (num_threads <= 1) {
+		load_media_files(files, 0, 1);
+	} else {
+		std::vector<MediaHashThread*> threads;
+		for (size_t i = 0; i < num_threads; i++) {
+			threads.push_back(new MediaHashThread(files, i, num_threads));
+			threads.back()->start();
+		}
+		for (size_t i = 0; i < num_threads; i++) {
+			threads[i]->wait();
+			delete threads[i];
 		}
 	}
+
+	// Put in list, later paths override earlier ones
+	for (std::vector<MediaHashJob>::const_iterator it = files.begin();
+			it != files.end(); ++it) {
+		if (!it->data)
+			continue;
+		m_media[it->name] = MediaInfo(it->path, it->sha1_digest, it->data);
+		it->data->drop();
+		verbosestream << "Server: " << hex_encode(base64_decode(it->sha1_digest))
+				<< " is " << it->name << std::endl;
+	}
+
+	if (num_hashed > 0 || files.size() != cache.size())
+		write_media_hash_cache(cache_path, files);
+
+	u64 total_size = 0;
+	for (UNORDERED_MAP<std::string, MediaInfo>::const_iterator it = m_media.begin();
+			it != m_media.end(); ++it)
+		total_size += it->second.data->getSize();
+
+	actionstream << "Server: Media checksums of " << m_media.size()
+			<< " files (" << (total_size / 1024) << " KiB) ready in "
+			<< (porting::getTimeMs() - start_ms) << "ms ("
+			<< num_hashed << " hashed, " << (files.size() - num_hashed)
+			<< " cached)" << std::endl;
 }
 
 void Server::sendMediaAnnouncement(u16 peer_id)
@@ -2495,24 +2814,10 @@ void Server::sendMediaAnnouncement(u16 peer_id)
 		pkt << i->first << i->second.sha1_digest;
 	}
 
-	pkt << g_settings->get("remote_media");
+	pkt << m_remote_media;
 	Send(&pkt);
 }
 
-struct SendableMedia
-{
-	std::string name;
-	std::string path;
-	std::string data;
-
-	SendableMedia(const std::string &name_="", const std::string &path_="",
-	              const std::string &data_=""):
-		name(name_),
-		path(path_),
-		data(data_)
-	{}
-};
-
 void Server::sendRequestedMedia(u16 peer_id,
 		const std::vector<std::string> &tosend)
 {
@@ -2521,68 +2826,44 @@ void Server::sendRequestedMedia(u16 peer_id,
 	verbosestream<<"Server::sendRequestedMedia(): "
 			<<"Sending files to client"<<std::endl;
 
-	/* Read files */
-
-	// Put 5kB in one bunch (this is not accurate)
-	u32 bytes_per_bunch = 5000;
+	/* Collect files */
 
-	std::vector< std::vector<SendableMedia> > file_bunches;
-	file_bunches.push_back(std::vector<SendableMedia>());
+	// Fill about half of the client's reliable send window with one bunch,
+	// so that bigger windows get fewer and larger packets
+	u32 window_size = m_con.getPeerWindowSize(peer_id,
+			clientCommandFactoryTable[TOCLIENT_MEDIA].channel);
+	u32 bytes_per_bunch = rangelim(window_size * 256, 5000, 1000000);
 
-	u32 file_size_bunch_total = 0;
+	// Bunches only point into the media store, the content is copied once
+	// when the packets are built
+	typedef UNORDERED_MAP<std::string, MediaInfo>::const_iterator MediaRef;
+	std::vector<std::vector<MediaRef> > file_bunches;
+	std::vector<u32> bunch_sizes;
+	file_bunches.push_back(std::vector<MediaRef>());
+	bunch_sizes.push_back(0);
 
 	for(std::vector<std::string>::const_iterator i = tosend.begin();
 			i != tosend.end(); ++i) {
 		const std::string &name = *i;
 
-		if (m_media.find(name) == m_media.end()) {
+		MediaRef it = m_media.find(name);
+		if (it == m_media.end()) {
 			errorstream<<"Server::sendRequestedMedia(): Client asked for "
 					<<"unknown file \""<<(name)<<"\""<<std::endl;
 			continue;
 		}
-
-		//TODO get path + name
-		std::string tpath = m_media[name].path;
-
-		// Read data
-		std::ifstream fis(tpath.c_str(), std::ios_base::binary);
-		if(fis.good() == false){
-			errorstream<<"Server::sendRequestedMedia(): Could not open \""
-					<<tpath<<"\" for reading"<<std::endl;
-			continue;
-		}
-		std::ostringstream tmp_os(std::ios_base::binary);
-		bool bad = false;
-		for(;;) {
-			char buf[1024];
-			fis.read(buf, 1024);
-			std::streamsize len = fis.gcount();
-			tmp_os.write(buf, len);
-			file_size_bunch_total += len;
-			if(fis.eof())
-				break;
-			if(!fis.good()) {
-				bad = true;
-				break;
-			}
-		}
-		if(bad) {
-			errorstream<<"Server::sendRequestedMedia(): Failed to read \""
-					<<name<<"\""<<std::endl;
+		if (!it->second.data->load())
 			continue;
-		}
-		/*infostream<<"Server::sendRequestedMedia(): Loaded \""
-				<<tname<<"\""<<std::endl;*/
+
 		// Put in list
-		file_bunches[file_bunches.size()-1].push_back(
-				SendableMedia(name, tpath, tmp_os.str()));
+		file_bunches.back().push_back(it);
+		bunch_sizes.back() += 2 + name.size() + 4 + it->second.data->getSize();
 
 		// Start next bunch if got enough data
-		if(file_size_bunch_total >= bytes_per_bunch) {
-			file_bunches.push_back(std::vector<SendableMedia>());
-			file_size_bunch_total = 0;
+		if (bunch_sizes.back() >= bytes_per_bunch) {
+			file_bunches.push_back(std::vector<MediaRef>());
+			bunch_sizes.push_back(0);
 		}
-
 	}
 
 	/* Create and send packets */
@@ -2602,14 +2883,14 @@ void Server::sendRequestedMedia(u16 peer_id,
 			}
 		*/
 
-		NetworkPacket pkt(TOCLIENT_MEDIA, 4 + 0, peer_id);
+		NetworkPacket pkt(TOCLIENT_MEDIA, 2 + 2 + 4 + bunch_sizes[i], peer_id);
 		pkt << num_bunches << i << (u32) file_bunches[i].size();
 
-		for(std::vector<SendableMedia>::iterator
-				j = file_bunches[i].begin();
+		for (std::vector<MediaRef>::const_iterator j = file_bunches[i].begin();
 				j != file_bunches[i].end(); ++j) {
-			pkt << j->name;
-			pkt.putLongString(j->data);
+			const MediaData *data = (*j)->second.data;
+			pkt << (*j)->first;
+			pkt.putLongString(data->getData(), data->getSize());
 		}
 
 		verbosestream << "Server::sendRequestedMedia(): bunch "
@@ -2620,35 +2901,68 @@ void Server::sendRequestedMedia(u16 peer_id,
 	}
 }
 
-void Server::sendDetachedInventory(const std::string &name, u16 peer_id)
+static std::string serialize_detached_inventory(const std::string &name,
+		Inventory *inv, bool dirty_slots)
+{
+	std::ostringstream os(std::ios_base::binary);
+	os << serializeString(name);
+	if (dirty_slots)
+		inv->serializeDirtySlots(os);
+	else
+		inv->serialize(os);
+	return os.str();
+}
+
+void Server::sendDetachedInventory(const std::string &name, u16 peer_id,
+		bool incremental)
 {
 	if(m_detached_inventories.count(name) == 0) {
 		errorstream<<FUNCTION_NAME<<": \""<<name<<"\" not found"<<std::endl;
 		return;
 	}
 	Inventory *inv = m_detached_inventories[name];
-	std::ostringstream os(std::ios_base::binary);
-
-	os << serializeString(name);
-	inv->serialize(os);
 
-	// Make data buffer
-	std::string s = os.str();
-
-	NetworkPacket pkt(TOCLIENT_DETACHED_INVENTORY, 0, peer_id);
-	pkt.putRawString(s.c_str(), s.size());
+	// Changes have to reach everyone before they can be forgotten
+	incremental = incremental && peer_id == PEER_ID_INEXISTENT &&
+		inv->canSerializeDirtySlots();
+	if (incremental && !inv->hasDirtySlots())
+		return;
 
 	const std::string &check = m_detached_inventories_player[name];
-	if (peer_id == PEER_ID_INEXISTENT) {
-		if (check == "")
-			return m_clients.sendToAll(&pkt);
-		RemotePlayer *p = m_env->getPlayer(check.c_str());
-		if (p)
-			m_clients.send(p->peer_id, 0, &pkt, true);
+	if (check != "") {
+		// Only the owner may see it. Its client is found through the
+		// player: the client list is locked when on_newplayer runs.
+		RemotePlayer *owner = m_env->getPlayer(check.c_str());
+		if (owner && owner->peer_id != 0 && (peer_id == PEER_ID_INEXISTENT ||
+				peer_id == owner->peer_id)) {
+			incremental = incremental && owner->protocol_version >= 34;
+			std::string s = serialize_detached_inventory(name, inv,
+				incremental);
+			NetworkPacket pkt(incremental ? TOCLIENT_INVENTORY_DELTA :
+				TOCLIENT_DETACHED_INVENTORY, 0, owner->peer_id);
+			pkt.putRawString(s.c_str(), s.size());
+			m_clients.send(owner->peer_id, 0, &pkt, true);
+		}
 	} else {
-		if (check == "" || getPlayerName(peer_id) == check)
+		std::string s = serialize_detached_inventory(name, inv, false);
+		NetworkPacket pkt(TOCLIENT_DETACHED_INVENTORY, 0, peer_id);
+		pkt.putRawString(s.c_str(), s.size());
+
+		if (peer_id != PEER_ID_INEXISTENT) {
 			Send(&pkt);
+		} else if (!incremental) {
+			m_clients.sendToAll(&pkt);
+		} else {
+			// Old clients get the full inventory
+			s = serialize_detached_inventory(name, inv, true);
+			NetworkPacket pkt_delta(TOCLIENT_INVENTORY_DELTA, 0);
+			pkt_delta.putRawString(s.c_str(), s.size());
+			m_clients.sendToAllCompat(&pkt_delta, &pkt, 34);
+		}
 	}
+
+	if (peer_id == PEER_ID_INEXISTENT)
+		inv->clearDirtySlots();
 }
 
 void Server::sendDetachedInventories(u16 peer_id)
@@ -3548,6 +3862,181 @@ std::string Server::getModStoragePath() const
 	return m_path_world + DIR_DELIM + "mod_storage";
 }
 
+ModMetadataDatabase *Server::openModStorageDatabase(const std::string &backend,
+		const std::string &world_path)
+{
+	if (backend == "sqlite3")
+		return new ModMetadataDatabaseSQLite3(world_path);
+	else if (backend == "files")
+		return new ModMetadataDatabaseFiles(world_path + DIR_DELIM + "mod_storage");
+	else
+		throw BaseException(std::string("Database backend ") + backend + " not supported.");
+}
+
+bool Server::migrateModStorageDatabase(const GameParams &game_params,
+		const Settings &cmd_args)
+{
+	std::string migrate_to = cmd_args.get("migrate-mod-storage");
+	Settings world_mt;
+	std::string world_mt_path = game_params.world_path + DIR_DELIM + "world.mt";
+	if (!world_mt.readConfigFile(world_mt_path.c_str())) {
+		errorstream << "Cannot read world.mt!" << std::endl;
+		return false;
+	}
+
+	std::string backend = "files";
+	world_mt.getNoEx("mod_storage_backend", backend);
+	if (backend == migrate_to) {
+		errorstream << "Cannot migrate: new backend is same"
+			<< " as the old one" << std::endl;
+		return false;
+	}
+
+	ModMetadataDatabase *srcdb = NULL;
+	ModMetadataDatabase *dstdb = NULL;
+	bool succeeded = false;
+
+	try {
+		srcdb = Server::openModStorageDatabase(backend, game_params.world_path);
+		dstdb = Server::openModStorageDatabase(migrate_to, game_params.world_path);
+
+		std::vector<std::string> mod_list;
+		srcdb->listMods(mod_list);
+		succeeded = true;
+		for (std::vector<std::string>::const_iterator it = mod_list.begin();
+				it != mod_list.end() && succeeded; ++it) {
+			StringMap meta;
+			succeeded = srcdb->getModEntries(*it, meta);
+			dstdb->beginSave();
+			for (StringMap::const_iterator var = meta.begin();
+					var != meta.end() && succeeded; ++var)
+				succeeded = dstdb->setModEntry(*it, var->first, var->second);
+			dstdb->endSave();
+			if (!succeeded)
+				errorstream << "Failed to migrate mod storage of " << *it << std::endl;
+		}
+
+		if (succeeded) {
+			actionstream << "Successfully migrated the mod storage of "
+				<< mod_list.size() << " mods" << std::endl;
+			world_mt.set("mod_storage_backend", migrate_to);
+			if (!world_mt.updateConfigFile(world_mt_path.c_str()))
+				errorstream << "Failed to update world.mt!" << std::endl;
+			else
+				actionstream << "world.mt updated" << std::endl;
+		}
+	} catch (BaseException &e) {
+		errorstream << "An error occurred during migration: " << e.what() << std::endl;
+		succeeded = false;
+	}
+
+	delete srcdb;
+	delete dstdb;
+
+	// Keep the old directory around, it isn't used anymore
+	if (succeeded && backend == "files") {
+		std::string storage_path = game_params.world_path + DIR_DELIM + "mod_storage";
+		fs::Rename(storage_path, storage_path + ".bak");
+	}
+	return succeeded;
+}
+
+AuthDatabase *Server::openAuthDatabase(const std::string &backend,
+		const std::string &world_path, const Settings &conf)
+{
+	if (backend == "sqlite3")
+		return new AuthDatabaseSQLite3(world_path);
+#if USE_POSTGRESQL
+	else if (backend == "postgresql") {
+		std::string connect_string = "";
+		conf.getNoEx("pgsql_auth_connection", connect_string);
+		return new AuthDatabasePostgreSQL(connect_string);
+	}
+#endif
+	else if (backend == "files")
+		return new AuthDatabaseFiles(world_path);
+	else
+		throw BaseException(std::string("Database backend ") + backend + " not supported.");
+}
+
+bool Server::migrateAuthDatabase(const GameParams &game_params,
+		const Settings &cmd_args)
+{
+	std::string migrate_to = cmd_args.get("migrate-auth");
+	Settings world_mt;
+	std::string world_mt_path = game_params.world_path + DIR_DELIM + "world.mt";
+	if (!world_mt.readConfigFile(world_mt_path.c_str())) {
+		errorstream << "Cannot read world.mt!" << std::endl;
+		return false;
+	}
+
+	std::string backend = "files";
+	world_mt.getNoEx("auth_backend", backend);
+	if (backend == migrate_to) {
+		errorstream << "Cannot migrate: new backend is same"
+			<< " as the old one" << std::endl;
+		return false;
+	}
+
+	AuthDatabase *srcdb = NULL;
+	AuthDatabase *dstdb = NULL;
+	bool succeeded = false;
+
+	try {
+		srcdb = Server::openAuthDatabase(backend, game_params.world_path, world_mt);
+		dstdb = Server::openAuthDatabase(migrate_to, game_params.world_path, world_mt);
+
+		std::vector<std::string> names_list;
+		srcdb->listNames(names_list);
+		succeeded = true;
+		u32 count = 0;
+		dstdb->beginSave();
+		for (std::vector<std::string>::const_iterator it = names_list.begin();
+				it != names_list.end() && succeeded; ++it) {
+			AuthEntry authEntry;
+			succeeded = srcdb->getAuth(*it, authEntry) &&
+				dstdb->createAuth(authEntry);
+			if (!succeeded) {
+				errorstream << "Failed to migrate " << *it << std::endl;
+			} else if (++count % 10000 == 0) {
+				dstdb->endSave();
+				actionstream << "Migrated " << count << " of "
+					<< names_list.size() << " auth entries" << std::endl;
+				dstdb->beginSave();
+			}
+		}
+		dstdb->endSave();
+
+		if (succeeded) {
+			actionstream << "Successfully migrated " << names_list.size()
+				<< " auth entries" << std::endl;
+			world_mt.set("auth_backend", migrate_to);
+			if (!world_mt.updateConfigFile(world_mt_path.c_str()))
+				errorstream << "Failed to update world.mt!" << std::endl;
+			else
+				actionstream << "world.mt updated" << std::endl;
+		}
+	} catch (BaseException &e) {
+		errorstream << "An error occurred during migration: " << e.what() << std::endl;
+		succeeded = false;
+	}
+
+	delete srcdb;
+	delete dstdb;
+
+	// Keep the old file around, it isn't used anymore
+	if (succeeded && backend == "files") {
+		std::string auth_path = game_params.world_path + DIR_DELIM + "auth.txt";
+		fs::Rename(auth_path, auth_path + ".bak");
+	}
+	return succeeded;
+}
+
+std::string Server::getTracePath() const
+{
+	return m_path_world + DIR_DELIM + "traces";
+}
+
 v3f Server::findSpawnPos()
 {
 	ServerMap &map = m_env->getServerMap();
@@ -3699,7 +4188,7 @@ void Server::unregisterModStorage(const std::string &name)
 	UNORDERED_MAP<std::string, ModMetadata *>::const_iterator it = m_mod_storages.find(name);
 	if (it != m_mod_storages.end()) {
 		// Save unconditionaly on unregistration
-		it->second->save(getModStoragePath());
+		it->second->save();
 		m_mod_storages.erase(name);
 	}
 }
@@ -3721,6 +4210,7 @@ void dedicated_server_loop(Server &server, bool &kill)
 		// because server.step() is very light
 		{
 			ScopeProfiler sp(g_profiler, "dedicated server sleep");
+			TraceScope ts(TZ_SERVER_SLEEP);
 			sleep_ms((int)(steplen*1000.0));
 		}
 		server.step(steplen);
@@ -38,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "clientiface.h"
 #include "remoteplayer.h"
 #include "network/networkpacket.h"
+#include "mediastore.h"
 #include <string>
 #include <list>
 #include <map>
@@ -55,8 +56,11 @@ struct RollbackAction;
 class EmergeManager;
 class ServerScripting;
 class ServerEnvironment;
+class AuthDatabase;
 struct SimpleSoundSpec;
 class ServerThread;
+class MediaHTTPServer;
+struct GameParams;
 
 enum ClientDeletionReason {
 	CDR_LEAVE,
@@ -64,6 +68,24 @@ enum ClientDeletionReason {
 	CDR_DENY
 };
 
+/*
+	Compressed item or node definitions as sent to the clients, kept until
+	the definitions change
+*/
+struct DefinitionsBlob
+{
+	// See IItemDefManager::getRevision() and INodeDefManager::getRevision()
+	u32 revision;
+	std::string data;
+	// SHA1 of data, which the clients cache it by
+	std::string sha1_digest;
+
+	DefinitionsBlob(): revision(0) {}
+
+	// Compresses the serialized definitions
+	void update(const std::string &serialized, u32 revision_);
+};
+
 class MapEditEventAreaIgnorer
 {
 public:
@@ -93,12 +115,45 @@ struct MediaInfo
 {
 	std::string path;
 	std::string sha1_digest;
+	// Loaded file content, may be NULL
+	MediaData *data;
 
 	MediaInfo(const std::string &path_="",
-	          const std::string &sha1_digest_=""):
+	          const std::string &sha1_digest_="",
+	          MediaData *data_=NULL):
 		path(path_),
-		sha1_digest(sha1_digest_)
+		sha1_digest(sha1_digest_),
+		data(data_)
+	{
+		if (data)
+			data->grab();
+	}
+
+	MediaInfo(const MediaInfo &other):
+		path(other.path),
+		sha1_digest(other.sha1_digest),
+		data(other.data)
 	{
+		if (data)
+			data->grab();
+	}
+
+	~MediaInfo()
+	{
+		if (data)
+			data->drop();
+	}
+
+	MediaInfo &operator=(const MediaInfo &other)
+	{
+		if (other.data)
+			other.data->grab();
+		if (data)
+			data->drop();
+		path = other.path;
+		sha1_digest = other.sha1_digest;
+		data = other.data;
+		return *this;
 	}
 };
 
@@ -299,7 +354,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void getModNames(std::vector<std::string> &modlist);
 	std::string getBuiltinLuaPath();
 	virtual std::string getWorldPath() const { return m_path_world; }
-	virtual std::string getModStoragePath() const;
+	std::string getModStoragePath() const;
+	virtual ModMetadataDatabase *getModStorageDatabase()
+	{ return m_mod_storage_database; }
+	AuthDatabase *getAuthDatabase() { return m_auth_database; }
+	std::string getTracePath() const;
 
 	inline bool isSingleplayer()
 			{ return m_simple_singleplayer_mode; }
@@ -307,6 +366,10 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	inline void setAsyncFatalError(const std::string &error)
 			{ m_async_fatal_error.set(error); }
 
+	// Appends the durations of the server steps to log, in microseconds.
+	// It may only be read while the server is stopped.
+	void setStepTimeLog(std::vector<u32> *log) { m_step_time_log = log; }
+
 	bool showFormspec(const char *name, const std::string &formspec, const std::string &formname);
 	Map & getMap() { return m_env->getMap(); }
 	ServerEnvironment & getEnv() { return *m_env; }
@@ -365,12 +428,18 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 
 	void SendPlayerHPOrDie(PlayerSAO *player);
 	void SendPlayerBreath(PlayerSAO *sao);
-	void SendInventory(PlayerSAO* playerSAO);
+	// Only sends the changed slots if incremental and the client supports it
+	void SendInventory(PlayerSAO* playerSAO, bool incremental = true);
 	void SendMovePlayer(u16 peer_id);
 
 	virtual bool registerModStorage(ModMetadata *storage);
 	virtual void unregisterModStorage(const std::string &name);
 
+	static bool migrateModStorageDatabase(const GameParams &game_params,
+			const Settings &cmd_args);
+	static bool migrateAuthDatabase(const GameParams &game_params,
+			const Settings &cmd_args);
+
 	// Bind address
 	Address m_bind_addr;
 
@@ -382,6 +451,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	friend class EmergeThread;
 	friend class RemoteClient;
 
+	static ModMetadataDatabase *openModStorageDatabase(const std::string &backend,
+			const std::string &world_path);
+	static AuthDatabase *openAuthDatabase(const std::string &backend,
+			const std::string &world_path, const Settings &conf);
+
 	void SendMovement(u16 peer_id);
 	void SendHP(u16 peer_id, u8 hp);
 	void SendBreath(u16 peer_id, u16 breath);
@@ -389,8 +463,11 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 		const std::string &custom_reason, bool reconnect = false);
 	void SendAccessDenied_Legacy(u16 peer_id, const std::wstring &reason);
 	void SendDeathscreen(u16 peer_id,bool set_camera_point_target, v3f camera_point_target);
-	void SendItemDef(u16 peer_id,IItemDefManager *itemdef, u16 protocol_version);
-	void SendNodeDef(u16 peer_id,INodeDefManager *nodedef, u16 protocol_version);
+	// cached_sha1: SHA1 of the definitions the client has cached
+	void SendItemDef(u16 peer_id, IItemDefManager *itemdef,
+			u16 protocol_version, const std::string &cached_sha1);
+	void SendNodeDef(u16 peer_id, INodeDefManager *nodedef,
+			u16 protocol_version, const std::string &cached_sha1);
 
 	/* mark blocks not sent for all clients */
 	void SetBlocksNotSent(std::map<v3s16, MapBlock *>& block);
@@ -441,11 +518,13 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	void SendBlocks(float dtime);
 
 	void fillMediaCache();
+	void startMediaServer(const Address &bind_addr);
 	void sendMediaAnnouncement(u16 peer_id);
 	void sendRequestedMedia(u16 peer_id,
 			const std::vector<std::string> &tosend);
 
-	void sendDetachedInventory(const std::string &name, u16 peer_id);
+	void sendDetachedInventory(const std::string &name, u16 peer_id,
+			bool incremental = false);
 	void sendDetachedInventories(u16 peer_id);
 
 	// Adds a ParticleSpawner on peer with peer_id (PEER_ID_INEXISTENT == all)
@@ -529,6 +608,8 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// Thread can set; step() will throw as ServerError
 	MutexedVariable<std::string> m_async_fatal_error;
 
+	std::vector<u32> *m_step_time_log;
+
 	// Some timers
 	float m_liquid_transform_timer;
 	float m_liquid_transform_every;
@@ -653,8 +734,16 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	*/
 	u16 m_ignore_map_edit_events_peer_id;
 
+	// Definitions sent to the clients, by protocol version
+	std::map<u16, DefinitionsBlob> m_itemdef_blobs;
+	std::map<u16, DefinitionsBlob> m_nodedef_blobs;
+
 	// media files known to server
 	UNORDERED_MAP<std::string, MediaInfo> m_media;
+	// Built-in remote media server, NULL if disabled
+	MediaHTTPServer *m_media_server;
+	// Remote media URL announced to clients
+	std::string m_remote_media;
 
 	/*
 		Sounds
@@ -670,9 +759,12 @@ class Server : public con::PeerHandler, public MapEventReceiver,
 	// value = "" (visible to all players) or player name
 	std::map<std::string, std::string> m_detached_inventories_player;
 
+	ModMetadataDatabase *m_mod_storage_database;
 	UNORDERED_MAP<std::string, ModMetadata *> m_mod_storages;
 	float m_mod_storage_save_timer;
 
+	AuthDatabase *m_auth_database;
+
 	DISABLE_CLASS_COPY(Server);
 };
 
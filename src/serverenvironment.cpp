@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "gamedef.h"
 #include "map.h"
 #include "profiler.h"
+#include "tracer.h"
 #include "raycast.h"
 #include "remoteplayer.h"
 #include "scripting_server.h"
@@ -48,6 +49,24 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // A number that is much smaller than the timeout for particle spawners should/could ever be
 #define PARTICLE_SPAWNER_NO_EXPIRY -1024.f
 
+// collisionMoveSimple() clamps dtime to this, longer steps are split
+#define OBJECT_STEP_DTIME_MAX 0.5f
+
+// Steps the object for dtime including the time it was not stepped
+static void step_object_skipped(ServerActiveObject *obj, float dtime,
+	bool send_recommended)
+{
+	dtime += obj->m_step_dtime_skipped;
+	obj->m_step_dtime_skipped = 0;
+	while (dtime > OBJECT_STEP_DTIME_MAX) {
+		obj->step(OBJECT_STEP_DTIME_MAX, send_recommended);
+		dtime -= OBJECT_STEP_DTIME_MAX;
+		if (obj->isGone())
+			return;
+	}
+	obj->step(dtime, send_recommended);
+}
+
 /*
 	ABMWithState
 */
@@ -376,6 +395,14 @@ ServerEnvironment::ServerEnvironment(ServerMap *map,
 	m_path_world(path_world),
 	m_send_recommended_timer(0),
 	m_active_block_interval_overload_skip(0),
+	m_deferred_lighting(g_settings->getBool("deferred_lighting")),
+	m_entity_lod_distance(g_settings->getS16("entity_lod_distance") * BS),
+	m_entity_lod_step_interval(g_settings->getFloat("entity_lod_step_interval")),
+	m_entity_sleep_distance(g_settings->getS16("entity_sleep_distance") * BS),
+	m_reduced_step_tick(0),
+	m_max_objects_activated_per_step(
+		g_settings->getU16("max_objects_activated_per_step")),
+	m_objects_activated(0),
 	m_game_time(0),
 	m_game_time_fraction_counter(0),
 	m_last_clear_objects_time(0),
@@ -412,6 +439,18 @@ ServerEnvironment::~ServerEnvironment()
 	// This makes the next one delete all active objects.
 	m_active_blocks.clear();
 
+	// Blocks still waiting keep their objects stored. The server finishes
+	// them before on_shutdown, scripting may be gone here. Their LBMs run
+	// on the next activation.
+	for (std::deque<PendingActivation>::iterator
+			i = m_pending_activations.begin();
+			i != m_pending_activations.end(); ++i) {
+		MapBlock *block = m_map->getBlockNoCreateNoEx(i->blockpos);
+		if (block)
+			block->setTimestampNoChangedFlag(i->stamp);
+	}
+	m_pending_activations.clear();
+
 	// Convert all objects to static and delete the active objects
 	deactivateFarObjects(true);
 
@@ -817,7 +856,7 @@ class ABMHandler
 		for(p0.Y=0; p0.Y<MAP_BLOCKSIZE; p0.Y++)
 		for(p0.Z=0; p0.Z<MAP_BLOCKSIZE; p0.Z++)
 		{
-			const MapNode &n = block->getNodeUnsafe(p0);
+			MapNode n = block->getNodeUnsafe(p0);
 			content_t c = n.getContent();
 
 			if (c >= m_aabms.size() || !m_aabms[c])
@@ -843,7 +882,7 @@ class ABMHandler
 						if (block->isValidPosition(p1)) {
 							// if the neighbor is found on the same map block
 							// get it straight from there
-							const MapNode &n = block->getNodeUnsafe(p1);
+							MapNode n = block->getNodeUnsafe(p1);
 							c = n.getContent();
 						} else {
 							// otherwise consult the map
@@ -908,15 +947,28 @@ void ServerEnvironment::activateBlock(MapBlock *block, u32 additional_dtime)
 	/*infostream<<"ServerEnvironment::activateBlock(): block is "
 			<<dtime_s<<" seconds old."<<std::endl;*/
 
-	// Activate stored objects
-	activateObjects(block, dtime_s);
-
-	/* Handle LoadingBlockModifiers */
-	m_lbm_mgr.applyLBMs(this, block, stamp);
+	// Activate stored objects and handle LoadingBlockModifiers, on the next
+	// steps if too many objects were activated already
+	u32 count = block->m_static_objects.m_stored.size();
+	if (count == 0 || m_max_objects_activated_per_step == 0 ||
+			(m_pending_activations.empty() && (m_objects_activated == 0 ||
+			m_objects_activated + count <= m_max_objects_activated_per_step))) {
+		m_objects_activated += count;
+		finishBlockActivation(block, dtime_s, stamp);
+	} else {
+		PendingActivation a;
+		a.blockpos = block->getPos();
+		a.dtime_s = dtime_s;
+		a.stamp = stamp;
+		a.queued_time = m_game_time;
+		m_pending_activations.push_back(a);
+	}
 
-	// Run node timers
+	// Run node timers, from now on they run on the wheel
 	std::vector<NodeTimer> elapsed_timers =
 		block->m_node_timers.step((float)dtime_s);
+	block->m_node_timers.schedule(&m_map->getNodeTimerWheel(),
+		block->getPos());
 	if (!elapsed_timers.empty()) {
 		MapNode n;
 		for (std::vector<NodeTimer>::iterator
@@ -971,6 +1023,44 @@ bool ServerEnvironment::setNode(v3s16 p, const MapNode &n)
 	return true;
 }
 
+u32 ServerEnvironment::setNodes(const std::vector<v3s16> &positions,
+	const MapNode &n)
+{
+	INodeDefManager *ndef = m_server->ndef();
+	std::vector<MapNode> old_nodes;
+	old_nodes.reserve(positions.size());
+
+	// Call destructors
+	for (size_t i = 0; i < positions.size(); i++) {
+		old_nodes.push_back(m_map->getNodeNoEx(positions[i]));
+		if (ndef->get(old_nodes[i]).has_on_destruct)
+			m_script->node_on_destruct(positions[i], old_nodes[i]);
+	}
+
+	// Replace the nodes, with one light update for all of them
+	u32 count = m_map->setNodesWithEvent(positions, n);
+
+	bool has_on_construct = ndef->get(n).has_on_construct;
+	for (size_t i = 0; i < positions.size(); i++) {
+		// Nodes that aren't loaded were not set
+		if (old_nodes[i].getContent() == CONTENT_IGNORE)
+			continue;
+
+		// Update active VoxelManipulator if a mapgen thread
+		m_map->updateVManip(positions[i]);
+
+		// Call post-destructor
+		if (ndef->get(old_nodes[i]).has_after_destruct)
+			m_script->node_after_destruct(positions[i], old_nodes[i]);
+
+		// Call constructor
+		if (has_on_construct)
+			m_script->node_on_construct(positions[i], n);
+	}
+
+	return count;
+}
+
 bool ServerEnvironment::removeNode(v3s16 p)
 {
 	INodeDefManager *ndef = m_server->ndef();
@@ -1165,6 +1255,9 @@ void ServerEnvironment::step(float dtime)
 	/* Step time of day */
 	stepTimeOfDay(dtime);
 
+	if (m_deferred_lighting)
+		m_map->beginLightingBatch();
+
 	// Update this one
 	// NOTE: This is kind of funny on a singleplayer game, but doesn't
 	// really matter that much.
@@ -1181,11 +1274,18 @@ void ServerEnvironment::step(float dtime)
 		m_game_time_fraction_counter -= (float)inc_i;
 	}
 
+	/*
+		Activate the objects of the blocks that were over the budget before
+	*/
+	m_objects_activated = 0;
+	finishPendingActivations();
+
 	/*
 		Handle players
 	*/
 	{
 		ScopeProfiler sp(g_profiler, "SEnv: handle players avg", SPT_AVG);
+		TraceScope ts(TZ_SENV_PLAYERS);
 		for (std::vector<RemotePlayer *>::iterator i = m_players.begin();
 			i != m_players.end(); ++i) {
 			RemotePlayer *player = dynamic_cast<RemotePlayer *>(*i);
@@ -1205,6 +1305,7 @@ void ServerEnvironment::step(float dtime)
 	*/
 	if (m_active_blocks_management_interval.step(dtime, m_cache_active_block_mgmt_interval)) {
 		ScopeProfiler sp(g_profiler, "SEnv: manage act. block list avg per interval", SPT_AVG);
+		TraceScope ts(TZ_SENV_ACTIVE_BLOCKS);
 		/*
 			Get player block positions
 		*/
@@ -1250,12 +1351,17 @@ void ServerEnvironment::step(float dtime)
 			/* infostream<<"Server: Block " << PP(p)
 				<< " became inactive"<<std::endl; */
 
+			// Its objects are deactivated again on the next interval
+			finishPendingActivation(p);
+
 			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
 			if(block==NULL)
 				continue;
 
 			// Set current time as timestamp (and let it set ChangedFlag)
 			block->setTimestamp(m_game_time);
+
+			block->m_node_timers.unschedule();
 		}
 
 		/*
@@ -1278,55 +1384,59 @@ void ServerEnvironment::step(float dtime)
 			/* infostream<<"Server: Block " << PP(p)
 				<< " became active"<<std::endl; */
 		}
-	}
-
-	/*
-		Mess around in active blocks
-	*/
-	if (m_active_blocks_nodemetadata_interval.step(dtime, m_cache_nodetimer_interval)) {
-		ScopeProfiler sp(g_profiler, "SEnv: mess in act. blocks avg per interval", SPT_AVG);
-
-		float dtime = m_cache_nodetimer_interval;
-
-		for(std::set<v3s16>::iterator
-			i = m_active_blocks.m_list.begin();
-			i != m_active_blocks.m_list.end(); ++i)
-		{
-			v3s16 p = *i;
 
-			/*infostream<<"Server: Block ("<<p.X<<","<<p.Y<<","<<p.Z
-					<<") being handled"<<std::endl;*/
+		/*
+			Keep active blocks loaded
+		*/
 
-			MapBlock *block = m_map->getBlockNoCreateNoEx(p);
-			if(block==NULL)
+		for (std::set<v3s16>::iterator i = m_active_blocks.m_list.begin();
+				i != m_active_blocks.m_list.end(); ++i) {
+			MapBlock *block = m_map->getBlockNoCreateNoEx(*i);
+			if (block == NULL)
 				continue;
 
 			// Reset block usage timer
 			block->resetUsageTimer();
 
-			// Set current time as timestamp
-			block->setTimestampNoChangedFlag(m_game_time);
 			// If time has changed much from the one on disk,
 			// set block to be saved when it is unloaded
-			if(block->getTimestamp() > block->getDiskTimestamp() + 60)
+			if (block->getTimestamp() > block->getDiskTimestamp() + 60)
 				block->raiseModified(MOD_STATE_WRITE_AT_UNLOAD,
 					MOD_REASON_BLOCK_EXPIRED);
 
-			// Run node timers
-			std::vector<NodeTimer> elapsed_timers =
-				block->m_node_timers.step((float)dtime);
-			if (!elapsed_timers.empty()) {
-				MapNode n;
-				for (std::vector<NodeTimer>::iterator i = elapsed_timers.begin();
-					i != elapsed_timers.end(); ++i) {
-					n = block->getNodeNoEx(i->position);
-					p = i->position + block->getPosRelative();
-					if (m_script->node_on_timer(p, n, i->elapsed)) {
-						block->setNodeTimer(NodeTimer(
-							i->timeout, 0, i->position));
-					}
-				}
-			}
+			// The block was reloaded while active
+			if (!block->m_node_timers.isScheduled())
+				block->m_node_timers.schedule(&m_map->getNodeTimerWheel(),
+					block->getPos());
+		}
+	}
+
+	/*
+		Run node timers of active blocks
+	*/
+	if (m_active_blocks_nodemetadata_interval.step(dtime, m_cache_nodetimer_interval)) {
+		ScopeProfiler sp(g_profiler, "SEnv: mess in act. blocks avg per interval", SPT_AVG);
+		TraceScope ts(TZ_SENV_NODE_TIMERS);
+
+		std::vector<NodeTimerWheel::Entry> expired;
+		m_map->getNodeTimerWheel().step(m_cache_nodetimer_interval, expired);
+		g_profiler->avg("SEnv: node timers per interval", expired.size());
+
+		for (std::vector<NodeTimerWheel::Entry>::iterator i = expired.begin();
+				i != expired.end(); ++i) {
+			// Callbacks may unload blocks, look the block up every time
+			MapBlock *block = m_map->getBlockNoCreateNoEx(i->blockpos);
+			if (block == NULL)
+				continue;
+
+			NodeTimer t;
+			if (!block->m_node_timers.takeExpired(*i, t))
+				continue;
+
+			MapNode n = block->getNodeNoEx(t.position);
+			v3s16 p = t.position + block->getPosRelative();
+			if (m_script->node_on_timer(p, n, t.elapsed))
+				block->setNodeTimer(NodeTimer(t.timeout, 0, t.position));
 		}
 	}
 
@@ -1338,6 +1448,7 @@ void ServerEnvironment::step(float dtime)
 				break;
 			}
 			ScopeProfiler sp(g_profiler, "SEnv: modify in blocks avg per interval", SPT_AVG);
+			TraceScope ts(TZ_SENV_ABM);
 			TimeTaker timer("modify in active blocks per interval");
 
 			// Initialize handling of ActiveBlockModifiers
@@ -1383,6 +1494,7 @@ void ServerEnvironment::step(float dtime)
 	*/
 	{
 		ScopeProfiler sp(g_profiler, "SEnv: step act. objs avg", SPT_AVG);
+		TraceScope ts(TZ_SENV_OBJECTS);
 		//TimeTaker timer("Step active objects");
 
 		g_profiler->avg("SEnv: num of objects", m_active_objects.size());
@@ -1396,6 +1508,16 @@ void ServerEnvironment::step(float dtime)
 			send_recommended = true;
 		}
 
+		if (m_step_levels_interval.step(dtime, 1.0))
+			updateStepLevels();
+
+		// Far objects are stepped every reduced_step_ticks ticks, staggered
+		// by their id so that the load is spread over the ticks
+		u32 reduced_step_ticks = 1;
+		if (dtime > 0)
+			reduced_step_ticks = MYMAX(1, m_entity_lod_step_interval / dtime + 0.5f);
+		u32 reduced_step_phase = m_reduced_step_tick++ % reduced_step_ticks;
+
 		for(ActiveObjectMap::iterator i = m_active_objects.begin();
 			i != m_active_objects.end(); ++i) {
 			ServerActiveObject* obj = i->second;
@@ -1403,13 +1525,33 @@ void ServerEnvironment::step(float dtime)
 				continue;
 
 			// Step object
-			obj->step(dtime, send_recommended);
+			switch (obj->m_step_level) {
+			case ServerActiveObject::STEP_FULL:
+				if (obj->m_step_dtime_skipped > 0)
+					step_object_skipped(obj, dtime, send_recommended);
+				else
+					obj->step(dtime, send_recommended);
+				break;
+			case ServerActiveObject::STEP_REDUCED:
+				if (obj->getId() % reduced_step_ticks == reduced_step_phase) {
+					// Changes must not wait for a send_recommended step
+					step_object_skipped(obj, dtime, true);
+				} else {
+					obj->m_step_dtime_skipped += dtime;
+				}
+				break;
+			case ServerActiveObject::STEP_SLEEPING:
+				break;
+			}
 			// Read messages from object
 			while (!obj->m_messages_out.empty()) {
 				m_active_object_messages.push(obj->m_messages_out.front());
 				obj->m_messages_out.pop();
 			}
 		}
+
+		// Entities with on_step_batch were only collected above
+		m_script->luaentity_StepBatches();
 	}
 
 	/*
@@ -1418,6 +1560,7 @@ void ServerEnvironment::step(float dtime)
 	if(m_object_management_interval.step(dtime, 0.5))
 	{
 		ScopeProfiler sp(g_profiler, "SEnv: remove removed objs avg /.5s", SPT_AVG);
+		TraceScope ts(TZ_SENV_REMOVE_OBJECTS);
 		removeRemovedObjects();
 	}
 
@@ -1440,6 +1583,20 @@ void ServerEnvironment::step(float dtime)
 				++i;
 		}
 	}
+
+	/*
+		Update the light of the nodes changed during this step
+	*/
+	{
+		ScopeProfiler sp(g_profiler, "SEnv: lighting batch avg", SPT_AVG);
+		TraceScope ts(TZ_SENV_LIGHTING_BATCH);
+		if (m_deferred_lighting)
+			m_map->endLightingBatch();
+		// Batches opened by mods don't outlive a step
+		if (u32 depth = m_map->endAllLightingBatches())
+			warningstream << depth << " lighting batch(es) were not ended"
+				<< " by a mod, ending them" << std::endl;
+	}
 }
 
 u32 ServerEnvironment::addParticleSpawner(float exptime)
@@ -1785,6 +1942,61 @@ u16 ServerEnvironment::addActiveObjectRaw(ServerActiveObject *object,
 /*
 	Remove objects that satisfy (isGone() && m_known_by_count==0)
 */
+void ServerEnvironment::updateStepLevels()
+{
+	if (m_entity_lod_distance <= 0 && m_entity_sleep_distance <= 0)
+		return;
+
+	std::vector<v3f> player_positions;
+	for (std::vector<RemotePlayer *>::iterator i = m_players.begin();
+			i != m_players.end(); ++i) {
+		RemotePlayer *player = *i;
+		if (player->peer_id == 0)
+			continue;
+		PlayerSAO *playersao = player->getPlayerSAO();
+		if (playersao)
+			player_positions.push_back(playersao->getBasePosition());
+	}
+
+	float lod_d2 = m_entity_lod_distance * m_entity_lod_distance;
+	float sleep_d2 = m_entity_sleep_distance * m_entity_sleep_distance;
+	u32 reduced_count = 0;
+	u32 sleeping_count = 0;
+	for (ActiveObjectMap::iterator i = m_active_objects.begin();
+			i != m_active_objects.end(); ++i) {
+		ServerActiveObject *obj = i->second;
+		if (obj->isGone())
+			continue;
+
+		ServerActiveObject::StepLevel level = ServerActiveObject::STEP_FULL;
+		if (obj->canReduceStepping()) {
+			v3f pos = obj->getBasePosition();
+			float d2 = FLT_MAX;
+			for (size_t j = 0; j < player_positions.size(); j++)
+				d2 = MYMIN(d2, pos.getDistanceFromSQ(player_positions[j]));
+
+			// Beyond the sleep distance no player can see the object
+			if (m_entity_sleep_distance > 0 && d2 > sleep_d2)
+				level = ServerActiveObject::STEP_SLEEPING;
+			else if (m_entity_lod_distance > 0 && d2 > lod_d2)
+				level = ServerActiveObject::STEP_REDUCED;
+		}
+
+		if (level == ServerActiveObject::STEP_SLEEPING) {
+			// The time asleep is not made up for
+			if (obj->m_step_level != ServerActiveObject::STEP_SLEEPING)
+				obj->m_step_dtime_skipped = 0;
+			sleeping_count++;
+		} else if (level == ServerActiveObject::STEP_REDUCED) {
+			reduced_count++;
+		}
+		obj->m_step_level = level;
+	}
+
+	g_profiler->avg("SEnv: num of objects stepped less often", reduced_count);
+	g_profiler->avg("SEnv: num of sleeping objects", sleeping_count);
+}
+
 void ServerEnvironment::removeRemovedObjects()
 {
 	std::vector<u16> objects_to_remove;
@@ -1972,6 +2184,66 @@ void ServerEnvironment::activateObjects(MapBlock *block, u32 dtime_s)
 	*/
 }
 
+void ServerEnvironment::finishBlockActivation(MapBlock *block, u32 dtime_s,
+	u32 stamp)
+{
+	// Activate stored objects
+	activateObjects(block, dtime_s);
+
+	/* Handle LoadingBlockModifiers */
+	m_lbm_mgr.applyLBMs(this, block, stamp);
+}
+
+void ServerEnvironment::finishPendingActivations()
+{
+	if (m_pending_activations.empty())
+		return;
+
+	ScopeProfiler sp(g_profiler, "SEnv: pending activations avg", SPT_AVG);
+	TraceScope ts(TZ_SENV_PENDING_ACTIVATIONS, m_pending_activations.size());
+	g_profiler->avg("SEnv: pending activations", m_pending_activations.size());
+
+	// At least one block is activated on every step
+	while (!m_pending_activations.empty()) {
+		PendingActivation a = m_pending_activations.front();
+		MapBlock *block = m_map->getBlockNoCreateNoEx(a.blockpos);
+		u32 count = block ? block->m_static_objects.m_stored.size() : 0;
+		if (m_objects_activated > 0 &&
+				m_objects_activated + count > m_max_objects_activated_per_step)
+			break;
+
+		m_pending_activations.pop_front();
+		m_objects_activated += count;
+		if (block)
+			finishBlockActivation(block,
+				a.dtime_s + m_game_time - a.queued_time, a.stamp);
+	}
+}
+
+void ServerEnvironment::finishAllPendingActivations()
+{
+	while (!m_pending_activations.empty())
+		finishPendingActivation(m_pending_activations.front().blockpos);
+}
+
+void ServerEnvironment::finishPendingActivation(v3s16 blockpos)
+{
+	for (std::deque<PendingActivation>::iterator
+			i = m_pending_activations.begin();
+			i != m_pending_activations.end(); ++i) {
+		if (i->blockpos != blockpos)
+			continue;
+
+		PendingActivation a = *i;
+		m_pending_activations.erase(i);
+		MapBlock *block = m_map->getBlockNoCreateNoEx(a.blockpos);
+		if (block)
+			finishBlockActivation(block,
+				a.dtime_s + m_game_time - a.queued_time, a.stamp);
+		return;
+	}
+}
+
 /*
 	Convert objects that are not standing inside active blocks to static.
 
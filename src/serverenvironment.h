@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "environment.h"
 #include "mapnode.h"
 #include "mapblock.h"
+#include <deque>
 #include <set>
 
 class IGameDef;
@@ -225,6 +226,10 @@ class ServerEnvironment : public Environment
 	void removePlayer(RemotePlayer *player);
 	bool removePlayerFromDatabase(const std::string &name);
 
+	// Activates the objects of all blocks that wait for it and runs their
+	// LBMs, see max_objects_activated_per_step
+	void finishAllPendingActivations();
+
 	/*
 		Save and load time of day and game timer
 	*/
@@ -316,6 +321,8 @@ class ServerEnvironment : public Environment
 	bool setNode(v3s16 p, const MapNode &n);
 	bool removeNode(v3s16 p);
 	bool swapNode(v3s16 p, const MapNode &n);
+	// Sets n at all positions, returns the number of nodes set
+	u32 setNodes(const std::vector<v3s16> &positions, const MapNode &n);
 
 	// Find all active objects inside a radius around a point
 	void getObjectsInsideRadius(std::vector<u16> &objects, v3f pos, float radius);
@@ -377,6 +384,14 @@ class ServerEnvironment : public Environment
 	*/
 	void activateObjects(MapBlock *block, u32 dtime_s);
 
+	/*
+		Activate the stored objects of the block and run its LBMs, the part
+		of activateBlock() that is delayed when over the object budget
+	*/
+	void finishBlockActivation(MapBlock *block, u32 dtime_s, u32 stamp);
+	void finishPendingActivations();
+	void finishPendingActivation(v3s16 blockpos);
+
 	/*
 		Convert objects that are not in active blocks to static.
 
@@ -388,6 +403,12 @@ class ServerEnvironment : public Environment
 	*/
 	void deactivateFarObjects(bool force_delete);
 
+	/*
+		Set how often the objects are stepped from their distance to the
+		nearest player, see entity_lod_distance and entity_sleep_distance.
+	*/
+	void updateStepLevels();
+
 	/*
 		A few helpers used by the three above methods
 	*/
@@ -421,6 +442,25 @@ class ServerEnvironment : public Environment
 	IntervalLimiter m_active_block_modifier_interval;
 	IntervalLimiter m_active_blocks_nodemetadata_interval;
 	int m_active_block_interval_overload_skip;
+	// Collect the light updates of each step into one lighting batch
+	bool m_deferred_lighting;
+	// Object level of detail, see updateStepLevels()
+	IntervalLimiter m_step_levels_interval;
+	float m_entity_lod_distance;
+	float m_entity_lod_step_interval;
+	float m_entity_sleep_distance;
+	u32 m_reduced_step_tick;
+	// Blocks whose objects are activated on the next steps, in order
+	struct PendingActivation
+	{
+		v3s16 blockpos;
+		u32 dtime_s;
+		u32 stamp;
+		u32 queued_time;
+	};
+	std::deque<PendingActivation> m_pending_activations;
+	u32 m_max_objects_activated_per_step;
+	u32 m_objects_activated;
 	// Time from the beginning of the game in seconds.
 	// Incremented in step().
 	u32 m_game_time;
@@ -29,6 +29,8 @@ ServerActiveObject::ServerActiveObject(ServerEnvironment *env, v3f pos):
 	m_pending_deactivation(false),
 	m_static_exists(false),
 	m_static_block(1337,1337,1337),
+	m_step_level(STEP_FULL),
+	m_step_dtime_skipped(0.0f),
 	m_env(env),
 	m_base_position(pos)
 {
@@ -246,6 +246,31 @@ class ServerActiveObject : public ActiveObject
 	*/
 	std::queue<ActiveObjectMessage> m_messages_out;
 
+	/*
+		How often the environment steps the object, see
+		ServerEnvironment::updateStepLevels(). Objects far from all players
+		are stepped less often with the skipped time added to dtime, or not
+		at all (sleeping) until wake() is called by something that changes
+		them.
+	*/
+	enum StepLevel {
+		STEP_FULL,
+		STEP_REDUCED,
+		STEP_SLEEPING
+	};
+	// Whether the object may be stepped at a level other than STEP_FULL
+	virtual bool canReduceStepping() const
+	{ return false; }
+	void wake()
+	{
+		if (m_step_level == STEP_SLEEPING)
+			m_step_level = STEP_FULL;
+	}
+
+	StepLevel m_step_level;
+	// Time passed since the last step, when not stepped at full rate
+	float m_step_dtime_skipped;
+
 protected:
 	// Used for creating objects based on type
 	typedef ServerActiveObject* (*Factory)
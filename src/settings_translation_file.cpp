@@ -297,6 +297,10 @@ fake_function() {
 	gettext("Enables caching of facedir rotated meshes.");
 	gettext("Mapblock mesh generation delay");
 	gettext("Delay between mesh updates on the client in ms. Increasing this will slow\ndown the rate of mesh updates, thus reducing jitter on slower clients.");
+	gettext("Mapblock mesh generation threads");
+	gettext("Number of threads making the meshes of mapblocks. More threads fill in\nthe world faster after teleporting or with a large viewing range.\n0 uses one thread less than the number of processors, at most 8.");
+	gettext("Merge faces of mapblock meshes");
+	gettext("Draws the faces of neighboring cube nodes with the same texture and lighting\nas one larger face, which reduces the vertex count of the mapblock meshes.\nWhen disabled, faces are only merged along rows of nodes.");
 	gettext("Mapblock mesh generator's MapBlock cache size MB");
 	gettext("Size of the MapBlock cache of the mesh generator. Increasing this will\nincrease the cache hit %, reducing the data being copied from the main\nthread, thus reducing jitter.");
 	gettext("Minimap");
@@ -393,6 +397,8 @@ fake_function() {
 	gettext("Enable to disallow old clients from connecting.\nOlder clients are compatible in the sense that they will not crash when connecting\nto new servers, but they may not support all new features that you are expecting.");
 	gettext("Remote media");
 	gettext("Specifies URL from which client fetches media instead of using UDP.\n$filename should be accessible from $remote_media$filename via cURL\n(obviously, remote_media should end with a slash).\nFiles that are not present will be fetched the usual way.");
+	gettext("Media server port");
+	gettext("Serve media files over HTTP on this TCP port for clients that support remote\nmedia, offloading media transfer from the game connection.\nThe announced URL is http://<server_address>:<port>/ unless remote_media is set.\n0 disables the built-in media server.");
 	gettext("IPv6 server");
 	gettext("Enable/disable running an IPv6 server.  An IPv6 server may be restricted\nto IPv6 clients, depending on system configuration.\nIgnored if bind_address is set.");
 	gettext("Advanced");
@@ -441,6 +447,8 @@ fake_function() {
 	gettext("If enabled, disable cheat prevention in multiplayer.");
 	gettext("Rollback recording");
 	gettext("If enabled, actions are recorded for rollback.\nThis option is only read when server starts.");
+	gettext("Rollback coalesce time");
+	gettext("Repeated changes of the same node by the same actor within this many\nseconds are stored as a single rollback record.\n0 stores every change.");
 	gettext("Shutdown message");
 	gettext("A message to be displayed to all clients when the server shuts down.");
 	gettext("Crash message");
@@ -451,6 +459,12 @@ fake_function() {
 	gettext("From how far clients know about objects, stated in mapblocks (16 nodes).");
 	gettext("Active block range");
 	gettext("How large area of blocks are subject to the active block stuff, stated in mapblocks (16 nodes).\nIn active blocks objects are loaded and ABMs run.");
+	gettext("Entity LOD distance");
+	gettext("Lua entities further than this from all players, stated in nodes, are stepped\nless often, see entity_lod_step_interval. 0 disables.\nEntities with full_step_rate in their properties always step at full rate.");
+	gettext("Entity LOD step interval");
+	gettext("Interval of stepping the Lua entities beyond entity_lod_distance, stated in seconds.\nThey get the whole time since their last step as dtime.");
+	gettext("Entity sleep distance");
+	gettext("Lua entities further than this from all players, stated in nodes, are not stepped\nuntil they are punched, moved or otherwise changed by a mod.\nThe time they sleep is lost. 0 disables.");
 	gettext("Max block send distance");
 	gettext("From how far blocks are sent to clients, stated in mapblocks (16 nodes).");
 	gettext("Maximum forceloaded blocks");
@@ -481,8 +495,12 @@ fake_function() {
 	gettext("Number of extra blocks that can be loaded by /clearobjects at once.\nThis is a trade-off between sqlite transaction overhead and\nmemory consumption (4096=100MB, as a rule of thumb).");
 	gettext("Unload unused server data");
 	gettext("How much the server will wait before unloading unused mapblocks.\nHigher value is smoother, but will use more RAM.");
+	gettext("Compact unused mapblocks");
+	gettext("Loaded mapblocks that have not been used for this many seconds store\ntheir nodes in a compact palette form, which needs much less memory.\nUseful with high unload timeouts. 0 disables.");
 	gettext("Maximum objects per block");
 	gettext("Maximum number of statically stored objects in a block.");
+	gettext("Maximum objects activated per step");
+	gettext("Maximum number of stored objects activated per server step.\nThe objects of blocks that become active beyond this are activated on the\nnext server steps, together with the loading block modifiers of the block.\n0 activates all objects at once.");
 	gettext("Synchronous SQLite");
 	gettext("See http://www.sqlite.org/pragma.html#pragma_synchronous");
 	gettext("Dedicated server step");
@@ -501,6 +519,10 @@ fake_function() {
 	gettext("The time (in seconds) that the liquids queue may grow beyond processing\ncapacity until an attempt is made to decrease its size by dumping old queue\nitems.  A value of 0 disables the functionality.");
 	gettext("Liquid update tick");
 	gettext("Liquid update interval in seconds.");
+	gettext("Liquid threads");
+	gettext("Number of threads that help the server thread compute liquid updates\nwhen many liquid nodes change at once.\n-1 picks a number based on the number of processors, 0 disables them.");
+	gettext("Deferred lighting");
+	gettext("Update the light of nodes changed by mods once at the end of each server step,\ninstead of after every single change.\nMakes large numbers of node changes faster, but the light of changed nodes\nis wrong until the end of the step.");
 	gettext("block send optimize distance");
 	gettext("At this distance the server will aggressively optimize which blocks are sent to clients.\nSmall values potentially improve performance a lot, at the expense of visible rendering glitches.\n(some blocks will not be rendered under water and in caves, as well as sometimes on land)\nSetting this to a value greater than max_block_send_distance disables this optimization.\nStated in mapblocks (16 nodes)");
 	gettext("Server side occlusion culling");
@@ -787,6 +809,14 @@ fake_function() {
 	gettext("Main menu mod manager");
 	gettext("Engine profiling data print interval");
 	gettext("Print the engine's profiling data in regular intervals (in seconds). 0 = disable. Useful for developers.");
+	gettext("Tracing");
+	gettext("Record a trace of what the server does in each step, in memory.\nTraces can be saved with the /trace command and viewed in chrome://tracing.");
+	gettext("Slow server step trace threshold");
+	gettext("When tracing, server steps taking longer than this many milliseconds\nget the trace around them saved to the world's traces directory.\nAt most one is saved every 10 seconds. 0 = disable.");
+	gettext("Callback profiling");
+	gettext("Account the time spent in Lua callbacks to the mods that registered them.\nThe results can be shown with the /callbacks command.");
+	gettext("Slow callback warning threshold");
+	gettext("When callback profiling, single calls of a callback taking longer than\nthis many milliseconds are logged as a warning.\nAt most one is logged per callback every 10 seconds. 0 = disable.");
 	gettext("Content Store");
 	gettext("ContentDB URL");
 	gettext("The URL for the content repository");
@@ -392,9 +392,9 @@ u32 ShaderSource::getShader(const std::string &name,
 	} else {
 		/*errorstream<<"getShader(): Queued: name=\""<<name<<"\""<<std::endl;*/
 
-		// We're gonna ask the result to be put into here
-
-		static ResultQueue<std::string, u32, u8, u8> result_queue;
+		// We're gonna ask the result to be put into here, one queue
+		// for each thread so that mesh threads don't take each other's
+		static thread_local ResultQueue<std::string, u32, u8, u8> result_queue;
 
 		// Throw a request in
 		m_get_shader_queue.add(name, 0, 0, &result_queue);
@@ -0,0 +1,246 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "tracer.h"
+#include <ctime>
+#include <sstream>
+#include <vector>
+#include "filesys.h"
+#include "log.h"
+#include "porting.h"
+#include "threading/mutex_auto_lock.h"
+#include "util/serialize.h"
+
+// Slow frames are saved at most this often
+#define TRACE_SLOW_FRAME_SAVE_INTERVAL_US 10000000
+
+static Tracer main_tracer;
+Tracer *g_tracer = &main_tracer;
+
+struct TraceZoneInfo
+{
+	const char *name;
+	const char *category;
+};
+
+static const TraceZoneInfo zone_info[TZ_COUNT] = {
+	{"Server step", "server"},
+	{"Server: sel and send blocks to clients", "server"},
+	{"Server: selecting blocks for sending", "server"},
+	{"SEnv step", "server"},
+	{"Server: map timer and unload", "server"},
+	{"Server: liquid transform", "server"},
+	{"Server: checking added and deleted objs", "server"},
+	{"Server: sending object messages", "server"},
+	{"Server: saving stuff", "server"},
+	{"Server::ProcessData", "server"},
+	{"dedicated server sleep", "server"},
+	{"Server: serialize definitions", "server"},
+	{"SEnv: handle players", "env"},
+	{"SEnv: manage act. block list", "env"},
+	{"SEnv: node timers", "env"},
+	{"SEnv: modify in blocks", "env"},
+	{"SEnv: step act. objs", "env"},
+	{"SEnv: remove removed objs", "env"},
+	{"SEnv: lighting batch", "env"},
+	{"SEnv: pending activations", "env"},
+	{"EmergeThread: Mapgen::makeChunk", "emerge"},
+	{"EmergeThread: after Mapgen::makeChunk", "emerge"},
+	{"ConnectionSend: iteration", "connection"},
+	{"ConnectionSend: runTimeouts", "connection"},
+	{"ConnectionSend: sendPackets", "connection"},
+	{"ConnectionReceive: iteration", "connection"},
+	{"Client: Block decoding", "client"},
+};
+
+Tracer::Tracer():
+	m_enabled(false),
+	m_buffer_count(0),
+	m_frame_start(0),
+	m_frame(0),
+	m_slow_frame_threshold(0),
+	m_last_slow_frame_save(0)
+{
+}
+
+Tracer::~Tracer()
+{
+	u32 count = m_buffer_count;
+	for (u32 i = 0; i < count; i++)
+		delete m_buffers[i];
+}
+
+void Tracer::setSlowFrameThreshold(u32 threshold_us,
+	const std::string &directory)
+{
+	m_slow_frame_threshold = threshold_us;
+	m_slow_frame_directory = directory;
+}
+
+u64 Tracer::getTime()
+{
+	return porting::getTimeUs();
+}
+
+const char *Tracer::getZoneName(TraceZone zone)
+{
+	return zone_info[zone].name;
+}
+
+Tracer::ThreadBuffer *Tracer::getBuffer()
+{
+	threadid_t thread = thr_get_current_thread_id();
+	u32 count = m_buffer_count;
+	for (u32 i = 0; i < count; i++) {
+		if (thr_compare_thread_id(m_buffers[i]->thread, thread))
+			return m_buffers[i];
+	}
+
+	// First event of this thread
+	MutexAutoLock lock(m_buffers_mutex);
+	count = m_buffer_count;
+	if (count == MAX_THREADS)
+		return NULL;
+
+	ThreadBuffer *buffer = new ThreadBuffer();
+	buffer->thread = thread;
+	buffer->name = g_logger.getThreadName();
+	buffer->head = 0;
+	m_buffers[count] = buffer;
+	m_buffer_count = count + 1;
+	return buffer;
+}
+
+void Tracer::record(TraceZone zone, u64 start_us, u32 arg)
+{
+	ThreadBuffer *buffer = getBuffer();
+	if (!buffer)
+		return;
+
+	u32 head = buffer->head;
+	Event &e = buffer->events[head % BUFFER_SIZE];
+	e.start = start_us;
+	e.duration = getTime() - start_us;
+	e.arg = arg;
+	e.zone = zone;
+	// Publishes the event to readers
+	buffer->head = head + 1;
+}
+
+void Tracer::beginFrame()
+{
+	m_frame_start = isEnabled() ? getTime() : 0;
+}
+
+void Tracer::endFrame()
+{
+	if (m_frame_start == 0)
+		return;
+
+	record(TZ_SERVER_STEP, m_frame_start, m_frame++);
+
+	u64 now = getTime();
+	if (m_slow_frame_threshold == 0 ||
+			now - m_frame_start <= m_slow_frame_threshold ||
+			now - m_last_slow_frame_save < TRACE_SLOW_FRAME_SAVE_INTERVAL_US)
+		return;
+	m_last_slow_frame_save = now;
+
+	std::ostringstream name;
+	name << "slow_step_" << time(NULL) << "_"
+		<< (now - m_frame_start) / 1000 << "ms";
+	std::string path = writeFile(m_slow_frame_directory, name.str(),
+		m_frame_start);
+	if (!path.empty()) {
+		warningstream << "Server step took " << (now - m_frame_start) / 1000
+			<< "ms, saved a trace to " << path << std::endl;
+	}
+}
+
+void Tracer::exportTrace(std::ostream &os, u64 since_us)
+{
+	os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	bool first = true;
+	std::vector<Event> events;
+	u32 count = m_buffer_count;
+	for (u32 i = 0; i < count; i++) {
+		ThreadBuffer *buffer = m_buffers[i];
+
+		if (!first)
+			os << ",";
+		first = false;
+		os << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+			<< i << ",\"args\":{\"name\":"
+			<< serializeJsonString(buffer->name) << "}}";
+
+		u32 head = buffer->head;
+		u32 begin = head > BUFFER_SIZE ? head - BUFFER_SIZE : 0;
+		events.clear();
+		for (u32 k = begin; k < head; k++)
+			events.push_back(buffer->events[k % BUFFER_SIZE]);
+
+		// The thread may have overwritten the oldest ones meanwhile,
+		// including the one after the last it has published
+		u32 new_head = buffer->head;
+		u32 valid = new_head >= BUFFER_SIZE ? new_head - BUFFER_SIZE + 1 : 0;
+
+		for (u32 k = MYMAX(begin, valid); k < head; k++) {
+			const Event &e = events[k - begin];
+			if (e.start + e.duration < since_us)
+				continue;
+			os << ",{\"ph\":\"X\",\"name\":\"" << zone_info[e.zone].name
+				<< "\",\"cat\":\"" << zone_info[e.zone].category
+				<< "\",\"pid\":1,\"tid\":" << i << ",\"ts\":" << e.start
+				<< ",\"dur\":" << e.duration;
+			if (e.arg != 0)
+				os << ",\"args\":{\"arg\":" << e.arg << "}";
+			os << "}";
+		}
+	}
+
+	os << "]}" << std::endl;
+}
+
+std::string Tracer::saveTrace(const std::string &directory)
+{
+	std::ostringstream name;
+	name << "trace_" << time(NULL);
+	return writeFile(directory, name.str(), 0);
+}
+
+std::string Tracer::writeFile(const std::string &directory,
+	const std::string &name, u64 since_us)
+{
+	if (!fs::CreateAllDirs(directory)) {
+		errorstream << "Tracer: Failed to create directory "
+			<< directory << std::endl;
+		return "";
+	}
+
+	std::ostringstream os(std::ios_base::binary);
+	exportTrace(os, since_us);
+
+	std::string path = directory + DIR_DELIM + name + ".json";
+	if (!fs::safeWriteToFile(path, os.str())) {
+		errorstream << "Tracer: Failed to write " << path << std::endl;
+		return "";
+	}
+	return path;
+}
@@ -0,0 +1,184 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef TRACER_HEADER
+#define TRACER_HEADER
+
+#include <iostream>
+#include <string>
+#include "irrlichttypes.h"
+#include "threads.h"
+#include "threading/atomic.h"
+#include "threading/mutex.h"
+#include "util/basic_macros.h"
+
+/*
+	Zones of the code that are traced, names are in tracer.cpp
+*/
+enum TraceZone
+{
+	TZ_SERVER_STEP,
+	TZ_SERVER_SEND_BLOCKS,
+	TZ_SERVER_SELECT_BLOCKS,
+	TZ_SERVER_ENV_STEP,
+	TZ_SERVER_MAP_TIMER,
+	TZ_SERVER_LIQUID,
+	TZ_SERVER_OBJECTS,
+	TZ_SERVER_OBJECT_MESSAGES,
+	TZ_SERVER_SAVE,
+	TZ_SERVER_PROCESS_DATA,
+	TZ_SERVER_SLEEP,
+	TZ_SERVER_SERIALIZE_DEFINITIONS,
+	TZ_SENV_PLAYERS,
+	TZ_SENV_ACTIVE_BLOCKS,
+	TZ_SENV_NODE_TIMERS,
+	TZ_SENV_ABM,
+	TZ_SENV_OBJECTS,
+	TZ_SENV_REMOVE_OBJECTS,
+	TZ_SENV_LIGHTING_BATCH,
+	TZ_SENV_PENDING_ACTIVATIONS,
+	TZ_EMERGE_MAKE_CHUNK,
+	TZ_EMERGE_FINISH_GEN,
+	TZ_CON_SEND_ITERATION,
+	TZ_CON_PEER_TIMEOUTS,
+	TZ_CON_PEER_SEND,
+	TZ_CON_RECEIVE_ITERATION,
+	TZ_CLIENT_BLOCK_DECODE,
+	TZ_COUNT
+};
+
+class Tracer;
+extern Tracer *g_tracer;
+
+/*
+	Records how long zones of code take, on every thread.
+
+	Each thread writes to a ring buffer of its own, without locking, so
+	only the most recent events are kept. Server steps are recorded as
+	frames. A frame that takes longer than the slow frame threshold gets
+	the events around it saved to a file, the whole buffers can be saved
+	on demand. Files are in the Chrome trace event format, they can be
+	viewed in chrome://tracing.
+
+	Nothing is recorded while disabled, tracing a zone costs a check of
+	a flag then.
+*/
+class Tracer
+{
+public:
+	Tracer();
+	~Tracer();
+
+	inline bool isEnabled() { return m_enabled; }
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+
+	// Frames taking longer than threshold_us are saved to directory,
+	// 0 disables this
+	void setSlowFrameThreshold(u32 threshold_us, const std::string &directory);
+
+	static u64 getTime();
+
+	// Records a zone that started at start_us and ends now
+	void record(TraceZone zone, u64 start_us, u32 arg = 0);
+
+	// Server steps are frames, only the server thread may use these
+	void beginFrame();
+	void endFrame();
+
+	// Writes the events that end after since_us
+	void exportTrace(std::ostream &os, u64 since_us = 0);
+	// Saves all events to a new file in directory, returns its path
+	// or "" on failure
+	std::string saveTrace(const std::string &directory);
+
+	static const char *getZoneName(TraceZone zone);
+
+	// Events kept per thread
+	static const u32 BUFFER_SIZE = 8192;
+
+private:
+	struct Event
+	{
+		u64 start;
+		u32 duration;
+		u32 arg;
+		u16 zone;
+	};
+
+	static const u32 MAX_THREADS = 64;
+
+	struct ThreadBuffer
+	{
+		threadid_t thread;
+		std::string name;
+		Event events[BUFFER_SIZE];
+		// Number of events written so far, the ring holds the last ones
+		Atomic<u32> head;
+	};
+
+	// Returns the buffer of the calling thread, NULL if there are too
+	// many threads
+	ThreadBuffer *getBuffer();
+
+	std::string writeFile(const std::string &directory,
+		const std::string &name, u64 since_us);
+
+	Atomic<bool> m_enabled;
+
+	ThreadBuffer *m_buffers[MAX_THREADS];
+	// Buffers are only ever added, up to this count they can be read
+	// without locking
+	Atomic<u32> m_buffer_count;
+	Mutex m_buffers_mutex;
+
+	// Only used by the server thread
+	u64 m_frame_start;
+	u32 m_frame;
+	u32 m_slow_frame_threshold;
+	std::string m_slow_frame_directory;
+	u64 m_last_slow_frame_save;
+
+	DISABLE_CLASS_COPY(Tracer);
+};
+
+/*
+	Traces the time until the end of the scope
+*/
+class TraceScope
+{
+public:
+	TraceScope(TraceZone zone, u32 arg = 0):
+		m_zone(zone),
+		m_arg(arg),
+		m_start(g_tracer->isEnabled() ? Tracer::getTime() : 0)
+	{}
+
+	~TraceScope()
+	{
+		if (m_start != 0)
+			g_tracer->record(m_zone, m_start, m_arg);
+	}
+
+private:
+	TraceZone m_zone;
+	u32 m_arg;
+	u64 m_start;
+};
+
+#endif
@@ -29,6 +29,7 @@ content_t t_CONTENT_STONE;
 content_t t_CONTENT_GRASS;
 content_t t_CONTENT_TORCH;
 content_t t_CONTENT_WATER;
+content_t t_CONTENT_WATER_FLOWING;
 content_t t_CONTENT_LAVA;
 content_t t_CONTENT_BRICK;
 
@@ -66,7 +67,7 @@ class TestGameDef : public IGameDef {
 		return testmodspec;
 	}
 	virtual const ModSpec* getModSpec(const std::string &modname) const { return NULL; }
-	virtual std::string getModStoragePath() const { return "."; }
+	virtual ModMetadataDatabase *getModStorageDatabase() { return NULL; }
 	virtual bool registerModStorage(ModMetadata *meta) { return true; }
 	virtual void unregisterModStorage(const std::string &name) {}
 
@@ -84,7 +85,15 @@ class TestGameDef : public IGameDef {
 };
 
 
-TestGameDef::TestGameDef()
+TestGameDef::TestGameDef() :
+	m_craftdef(NULL),
+	m_texturesrc(NULL),
+	m_shadersrc(NULL),
+	m_soundmgr(NULL),
+	m_eventmgr(NULL),
+	m_scenemgr(NULL),
+	m_rollbackmgr(NULL),
+	m_emergemgr(NULL)
 {
 	m_itemdef = createItemDefManager();
 	m_nodedef = createNodeDefManager();
@@ -173,6 +182,8 @@ void TestGameDef::defineSomeNodes()
 	f.alpha = 128;
 	f.liquid_type = LIQUID_SOURCE;
 	f.liquid_viscosity = 4;
+	f.liquid_alternative_flowing = "default:water_flowing";
+	f.liquid_alternative_source = "default:water";
 	f.is_ground_content = true;
 	f.groups["liquids"] = 3;
 	for(int i = 0; i < 6; i++)
@@ -180,6 +191,25 @@ void TestGameDef::defineSomeNodes()
 	idef->registerItem(itemdef);
 	t_CONTENT_WATER = ndef->set(f.name, f);
 
+	//// Flowing water
+	itemdef = ItemDefinition();
+	itemdef.type = ITEM_NODE;
+	itemdef.name = "default:water_flowing";
+	itemdef.description = "Flowing Water";
+	f = ContentFeatures();
+	f.name = itemdef.name;
+	f.alpha = 128;
+	f.param_type_2 = CPT2_FLOWINGLIQUID;
+	f.liquid_type = LIQUID_FLOWING;
+	f.liquid_viscosity = 1;
+	f.liquid_alternative_flowing = "default:water_flowing";
+	f.liquid_alternative_source = "default:water";
+	f.is_ground_content = true;
+	for(int i = 0; i < 6; i++)
+		f.tiledef[i].name = "default_water.png";
+	idef->registerItem(itemdef);
+	t_CONTENT_WATER_FLOWING = ndef->set(f.name, f);
+
 	//// Lava
 	itemdef = ItemDefinition();
 	itemdef.type = ITEM_NODE;
@@ -267,6 +297,55 @@ bool run_tests()
 	return num_modules_failed;
 }
 
+////
+//// run_benchmarks
+////
+
+bool run_benchmarks(const std::string &module_name)
+{
+	DSTACK(FUNCTION_NAME);
+
+	u64 t1 = porting::getTimeMs();
+	TestGameDef gamedef;
+
+	g_logger.setLevelSilenced(LL_ERROR, true);
+
+	u32 num_modules_run    = 0;
+	u32 num_modules_failed = 0;
+	std::vector<TestBase *> &testmods = TestManager::getTestModules();
+	for (size_t i = 0; i != testmods.size(); i++) {
+		if (!module_name.empty() && module_name != testmods[i]->getName())
+			continue;
+
+		num_modules_run++;
+		if (!testmods[i]->benchmarkModule(&gamedef))
+			num_modules_failed++;
+	}
+
+	u64 tdiff = porting::getTimeMs() - t1;
+
+	g_logger.setLevelSilenced(LL_ERROR, false);
+
+	if (num_modules_run == 0) {
+		errorstream << "No test module named \"" << module_name << "\""
+			<< std::endl;
+		return false;
+	}
+
+	rawstream
+		<< "++++++++++++++++++++++++++++++++++++++++"
+		<< "++++++++++++++++++++++++++++++++++++++++" << std::endl
+		<< "Benchmark Results: " << (num_modules_failed == 0 ? "PASSED" : "FAILED")
+		<< std::endl
+		<< "    " << num_modules_failed << " / " << num_modules_run
+		<< " failed modules." << std::endl
+		<< "    Benchmarks took " << tdiff << "ms total." << std::endl
+		<< "++++++++++++++++++++++++++++++++++++++++"
+		<< "++++++++++++++++++++++++++++++++++++++++" << std::endl;
+
+	return num_modules_failed == 0;
+}
+
 ////
 //// TestBase
 ////
@@ -291,6 +370,25 @@ bool TestBase::testModule(IGameDef *gamedef)
 	return num_tests_failed == 0;
 }
 
+bool TestBase::benchmarkModule(IGameDef *gamedef)
+{
+	rawstream << "======== Benchmarking module " << getName() << std::endl;
+	u64 t1 = porting::getTimeMs();
+	u32 failed_before = num_tests_failed;
+
+	runBenchmarks(gamedef);
+
+	u64 tdiff = porting::getTimeMs() - t1;
+	bool passed = num_tests_failed == failed_before;
+	rawstream << "======== Module " << getName() << " "
+		<< (passed ? "passed" : "failed") << " - " << tdiff << "ms" << std::endl;
+
+	if (!m_test_dir.empty())
+		fs::RecursiveDelete(m_test_dir);
+
+	return passed;
+}
+
 std::string TestBase::getTestTempDirectory()
 {
 	if (!m_test_dir.empty())
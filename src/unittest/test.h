@@ -107,10 +107,13 @@ class IGameDef;
 class TestBase {
 public:
 	bool testModule(IGameDef *gamedef);
+	bool benchmarkModule(IGameDef *gamedef);
 	std::string getTestTempDirectory();
 	std::string getTestTempFile();
 
 	virtual void runTests(IGameDef *gamedef) = 0;
+	// Timing runs, only done by --run-benchmark. Use TEST() like runTests().
+	virtual void runBenchmarks(IGameDef *gamedef) {}
 	virtual const char *getName() = 0;
 
 	u32 num_tests_failed;
@@ -139,9 +142,12 @@ extern content_t t_CONTENT_STONE;
 extern content_t t_CONTENT_GRASS;
 extern content_t t_CONTENT_TORCH;
 extern content_t t_CONTENT_WATER;
+extern content_t t_CONTENT_WATER_FLOWING;
 extern content_t t_CONTENT_LAVA;
 extern content_t t_CONTENT_BRICK;
 
 bool run_tests();
+// Runs the benchmarks of all modules, or only of the one named module_name
+bool run_benchmarks(const std::string &module_name);
 
 #endif
@@ -0,0 +1,180 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "database-files.h"
+#include "database-sqlite3.h"
+#include "filesys.h"
+
+class TestAuthDatabase : public TestBase {
+public:
+	TestAuthDatabase() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestAuthDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBackend(AuthDatabase *db);
+	void testFilesPersistence();
+	void testSQLite3Persistence();
+
+private:
+	std::string m_dir;
+};
+
+static TestAuthDatabase g_test_instance;
+
+void TestAuthDatabase::runTests(IGameDef *gamedef)
+{
+	m_dir = getTestTempDirectory() + DIR_DELIM + "authdb";
+	fs::CreateAllDirs(m_dir);
+
+	AuthDatabaseFiles files_db(m_dir);
+	TEST(testBackend, &files_db);
+	TEST(testFilesPersistence);
+
+	{
+		AuthDatabaseSQLite3 sqlite_db(m_dir);
+		TEST(testBackend, &sqlite_db);
+	}
+	TEST(testSQLite3Persistence);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestAuthDatabase::testBackend(AuthDatabase *db)
+{
+	AuthEntry entry;
+	entry.id = 0;
+	entry.name = "player1";
+	entry.password = "#1#salt#verifier";
+	entry.privileges.push_back("interact");
+	entry.privileges.push_back("shout");
+	entry.last_login = 1500000000;
+	UASSERT(db->createAuth(entry));
+
+	AuthEntry entry2;
+	entry2.id = 0;
+	entry2.name = "Player2";
+	entry2.password = "";
+	entry2.last_login = -1;
+	UASSERT(db->createAuth(entry2));
+
+	AuthEntry res;
+	UASSERT(!db->getAuth("player3", res));
+	UASSERT(db->getAuth("player1", res));
+	UASSERT(res.id == entry.id);
+	UASSERT(res.password == entry.password);
+	UASSERTEQ(size_t, res.privileges.size(), 2);
+	UASSERT(std::find(res.privileges.begin(), res.privileges.end(),
+		"shout") != res.privileges.end());
+	UASSERTEQ(s64, res.last_login, 1500000000);
+
+	// Saving replaces the privileges
+	res.privileges.clear();
+	res.privileges.push_back("fly");
+	res.last_login = 1500000100;
+	UASSERT(db->saveAuth(res));
+	UASSERT(db->getAuth("player1", res));
+	UASSERTEQ(size_t, res.privileges.size(), 1);
+	UASSERT(res.privileges[0] == "fly");
+	UASSERTEQ(s64, res.last_login, 1500000100);
+
+	UASSERT(db->getAuth("Player2", res));
+	UASSERT(res.privileges.empty());
+	UASSERTEQ(s64, res.last_login, -1);
+
+	std::vector<std::string> names;
+	db->listNames(names);
+	std::sort(names.begin(), names.end());
+	UASSERTEQ(size_t, names.size(), 2);
+	UASSERT(names[0] == "Player2");
+	UASSERT(names[1] == "player1");
+
+	// Account names are unique regardless of case on join
+	std::string found;
+	UASSERT(db->findNameCaseInsensitive("PLAYER1", found));
+	UASSERT(found == "player1");
+	UASSERT(db->findNameCaseInsensitive("player2", found));
+	UASSERT(found == "Player2");
+	UASSERT(!db->findNameCaseInsensitive("player3", found));
+
+	UASSERT(db->deleteAuth("Player2"));
+	UASSERT(!db->deleteAuth("Player2"));
+	UASSERT(!db->getAuth("Player2", res));
+	UASSERT(!db->findNameCaseInsensitive("player2", found));
+}
+
+void TestAuthDatabase::testFilesPersistence()
+{
+	// The entries of testBackend() were written to auth.txt
+	AuthDatabaseFiles db(m_dir);
+	AuthEntry res;
+	UASSERT(db.getAuth("player1", res));
+	UASSERTEQ(size_t, res.privileges.size(), 1);
+	UASSERT(!db.getAuth("Player2", res));
+
+	// Older versions of the file have no last login
+	std::string path = m_dir + DIR_DELIM + "auth.txt";
+	UASSERT(fs::safeWriteToFile(path, "foo::interact, shout\nbar::\n"));
+	db.reload();
+	UASSERT(db.getAuth("foo", res));
+	UASSERTEQ(size_t, res.privileges.size(), 2);
+	UASSERT(res.privileges[1] == "shout");
+	UASSERTEQ(s64, res.last_login, -1);
+	UASSERT(db.getAuth("bar", res));
+	UASSERT(res.privileges.empty());
+	UASSERT(!db.getAuth("player1", res));
+	std::string found;
+	UASSERT(db.findNameCaseInsensitive("FOO", found));
+	UASSERT(found == "foo");
+	UASSERT(!db.findNameCaseInsensitive("player1", found));
+
+	// The file is written once at the end of a save
+	db.beginSave();
+	UASSERT(db.deleteAuth("bar"));
+	db.reload();
+	UASSERT(db.getAuth("bar", res));
+	UASSERT(db.deleteAuth("bar"));
+	db.endSave();
+	db.reload();
+	UASSERT(!db.getAuth("bar", res));
+}
+
+void TestAuthDatabase::testSQLite3Persistence()
+{
+	AuthDatabaseSQLite3 db(m_dir);
+	AuthEntry res;
+	UASSERT(db.getAuth("player1", res));
+	UASSERTEQ(size_t, res.privileges.size(), 1);
+	UASSERT(res.privileges[0] == "fly");
+	UASSERT(!db.getAuth("Player2", res));
+
+	// The privileges go with the entry
+	UASSERT(db.deleteAuth("player1"));
+	AuthEntry entry;
+	entry.id = 0;
+	entry.name = "player1";
+	entry.password = "";
+	entry.last_login = 0;
+	UASSERT(db.createAuth(entry));
+	UASSERT(db.getAuth("player1", res));
+	UASSERT(res.privileges.empty());
+}
@@ -0,0 +1,174 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "callbackprofiler.h"
+#include "porting.h"
+
+class TestCallbackProfiler : public TestBase {
+public:
+	TestCallbackProfiler() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestCallbackProfiler"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testRecord();
+	void testScope();
+	void testWarningThreshold();
+
+	void benchOverhead();
+};
+
+static TestCallbackProfiler g_test_instance;
+
+void TestCallbackProfiler::runTests(IGameDef *gamedef)
+{
+	TEST(testRecord);
+	TEST(testScope);
+	TEST(testWarningThreshold);
+}
+
+void TestCallbackProfiler::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchOverhead);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestCallbackProfiler::testRecord()
+{
+	CallbackProfiler profiler;
+	profiler.setEnabled(true);
+
+	u64 now = porting::getTimeUs();
+	for (u32 i = 0; i < 10; i++)
+		profiler.record("default", "register_globalstep", now - 1000);
+	profiler.record("default", "on_step", now - 2000);
+	profiler.record("mobs", "on_step", now - 5000);
+
+	// Sorted by the total time...
+	std::vector<CallbackStats> stats;
+	profiler.getTop(stats, 10, false);
+	UASSERTEQ(u32, stats.size(), 3);
+	UASSERT(stats[0].mod == "default");
+	UASSERT(stats[0].callback == "register_globalstep");
+	UASSERTEQ(u32, stats[0].calls, 10);
+	UASSERT(stats[0].total_us >= 10000);
+	UASSERT(stats[1].mod == "mobs");
+	UASSERT(stats[2].callback == "on_step");
+
+	// ...or the longest single call
+	profiler.getTop(stats, 2, true);
+	UASSERTEQ(u32, stats.size(), 2);
+	UASSERT(stats[0].mod == "mobs");
+	UASSERT(stats[0].max_us >= 5000);
+	UASSERT(stats[1].callback == "on_step");
+
+	// Enabling again starts over
+	profiler.setEnabled(false);
+	profiler.getTop(stats, 10, false);
+	UASSERTEQ(u32, stats.size(), 3);
+	profiler.setEnabled(true);
+	profiler.getTop(stats, 10, false);
+	UASSERT(stats.empty());
+}
+
+void TestCallbackProfiler::testWarningThreshold()
+{
+	CallbackProfiler profiler;
+	profiler.setEnabled(true);
+	u64 now = porting::getTimeUs();
+
+	// Nothing is logged by default
+	UASSERT(!profiler.record("default", "on_step", now - 20000));
+
+	// Single callbacks can have their own threshold
+	profiler.setWarningThreshold(50000);
+	profiler.setWarningThreshold(10000, "on_step");
+	UASSERTEQ(u32, profiler.getWarningThreshold("on_step"), 10000);
+	UASSERTEQ(u32, profiler.getWarningThreshold("on_punch"), 50000);
+	UASSERT(profiler.record("mobs", "on_step", now - 20000));
+	UASSERT(!profiler.record("mobs", "on_punch", now - 20000));
+	UASSERT(profiler.record("mobs", "on_punch", now - 60000));
+
+	// Each callback warns at most once per interval
+	UASSERT(!profiler.record("mobs", "on_step", now - 20000));
+
+	// Changing the threshold applies to callbacks already seen
+	profiler.setWarningThreshold(0, "register_globalstep");
+	profiler.setWarningThreshold(15000, "on_step");
+	UASSERT(!profiler.record("default", "register_globalstep", now - 90000));
+	UASSERT(profiler.record("default", "on_step", now - 20000));
+}
+
+void TestCallbackProfiler::testScope()
+{
+	CallbackProfiler profiler;
+	std::string origin = "default";
+	std::vector<CallbackStats> stats;
+
+	{
+		CallbackScope scope(&profiler, origin, "on_punch");
+	}
+	profiler.getTop(stats, 10, false);
+	UASSERT(stats.empty());
+
+	profiler.setEnabled(true);
+	{
+		CallbackScope scope(&profiler, origin, "on_punch");
+		// A nested callback changes the origin
+		origin = "mobs";
+		CallbackScope inner(&profiler, origin, "on_step");
+		sleep_ms(2);
+	}
+	profiler.getTop(stats, 10, false);
+	UASSERTEQ(u32, stats.size(), 2);
+	for (size_t i = 0; i < stats.size(); i++) {
+		UASSERT(stats[i].mod == (stats[i].callback == "on_punch" ?
+			"default" : "mobs"));
+		UASSERT(stats[i].total_us >= 2000);
+	}
+}
+
+void TestCallbackProfiler::benchOverhead()
+{
+	const u32 calls = 100000;
+	CallbackProfiler profiler;
+	std::string origin = "default";
+
+	u64 t0 = porting::getTimeUs();
+	for (u32 i = 0; i < calls; i++)
+		CallbackScope scope(&profiler, origin, "on_step");
+	u64 t1 = porting::getTimeUs();
+
+	profiler.setEnabled(true);
+	for (u32 i = 0; i < calls; i++)
+		CallbackScope scope(&profiler, origin, "on_step");
+	u64 t2 = porting::getTimeUs();
+
+	std::vector<CallbackStats> stats;
+	profiler.getTop(stats, 1, false);
+	UASSERTEQ(u32, stats[0].calls, calls);
+
+	rawstream << "TestCallbackProfiler: " << calls << " callbacks: "
+		<< (t1 - t0) << "us disabled, " << (t2 - t1) << "us profiled"
+		<< std::endl;
+}
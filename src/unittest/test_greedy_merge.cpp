@@ -0,0 +1,418 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "mapnode.h"
+#include "noise.h"
+#include "porting.h"
+#include "util/greedy_merge.h"
+#include "util/numeric.h"
+
+#define GRID_SIZE 16
+
+// Cells with the same key > 0 can be merged, 0 is no face
+struct KeyCells
+{
+	u16 keys[GRID_SIZE * GRID_SIZE];
+
+	bool has(u32 i) const { return keys[i] != 0; }
+	bool mergeable(u32 i, u32 j) const { return keys[i] == keys[j]; }
+};
+
+// A mapblock and the nodes around it, at -1 to GRID_SIZE
+struct SampleBlock
+{
+	content_t nodes[(GRID_SIZE + 2) * (GRID_SIZE + 2) * (GRID_SIZE + 2)];
+
+	content_t &at(s16 x, s16 y, s16 z)
+	{
+		const s16 side = GRID_SIZE + 2;
+		return nodes[((z + 1) * side + y + 1) * side + x + 1];
+	}
+};
+
+class TestGreedyMerge : public TestBase {
+public:
+	TestGreedyMerge() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestGreedyMerge"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testEmptyAndFull();
+	void testCheckerboard();
+	void testCoverage();
+	void testSampleBlocks();
+
+	void benchSamplePlanes();
+	void benchSampleMapBlocks();
+
+	void checkRects(const KeyCells &cells, const std::vector<MergedRect> &rects);
+	u32 countRows(const KeyCells &cells);
+	void makeTerrainPlanes(std::vector<KeyCells> &planes);
+	void makeWallPlanes(std::vector<KeyCells> &planes);
+	void makeNoisePlanes(std::vector<KeyCells> &planes);
+	void makeHillsBlock(SampleBlock &block);
+	void makeCaveBlock(SampleBlock &block);
+	void makeBlockPlanes(SampleBlock &block, std::vector<KeyCells> &planes);
+	void checkPlanes(const std::vector<KeyCells> &planes);
+	void benchmark(const char *name, const std::vector<KeyCells> &planes);
+};
+
+static TestGreedyMerge g_test_instance;
+
+void TestGreedyMerge::runTests(IGameDef *gamedef)
+{
+	TEST(testEmptyAndFull);
+	TEST(testCheckerboard);
+	TEST(testCoverage);
+	TEST(testSampleBlocks);
+}
+
+void TestGreedyMerge::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchSamplePlanes);
+	TEST(benchSampleMapBlocks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestGreedyMerge::testEmptyAndFull()
+{
+	KeyCells cells;
+	std::vector<bool> covered;
+	std::vector<MergedRect> rects;
+
+	memset(cells.keys, 0, sizeof(cells.keys));
+	greedy_merge(GRID_SIZE, GRID_SIZE, cells, covered, rects);
+	UASSERT(rects.empty());
+
+	for (u32 i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+		cells.keys[i] = 7;
+	greedy_merge(GRID_SIZE, GRID_SIZE, cells, covered, rects);
+	UASSERTEQ(size_t, rects.size(), 1);
+	UASSERT(rects[0].x == 0 && rects[0].y == 0);
+	UASSERT(rects[0].w == GRID_SIZE && rects[0].h == GRID_SIZE);
+}
+
+void TestGreedyMerge::testCheckerboard()
+{
+	KeyCells cells;
+	std::vector<bool> covered;
+	std::vector<MergedRect> rects;
+
+	for (u32 y = 0; y < GRID_SIZE; y++)
+	for (u32 x = 0; x < GRID_SIZE; x++)
+		cells.keys[y * GRID_SIZE + x] = (x + y) % 2 + 1;
+	greedy_merge(GRID_SIZE, GRID_SIZE, cells, covered, rects);
+	UASSERTEQ(size_t, rects.size(), GRID_SIZE * GRID_SIZE);
+	checkRects(cells, rects);
+
+	// Columns of different keys, with the covered cells of the last call
+	rects.clear();
+	for (u32 y = 0; y < GRID_SIZE; y++)
+	for (u32 x = 0; x < GRID_SIZE; x++)
+		cells.keys[y * GRID_SIZE + x] = x % 4 + 1;
+	greedy_merge(GRID_SIZE, GRID_SIZE, cells, covered, rects);
+	UASSERTEQ(size_t, rects.size(), GRID_SIZE);
+	checkRects(cells, rects);
+}
+
+void TestGreedyMerge::testCoverage()
+{
+	PseudoRandom pr(1234);
+	std::vector<bool> covered;
+	for (u32 n = 0; n < 100; n++) {
+		KeyCells cells;
+		for (u32 i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+			cells.keys[i] = pr.range(0, n % 4 + 1);
+
+		std::vector<MergedRect> rects;
+		greedy_merge(GRID_SIZE, GRID_SIZE, cells, covered, rects);
+		checkRects(cells, rects);
+		UASSERT(rects.size() <= countRows(cells));
+	}
+}
+
+void TestGreedyMerge::testSampleBlocks()
+{
+	std::vector<KeyCells> planes;
+	makeTerrainPlanes(planes);
+	makeWallPlanes(planes);
+	makeNoisePlanes(planes);
+
+	SampleBlock block;
+	makeHillsBlock(block);
+	makeBlockPlanes(block, planes);
+	makeCaveBlock(block);
+	makeBlockPlanes(block, planes);
+
+	checkPlanes(planes);
+}
+
+void TestGreedyMerge::benchSamplePlanes()
+{
+	std::vector<KeyCells> planes;
+	makeTerrainPlanes(planes);
+	benchmark("terrain", planes);
+
+	planes.clear();
+	makeWallPlanes(planes);
+	benchmark("stone with ores", planes);
+
+	planes.clear();
+	makeNoisePlanes(planes);
+	benchmark("noise", planes);
+}
+
+// All the cube faces of whole mapblocks, as updateAllFastFacePlanes() makes them
+void TestGreedyMerge::benchSampleMapBlocks()
+{
+	SampleBlock block;
+	std::vector<KeyCells> planes;
+	makeHillsBlock(block);
+	makeBlockPlanes(block, planes);
+	benchmark("hills mapblock", planes);
+
+	planes.clear();
+	makeCaveBlock(block);
+	makeBlockPlanes(block, planes);
+	benchmark("cave mapblock", planes);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Every face is in exactly one rectangle of faces with the same key
+void TestGreedyMerge::checkRects(const KeyCells &cells,
+	const std::vector<MergedRect> &rects)
+{
+	u32 covered[GRID_SIZE * GRID_SIZE] = {0};
+	for (size_t r = 0; r < rects.size(); r++) {
+		const MergedRect &rect = rects[r];
+		UASSERT(rect.w > 0 && rect.h > 0);
+		UASSERT(rect.x + rect.w <= GRID_SIZE && rect.y + rect.h <= GRID_SIZE);
+		u16 key = cells.keys[rect.y * GRID_SIZE + rect.x];
+		for (u32 y = rect.y; y < (u32)rect.y + rect.h; y++)
+		for (u32 x = rect.x; x < (u32)rect.x + rect.w; x++) {
+			UASSERT(cells.keys[y * GRID_SIZE + x] == key);
+			covered[y * GRID_SIZE + x]++;
+		}
+	}
+	for (u32 i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+		UASSERTEQ(u32, covered[i], cells.has(i) ? 1 : 0);
+}
+
+// Number of faces when merging only along rows, as before greedy_merge()
+u32 TestGreedyMerge::countRows(const KeyCells &cells)
+{
+	u32 count = 0;
+	for (u32 y = 0; y < GRID_SIZE; y++)
+	for (u32 x = 0; x < GRID_SIZE; x++) {
+		u32 i = y * GRID_SIZE + x;
+		if (cells.has(i) && (x == 0 || !cells.has(i - 1) ||
+				!cells.mergeable(i - 1, i)))
+			count++;
+	}
+	return count;
+}
+
+/*
+	Top faces of hilly terrain: grass, sand below y = 4, darker where a
+	neighbor is higher
+*/
+void TestGreedyMerge::makeTerrainPlanes(std::vector<KeyCells> &planes)
+{
+	NoiseParams np(8, 6, v3f(32, 32, 32), 42, 2, 0.5, 2.0);
+	Noise noise(&np, 1, GRID_SIZE + 1, GRID_SIZE + 1);
+	noise.perlinMap2D(0, 0);
+
+	s16 height[(GRID_SIZE + 1) * (GRID_SIZE + 1)];
+	for (u32 i = 0; i < (GRID_SIZE + 1) * (GRID_SIZE + 1); i++)
+		height[i] = rangelim((s16)noise.result[i], 0, GRID_SIZE - 1);
+
+	for (s16 plane_y = 0; plane_y < GRID_SIZE; plane_y++) {
+		KeyCells cells;
+		for (u32 z = 0; z < GRID_SIZE; z++)
+		for (u32 x = 0; x < GRID_SIZE; x++) {
+			s16 h = height[z * (GRID_SIZE + 1) + x];
+			u16 &key = cells.keys[z * GRID_SIZE + x];
+			if (h != plane_y) {
+				key = 0;
+				continue;
+			}
+			bool shaded = height[z * (GRID_SIZE + 1) + x + 1] > h ||
+				height[(z + 1) * (GRID_SIZE + 1) + x] > h;
+			key = (h < 4 ? 1 : 2) + (shaded ? 10 : 0);
+		}
+		planes.push_back(cells);
+	}
+}
+
+// Side faces of an exposed stone wall with 5% ores
+void TestGreedyMerge::makeWallPlanes(std::vector<KeyCells> &planes)
+{
+	PseudoRandom pr(4321);
+	for (u32 n = 0; n < GRID_SIZE; n++) {
+		KeyCells cells;
+		for (u32 i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+			cells.keys[i] = pr.range(0, 99) < 5 ? 2 : 1;
+		planes.push_back(cells);
+	}
+}
+
+// Faces of random nodes of 3 kinds, the worst case
+void TestGreedyMerge::makeNoisePlanes(std::vector<KeyCells> &planes)
+{
+	PseudoRandom pr(5678);
+	for (u32 n = 0; n < GRID_SIZE; n++) {
+		KeyCells cells;
+		for (u32 i = 0; i < GRID_SIZE * GRID_SIZE; i++)
+			cells.keys[i] = pr.range(0, 3);
+		planes.push_back(cells);
+	}
+}
+
+// Grass on stone below a noise height
+void TestGreedyMerge::makeHillsBlock(SampleBlock &block)
+{
+	NoiseParams np(6, 5, v3f(24, 24, 24), 42, 3, 0.5, 2.0);
+	Noise noise(&np, 1, GRID_SIZE + 2, GRID_SIZE + 2);
+	noise.perlinMap2D(-1, -1);
+
+	for (s16 z = -1; z <= GRID_SIZE; z++)
+	for (s16 x = -1; x <= GRID_SIZE; x++) {
+		s16 h = noise.result[(z + 1) * (GRID_SIZE + 2) + x + 1];
+		for (s16 y = -1; y <= GRID_SIZE; y++) {
+			content_t &c = block.at(x, y, z);
+			if (y > h)
+				c = CONTENT_AIR;
+			else if (y == h)
+				c = t_CONTENT_GRASS;
+			else
+				c = t_CONTENT_STONE;
+		}
+	}
+}
+
+// Stone with 3D noise caves and 5% bricks as ores
+void TestGreedyMerge::makeCaveBlock(SampleBlock &block)
+{
+	NoiseParams np(0, 1, v3f(12, 12, 12), 7, 3, 0.5, 2.0);
+	Noise noise(&np, 1, GRID_SIZE + 2, GRID_SIZE + 2, GRID_SIZE + 2);
+	noise.perlinMap3D(-1, -1, -1);
+
+	PseudoRandom pr(8765);
+	u32 i = 0;
+	for (s16 z = -1; z <= GRID_SIZE; z++)
+	for (s16 y = -1; y <= GRID_SIZE; y++)
+	for (s16 x = -1; x <= GRID_SIZE; x++, i++) {
+		content_t &c = block.at(x, y, z);
+		if (noise.result[i] > 0.3f)
+			c = CONTENT_AIR;
+		else
+			c = pr.range(0, 99) < 5 ? t_CONTENT_BRICK : t_CONTENT_STONE;
+	}
+}
+
+/*
+	The faces between the nodes of the block and their neighbors at +x, +y
+	and +z, keyed by the content and the side of the solid node. The lights,
+	which also split faces in real meshes, are left out.
+*/
+void TestGreedyMerge::makeBlockPlanes(SampleBlock &block,
+	std::vector<KeyCells> &planes)
+{
+	const v3s16 dirs[3] = {v3s16(0, 1, 0), v3s16(1, 0, 0), v3s16(0, 0, 1)};
+	const v3s16 u_dirs[3] = {v3s16(1, 0, 0), v3s16(0, 0, 1), v3s16(1, 0, 0)};
+	const v3s16 v_dirs[3] = {v3s16(0, 0, 1), v3s16(0, 1, 0), v3s16(0, 1, 0)};
+
+	for (u32 k = 0; k < 3; k++)
+	for (s16 d = 0; d < GRID_SIZE; d++) {
+		KeyCells cells;
+		for (s16 v = 0; v < GRID_SIZE; v++)
+		for (s16 u = 0; u < GRID_SIZE; u++) {
+			v3s16 p = dirs[k] * d + u_dirs[k] * u + v_dirs[k] * v;
+			v3s16 p2 = p + dirs[k];
+			content_t c1 = block.at(p.X, p.Y, p.Z);
+			content_t c2 = block.at(p2.X, p2.Y, p2.Z);
+			u16 &key = cells.keys[v * GRID_SIZE + u];
+			if ((c1 == CONTENT_AIR) == (c2 == CONTENT_AIR))
+				key = 0;
+			else if (c2 == CONTENT_AIR)
+				key = (c1 + 1) * 2;
+			else
+				key = (c2 + 1) * 2 + 1;
+		}
+		planes.push_back(cells);
+	}
+}
+
+void TestGreedyMerge::checkPlanes(const std::vector<KeyCells> &planes)
+{
+	std::vector<bool> covered;
+	std::vector<MergedRect> rects;
+	u32 rects_count = 0;
+	u32 rows = 0;
+	for (size_t i = 0; i < planes.size(); i++) {
+		rects.clear();
+		greedy_merge(GRID_SIZE, GRID_SIZE, planes[i], covered, rects);
+		checkRects(planes[i], rects);
+		rects_count += rects.size();
+		rows += countRows(planes[i]);
+	}
+	// A single plane can take more rectangles than rows
+	UASSERT(rects_count <= rows);
+}
+
+void TestGreedyMerge::benchmark(const char *name,
+	const std::vector<KeyCells> &planes)
+{
+	const u32 iterations = 100;
+	u32 faces = 0;
+	u32 rows = 0;
+	u32 rects_count = 0;
+	std::vector<bool> covered;
+	std::vector<MergedRect> rects;
+
+	u64 t0 = porting::getTimeUs();
+	for (u32 n = 0; n < iterations; n++) {
+		rects_count = 0;
+		for (size_t i = 0; i < planes.size(); i++) {
+			rects.clear();
+			greedy_merge(GRID_SIZE, GRID_SIZE, planes[i], covered, rects);
+			rects_count += rects.size();
+		}
+	}
+	u64 t1 = porting::getTimeUs();
+
+	for (size_t i = 0; i < planes.size(); i++) {
+		for (u32 j = 0; j < GRID_SIZE * GRID_SIZE; j++)
+			faces += planes[i].has(j);
+		rows += countRows(planes[i]);
+	}
+	UASSERT(rects_count <= rows && rows <= faces);
+
+	// Each face is drawn with 4 vertices
+	rawstream << "TestGreedyMerge: " << name << ": " << faces * 4
+		<< " vertices unmerged, " << rows * 4 << " merged in rows, "
+		<< rects_count * 4 << " merged in rectangles, "
+		<< (t1 - t0) / iterations << "us per " << planes.size()
+		<< " planes" << std::endl;
+}
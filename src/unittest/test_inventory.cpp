@@ -23,6 +23,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "gamedef.h"
 #include "inventory.h"
+#include "inventorymanager.h"
 
 class TestInventory : public TestBase {
 public:
@@ -32,6 +33,8 @@ class TestInventory : public TestBase {
 	void runTests(IGameDef *gamedef);
 
 	void testSerializeDeserialize(IItemDefManager *idef);
+	void testDirtySlots(IItemDefManager *idef);
+	void testDeniedMove(IItemDefManager *idef);
 
 	static const char *serialized_inventory;
 	static const char *serialized_inventory_2;
@@ -42,6 +45,40 @@ static TestInventory g_test_instance;
 void TestInventory::runTests(IGameDef *gamedef)
 {
 	TEST(testSerializeDeserialize, gamedef->getItemDefManager());
+	TEST(testDirtySlots, gamedef->getItemDefManager());
+	TEST(testDeniedMove, gamedef->getItemDefManager());
+}
+
+// Player and detached inventories of the server
+class TestInventoryManager : public InventoryManager
+{
+public:
+	TestInventoryManager(Inventory *player, Inventory *detached):
+		m_player(player),
+		m_detached(detached)
+	{}
+
+	Inventory *getInventory(const InventoryLocation &loc)
+	{
+		if (loc.type == InventoryLocation::PLAYER)
+			return m_player;
+		if (loc.type == InventoryLocation::DETACHED)
+			return m_detached;
+		return NULL;
+	}
+
+private:
+	Inventory *m_player;
+	Inventory *m_detached;
+};
+
+static void send_delta(Inventory *server_inv, Inventory *client_inv)
+{
+	std::ostringstream os(std::ios::binary);
+	server_inv->serializeDirtySlots(os);
+	server_inv->clearDirtySlots();
+	std::istringstream is(os.str(), std::ios::binary);
+	client_inv->deSerializeDirtySlots(is);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -66,6 +103,81 @@ void TestInventory::testSerializeDeserialize(IItemDefManager *idef)
 	UASSERTEQ(std::string, inv_os.str(), serialized_inventory_2);
 }
 
+void TestInventory::testDirtySlots(IItemDefManager *idef)
+{
+	Inventory inv(idef);
+	std::istringstream is(serialized_inventory, std::ios::binary);
+	inv.deSerialize(is);
+	UASSERT(inv.hasDirtySlots());
+
+	inv.clearDirtySlots();
+	UASSERT(!inv.hasDirtySlots());
+	UASSERT(inv.canSerializeDirtySlots());
+	Inventory client_inv(inv);
+
+	InventoryList *list = inv.getList("0");
+	list->takeItem(9, 10);
+	list->changeItem(0, ItemStack("default:dirt", 5, 0, idef));
+	list->getItem(24).metadata.setString("foo", "bar");
+	list->setSlotDirty(24);
+	inv.addList("craft", 9)->setWidth(3);
+	UASSERT(list->isSlotDirty(9));
+	UASSERT(!list->isSlotDirty(10));
+
+	// Reading doesn't mark slots
+	UASSERT(!list->getItem(16).empty());
+	UASSERT(!list->isSlotDirty(16));
+	UASSERT(inv.hasDirtySlots());
+
+	std::ostringstream os(std::ios::binary);
+	inv.serializeDirtySlots(os);
+	inv.clearDirtySlots();
+	std::istringstream delta_is(os.str(), std::ios::binary);
+	client_inv.deSerializeDirtySlots(delta_is);
+	UASSERT(client_inv == inv);
+
+	// Removed lists need a full resend
+	inv.deleteList("craft");
+	UASSERT(!inv.canSerializeDirtySlots());
+}
+
+void TestInventory::testDeniedMove(IItemDefManager *idef)
+{
+	Inventory player_inv(idef);
+	std::istringstream is(serialized_inventory, std::ios::binary);
+	player_inv.deSerialize(is);
+	Inventory detached_inv(idef);
+	detached_inv.addList("trash", 4);
+	player_inv.clearDirtySlots();
+	detached_inv.clearDirtySlots();
+
+	// The client shows the item moved to the detached inventory already
+	Inventory client_player_inv(player_inv);
+	Inventory client_detached_inv(detached_inv);
+	client_player_inv.getList("0")->moveItem(9,
+		client_detached_inv.getList("trash"), 2);
+	UASSERT(client_player_inv.getList("0")->getItem(9).empty());
+
+	IMoveAction a;
+	a.from_inv.setPlayer("singleplayer");
+	a.from_list = "0";
+	a.from_i = 9;
+	a.to_inv.setDetached("trash");
+	a.to_list = "trash";
+	a.to_i = 2;
+
+	// Denied by allow_put of the detached inventory: nothing is applied
+	TestInventoryManager mgr(&player_inv, &detached_inv);
+	a.setSlotsDirty(&mgr);
+	UASSERT(player_inv.getList("0")->isSlotDirty(9));
+	UASSERT(detached_inv.getList("trash")->isSlotDirty(2));
+
+	send_delta(&player_inv, &client_player_inv);
+	send_delta(&detached_inv, &client_detached_inv);
+	UASSERT(client_player_inv == player_inv);
+	UASSERT(client_detached_inv == detached_inv);
+}
+
 const char *TestInventory::serialized_inventory =
 	"List 0 32\n"
 	"Width 3\n"
@@ -0,0 +1,217 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "liquid_queue.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "noise.h"
+#include "porting.h"
+#include "settings.h"
+
+class TestLiquidQueue : public TestBase {
+public:
+	TestLiquidQueue() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestLiquidQueue"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testQueue();
+	void testFlood(IGameDef *gamedef);
+
+	void benchFlood(IGameDef *gamedef);
+
+	// Floods a test map of blocks x 3 x blocks MapBlocks until the liquids
+	// settle, returns the time taken
+	u64 flood(IGameDef *gamedef, const std::string &num_threads, s16 blocks,
+		u32 sources, std::vector<MapNode> &result, u32 *steps);
+	// Checks that the serial and parallel results match, returns the
+	// number of flowing nodes
+	u32 compareFloods(const std::vector<MapNode> &serial,
+		const std::vector<MapNode> &parallel);
+};
+
+static TestLiquidQueue g_test_instance;
+
+void TestLiquidQueue::runTests(IGameDef *gamedef)
+{
+	TEST(testQueue);
+	TEST(testFlood, gamedef);
+}
+
+void TestLiquidQueue::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchFlood, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// A map that only exists in memory
+class TestLiquidMap : public Map
+{
+public:
+	TestLiquidMap(IGameDef *gamedef) :
+		Map(dstream, gamedef)
+	{}
+
+	MapBlock *createBlock(v3s16 p)
+	{
+		v2s16 p2d(p.X, p.Z);
+		MapSector *sector = getSectorNoGenerateNoEx(p2d);
+		if (!sector) {
+			sector = new ServerMapSector(this, p2d, m_gamedef);
+			m_sectors[p2d] = sector;
+		}
+		return sector->createBlankBlock(p.Y);
+	}
+};
+
+void TestLiquidQueue::testQueue()
+{
+	LiquidQueue queue;
+	v3s16 a(1, 2, 3), b(-1, 2, 3), c(4, 2, 3);
+
+	UASSERT(queue.push_back(a));
+	UASSERT(queue.push_back(b));
+	UASSERT(queue.push_back(c));
+	UASSERT(!queue.push_back(a));
+	UASSERTEQ(u32, queue.size(), 3);
+
+	// Nodes of a block stay together, blocks keep their order
+	UASSERT(queue.front() == a);
+	queue.pop_front();
+	UASSERT(queue.front() == c);
+	queue.pop_front();
+	UASSERT(queue.front() == b);
+
+	// Popped nodes can be queued again
+	UASSERT(queue.push_back(a));
+	UASSERTEQ(u32, queue.size(), 2);
+
+	std::vector<v3s16> nodes;
+	std::vector<u32> block_ends;
+	for (s16 x = 0; x < 40; x++)
+		queue.push_back(v3s16(x, 0, 0));
+	queue.popBlocks(10, nodes, block_ends);
+	UASSERTEQ(u32, nodes.size(), 10);
+	UASSERT(nodes[0] == b);
+	UASSERT(nodes[1] == a);
+	UASSERTEQ(u32, block_ends.size(), 2);
+	UASSERTEQ(u32, block_ends[0], 1);
+	UASSERTEQ(u32, queue.size(), 32);
+
+	queue.clear();
+	UASSERTEQ(u32, queue.size(), 0);
+	UASSERT(queue.push_back(a));
+}
+
+u64 TestLiquidQueue::flood(IGameDef *gamedef, const std::string &num_threads,
+	s16 blocks, u32 sources, std::vector<MapNode> &result, u32 *steps)
+{
+	// Stone floor at y = 0, sources scattered above it
+	const s16 size = blocks * MAP_BLOCKSIZE;
+	const s16 height = 3 * MAP_BLOCKSIZE;
+
+	g_settings->set("num_liquid_threads", num_threads);
+	TestLiquidMap map(gamedef);
+	for (s16 z = 0; z < size / MAP_BLOCKSIZE; z++)
+	for (s16 y = 0; y < height / MAP_BLOCKSIZE; y++)
+	for (s16 x = 0; x < size / MAP_BLOCKSIZE; x++) {
+		MapBlock *block = map.createBlock(v3s16(x, y, z));
+		block->fillNodes(MapNode(y == 0 ? t_CONTENT_STONE : CONTENT_AIR));
+	}
+
+	PcgRandom pr(11);
+	MapNode source(t_CONTENT_WATER);
+	for (u32 i = 0; i < sources; i++) {
+		v3s16 p(pr.range(1, size - 2), pr.range(1, height - 2),
+			pr.range(1, size - 2));
+		map.setNode(p, source);
+		map.transforming_liquid_add(p);
+	}
+
+	std::map<v3s16, MapBlock *> modified_blocks;
+	*steps = 0;
+	u64 t0 = porting::getTimeUs();
+	while (map.transforming_liquid_size() > 0 && *steps < 1000) {
+		map.transformLiquids(modified_blocks, NULL);
+		(*steps)++;
+	}
+	u64 t1 = porting::getTimeUs();
+
+	result.clear();
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = 0; y < height; y++)
+	for (s16 x = 0; x < size; x++)
+		result.push_back(map.getNodeNoEx(v3s16(x, y, z)));
+	return t1 - t0;
+}
+
+u32 TestLiquidQueue::compareFloods(const std::vector<MapNode> &serial,
+	const std::vector<MapNode> &parallel)
+{
+	UASSERTEQ(size_t, serial.size(), parallel.size());
+	u32 flowing = 0;
+	for (size_t i = 0; i < serial.size(); i++) {
+		MapNode n = serial[i];
+		UASSERT(n == parallel[i]);
+		flowing += n.getContent() == t_CONTENT_WATER_FLOWING;
+	}
+	UASSERT(flowing > 0);
+	return flowing;
+}
+
+void TestLiquidQueue::testFlood(IGameDef *gamedef)
+{
+	std::string old_threads = g_settings->get("num_liquid_threads");
+
+	std::vector<MapNode> serial, parallel;
+	u32 serial_steps, parallel_steps;
+	flood(gamedef, "0", 3, 30, serial, &serial_steps);
+	flood(gamedef, "4", 3, 30, parallel, &parallel_steps);
+	g_settings->set("num_liquid_threads", old_threads);
+
+	// The liquids settle, no matter how many threads computed them
+	UASSERT(serial_steps < 1000);
+	UASSERTEQ(u32, serial_steps, parallel_steps);
+	compareFloods(serial, parallel);
+}
+
+void TestLiquidQueue::benchFlood(IGameDef *gamedef)
+{
+	std::string old_threads = g_settings->get("num_liquid_threads");
+
+	std::vector<MapNode> serial, parallel;
+	u32 serial_steps, parallel_steps;
+	u64 t_serial = flood(gamedef, "0", 8, 200, serial, &serial_steps);
+	u64 t_parallel = flood(gamedef, "4", 8, 200, parallel, &parallel_steps);
+	g_settings->set("num_liquid_threads", old_threads);
+
+	UASSERTEQ(u32, serial_steps, parallel_steps);
+	u32 flowing = compareFloods(serial, parallel);
+
+	rawstream << "TestLiquidQueue: flood of " << flowing
+		<< " flowing nodes settled in " << serial_steps << " steps: "
+		<< t_serial << "us with no liquid threads, " << t_parallel
+		<< "us with 4" << std::endl;
+}
@@ -0,0 +1,202 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "database-dummy.h"
+#include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "nodemetadata.h"
+#include "serialization.h"
+
+class TestMapBlock : public TestBase {
+public:
+	TestMapBlock() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlock"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testUniformTracking(IGameDef *gamedef);
+	void testUniformSerialization(IGameDef *gamedef);
+	void testSaveVersion(IGameDef *gamedef);
+	void testSwapDeserializedData(IGameDef *gamedef);
+
+	// Serializes and deserializes the block, returns the serialized size
+	size_t roundTrip(IGameDef *gamedef, MapBlock &block, u8 version,
+		bool disk, MapBlock &result);
+};
+
+static TestMapBlock g_test_instance;
+
+void TestMapBlock::runTests(IGameDef *gamedef)
+{
+	TEST(testUniformTracking, gamedef);
+	TEST(testUniformSerialization, gamedef);
+	TEST(testSaveVersion, gamedef);
+	TEST(testSwapDeserializedData, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t TestMapBlock::roundTrip(IGameDef *gamedef, MapBlock &block,
+	u8 version, bool disk, MapBlock &result)
+{
+	std::ostringstream os(std::ios_base::binary);
+	block.serialize(os, version, disk);
+	std::istringstream is(os.str(), std::ios_base::binary);
+	result.deSerialize(is, version, disk);
+	return os.str().size();
+}
+
+void TestMapBlock::testUniformTracking(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	MapNode air(CONTENT_AIR, 15, 0);
+	MapNode stone(t_CONTENT_STONE);
+
+	// A new block is full of CONTENT_IGNORE
+	UASSERT(block.isUniform());
+	UASSERT(block.getUniformNode().getContent() == CONTENT_IGNORE);
+
+	block.fillNodes(air);
+	UASSERT(block.isUniform());
+	UASSERT(block.getUniformNode() == air);
+
+	// Setting the same node keeps it uniform, anything else doesn't
+	block.setNode(v3s16(1, 1, 1), air);
+	UASSERT(block.isUniform());
+	block.setNode(v3s16(1, 1, 1), stone);
+	UASSERT(!block.isUniform());
+	block.setNode(v3s16(1, 1, 1), air);
+	UASSERT(!block.isUniform());
+
+	// Raw access triggers a rescan
+	block.getData()[MapBlock::ystride + MapBlock::zstride + 1] = air;
+	UASSERT(block.isUniform());
+
+	// Compacting keeps the state
+	block.compact();
+	UASSERT(block.isCompact());
+	UASSERT(block.isUniform());
+	block.setNode(v3s16(15, 15, 15), stone);
+	UASSERT(!block.isCompact());
+	UASSERT(!block.isUniform());
+
+	// Differences in param1 count as well
+	block.fillNodes(stone);
+	UASSERT(block.isUniform());
+	MapNode lit_stone(t_CONTENT_STONE, 3, 0);
+	block.setNodeNoCheck(v3s16(0, 0, 0), lit_stone);
+	UASSERT(!block.isUniform());
+}
+
+void TestMapBlock::testUniformSerialization(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	MapBlock result(NULL, v3s16(0, 0, 0), gamedef);
+	MapNode stone(t_CONTENT_STONE, 0, 7);
+	block.fillNodes(stone);
+
+	bool disk[] = {false, true};
+	for (size_t i = 0; i < ARRLEN(disk); i++) {
+		size_t size = roundTrip(gamedef, block, SER_FMT_VER_HIGHEST_WRITE,
+			disk[i], result);
+		UASSERT(result.isUniform());
+		UASSERT(result.getUniformNode() == stone);
+		UASSERT(result.getNodeNoEx(v3s16(4, 5, 6)) == stone);
+
+		// The old format stores the whole node array
+		size_t old_size = roundTrip(gamedef, block, 28, disk[i], result);
+		UASSERT(result.isUniform());
+		UASSERT(result.getNodeNoEx(v3s16(15, 0, 15)) == stone);
+		UASSERT(size < old_size);
+
+		infostream << "TestMapBlock: uniform block "
+			<< (disk[i] ? "on disk" : "over network") << ": " << size
+			<< " bytes, version 28: " << old_size << " bytes" << std::endl;
+	}
+
+	// Blocks that are not uniform still use the node array
+	MapNode torch(t_CONTENT_TORCH, 14, 3);
+	block.setNode(v3s16(1, 2, 3), torch);
+	roundTrip(gamedef, block, SER_FMT_VER_HIGHEST_WRITE, true, result);
+	UASSERT(!result.isUniform());
+	UASSERT(result.getNodeNoEx(v3s16(1, 2, 3)) == torch);
+	UASSERT(result.getNodeNoEx(v3s16(3, 2, 1)) == stone);
+}
+
+void TestMapBlock::testSaveVersion(IGameDef *gamedef)
+{
+	Database_Dummy db;
+	v3s16 p(0, 0, 0);
+	MapBlock block(NULL, p, gamedef);
+	MapNode stone(t_CONTENT_STONE), torch(t_CONTENT_TORCH);
+	block.fillNodes(stone);
+
+	// Only uniform blocks need the new format
+	std::string data;
+	UASSERT(ServerMap::saveBlock(&block, &db));
+	db.loadBlock(p, &data);
+	UASSERTEQ(int, (u8)data[0], SER_FMT_VER_HIGHEST_WRITE);
+
+	block.setNode(v3s16(1, 2, 3), torch);
+	UASSERT(ServerMap::saveBlock(&block, &db));
+	db.loadBlock(p, &data);
+	UASSERTEQ(int, (u8)data[0], SER_FMT_VER_COMPAT_WRITE);
+}
+
+void TestMapBlock::testSwapDeserializedData(IGameDef *gamedef)
+{
+	MapNode stone(t_CONTENT_STONE);
+	MapNode torch(t_CONTENT_TORCH, 14, 3);
+
+	// The block as the server sends it
+	MapBlock sent(NULL, v3s16(1, 2, 3), gamedef);
+	sent.fillNodes(stone);
+	sent.setNode(v3s16(1, 2, 3), torch);
+	sent.setIsUnderground(true);
+	NodeMetadata *meta = new NodeMetadata(gamedef->idef());
+	meta->setString("infotext", "hello");
+	sent.m_node_metadata.set(v3s16(1, 2, 3), meta);
+
+	// Read into a new block, like on the client's decode thread
+	MapBlock decoded(NULL, v3s16(1, 2, 3), gamedef);
+	roundTrip(gamedef, sent, SER_FMT_VER_HIGHEST_WRITE, false, decoded);
+
+	MapBlock block(NULL, v3s16(1, 2, 3), gamedef);
+	block.fillNodes(MapNode(CONTENT_AIR));
+	block.m_node_metadata.set(v3s16(4, 4, 4),
+		new NodeMetadata(gamedef->idef()));
+	block.swapDeserializedData(&decoded);
+
+	UASSERT(!block.isUniform());
+	UASSERT(block.getNodeNoEx(v3s16(1, 2, 3)) == torch);
+	UASSERT(block.getNodeNoEx(v3s16(0, 0, 0)) == stone);
+	UASSERT(block.getIsUnderground());
+	UASSERT(block.m_node_metadata.get(v3s16(4, 4, 4)) == NULL);
+	NodeMetadata *got = block.m_node_metadata.get(v3s16(1, 2, 3));
+	UASSERT(got && got->getString("infotext") == "hello");
+
+	// The old contents are in the other block, to be deleted with it
+	UASSERT(decoded.isUniform());
+	UASSERT(decoded.getNodeNoEx(v3s16(1, 2, 3)).getContent() == CONTENT_AIR);
+	UASSERT(decoded.m_node_metadata.get(v3s16(4, 4, 4)) != NULL);
+}
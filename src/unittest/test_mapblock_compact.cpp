@@ -0,0 +1,222 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "gamedef.h"
+#include "mapblock.h"
+#include "noise.h"
+#include "porting.h"
+#include "voxel.h"
+
+class TestMapBlockCompact : public TestBase {
+public:
+	TestMapBlockCompact() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlockCompact"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testRoundTrip();
+	void testMapBlock(IGameDef *gamedef);
+	void testVoxelManipulator(IGameDef *gamedef);
+
+	void runBenchmarks(IGameDef *gamedef);
+
+	void benchMemoryAndSpeed(IGameDef *gamedef);
+
+	// Fills nodes with about palette_size different contents
+	void makeNodes(MapNode *nodes, u32 palette_size, bool light);
+	bool roundTrips(const MapNode *nodes);
+};
+
+static TestMapBlockCompact g_test_instance;
+
+void TestMapBlockCompact::runTests(IGameDef *gamedef)
+{
+	TEST(testRoundTrip);
+	TEST(testMapBlock, gamedef);
+	TEST(testVoxelManipulator, gamedef);
+}
+
+void TestMapBlockCompact::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchMemoryAndSpeed, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMapBlockCompact::makeNodes(MapNode *nodes, u32 palette_size,
+		bool light)
+{
+	PcgRandom pr(palette_size);
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		nodes[i] = MapNode(CONTENT_AIR);
+		if (palette_size > 1)
+			nodes[i].setContent(pr.range(0, palette_size - 1) + 100);
+		if (light)
+			nodes[i].param1 = pr.range(0, 255);
+	}
+}
+
+bool TestMapBlockCompact::roundTrips(const MapNode *nodes)
+{
+	CompactNodeData *d = CompactNodeData::create(nodes);
+	if (!d)
+		return false;
+
+	MapNode out[MapBlock::nodecount];
+	d->decompress(out);
+	bool ok = true;
+	for (u32 i = 0; i < MapBlock::nodecount && ok; i++) {
+		ok = out[i] == nodes[i];
+		ok = ok && d->get(i) == nodes[i];
+	}
+	delete d;
+	return ok;
+}
+
+void TestMapBlockCompact::testRoundTrip()
+{
+	MapNode nodes[MapBlock::nodecount];
+
+	makeNodes(nodes, 1, false);
+	CompactNodeData *d = CompactNodeData::create(nodes);
+	UASSERT(d && d->isUniform());
+	UASSERT(d->getMemoryUsage() < 256);
+	delete d;
+
+	u32 sizes[] = {1, 2, 16, 17, 256, 257, 1000};
+	for (size_t i = 0; i < ARRLEN(sizes); i++) {
+		makeNodes(nodes, sizes[i], false);
+		UASSERT(roundTrips(nodes));
+		makeNodes(nodes, sizes[i], true);
+		UASSERT(roundTrips(nodes));
+	}
+
+	// No gain possible: every node different in everything
+	PcgRandom pr(3);
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		nodes[i] = MapNode(i, pr.range(0, 255), pr.range(0, 255));
+	UASSERT(CompactNodeData::create(nodes) == NULL);
+}
+
+void TestMapBlockCompact::testMapBlock(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+	MapNode stone(t_CONTENT_STONE);
+	MapNode torch(t_CONTENT_TORCH, 14, 3);
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		block.getData()[i] = stone;
+	block.setNode(v3s16(1, 2, 3), torch);
+
+	block.compact();
+	UASSERT(block.isCompact());
+	UASSERT(!block.isDummy());
+	UASSERT(block.getNodeMemoryUsage() < sizeof(MapNode) * MapBlock::nodecount);
+	UASSERT(block.getNodeNoEx(v3s16(1, 2, 3)) == torch);
+	UASSERT(block.getNodeNoEx(v3s16(3, 2, 1)) == stone);
+	UASSERT(block.getNodeUnsafe(1, 2, 3) == torch);
+	bool valid;
+	UASSERT(block.getNodeNoCheck(v3s16(0, 15, 0), &valid) == stone && valid);
+
+	MapNode all[MapBlock::nodecount];
+	block.getNodes(all);
+	UASSERT(all[3 * MapBlock::zstride + 2 * MapBlock::ystride + 1] == torch);
+	UASSERT(block.isCompact());
+
+	// Writing expands the block
+	block.setNode(v3s16(0, 0, 0), torch);
+	UASSERT(!block.isCompact());
+	UASSERT(block.getNodeNoEx(v3s16(0, 0, 0)) == torch);
+	UASSERT(block.getNodeNoEx(v3s16(1, 2, 3)) == torch);
+	UASSERT(block.getNodeNoEx(v3s16(5, 5, 5)) == stone);
+}
+
+void TestMapBlockCompact::testVoxelManipulator(IGameDef *gamedef)
+{
+	MapBlock block(NULL, v3s16(1, 0, 0), gamedef);
+	MapNode air(CONTENT_AIR);
+	MapNode stone(t_CONTENT_STONE);
+	for (u32 i = 0; i < MapBlock::nodecount; i++)
+		block.getData()[i] = (i % 7) ? air : stone;
+	block.compact();
+	UASSERT(block.isCompact());
+
+	VoxelManipulator vm;
+	v3s16 p0 = block.getPosRelative();
+	vm.addArea(VoxelArea(p0, p0 + v3s16(15, 15, 15)));
+	block.copyTo(vm);
+	for (u32 i = 0; i < MapBlock::nodecount; i++) {
+		v3s16 p(i % 16, (i / 16) % 16, i / 256);
+		UASSERT(vm.getNodeNoExNoEmerge(p0 + p) == block.getNodeNoEx(p));
+	}
+
+	// Writing back a single node type keeps the block compact
+	for (s16 z = 0; z < 16; z++)
+	for (s16 y = 0; y < 16; y++)
+	for (s16 x = 0; x < 16; x++)
+		vm.setNode(p0 + v3s16(x, y, z), air);
+	block.copyFrom(vm);
+	UASSERT(block.isCompact());
+	UASSERT(block.getNodeNoEx(v3s16(0, 0, 0)) == air);
+
+	// CONTENT_IGNORE keeps the old node
+	vm.setNode(p0, stone);
+	vm.setNode(p0 + v3s16(1, 0, 0), MapNode(CONTENT_IGNORE));
+	block.copyFrom(vm);
+	UASSERT(!block.isCompact());
+	UASSERT(block.getNodeNoEx(v3s16(0, 0, 0)) == stone);
+	UASSERT(block.getNodeNoEx(v3s16(1, 0, 0)) == air);
+}
+
+void TestMapBlockCompact::benchMemoryAndSpeed(IGameDef *gamedef)
+{
+	const u32 palette_sizes[] = {1, 4, 40, 300};
+	const u32 reads = 500;
+
+	for (size_t k = 0; k < ARRLEN(palette_sizes); k++) {
+		MapBlock block(NULL, v3s16(0, 0, 0), gamedef);
+		makeNodes(block.getData(), palette_sizes[k], false);
+		size_t plain = block.getNodeMemoryUsage();
+
+		u32 sum = 0;
+		u64 t0 = porting::getTimeUs();
+		for (u32 r = 0; r < reads; r++)
+		for (u32 i = 0; i < MapBlock::nodecount; i++)
+			sum += block.getNodeUnsafe(i % 16, (i / 16) % 16, i / 256).param0;
+		u64 t1 = porting::getTimeUs();
+
+		block.compact();
+		UASSERT(block.isCompact());
+		size_t compact = block.getNodeMemoryUsage();
+
+		u32 sum_compact = 0;
+		u64 t2 = porting::getTimeUs();
+		for (u32 r = 0; r < reads; r++)
+		for (u32 i = 0; i < MapBlock::nodecount; i++)
+			sum_compact += block.getNodeUnsafe(i % 16, (i / 16) % 16, i / 256).param0;
+		u64 t3 = porting::getTimeUs();
+
+		UASSERTEQ(u32, sum, sum_compact);
+		rawstream << "TestMapBlockCompact: " << palette_sizes[k]
+			<< " contents: " << plain << " -> " << compact << " bytes, "
+			<< (reads * MapBlock::nodecount) << " reads " << (t1 - t0)
+			<< "us plain, " << (t3 - t2) << "us compact" << std::endl;
+	}
+}
@@ -0,0 +1,250 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <map>
+#include "map.h"
+#include "mapblock.h"
+#include "mapblock_index.h"
+#include "mapsector.h"
+#include "noise.h"
+#include "porting.h"
+#include "threading/semaphore.h"
+#include "threading/thread.h"
+
+class TestMapBlockIndex : public TestBase {
+public:
+	TestMapBlockIndex() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMapBlockIndex"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testInsertRemove();
+	void testRandomChurn();
+	void testRecentPerThread();
+
+	void runBenchmarks(IGameDef *gamedef);
+
+	void benchGetNode(IGameDef *gamedef);
+};
+
+static TestMapBlockIndex g_test_instance;
+
+void TestMapBlockIndex::runTests(IGameDef *gamedef)
+{
+	TEST(testInsertRemove);
+	TEST(testRandomChurn);
+	TEST(testRecentPerThread);
+}
+
+void TestMapBlockIndex::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchGetNode, gamedef);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The index never dereferences the blocks, any unique non-NULL value works
+static MapBlock *fake_block(u32 i)
+{
+	return (MapBlock *)(size_t)((i + 1) * 16);
+}
+
+void TestMapBlockIndex::testInsertRemove()
+{
+	MapBlockIndex index;
+	v3s16 p1(0, 0, 0), p2(-1, 2, -3), p3(-2048, 2047, -2048);
+
+	UASSERT(index.get(p1) == NULL);
+	index.insert(p1, fake_block(1));
+	index.insert(p2, fake_block(2));
+	index.insert(p3, fake_block(3));
+	UASSERTEQ(u32, index.size(), 3);
+	UASSERT(index.get(p1) == fake_block(1));
+	UASSERT(index.lookup(p2) == fake_block(2));
+	UASSERT(index.lookup(p3) == fake_block(3));
+	UASSERT(index.lookup(v3s16(2, -1, -3)) == NULL);
+
+	// Replacing must not leave a stale recently used entry
+	index.insert(p2, fake_block(4));
+	UASSERTEQ(u32, index.size(), 3);
+	UASSERT(index.lookup(p2) == fake_block(4));
+
+	index.remove(p2);
+	UASSERT(index.lookup(p2) == NULL);
+	UASSERT(index.lookup(p1) == fake_block(1));
+	index.remove(p2);
+	UASSERTEQ(u32, index.size(), 2);
+
+	index.clear();
+	UASSERTEQ(u32, index.size(), 0);
+	UASSERT(index.lookup(p1) == NULL);
+}
+
+// Looks up a position twice, each time when lookup() is called
+class IndexLookupThread : public Thread
+{
+public:
+	IndexLookupThread(MapBlockIndex *index, v3s16 p):
+		Thread("IndexLookup"),
+		m_index(index),
+		m_p(p),
+		m_result(NULL)
+	{}
+
+	MapBlock *lookup()
+	{
+		m_go.post();
+		m_done.wait();
+		return m_result;
+	}
+
+	void *run()
+	{
+		for (u32 i = 0; i < 2; i++) {
+			m_go.wait();
+			m_result = m_index->lookup(m_p);
+			m_done.post();
+		}
+		return NULL;
+	}
+
+private:
+	MapBlockIndex *m_index;
+	v3s16 m_p;
+	MapBlock *m_result;
+	Semaphore m_go;
+	Semaphore m_done;
+};
+
+void TestMapBlockIndex::testRecentPerThread()
+{
+	MapBlockIndex index, other_index;
+	v3s16 p(1, 2, 3);
+	index.insert(p, fake_block(1));
+	other_index.insert(p, fake_block(2));
+
+	// Each index has to be told apart by the same thread
+	UASSERT(index.lookup(p) == fake_block(1));
+	UASSERT(other_index.lookup(p) == fake_block(2));
+	UASSERT(index.lookup(p) == fake_block(1));
+
+	IndexLookupThread thread(&index, p);
+	thread.start();
+	UASSERT(thread.lookup() == fake_block(1));
+
+	// Removing a block is seen by threads that used it before
+	index.remove(p);
+	UASSERT(index.lookup(p) == NULL);
+	UASSERT(thread.lookup() == NULL);
+	thread.wait();
+}
+
+void TestMapBlockIndex::testRandomChurn()
+{
+	MapBlockIndex index;
+	std::map<v3s16, MapBlock *> reference;
+	PcgRandom pr(1234);
+
+	// Small coordinate range so that removals hit and clusters form
+	for (u32 i = 0; i < 200000; i++) {
+		v3s16 p(pr.range(-20, 20), pr.range(-20, 20), pr.range(-20, 20));
+		if (pr.range(0, 2) == 0) {
+			index.remove(p);
+			reference.erase(p);
+		} else {
+			index.insert(p, fake_block(i));
+			reference[p] = fake_block(i);
+		}
+
+		if (i % 1000 == 0)
+			UASSERT(index.lookup(p) == index.get(p));
+	}
+
+	UASSERTEQ(u32, index.size(), reference.size());
+	for (std::map<v3s16, MapBlock *>::const_iterator it = reference.begin();
+			it != reference.end(); ++it)
+		UASSERT(index.get(it->first) == it->second);
+
+	// Remove everything, the table has to shrink again
+	for (std::map<v3s16, MapBlock *>::const_iterator it = reference.begin();
+			it != reference.end(); ++it)
+		index.remove(it->first);
+	UASSERTEQ(u32, index.size(), 0);
+	UASSERT(index.capacity() <= 2048);
+}
+
+void TestMapBlockIndex::benchGetNode(IGameDef *gamedef)
+{
+	// About 200k blocks, like a busy server
+	const s16 r = 40, h = 16;
+	Map map(dstream, gamedef);
+	std::map<v2s16, MapSector *> *sectors = map.getSectorsPtr();
+	MapNode stone(t_CONTENT_STONE);
+	u32 n = 0;
+	for (s16 x = -r; x < r; x++)
+	for (s16 z = -r; z < r; z++) {
+		v2s16 p2d(x, z);
+		MapSector *sector = new ServerMapSector(&map, p2d, gamedef);
+		(*sectors)[p2d] = sector;
+		for (s16 y = -h; y < h; y++) {
+			// Keep the blocks small, they only differ in position
+			MapBlock *block = sector->createBlankBlock(y);
+			MapNode *data = block->getData();
+			for (u32 i = 0; i < MapBlock::nodecount; i++)
+				data[i] = stone;
+			block->compact();
+			n++;
+		}
+	}
+
+	const u32 count = 1000000;
+	std::vector<v3s16> positions;
+	positions.reserve(count);
+	PcgRandom pr(42);
+	for (u32 i = 0; i < count; i++)
+		positions.push_back(v3s16(
+			pr.range(-r * MAP_BLOCKSIZE, r * MAP_BLOCKSIZE),
+			pr.range(-h * MAP_BLOCKSIZE, h * MAP_BLOCKSIZE),
+			pr.range(-r * MAP_BLOCKSIZE, r * MAP_BLOCKSIZE)));
+
+	// Random positions, almost every lookup misses the recently used blocks
+	u32 found_random = 0;
+	u64 t0 = porting::getTimeUs();
+	for (u32 i = 0; i < count; i++)
+		found_random += map.getNodeNoEx(positions[i]).getContent() != CONTENT_IGNORE;
+	u64 t1 = porting::getTimeUs();
+
+	// A walk along x, like the neighbour lookups of ABMs and liquids
+	u32 found_walk = 0;
+	for (u32 i = 0; i < count; i++) {
+		v3s16 p = positions[i / 64];
+		p.X += i % 64;
+		found_walk += map.getNodeNoEx(p).getContent() != CONTENT_IGNORE;
+	}
+	u64 t2 = porting::getTimeUs();
+
+	UASSERT(found_random > count / 2);
+	UASSERT(found_walk > count / 2);
+
+	rawstream << "TestMapBlockIndex: " << count << " getNodeNoEx() in "
+		<< n << " blocks: random " << (t1 - t0) << "us, walk "
+		<< (t2 - t1) << "us" << std::endl;
+}
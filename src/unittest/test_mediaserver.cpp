@@ -0,0 +1,148 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include "network/mediaserver.h"
+
+class TestMediaServer : public TestBase {
+public:
+	TestMediaServer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMediaServer"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testParseGet();
+	void testParsePost();
+	void testParseIncomplete();
+	void testParseTooLarge();
+	void testParsePipelined();
+};
+
+static TestMediaServer g_test_instance;
+
+void TestMediaServer::runTests(IGameDef *gamedef)
+{
+	TEST(testParseGet);
+	TEST(testParsePost);
+	TEST(testParseIncomplete);
+	TEST(testParseTooLarge);
+	TEST(testParsePipelined);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMediaServer::testParseGet()
+{
+	MediaHTTPRequest request;
+	std::string in = "GET /0123456789abcdef?x=1 HTTP/1.1\r\n"
+		"Host: example.com\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERTEQ(std::string, request.method, "GET");
+	UASSERTEQ(std::string, request.target, "0123456789abcdef");
+	UASSERT(request.body.empty());
+	UASSERT(request.keep_alive);
+	UASSERTEQ(size_t, request.size, in.size());
+
+	// HTTP/1.0 closes the connection unless asked not to
+	in = "GET / HTTP/1.0\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERTEQ(std::string, request.target, "/");
+	UASSERT(!request.keep_alive);
+
+	in = "GET /a HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERT(request.keep_alive);
+
+	in = "GET /a HTTP/1.1\r\nconnection:close\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERT(!request.keep_alive);
+}
+
+void TestMediaServer::testParsePost()
+{
+	MediaHTTPRequest request;
+	std::string in = "POST /index.mth HTTP/1.1\r\n"
+		"Content-Type: application/octet-stream\r\n"
+		"Content-Length: 6\r\n\r\n";
+	in.append("MTHS\x00\x01", 6);
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERTEQ(std::string, request.method, "POST");
+	UASSERTEQ(std::string, request.target, "index.mth");
+	UASSERTEQ(std::string, request.body, std::string("MTHS\x00\x01", 6));
+
+	// Invalid lengths must not throw
+	in = "POST /index.mth HTTP/1.1\r\nContent-Length: abc\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERT(request.body.empty());
+	in = "POST /index.mth HTTP/1.1\r\nContent-Length: -5\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERT(request.body.empty());
+}
+
+void TestMediaServer::testParseIncomplete()
+{
+	MediaHTTPRequest request;
+	std::string in = "GET /index.mth HTTP/1.1\r\nHost: exa";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_INCOMPLETE);
+	UASSERT(!request.expect_continue);
+
+	// Header complete, waiting for the body
+	in = "POST /index.mth HTTP/1.1\r\nContent-Length: 26\r\n"
+		"Expect: 100-continue\r\n\r\nMTHS";
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_INCOMPLETE);
+	UASSERT(request.expect_continue);
+
+	in.append(22, 'x');
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERTEQ(size_t, request.body.size(), 26);
+}
+
+void TestMediaServer::testParseTooLarge()
+{
+	MediaHTTPRequest request;
+	std::string in = "POST /index.mth HTTP/1.1\r\nContent-Length: 101\r\n\r\n";
+	UASSERT(parse_media_http_request(in, 100, &request) ==
+		MEDIA_HTTP_BODY_TOO_LARGE);
+
+	in = "GET /index.mth HTTP/1.1\r\nX-Padding: ";
+	in.append(10000, 'x');
+	UASSERT(parse_media_http_request(in, 100, &request) ==
+		MEDIA_HTTP_HEADER_TOO_LARGE);
+	in.append("\r\n\r\n");
+	UASSERT(parse_media_http_request(in, 100, &request) ==
+		MEDIA_HTTP_HEADER_TOO_LARGE);
+}
+
+void TestMediaServer::testParsePipelined()
+{
+	MediaHTTPRequest request;
+	std::string first = "GET /aa HTTP/1.1\r\n\r\n";
+	std::string second = "HEAD /bb HTTP/1.1\r\n\r\n";
+	std::string in = first + second;
+
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERTEQ(std::string, request.target, "aa");
+	UASSERTEQ(size_t, request.size, first.size());
+
+	in.erase(0, request.size);
+	UASSERT(parse_media_http_request(in, 100, &request) == MEDIA_HTTP_COMPLETE);
+	UASSERTEQ(std::string, request.method, "HEAD");
+	UASSERTEQ(std::string, request.target, "bb");
+}
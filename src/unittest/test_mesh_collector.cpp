@@ -0,0 +1,171 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <map>
+#include "mapblock_mesh.h"
+#include "porting.h"
+
+#define MATERIALS 3
+#define FACES_PER_MATERIAL 1000
+
+class TestMeshCollector : public TestBase {
+public:
+	TestMeshCollector() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestMeshCollector"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testAppend();
+	void testReuse();
+
+	void benchReuse();
+
+	u32 fill(MeshCollector &collector, bool reserve);
+};
+
+static TestMeshCollector g_test_instance;
+
+void TestMeshCollector::runTests(IGameDef *gamedef)
+{
+	TEST(testAppend);
+	TEST(testReuse);
+}
+
+void TestMeshCollector::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchReuse);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestMeshCollector::testAppend()
+{
+	MeshCollector collector(false);
+	fill(collector, false);
+
+	UASSERTEQ(size_t, collector.prebuffers[0].size(), MATERIALS);
+	UASSERT(collector.prebuffers[1].empty());
+	for (u32 i = 0; i < MATERIALS; i++) {
+		const PreMeshBuffer &p = collector.prebuffers[0][i];
+		UASSERTEQ(size_t, p.vertices.size(), FACES_PER_MATERIAL * 4);
+		UASSERTEQ(size_t, p.indices.size(), FACES_PER_MATERIAL * 6);
+		// The indices of the last face point to its vertices
+		UASSERTEQ(u32, p.indices.back(), FACES_PER_MATERIAL * 4 - 4);
+	}
+
+	collector.clear();
+	UASSERT(collector.prebuffers[0].empty());
+}
+
+void TestMeshCollector::testReuse()
+{
+	{
+		MeshCollector collector(false);
+		UASSERT(fill(collector, false) > 0);
+	}
+
+	MeshCollector collector(false);
+	UASSERTEQ(u32, fill(collector, true), 0);
+
+	// Only the first mesh grows the arrays of a reused collector
+	collector.clear();
+	UASSERTEQ(u32, fill(collector, false), 0);
+}
+
+void TestMeshCollector::benchReuse()
+{
+	const u32 rounds = 100;
+
+	u64 t0 = porting::getTimeUs();
+	u32 reallocs_new = 0;
+	for (u32 i = 0; i < rounds; i++) {
+		MeshCollector collector(false);
+		reallocs_new += fill(collector, false);
+	}
+	u64 t1 = porting::getTimeUs();
+	u32 reallocs_reserved = 0;
+	for (u32 i = 0; i < rounds; i++) {
+		MeshCollector collector(false);
+		reallocs_reserved += fill(collector, true);
+	}
+	u64 t2 = porting::getTimeUs();
+	u32 reallocs_reused = 0;
+	MeshCollector collector(false);
+	for (u32 i = 0; i < rounds; i++) {
+		collector.clear();
+		reallocs_reused += fill(collector, false);
+	}
+	u64 t3 = porting::getTimeUs();
+
+	UASSERT(reallocs_new > 0);
+	UASSERTEQ(u32, reallocs_reserved, 0);
+	// Only the first mesh grows the arrays of a reused collector
+	UASSERTEQ(u32, reallocs_reused, reallocs_new / rounds);
+
+	rawstream << "TestMeshCollector: " << rounds << " meshes: "
+		<< reallocs_new << " reallocations in " << (t1 - t0) << "us new, "
+		<< reallocs_reserved << " in " << (t2 - t1) << "us reserved, "
+		<< reallocs_reused << " in " << (t3 - t2) << "us reused"
+		<< std::endl;
+}
+
+// Appends the faces of all materials, returns how many times the arrays
+// were moved to grow
+u32 TestMeshCollector::fill(MeshCollector &collector, bool reserve)
+{
+	TileLayer layers[MATERIALS];
+	for (u32 m = 0; m < MATERIALS; m++)
+		layers[m].texture_id = m + 1;
+
+	if (reserve)
+		for (u32 m = 0; m < MATERIALS; m++)
+			collector.reserveFaces(layers[m], 0, FACES_PER_MATERIAL);
+
+	const u16 indices[] = {0, 1, 2, 2, 3, 0};
+	video::S3DVertex vertices[4];
+	for (u32 i = 0; i < 4; i++)
+		vertices[i] = video::S3DVertex(v3f(i % 2, i / 2, 0), v3f(0, 0, 1),
+			video::SColor(255, 255, 255, 255), v2f(i % 2, i / 2));
+
+	// Data pointers of the arrays of each material after its first face
+	std::map<u32, std::pair<const void *, const void *> > arrays;
+	u32 reallocations = 0;
+	for (u32 n = 0; n < FACES_PER_MATERIAL; n++)
+	for (u32 m = 0; m < MATERIALS; m++) {
+		collector.append(layers[m], vertices, 4, indices, 6, 0);
+
+		const std::vector<PreMeshBuffer> &buffers = collector.prebuffers[0];
+		for (size_t i = 0; i < buffers.size(); i++) {
+			if (buffers[i].layer != layers[m])
+				continue;
+			std::pair<const void *, const void *> &a =
+				arrays[layers[m].texture_id];
+			if (n > 0 && a.first != (const void *)&buffers[i].vertices[0])
+				reallocations++;
+			if (n > 0 && a.second != (const void *)&buffers[i].indices[0])
+				reallocations++;
+			a.first = &buffers[i].vertices[0];
+			a.second = &buffers[i].indices[0];
+		}
+	}
+	return reallocations;
+}
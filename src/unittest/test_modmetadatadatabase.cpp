@@ -0,0 +1,244 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <algorithm>
+#include "content/mods.h"
+#include "database-files.h"
+#include "database-sqlite3.h"
+#include "exceptions.h"
+#include "filesys.h"
+
+// Counts the writes that reach the database, and fails writes and saves on
+// request
+class CountingModMetadataDatabase : public ModMetadataDatabase
+{
+public:
+	CountingModMetadataDatabase(ModMetadataDatabase *db) :
+		writes(0),
+		fail_write(0),
+		fail_save(false),
+		m_db(db)
+	{}
+
+	bool getModEntries(const std::string &modname, StringMap &storage)
+	{ return m_db->getModEntries(modname, storage); }
+	bool setModEntry(const std::string &modname,
+		const std::string &key, const std::string &value)
+	{ countWrite(); return m_db->setModEntry(modname, key, value); }
+	bool removeModEntry(const std::string &modname, const std::string &key)
+	{ countWrite(); return m_db->removeModEntry(modname, key); }
+	void listMods(std::vector<std::string> &res) { m_db->listMods(res); }
+
+	void beginSave() { m_db->beginSave(); }
+	void endSave()
+	{
+		m_db->endSave();
+		if (fail_save)
+			throw DatabaseException("save failed");
+	}
+	void abortSave() { m_db->abortSave(); }
+
+	u32 writes;
+	// The write that throws, 0 for none
+	u32 fail_write;
+	bool fail_save;
+
+private:
+	void countWrite()
+	{
+		writes++;
+		if (writes == fail_write)
+			throw DatabaseException("write failed");
+	}
+
+	ModMetadataDatabase *m_db;
+};
+
+class TestModMetadataDatabase : public TestBase {
+public:
+	TestModMetadataDatabase() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestModMetadataDatabase"; }
+
+	void runTests(IGameDef *gamedef);
+
+	void testBackend(ModMetadataDatabase *db);
+	void testFilesPersistence();
+	void testSQLite3Persistence();
+	void testModMetadata();
+
+private:
+	std::string m_dir;
+};
+
+static TestModMetadataDatabase g_test_instance;
+
+void TestModMetadataDatabase::runTests(IGameDef *gamedef)
+{
+	m_dir = getTestTempDirectory() + DIR_DELIM + "modstoragedb";
+	fs::RecursiveDelete(m_dir);
+	fs::CreateAllDirs(m_dir);
+
+	{
+		ModMetadataDatabaseFiles files_db(m_dir + DIR_DELIM + "mod_storage");
+		TEST(testBackend, &files_db);
+	}
+	TEST(testFilesPersistence);
+
+	{
+		ModMetadataDatabaseSQLite3 sqlite_db(m_dir);
+		TEST(testBackend, &sqlite_db);
+	}
+	TEST(testSQLite3Persistence);
+
+	TEST(testModMetadata);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestModMetadataDatabase::testBackend(ModMetadataDatabase *db)
+{
+	StringMap res;
+	UASSERT(db->getModEntries("mod1", res));
+	UASSERT(res.empty());
+
+	UASSERT(db->setModEntry("mod1", "key1", "value1"));
+	UASSERT(db->setModEntry("mod1", "key2", std::string("a\0b", 3)));
+	UASSERT(db->setModEntry("mod2", "key1", "value2"));
+	UASSERT(db->setModEntry("mod1", "key1", "value3"));
+
+	UASSERT(db->getModEntries("mod1", res));
+	UASSERTEQ(size_t, res.size(), 2);
+	UASSERT(res["key1"] == "value3");
+	UASSERT(res["key2"] == std::string("a\0b", 3));
+
+	// Changes between beginSave() and endSave() are kept too
+	db->beginSave();
+	UASSERT(db->removeModEntry("mod1", "key2"));
+	UASSERT(db->removeModEntry("mod1", "nonexistent"));
+	UASSERT(db->setModEntry("mod3", "key1", "value4"));
+	db->endSave();
+
+	res.clear();
+	UASSERT(db->getModEntries("mod1", res));
+	UASSERTEQ(size_t, res.size(), 1);
+	UASSERT(res["key1"] == "value3");
+
+	std::vector<std::string> mods;
+	db->listMods(mods);
+	std::sort(mods.begin(), mods.end());
+	UASSERTEQ(size_t, mods.size(), 3);
+	UASSERT(mods[0] == "mod1");
+	UASSERT(mods[2] == "mod3");
+}
+
+void TestModMetadataDatabase::testFilesPersistence()
+{
+	// The entries of testBackend() were written to the JSON files
+	ModMetadataDatabaseFiles db(m_dir + DIR_DELIM + "mod_storage");
+	StringMap res;
+	UASSERT(db.getModEntries("mod2", res));
+	UASSERTEQ(size_t, res.size(), 1);
+	UASSERT(res["key1"] == "value2");
+
+	// Files of older versions are read as they are
+	std::string path = m_dir + DIR_DELIM + "mod_storage" + DIR_DELIM + "mod4";
+	UASSERT(fs::safeWriteToFile(path, "{\"foo\":\"bar\"}\n"));
+	res.clear();
+	UASSERT(db.getModEntries("mod4", res));
+	UASSERT(res["foo"] == "bar");
+}
+
+void TestModMetadataDatabase::testSQLite3Persistence()
+{
+	ModMetadataDatabaseSQLite3 db(m_dir);
+	StringMap res;
+	UASSERT(db.getModEntries("mod1", res));
+	UASSERTEQ(size_t, res.size(), 1);
+	UASSERT(res["key1"] == "value3");
+	res.clear();
+	UASSERT(db.getModEntries("mod3", res));
+	UASSERT(res["key1"] == "value4");
+}
+
+void TestModMetadataDatabase::testModMetadata()
+{
+	ModMetadataDatabaseSQLite3 sqlite_db(m_dir);
+	CountingModMetadataDatabase db(&sqlite_db);
+
+	ModMetadata meta("mod5", &db);
+	UASSERT(meta.load());
+	for (u32 i = 0; i < 100; i++)
+		meta.setString("key" + itos(i), itos(i));
+	UASSERT(meta.isModified());
+	UASSERT(meta.save());
+	UASSERTEQ(u32, db.writes, 100);
+	UASSERT(!meta.isModified());
+
+	// Only the changed keys are written
+	db.writes = 0;
+	meta.setString("key1", "changed");
+	meta.setString("key2", "2");
+	meta.setString("key3", "");
+	UASSERT(meta.save());
+	UASSERTEQ(u32, db.writes, 2);
+
+	ModMetadata meta2("mod5", &db);
+	UASSERT(meta2.load());
+	UASSERTEQ(size_t, meta2.size(), 99);
+	UASSERT(meta2.getString("key1") == "changed");
+	UASSERT(!meta2.contains("key3"));
+
+	// A failed save keeps the changed keys for the next one
+	db.fail_save = true;
+	meta2.setString("key1", "again");
+	UASSERT(!meta2.save());
+	UASSERT(meta2.isModified());
+	db.fail_save = false;
+	db.writes = 0;
+	UASSERT(meta2.save());
+	UASSERTEQ(u32, db.writes, 1);
+	UASSERT(!meta2.isModified());
+
+	// A failed write rolls back the writes before it
+	db.writes = 0;
+	db.fail_write = 2;
+	meta2.setString("key1", "rolled back");
+	meta2.setString("key2", "rolled back");
+	UASSERT(!meta2.save());
+	UASSERT(meta2.isModified());
+	UASSERT(meta.load());
+	UASSERT(meta.getString("key1") == "again");
+	UASSERT(meta.getString("key2") == "2");
+	db.fail_write = 0;
+	db.writes = 0;
+	UASSERT(meta2.save());
+	UASSERTEQ(u32, db.writes, 2);
+	UASSERT(meta.load());
+	UASSERT(meta.getString("key1") == "rolled back");
+
+	// Clearing removes all keys
+	db.writes = 0;
+	meta2.clear();
+	UASSERT(meta2.save());
+	UASSERTEQ(u32, db.writes, 99);
+	UASSERT(meta.load());
+	UASSERT(meta.empty());
+}
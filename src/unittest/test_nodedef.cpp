@@ -34,6 +34,7 @@ class TestNodeDef : public TestBase
 	void runTests(IGameDef *gamedef);
 
 	void testContentFeaturesSerialization();
+	void testRevision();
 };
 
 static TestNodeDef g_test_instance;
@@ -41,6 +42,7 @@ static TestNodeDef g_test_instance;
 void TestNodeDef::runTests(IGameDef *gamedef)
 {
 	TEST(testContentFeaturesSerialization);
+	TEST(testRevision);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -65,3 +67,30 @@ void TestNodeDef::testContentFeaturesSerialization()
 	UASSERT(f.walkable == f2.walkable);
 	UASSERT(f.node_box.type == f2.node_box.type);
 }
+
+void TestNodeDef::testRevision()
+{
+	IWritableNodeDefManager *ndef = createNodeDefManager();
+	u32 revision = ndef->getRevision();
+
+	ContentFeatures f;
+	f.name = "test:revision";
+	ndef->set(f.name, f);
+	UASSERT(ndef->getRevision() != revision);
+	revision = ndef->getRevision();
+
+	// Reading the definitions does not change them
+	std::ostringstream os(std::ios::binary);
+	ndef->serialize(os, LATEST_PROTOCOL_VERSION);
+	ndef->getId("test:revision");
+	UASSERTEQ(u32, ndef->getRevision(), revision);
+
+	ndef->removeNode(f.name);
+	UASSERT(ndef->getRevision() != revision);
+	revision = ndef->getRevision();
+	// Nothing to remove
+	ndef->removeNode(f.name);
+	UASSERTEQ(u32, ndef->getRevision(), revision);
+
+	delete ndef;
+}
@@ -0,0 +1,298 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <cmath>
+#include <sstream>
+#include "nodetimer.h"
+#include "noise.h"
+#include "porting.h"
+#include "serialization.h"
+
+class TestNodeTimer : public TestBase {
+public:
+	TestNodeTimer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestNodeTimer"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testWheel();
+	void testList();
+	void testRestartedTimers();
+	void testManyBlocks();
+
+	void benchManyBlocks();
+
+	// Runs the timers of many blocks, few of them with timers, once by
+	// stepping every block and once on a wheel. Counts the fired timers and
+	// the time taken by each.
+	void stepManyBlocks(u32 blocks, u32 steps, u32 *fired, u32 *fired_wheel,
+		u64 *t_list, u64 *t_wheel);
+};
+
+static TestNodeTimer g_test_instance;
+
+void TestNodeTimer::runTests(IGameDef *gamedef)
+{
+	TEST(testWheel);
+	TEST(testList);
+	TEST(testRestartedTimers);
+	TEST(testManyBlocks);
+}
+
+void TestNodeTimer::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchManyBlocks);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TestNodeTimer::testWheel()
+{
+	NodeTimerWheel wheel(1.0);
+	PcgRandom pr(7);
+
+	// Spread over all levels, some beyond the last one
+	std::vector<double> triggers;
+	for (u32 i = 0; i < 2000; i++)
+		triggers.push_back(pr.range(1, 300000) + pr.range(0, 99) * 0.01);
+	for (u32 i = 0; i < 20; i++)
+		triggers.push_back(20000000 + pr.range(0, 1000000));
+	for (size_t i = 0; i < triggers.size(); i++)
+		UASSERTEQ(u32, wheel.schedule(v3s16(i, 0, 0), 0, triggers[i]), i + 1);
+	UASSERTEQ(u32, wheel.size(), triggers.size());
+
+	// Every entry comes up at the first tick not before its trigger time
+	std::vector<NodeTimerWheel::Entry> expired;
+	u32 count = 0;
+	while (wheel.getTime() < 300001) {
+		wheel.step(1.0, expired);
+		for (size_t i = 0; i < expired.size(); i++) {
+			double trigger = triggers[expired[i].blockpos.X];
+			UASSERT(trigger <= 300001);
+			UASSERT(std::fabs(std::ceil(trigger) - wheel.getTime()) < 0.01);
+		}
+		count += expired.size();
+		expired.clear();
+	}
+	UASSERTEQ(u32, count, 2000);
+	UASSERTEQ(u32, wheel.size(), 20);
+
+	// Large steps go through the far away ones
+	while (wheel.size() > 0) {
+		wheel.step(65536.0, expired);
+		for (size_t i = 0; i < expired.size(); i++) {
+			double trigger = triggers[expired[i].blockpos.X];
+			UASSERT(trigger <= wheel.getTime());
+			UASSERT(trigger > wheel.getTime() - 65536.0);
+		}
+		expired.clear();
+	}
+
+	// Timers that are due trigger on the next tick
+	wheel.schedule(v3s16(0, 0, 0), 1, 0.0);
+	wheel.step(0.5, expired);
+	UASSERT(expired.empty());
+	wheel.step(0.5, expired);
+	UASSERTEQ(u32, expired.size(), 1);
+	UASSERTEQ(u16, expired[0].index, 1);
+}
+
+void TestNodeTimer::testList()
+{
+	NodeTimerWheel wheel(0.5);
+	NodeTimerList list;
+	std::vector<NodeTimerWheel::Entry> expired;
+	v3s16 blockpos(1, -2, 3);
+	v3s16 a(1, 2, 3), b(15, 0, 7);
+	NodeTimer t;
+
+	// Unscheduled lists run on their own clock
+	list.insert(NodeTimer(2.0, 0.5, a));
+	std::vector<NodeTimer> elapsed = list.step(2.0);
+	UASSERTEQ(u32, elapsed.size(), 1);
+	UASSERT(elapsed[0].position == a);
+	UASSERT(std::fabs(elapsed[0].elapsed - 2.5) < 0.001);
+	UASSERTEQ(u32, list.size(), 0);
+
+	list.insert(NodeTimer(3.0, 0.0, a));
+	list.insert(NodeTimer(10.0, 0.0, b));
+	list.step(1.0);
+
+	// Scheduling keeps what has elapsed
+	wheel.step(100.0, expired);
+	list.schedule(&wheel, blockpos);
+	UASSERT(list.isScheduled());
+	UASSERTEQ(u32, wheel.size(), 2);
+	UASSERT(std::fabs(list.get(a).elapsed - 1.0) < 0.001);
+
+	// Replacing a timer cancels its old entry
+	list.set(NodeTimer(4.0, 0.0, a));
+	UASSERTEQ(u32, wheel.size(), 3);
+	wheel.step(2.0, expired);
+	UASSERT(expired.empty());
+	UASSERTEQ(u32, wheel.size(), 2);
+	UASSERTEQ(u32, list.size(), 2);
+
+	wheel.step(2.0, expired);
+	UASSERTEQ(u32, expired.size(), 1);
+	UASSERT(expired[0].blockpos == blockpos);
+	UASSERT(list.takeExpired(expired[0], t));
+	UASSERT(t.position == a);
+	UASSERT(std::fabs(t.elapsed - 4.0) < 0.001);
+	UASSERT(list.get(a).timeout == 0);
+	// Nor can an entry be taken twice
+	UASSERT(!list.takeExpired(expired[0], t));
+	expired.clear();
+
+	// The serialized format stores the elapsed time, as before
+	std::ostringstream os(std::ios_base::binary);
+	list.serialize(os, SER_FMT_VER_HIGHEST_WRITE);
+	NodeTimerList loaded;
+	std::istringstream is(os.str(), std::ios_base::binary);
+	loaded.deSerialize(is, SER_FMT_VER_HIGHEST_WRITE);
+	UASSERTEQ(u32, loaded.size(), 1);
+	UASSERT(std::fabs(loaded.get(b).elapsed - 5.0) < 0.001);
+	UASSERT(loaded.get(b).timeout == 10.0);
+
+	// Entries the list did not cancel are rejected
+	NodeTimerWheel::Entry unknown = {blockpos, 0, 12345, 0};
+	UASSERT(!list.takeExpired(unknown, t));
+
+	// Unscheduled lists keep the time and ignore the wheel
+	list.unschedule();
+	UASSERT(!list.isScheduled());
+	wheel.step(10.0, expired);
+	UASSERT(expired.empty());
+	UASSERTEQ(u32, wheel.size(), 0);
+	UASSERT(std::fabs(list.get(b).elapsed - 5.0) < 0.001);
+	elapsed = list.step(5.0);
+	UASSERTEQ(u32, elapsed.size(), 1);
+	UASSERT(elapsed[0].position == b);
+}
+
+void TestNodeTimer::testRestartedTimers()
+{
+	NodeTimerWheel wheel(1.0);
+	NodeTimerList list;
+	std::vector<NodeTimerWheel::Entry> expired;
+	list.schedule(&wheel, v3s16(0, 0, 0));
+
+	// Long timers restarted every tick, like a mod that keeps a node busy
+	for (u32 s = 0; s < 100; s++) {
+		for (s16 i = 0; i < 100; i++)
+			list.set(NodeTimer(3600.0, 0.0, v3s16(i % 16, i / 16, 0)));
+		wheel.step(1.0, expired);
+		UASSERT(expired.empty());
+	}
+
+	// The cancelled entries don't pile up
+	UASSERTEQ(u32, list.size(), 100);
+	UASSERT(wheel.size() < 100 + 2048);
+
+	// The current ones still fire
+	NodeTimer t;
+	u32 fired = 0;
+	while (list.size() > 0 && wheel.getTime() < 4000) {
+		wheel.step(1.0, expired);
+		for (size_t i = 0; i < expired.size(); i++)
+			fired += list.takeExpired(expired[i], t);
+		expired.clear();
+	}
+	UASSERTEQ(u32, fired, 100);
+	UASSERTEQ(u32, wheel.size(), 0);
+}
+
+void TestNodeTimer::testManyBlocks()
+{
+	u32 fired, fired_wheel;
+	u64 t_list, t_wheel;
+	stepManyBlocks(1000, 50, &fired, &fired_wheel, &t_list, &t_wheel);
+
+	UASSERT(fired > 0);
+	UASSERTEQ(u32, fired, fired_wheel);
+}
+
+void TestNodeTimer::benchManyBlocks()
+{
+	const u32 blocks = 20000;
+	const u32 steps = 50;
+	u32 fired, fired_wheel;
+	u64 t_list, t_wheel;
+	stepManyBlocks(blocks, steps, &fired, &fired_wheel, &t_list, &t_wheel);
+
+	UASSERTEQ(u32, fired, fired_wheel);
+
+	rawstream << "TestNodeTimer: " << blocks << " blocks, " << fired
+		<< " timers fired in " << steps << " steps: " << t_list
+		<< "us stepping every block, " << t_wheel << "us on the wheel"
+		<< std::endl;
+}
+
+void TestNodeTimer::stepManyBlocks(u32 blocks, u32 steps, u32 *fired,
+	u32 *fired_wheel, u64 *t_list, u64 *t_wheel)
+{
+	const float interval = 0.2;
+
+	NodeTimerWheel wheel(interval);
+	std::vector<NodeTimerList> lists(blocks), scheduled(blocks);
+	PcgRandom pr(5);
+	for (u32 i = 0; i < blocks; i += 100) {
+		NodeTimer t(pr.range(1, 20) * 0.5, 0, v3s16(i % 16, 0, 0));
+		lists[i].insert(t);
+		scheduled[i].insert(t);
+		scheduled[i].schedule(&wheel, v3s16(i, 0, 0));
+	}
+
+	// Stepping every block, as the environment did before
+	*fired = 0;
+	u64 t0 = porting::getTimeUs();
+	for (u32 s = 0; s < steps; s++) {
+		for (u32 i = 0; i < blocks; i++) {
+			std::vector<NodeTimer> elapsed = lists[i].step(interval);
+			for (size_t k = 0; k < elapsed.size(); k++) {
+				lists[i].insert(NodeTimer(elapsed[k].timeout, 0,
+					elapsed[k].position));
+				(*fired)++;
+			}
+		}
+	}
+	u64 t1 = porting::getTimeUs();
+
+	*fired_wheel = 0;
+	std::vector<NodeTimerWheel::Entry> expired;
+	NodeTimer t;
+	for (u32 s = 0; s < steps; s++) {
+		wheel.step(interval, expired);
+		for (size_t k = 0; k < expired.size(); k++) {
+			NodeTimerList &list = scheduled[expired[k].blockpos.X];
+			if (!list.takeExpired(expired[k], t))
+				continue;
+			list.insert(NodeTimer(t.timeout, 0, t.position));
+			(*fired_wheel)++;
+		}
+		expired.clear();
+	}
+	u64 t2 = porting::getTimeUs();
+
+	*t_list = t1 - t0;
+	*t_wheel = t2 - t1;
+}
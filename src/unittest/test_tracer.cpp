@@ -0,0 +1,171 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "test.h"
+
+#include <sstream>
+#include "porting.h"
+#include "profiler.h"
+#include "tracer.h"
+#include "threading/thread.h"
+
+class TestTracer : public TestBase {
+public:
+	TestTracer() { TestManager::registerTestModule(this); }
+	const char *getName() { return "TestTracer"; }
+
+	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
+
+	void testExport();
+	void testRingBuffer();
+
+	void benchOverhead();
+
+	static u32 countEvents(const std::string &json, TraceZone zone);
+};
+
+static TestTracer g_test_instance;
+
+void TestTracer::runTests(IGameDef *gamedef)
+{
+	TEST(testExport);
+	TEST(testRingBuffer);
+}
+
+void TestTracer::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchOverhead);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class TracingTestThread : public Thread {
+public:
+	TracingTestThread(Tracer *tracer) :
+		Thread("TracingTest"),
+		m_tracer(tracer)
+	{
+	}
+
+private:
+	void *run()
+	{
+		for (u32 i = 0; i < 100; i++)
+			m_tracer->record(TZ_EMERGE_MAKE_CHUNK, Tracer::getTime(), i);
+
+		while (!stopRequested())
+			sleep_ms(1);
+		return NULL;
+	}
+
+	Tracer *m_tracer;
+};
+
+u32 TestTracer::countEvents(const std::string &json, TraceZone zone)
+{
+	std::string name = std::string("\"name\":\"") +
+		Tracer::getZoneName(zone) + "\"";
+	u32 count = 0;
+	for (size_t i = json.find(name); i != std::string::npos;
+			i = json.find(name, i + 1))
+		count++;
+	return count;
+}
+
+void TestTracer::testExport()
+{
+	Tracer tracer;
+	tracer.setEnabled(true);
+
+	u64 start = Tracer::getTime();
+	tracer.record(TZ_SERVER_ENV_STEP, start);
+	tracer.beginFrame();
+	tracer.record(TZ_SENV_ABM, Tracer::getTime(), 42);
+	tracer.endFrame();
+
+	TracingTestThread thread(&tracer);
+	thread.start();
+	thread.stop();
+	thread.wait();
+
+	std::ostringstream os;
+	tracer.exportTrace(os);
+	std::string json = os.str();
+	UASSERT(json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") == 0);
+	UASSERT(json.find("]}") == json.size() - 3);
+	UASSERTEQ(u32, countEvents(json, TZ_SERVER_ENV_STEP), 1);
+	UASSERTEQ(u32, countEvents(json, TZ_SERVER_STEP), 1);
+	UASSERTEQ(u32, countEvents(json, TZ_EMERGE_MAKE_CHUNK), 100);
+	UASSERT(json.find("\"args\":{\"arg\":42}") != std::string::npos);
+
+	// Both threads are named
+	UASSERT(json.find("\"tid\":1,\"args\":{\"name\":\"TracingTest\"}")
+		!= std::string::npos);
+
+	// Events that ended before are left out
+	std::ostringstream recent;
+	tracer.exportTrace(recent, Tracer::getTime() + 1000000);
+	UASSERTEQ(u32, countEvents(recent.str(), TZ_EMERGE_MAKE_CHUNK), 0);
+}
+
+void TestTracer::testRingBuffer()
+{
+	Tracer tracer;
+	tracer.setEnabled(true);
+	for (u32 i = 0; i < Tracer::BUFFER_SIZE + 100; i++)
+		tracer.record(i < 100 ? TZ_SERVER_LIQUID : TZ_SERVER_SAVE,
+			Tracer::getTime());
+
+	// The oldest ones were overwritten. The slot the thread writes next
+	// is left out too, it could be half written.
+	std::ostringstream os;
+	tracer.exportTrace(os);
+	UASSERTEQ(u32, countEvents(os.str(), TZ_SERVER_LIQUID), 0);
+	UASSERTEQ(u32, countEvents(os.str(), TZ_SERVER_SAVE),
+		Tracer::BUFFER_SIZE - 1);
+}
+
+void TestTracer::benchOverhead()
+{
+	const u32 scopes = 100000;
+	bool was_enabled = g_tracer->isEnabled();
+
+	g_tracer->setEnabled(false);
+	u64 t0 = porting::getTimeUs();
+	for (u32 i = 0; i < scopes; i++)
+		TraceScope ts(TZ_SERVER_OBJECTS);
+	u64 t1 = porting::getTimeUs();
+
+	g_tracer->setEnabled(true);
+	for (u32 i = 0; i < scopes; i++)
+		TraceScope ts(TZ_SERVER_OBJECTS);
+	u64 t2 = porting::getTimeUs();
+	g_tracer->setEnabled(was_enabled);
+
+	Profiler profiler;
+	for (u32 i = 0; i < scopes; i++)
+		ScopeProfiler sp(&profiler, "Server: checking added and deleted objs",
+			SPT_AVG);
+	u64 t3 = porting::getTimeUs();
+
+	rawstream << "TestTracer: " << scopes << " scopes: " << (t1 - t0)
+		<< "us disabled, " << (t2 - t1) << "us traced, " << (t3 - t2)
+		<< "us with ScopeProfiler" << std::endl;
+}
@@ -20,6 +20,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "test.h"
 
 #include "gamedef.h"
+#include "map.h"
+#include "mapblock.h"
+#include "mapsector.h"
+#include "noise.h"
+#include "porting.h"
 #include "voxelalgorithms.h"
 #include "util/numeric.h"
 
@@ -29,10 +34,16 @@ class TestVoxelAlgorithms : public TestBase {
 	const char *getName() { return "TestVoxelAlgorithms"; }
 
 	void runTests(IGameDef *gamedef);
+	void runBenchmarks(IGameDef *gamedef);
 
 	void testPropogateSunlight(INodeDefManager *ndef);
 	void testClearLightAndCollectSources(INodeDefManager *ndef);
 	void testVoxelLineIterator(INodeDefManager *ndef);
+	void testLightingBatch(IGameDef *gamedef);
+	void testBulkSetNodes(IGameDef *gamedef);
+
+	void benchLightingBatch(IGameDef *gamedef);
+	void benchBulkSetNodes(IGameDef *gamedef);
 };
 
 static TestVoxelAlgorithms g_test_instance;
@@ -44,6 +55,14 @@ void TestVoxelAlgorithms::runTests(IGameDef *gamedef)
 	TEST(testPropogateSunlight, ndef);
 	TEST(testClearLightAndCollectSources, ndef);
 	TEST(testVoxelLineIterator, ndef);
+	TEST(testLightingBatch, gamedef);
+	TEST(testBulkSetNodes, gamedef);
+}
+
+void TestVoxelAlgorithms::runBenchmarks(IGameDef *gamedef)
+{
+	TEST(benchLightingBatch, gamedef);
+	TEST(benchBulkSetNodes, gamedef);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -261,3 +280,237 @@ void TestVoxelAlgorithms::testVoxelLineIterator(INodeDefManager *ndef)
 		UASSERTEQ(int, actual_nodecount, nodecount);
 	}
 }
+
+// A map of stone blocks that only exists in memory
+class TestLightingMap : public Map
+{
+public:
+	TestLightingMap(IGameDef *gamedef, s16 size) :
+		Map(dstream, gamedef)
+	{
+		for (s16 z = 0; z < size; z++)
+		for (s16 x = 0; x < size; x++) {
+			v2s16 p2d(x, z);
+			MapSector *sector = new ServerMapSector(this, p2d, gamedef);
+			m_sectors[p2d] = sector;
+			for (s16 y = 0; y < size; y++)
+				sector->createBlankBlock(y)->fillNodes(
+					MapNode(t_CONTENT_STONE));
+		}
+	}
+};
+
+// Returns the time taken
+static u64 apply_node_by_node(TestLightingMap &map,
+	const std::vector<std::pair<v3s16, MapNode> > &changes)
+{
+	std::map<v3s16, MapBlock *> modified_blocks;
+	u64 t0 = porting::getTimeUs();
+	for (size_t i = 0; i < changes.size(); i++)
+		map.addNodeAndUpdate(changes[i].first, changes[i].second,
+			modified_blocks);
+	return porting::getTimeUs() - t0;
+}
+
+// Returns the time taken
+static u64 apply_batched(TestLightingMap &map,
+	const std::vector<std::pair<v3s16, MapNode> > &changes)
+{
+	std::map<v3s16, MapBlock *> modified_blocks;
+	u64 t0 = porting::getTimeUs();
+	map.beginLightingBatch();
+	for (size_t i = 0; i < changes.size(); i++)
+		map.addNodeAndUpdate(changes[i].first, changes[i].second,
+			modified_blocks);
+	map.endLightingBatch();
+	return porting::getTimeUs() - t0;
+}
+
+// Returns the number of nodes with day light
+static u32 compare_light(TestLightingMap &map, TestLightingMap &batched_map,
+	INodeDefManager *ndef)
+{
+	const s16 size = 3 * MAP_BLOCKSIZE;
+	u32 lit = 0;
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = 0; y < size; y++)
+	for (s16 x = 0; x < size; x++) {
+		v3s16 p(x, y, z);
+		MapNode n = map.getNodeNoEx(p);
+		UASSERT(batched_map.getNodeNoEx(p) == n);
+		lit += n.getLight(LIGHTBANK_DAY, ndef) > 0;
+	}
+	return lit;
+}
+
+// Changes to the 3x3x3 blocks of a TestLightingMap
+static void make_light_changes(
+	std::vector<std::pair<v3s16, MapNode> > &dig,
+	std::vector<std::pair<v3s16, MapNode> > &rebuild)
+{
+	const s16 size = 3 * MAP_BLOCKSIZE;
+	MapNode air(CONTENT_AIR), stone(t_CONTENT_STONE), torch(t_CONTENT_TORCH);
+
+	// A shaft from the sky into a cave with torches
+	for (s16 y = size - 1; y > 30; y--)
+	for (s16 z = 20; z <= 22; z++)
+	for (s16 x = 20; x <= 22; x++)
+		dig.push_back(std::make_pair(v3s16(x, y, z), air));
+	for (s16 y = 20; y <= 30; y++)
+	for (s16 z = 4; z <= 40; z++)
+	for (s16 x = 4; x <= 40; x++)
+		dig.push_back(std::make_pair(v3s16(x, y, z), air));
+	PcgRandom pr(5);
+	std::vector<v3s16> torches;
+	for (u32 i = 0; i < 20; i++) {
+		v3s16 p(pr.range(4, 40), pr.range(20, 30), pr.range(4, 40));
+		torches.push_back(p);
+		dig.push_back(std::make_pair(p, torch));
+	}
+
+	// Then some of it filled in again, torches taken away, the shaft
+	// partly covered and a tunnel dug next to the lit cave
+	for (u32 i = 0; i < 200; i++) {
+		v3s16 p(pr.range(4, 40), pr.range(20, 30), pr.range(4, 40));
+		rebuild.push_back(std::make_pair(p, stone));
+	}
+	for (u32 i = 0; i < 5; i++)
+		rebuild.push_back(std::make_pair(torches[i], air));
+	rebuild.push_back(std::make_pair(v3s16(20, size - 1, 20), stone));
+	for (s16 z = 4; z <= 40; z++)
+		rebuild.push_back(std::make_pair(v3s16(41, 25, z), air));
+}
+
+void TestVoxelAlgorithms::testLightingBatch(IGameDef *gamedef)
+{
+	INodeDefManager *ndef = gamedef->getNodeDefManager();
+	TestLightingMap map(gamedef, 3);
+	TestLightingMap batched_map(gamedef, 3);
+
+	// Batches nest
+	batched_map.beginLightingBatch();
+	batched_map.beginLightingBatch();
+	UASSERT(batched_map.endLightingBatch());
+	UASSERTEQ(u32, batched_map.getLightingBatchDepth(), 1);
+	UASSERT(batched_map.endLightingBatch());
+	UASSERT(!batched_map.endLightingBatch());
+
+	std::vector<std::pair<v3s16, MapNode> > dig, rebuild;
+	make_light_changes(dig, rebuild);
+	apply_node_by_node(map, dig);
+	apply_batched(batched_map, dig);
+	apply_node_by_node(map, rebuild);
+	apply_batched(batched_map, rebuild);
+
+	// Both ways end up with the same light
+	compare_light(map, batched_map, ndef);
+	UASSERTEQ(int, map.getNodeNoEx(v3s16(21, 25, 21)).getLight(
+		LIGHTBANK_DAY, ndef), LIGHT_SUN);
+}
+
+void TestVoxelAlgorithms::benchLightingBatch(IGameDef *gamedef)
+{
+	INodeDefManager *ndef = gamedef->getNodeDefManager();
+	TestLightingMap map(gamedef, 3);
+	TestLightingMap batched_map(gamedef, 3);
+
+	std::vector<std::pair<v3s16, MapNode> > dig, rebuild;
+	make_light_changes(dig, rebuild);
+	u64 t_dig_nodes = apply_node_by_node(map, dig);
+	u64 t_dig_batch = apply_batched(batched_map, dig);
+	u64 t_rebuild_nodes = apply_node_by_node(map, rebuild);
+	u64 t_rebuild_batch = apply_batched(batched_map, rebuild);
+	u32 lit = compare_light(map, batched_map, ndef);
+
+	rawstream << "TestVoxelAlgorithms: " << dig.size() << " + "
+		<< rebuild.size() << " node changes, " << lit << " lit nodes: "
+		<< t_dig_nodes << "us + " << t_rebuild_nodes
+		<< "us updating light per node, " << t_dig_batch << "us + "
+		<< t_rebuild_batch << "us in batches" << std::endl;
+}
+
+// Counts the map edit events and the blocks they name
+class TestEventCounter : public MapEventReceiver
+{
+public:
+	TestEventCounter() : events(0) {}
+
+	void onMapEditEvent(MapEditEvent *event)
+	{
+		events++;
+		blocks.insert(event->modified_blocks.begin(),
+			event->modified_blocks.end());
+	}
+
+	u32 events;
+	std::set<v3s16> blocks;
+};
+
+// Digs count nodes one by one and at once, checks that the results match.
+// Returns the number of events sent one by one.
+static u32 compare_bulk_set(IGameDef *gamedef, u32 count, u64 *t_single,
+	u64 *t_bulk)
+{
+	const s16 size = 3 * MAP_BLOCKSIZE;
+	MapNode air(CONTENT_AIR);
+
+	// Dig from the top down, so every node gets sunlight
+	std::vector<v3s16> positions;
+	for (u32 i = 0; i < count; i++) {
+		s16 y = size - 1 - i / (size * size);
+		positions.push_back(v3s16(i % size, y, (i / size) % size));
+	}
+	// Plus one position that isn't loaded
+	positions.push_back(v3s16(0, -100, 0));
+
+	TestLightingMap map(gamedef, 3);
+	TestLightingMap bulk_map(gamedef, 3);
+	TestEventCounter counter, bulk_counter;
+	map.addEventReceiver(&counter);
+	bulk_map.addEventReceiver(&bulk_counter);
+
+	u64 t0 = porting::getTimeUs();
+	u32 set = 0;
+	for (size_t i = 0; i < positions.size(); i++)
+		set += map.addNodeWithEvent(positions[i], air);
+	u64 t1 = porting::getTimeUs();
+	u32 bulk_set = bulk_map.setNodesWithEvent(positions, air);
+	u64 t2 = porting::getTimeUs();
+
+	UASSERTEQ(u32, set, count);
+	UASSERTEQ(u32, bulk_set, count);
+	UASSERTEQ(u32, bulk_counter.events, 1);
+	UASSERT(bulk_counter.blocks == counter.blocks);
+	UASSERTEQ(u32, bulk_map.getLightingBatchDepth(), 0);
+	for (s16 z = 0; z < size; z++)
+	for (s16 y = 0; y < size; y++)
+	for (s16 x = 0; x < size; x++) {
+		v3s16 p(x, y, z);
+		UASSERT(bulk_map.getNodeNoEx(p) == map.getNodeNoEx(p));
+	}
+
+	*t_single = t1 - t0;
+	*t_bulk = t2 - t1;
+	return counter.events;
+}
+
+void TestVoxelAlgorithms::testBulkSetNodes(IGameDef *gamedef)
+{
+	u64 t_single, t_bulk;
+	compare_bulk_set(gamedef, 1000, &t_single, &t_bulk);
+}
+
+void TestVoxelAlgorithms::benchBulkSetNodes(IGameDef *gamedef)
+{
+	const u32 counts[] = {10000, 100000};
+
+	for (size_t k = 0; k < ARRLEN(counts); k++) {
+		u64 t_single, t_bulk;
+		u32 events = compare_bulk_set(gamedef, counts[k], &t_single,
+			&t_bulk);
+		rawstream << "TestVoxelAlgorithms: setting " << counts[k]
+			<< " nodes: " << t_single << "us and " << events
+			<< " events one by one, " << t_bulk << "us and 1 event at once"
+			<< std::endl;
+	}
+}
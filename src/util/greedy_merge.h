@@ -0,0 +1,78 @@
+/*
+Minetest
+Copyright (C) 2017 celeron55, Perttu Ahola <celeron55@gmail.com>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation; either version 2.1 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef UTIL_GREEDY_MERGE_HEADER
+#define UTIL_GREEDY_MERGE_HEADER
+
+#include <vector>
+#include "irrlichttypes.h"
+
+// Cells x to x + w - 1 of rows y to y + h - 1
+struct MergedRect
+{
+	u16 x, y, w, h;
+};
+
+/*
+	Covers the cells of a width * height grid for which cells.has(i) is true
+	with as few rectangles as the greedy approach finds: at the first cell not
+	covered yet, the rectangle is made as wide and then as high as possible.
+	Cell i is at x = i % width, y = i / width.
+
+	cells.mergeable(i, j) tells whether cell j can be in the rectangle started
+	at cell i. It is only called with cells for which has() is true.
+	covered is working space, passed in so that callers can reuse it.
+*/
+template <typename Cells>
+void greedy_merge(u16 width, u16 height, const Cells &cells,
+		std::vector<bool> &covered, std::vector<MergedRect> &dest)
+{
+	covered.assign(width * height, false);
+	for (u16 y = 0; y < height; y++)
+	for (u16 x = 0; x < width; x++) {
+		u32 i = y * width + x;
+		if (covered[i] || !cells.has(i))
+			continue;
+
+		u16 w = 1;
+		while (x + w < width && !covered[i + w] && cells.has(i + w) &&
+				cells.mergeable(i, i + w))
+			w++;
+
+		u16 h = 1;
+		for (; y + h < height; h++) {
+			u32 row = (y + h) * width + x;
+			bool row_fits = true;
+			for (u16 k = 0; k < w && row_fits; k++)
+				row_fits = !covered[row + k] && cells.has(row + k) &&
+					cells.mergeable(i, row + k);
+			if (!row_fits)
+				break;
+		}
+
+		for (u16 dy = 0; dy < h; dy++)
+			for (u16 dx = 0; dx < w; dx++)
+				covered[i + dy * width + dx] = true;
+
+		MergedRect rect = {x, y, w, h};
+		dest.push_back(rect);
+	}
+}
+
+#endif
@@ -600,11 +600,54 @@ bool is_sunlight_above(Map *map, v3s16 pos, INodeDefManager *ndef)
 	return sunlight;
 }
 
+/*!
+ * Returns the light of the brightest neighbor of a node, ignoring
+ * neighbors darker than min_light. Unloaded neighbors are ignored.
+ */
+static u8 get_brightest_neighbor_light(Map *map, INodeDefManager *ndef,
+	LightBank bank, MapBlock *block, const mapblock_v3 &block_pos,
+	const relative_v3 &rel_pos, u8 min_light)
+{
+	u8 brightest = 0;
+	bool is_valid_position;
+	for (direction i = 0; i < 6; i++) {
+		relative_v3 neighbor_rel_pos = rel_pos;
+		mapblock_v3 neighbor_block_pos = block_pos;
+		MapBlock *neighbor_block = block;
+		if (step_rel_block_pos(i, neighbor_rel_pos, neighbor_block_pos)) {
+			neighbor_block = map->getBlockNoCreateNoEx(neighbor_block_pos);
+			if (neighbor_block == NULL || neighbor_block->isDummy())
+				continue;
+		}
+		MapNode neighbor = neighbor_block->getNodeNoCheck(neighbor_rel_pos,
+			&is_valid_position);
+		u8 light = neighbor.getLight(bank, ndef);
+		if (light >= min_light)
+			brightest = MYMAX(brightest, light);
+	}
+	return brightest;
+}
+
+/*!
+ * Moves to the node below, and to its block if that is another one.
+ * Returns false if the block below isn't loaded.
+ */
+static bool step_down(Map *map, relative_v3 &rel_pos, mapblock_v3 &block_pos,
+	MapBlock *&block)
+{
+	if (step_rel_block_pos(4, rel_pos, block_pos)) {
+		block = map->getBlockNoCreateNoEx(block_pos);
+		if (block == NULL || block->isDummy())
+			return false;
+	}
+	return true;
+}
+
 static const LightBank banks[] = { LIGHTBANK_DAY, LIGHTBANK_NIGHT };
 
 void update_lighting_nodes(Map *map,
 	std::vector<std::pair<v3s16, MapNode> > &oldnodes,
-	std::map<v3s16, MapBlock*> &modified_blocks)
+	std::map<v3s16, MapBlock*> &modified_blocks, bool from_neighbors)
 {
 	INodeDefManager *ndef = map->getNodeDefManager();
 	// For node getter functions
@@ -663,19 +706,12 @@ void update_lighting_nodes(Map *map,
 					new_light = LIGHT_SUN;
 				} else {
 					new_light = ndef->get(n).light_source;
-					for (int i = 0; i < 6; i++) {
-						v3s16 p2 = p + neighbor_dirs[i];
-						bool is_valid;
-						MapNode n2 = map->getNodeNoEx(p2, &is_valid);
-						if (is_valid) {
-							u8 spread = n2.getLight(bank, ndef);
-							// If it is sure that the neighbor won't be
-							// unlighted, its light can spread to this node.
-							if (spread > new_light && spread >= min_safe_light) {
-								new_light = spread - 1;
-							}
-						}
-					}
+					// If it is sure that the neighbor won't be
+					// unlighted, its light can spread to this node.
+					u8 spread = get_brightest_neighbor_light(map, ndef, bank,
+						block, block_pos, rel_pos, min_safe_light);
+					if (spread > new_light)
+						new_light = spread - 1;
 				}
 			} else {
 				// If this is an opaque node, it still can emit light.
@@ -698,14 +734,12 @@ void update_lighting_nodes(Map *map,
 
 				// Remove sunlight, if there was any
 				if (bank == LIGHTBANK_DAY && old_light == LIGHT_SUN) {
-					for (s16 y = p.Y - 1;; y--) {
-						v3s16 n2pos(p.X, y, p.Z);
-
-						MapNode n2;
-
-						n2 = map->getNodeNoEx(n2pos, &is_valid_position);
-						if (!is_valid_position)
-							break;
+					relative_v3 rel_pos2 = rel_pos;
+					mapblock_v3 block_pos2 = block_pos;
+					MapBlock *block2 = block;
+					while (step_down(map, rel_pos2, block_pos2, block2)) {
+						MapNode n2 = block2->getNodeNoCheck(rel_pos2,
+							&is_valid_position);
 
 						// If this node doesn't have sunlight, the nodes below
 						// it don't have too.
@@ -714,12 +748,7 @@ void update_lighting_nodes(Map *map,
 						}
 						// Remove sunlight and add to unlight queue.
 						n2.setLight(LIGHTBANK_DAY, 0, ndef);
-						map->setNode(n2pos, n2);
-						relative_v3 rel_pos2;
-						mapblock_v3 block_pos2;
-						getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
-						MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block_pos2);
+						block2->setNodeNoCheck(rel_pos2, n2);
 						disappearing_lights.push(LIGHT_SUN, rel_pos2,
 							block_pos2, block2,
 							4 /* The node above caused the change */);
@@ -730,14 +759,12 @@ void update_lighting_nodes(Map *map,
 				// one, unlighting is not necessary.
 				// Propagate sunlight
 				if (bank == LIGHTBANK_DAY && new_light == LIGHT_SUN) {
-					for (s16 y = p.Y - 1;; y--) {
-						v3s16 n2pos(p.X, y, p.Z);
-
-						MapNode n2;
-
-						n2 = map->getNodeNoEx(n2pos, &is_valid_position);
-						if (!is_valid_position)
-							break;
+					relative_v3 rel_pos2 = rel_pos;
+					mapblock_v3 block_pos2 = block_pos;
+					MapBlock *block2 = block;
+					while (step_down(map, rel_pos2, block_pos2, block2)) {
+						MapNode n2 = block2->getNodeNoCheck(rel_pos2,
+							&is_valid_position);
 
 						// This should not happen, but if the node has sunlight
 						// then the iteration should stop.
@@ -748,11 +775,6 @@ void update_lighting_nodes(Map *map,
 						if (!ndef->get(n2).sunlight_propagates) {
 							break;
 						}
-						relative_v3 rel_pos2;
-						mapblock_v3 block_pos2;
-						getNodeBlockPosWithOffset(n2pos, block_pos2, rel_pos2);
-						MapBlock *block2 = map->getBlockNoCreateNoEx(
-							block_pos2);
 						// Mark node for lighting.
 						light_sources.push(LIGHT_SUN, rel_pos2, block_pos2,
 							block2, 4);
@@ -764,6 +786,28 @@ void update_lighting_nodes(Map *map,
 		// Remove lights
 		unspread_light(map, ndef, bank, disappearing_lights, light_sources,
 			modified_blocks);
+		// In a batch, the neighbors of a changed node may not have been
+		// safe to take light from. All light left on the map now is, so
+		// take it from them.
+		if (from_neighbors) {
+			for (std::vector<std::pair<v3s16, MapNode> >::iterator it =
+					oldnodes.begin(); it < oldnodes.end(); ++it) {
+				relative_v3 rel_pos;
+				mapblock_v3 block_pos;
+				getNodeBlockPosWithOffset(it->first, block_pos, rel_pos);
+				MapBlock *block = map->getBlockNoCreateNoEx(block_pos);
+				if (block == NULL || block->isDummy())
+					continue;
+				MapNode n = block->getNodeNoCheck(rel_pos, &is_valid_position);
+				if (!ndef->get(n).light_propagates)
+					continue;
+				u8 spread = get_brightest_neighbor_light(map, ndef, bank,
+					block, block_pos, rel_pos, 0);
+				if (spread > 1)
+					light_sources.push(spread - 1, rel_pos, block_pos, block,
+						6);
+			}
+		}
 		// Initialize light values for light spreading.
 		for (u8 i = 0; i <= LIGHT_SUN; i++) {
 			const std::vector<ChangingLight> &lights = light_sources.lights[i];
@@ -1186,6 +1230,8 @@ void finish_bulk_light_update(Map *map, mapblock_v3 minblock,
 void blit_back_with_light(ServerMap *map, MMVManip *vm,
 	std::map<v3s16, MapBlock*> *modified_blocks)
 {
+	// Pending light updates assume the rest of the map is lit correctly
+	map->flushLightingBatch();
 	INodeDefManager *ndef = map->getNodeDefManager();
 	mapblock_v3 minblock = getNodeBlockPos(vm->m_area.MinEdge);
 	mapblock_v3 maxblock = getNodeBlockPos(vm->m_area.MaxEdge);
@@ -1282,6 +1328,40 @@ void blit_back_with_light(ServerMap *map, MMVManip *vm,
 		modified_blocks);
 }
 
+/*!
+ * fill_with_sunlight() for a block that consists of a single node.
+ * Returns false if the block doesn't stay uniform, i.e. some
+ * columns get sunlight and others don't.
+ */
+static bool fill_uniform_with_sunlight(MapBlock *block,
+	INodeDefManager *ndef, bool light[MAP_BLOCKSIZE][MAP_BLOCKSIZE])
+{
+	MapNode n = block->getUniformNode();
+	// IGNORE nodes are left alone
+	if (n.getContent() == CONTENT_IGNORE)
+		return true;
+	const ContentFeatures &f = ndef->get(n.getContent());
+	bool lig = false;
+	if (f.sunlight_propagates) {
+		// All columns must agree
+		lig = light[0][0];
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++) {
+			if (light[z][x] != lig)
+				return false;
+		}
+	} else {
+		// Sunlight is stopped in every column
+		for (s16 z = 0; z < MAP_BLOCKSIZE; z++)
+		for (s16 x = 0; x < MAP_BLOCKSIZE; x++)
+			light[z][x] = false;
+	}
+	n.setLight(LIGHTBANK_DAY, lig ? 15 : 0, f);
+	n.setLight(LIGHTBANK_NIGHT, 0, f);
+	block->fillNodes(n);
+	return true;
+}
+
 /*!
  * Resets the lighting of the given map block to
  * complete darkness and full sunlight.
@@ -1297,6 +1377,9 @@ void fill_with_sunlight(MapBlock *block, INodeDefManager *ndef,
 {
 	if (block->isDummy())
 		return;
+	if (block->isUniform() &&
+			fill_uniform_with_sunlight(block, ndef, light))
+		return;
 	// dummy boolean
 	bool is_valid;
 	// For each column of nodes:
@@ -1325,11 +1408,25 @@ void fill_with_sunlight(MapBlock *block, INodeDefManager *ndef,
 	}
 }
 
+/*!
+ * Writes the day and night light of the node to light[0] and light[1].
+ */
+static void get_node_lights(INodeDefManager *ndef, MapNode node,
+	u8 light[2])
+{
+	const ContentFeatures &f = ndef->get(node);
+	for (size_t b = 0; b < 2; b++)
+		light[b] = f.param_type == CPT_LIGHT ?
+			node.getLightNoChecks(banks[b], &f):
+			f.light_source;
+}
+
 void repair_block_light(ServerMap *map, MapBlock *block,
 	std::map<v3s16, MapBlock*> *modified_blocks)
 {
 	if (!block || block->isDummy())
 		return;
+	map->flushLightingBatch();
 	INodeDefManager *ndef = map->getNodeDefManager();
 	// First queue is for day light, second is for night light.
 	UnlightQueue unlight[] = { UnlightQueue(256), UnlightQueue(256) };
@@ -1368,6 +1465,11 @@ void repair_block_light(ServerMap *map, MapBlock *block,
 
 	// --- STEP 2: Get nodes from borders to unlight
 
+	// A uniform block has the same light everywhere
+	bool uniform = block->isUniform();
+	u8 light[2] = {0, 0};
+	if (uniform)
+		get_node_lights(ndef, block->getUniformNode(), light);
 	// For each border of the block:
 	for (direction d = 0; d < 6; d++) {
 		VoxelArea a = block_pad[d];
@@ -1377,18 +1479,15 @@ void repair_block_light(ServerMap *map, MapBlock *block,
 		for (s32 y = a.MinEdge.Y; y <= a.MaxEdge.Y; y++) {
 			v3s16 relpos(x, y, z);
 			// Get node
-			MapNode node = block->getNodeNoCheck(x, y, z, &is_valid);
-			const ContentFeatures &f = ndef->get(node);
+			if (!uniform)
+				get_node_lights(ndef,
+					block->getNodeNoCheck(x, y, z, &is_valid), light);
 			// For each light bank
 			for (size_t b = 0; b < 2; b++) {
-				LightBank bank = banks[b];
-				u8 light = f.param_type == CPT_LIGHT ?
-					node.getLightNoChecks(bank, &f):
-					f.light_source;
 				// If the new node is dimmer than sunlight, unlight.
 				// (if it has maximal light, it is pointless to remove
 				// surrounding light, as it can only become brighter)
-				if (LIGHT_SUN > light) {
+				if (LIGHT_SUN > light[b]) {
 					unlight[b].push(
 						LIGHT_SUN, relpos, blockpos, block, 6);
 				}
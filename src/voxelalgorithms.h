@@ -68,11 +68,15 @@ SunlightPropagateResult propagateSunlight(VoxelManipulator &v, VoxelArea a,
  * MapNodes and their positions
  * \param modified_blocks output, contains all map blocks that
  * the function modified
+ * \param from_neighbors if true, changed nodes also take light from their
+ * neighbors once all light is removed. Needed for lighting batches, where
+ * the neighbors of a changed node may have been changed too.
  */
 void update_lighting_nodes(
 	Map *map,
 	std::vector<std::pair<v3s16, MapNode> > &oldnodes,
-	std::map<v3s16, MapBlock*> &modified_blocks);
+	std::map<v3s16, MapBlock*> &modified_blocks,
+	bool from_neighbors = false);
 
 /*!
  * Updates borders of the given mapblock.